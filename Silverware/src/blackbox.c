@@ -0,0 +1,281 @@
+// blackbox flight recorder
+// while armed, every BLACKBOX_RATE th pid loop is encoded into a ram ring buffer by blackbox_log()
+// blackbox_write() moves the ring to the free flash between the program and the settings page
+// ( BLACKBOX_FLASH ) or to the serial port ( BLACKBOX_SERIAL ) a few bytes at a time
+// a flash halfword write stalls the cpu about 50uS, so while armed one halfword is written per 1000uS of loop time
+// ( every BLACKBOX_FLASH_INTERVAL loops ), 5% of the cpu and 2 bytes/ms of log at any LOOPTIME
+// a record is about 18 bytes, config.h keeps BLACKBOX_RATE * LOOPTIME at 12mS or more for the flash
+//
+// records are a type byte and one zigzag varint per field, the fields are in blackbox.h
+// I frames hold the values, P frames the change from the last record ( 1 - 2 bytes per field in flight )
+// an I frame follows every BLACKBOX_IFRAME_INTERVAL records and any record dropped on a full ring
+//
+// the flash log keeps all sessions ( arm to disarm ) until it is full, the DDD gesture erases it
+// erased flash reads 0xFF which is not a record type, so the log ends at the first 0xFF
+// read it out with the debugger and convert it with gcc/sil/blackbox_decode
+
+#include <inttypes.h>
+
+#include "config.h"
+#include "blackbox.h"
+
+#ifdef BLACKBOX
+
+#ifndef BLACKBOX_RATE
+#define BLACKBOX_RATE 16
+#endif
+
+#define BLACKBOX_IFRAME_INTERVAL 32
+
+// 256 so the uint8_t ring indices wrap by themselves
+#define BLACKBOX_RING_SIZE 256
+
+// type byte and 5 bytes per field
+#define BLACKBOX_RECORD_MAX ( 1 + BB_FIELDS * 5 )
+
+// pid loops per flash halfword while armed, the cpu stalls about 50uS for each
+#define BLACKBOX_FLASH_INTERVAL ( 1000 / LOOPTIME )
+
+#define BLACKBOX_PAGE_SIZE 1024
+
+extern float gyro[3];
+extern float setpoint[3];
+extern float pidoutput[3];
+extern float vbattfilt;
+extern int armed_state;
+
+// mixer output, set by control.c
+float blackbox_motor[4];
+
+// records lost on a full ring
+uint16_t blackbox_dropped = 0;
+
+static uint8_t ring[BLACKBOX_RING_SIZE];
+static uint8_t ring_head;
+static uint8_t ring_tail;
+
+static int32_t last[BB_FIELDS];
+static uint32_t iteration;
+static int armed_last;
+static int rate_count;
+static int iframe_count;
+
+#ifdef BLACKBOX_FLASH
+extern unsigned long fmc_free_start( void);
+extern unsigned long fmc_free_end( void);
+extern int fmc_erase_page( unsigned long address );
+extern int fmc_write_halfword( unsigned long address , uint16_t value );
+extern void fmc_unlock( void);
+extern void fmc_lock( void);
+
+static unsigned long flash_start;
+static unsigned long flash_end;
+static unsigned long flash_pos;
+static int flash_flush;
+#endif
+
+// no room left for records
+static int blackbox_full;
+
+static int ring_free( void)
+{
+	return BLACKBOX_RING_SIZE - 1 - (uint8_t) ( ring_head - ring_tail );
+}
+
+static void ring_put( uint8_t data )
+{
+	ring[ring_head++] = data;
+}
+
+static void ring_put_varint( int32_t value )
+{
+	// zigzag, small negative numbers get short codes too
+	uint32_t v = ( (uint32_t) value << 1 ) ^ (uint32_t) ( value >> 31 );
+
+	while ( v >= 0x80 )
+	{
+		ring_put( ( v & 0x7f ) | 0x80 );
+		v >>= 7;
+	}
+	ring_put( v );
+}
+
+static void blackbox_start( void)
+{
+	if ( ring_free() < 10 )
+	{
+		blackbox_full = 1;
+		return;
+	}
+	ring_put( BLACKBOX_HEADER );
+	ring_put( 'B' );
+	ring_put( 'B' );
+	ring_put( BLACKBOX_VERSION );
+	ring_put_varint( LOOPTIME );
+	ring_put_varint( BLACKBOX_RATE );
+	ring_put_varint( BB_FIELDS );
+
+	rate_count = BLACKBOX_RATE;
+	iframe_count = BLACKBOX_IFRAME_INTERVAL;
+#ifdef BLACKBOX_FLASH
+	// the end of the last session is followed by this one, no padding
+	flash_flush = 0;
+#endif
+}
+
+// once per pid loop, after control()
+void blackbox_log( uint32_t looptime_us )
+{
+	iteration++;
+
+	if ( armed_state != armed_last )
+	{
+		armed_last = armed_state;
+		if ( blackbox_full ) return;
+		if ( armed_state ) blackbox_start();
+		else
+		{
+			if ( ring_free() ) ring_put( BLACKBOX_END );
+#ifdef BLACKBOX_FLASH
+			flash_flush = 1;
+#endif
+		}
+	}
+
+	if ( !armed_state || blackbox_full ) return;
+	if ( ++rate_count < BLACKBOX_RATE ) return;
+	rate_count = 0;
+
+	if ( ring_free() < BLACKBOX_RECORD_MAX )
+	{
+		blackbox_dropped++;
+		iframe_count = BLACKBOX_IFRAME_INTERVAL;
+		return;
+	}
+
+	int32_t value[BB_FIELDS];
+
+	value[BB_ITERATION] = iteration;
+	value[BB_LOOPTIME] = looptime_us;
+	for ( int i = 0 ; i < 3 ; i++)
+	{
+		value[BB_GYRO + i] = gyro[i] * 1000.0f;
+		value[BB_SETPOINT + i] = setpoint[i] * 1000.0f;
+		value[BB_PID + i] = pidoutput[i] * 1000.0f;
+	}
+	for ( int i = 0 ; i < 4 ; i++) value[BB_MOTOR + i] = blackbox_motor[i] * 1000.0f;
+	value[BB_VBATT] = vbattfilt * 1000.0f;
+
+	int iframe = ++iframe_count >= BLACKBOX_IFRAME_INTERVAL;
+	if ( iframe ) iframe_count = 0;
+
+	ring_put( iframe ? BLACKBOX_IFRAME : BLACKBOX_PFRAME );
+	for ( int i = 0 ; i < BB_FIELDS ; i++)
+	{
+		ring_put_varint( iframe ? value[i] : value[i] - last[i] );
+		last[i] = value[i];
+	}
+}
+
+#ifdef BLACKBOX_FLASH
+
+void blackbox_init( void)
+{
+	flash_start = fmc_free_start();
+	flash_end = fmc_free_end();
+
+	if ( flash_start >= flash_end )
+	{
+		blackbox_full = 1;
+		return;
+	}
+
+	// continue after the last written halfword
+	flash_pos = flash_end;
+	while ( flash_pos > flash_start && *(volatile uint16_t *) ( flash_pos - 2 ) == 0xFFFF ) flash_pos -= 2;
+
+	blackbox_full = flash_pos >= flash_end;
+}
+
+// slow, 20mS per page, only on the ground
+void blackbox_erase( void)
+{
+	fmc_unlock();
+	for ( unsigned long page = flash_start ; page < flash_end ; page += BLACKBOX_PAGE_SIZE )
+	{
+		for ( unsigned long a = page ; a < page + BLACKBOX_PAGE_SIZE ; a += 4 )
+		{
+			if ( *(volatile uint32_t *) a != 0xFFFFFFFF )
+			{
+				fmc_erase_page( page );
+				break;
+			}
+		}
+	}
+	fmc_lock();
+
+	flash_pos = flash_start;
+	blackbox_full = flash_start >= flash_end;
+	ring_tail = ring_head;
+}
+
+// one halfword per BLACKBOX_FLASH_INTERVAL loops while armed, every loop once disarmed to drain the ring
+void blackbox_write( void)
+{
+	static int write_count;
+	uint16_t data;
+
+	if ( ring_head == ring_tail ) return;
+	if ( armed_state && ++write_count < BLACKBOX_FLASH_INTERVAL ) return;
+	write_count = 0;
+
+	if ( (uint8_t) ( ring_head - ring_tail ) >= 2 )
+	{
+		data = ring[ring_tail++];
+		data |= ring[ring_tail++] << 8;
+	}
+	else if ( flash_flush )
+	{
+		// odd byte at the session end, 0xFF is skipped by the decoder
+		data = ring[ring_tail++] | 0xFF00;
+	}
+	else return;
+
+	fmc_unlock();
+	if ( flash_pos >= flash_end || fmc_write_halfword( flash_pos , data ) )
+	{
+		blackbox_full = 1;
+		ring_tail = ring_head;
+	}
+	else flash_pos += 2;
+	fmc_lock();
+
+	if ( ring_head == ring_tail ) flash_flush = 0;
+}
+
+#endif
+
+#ifdef BLACKBOX_SERIAL
+
+extern void buffer_add( int val );
+extern int serial_free( void);
+
+void blackbox_init( void)
+{
+}
+
+void blackbox_erase( void)
+{
+}
+
+// as much as fits the serial buffer
+void blackbox_write( void)
+{
+	int count = serial_free();
+
+	while ( count-- > 0 && ring_head != ring_tail ) buffer_add( ring[ring_tail++] );
+}
+
+#endif
+
+#endif
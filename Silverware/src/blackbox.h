@@ -0,0 +1,29 @@
+
+#include <inttypes.h>
+
+// record layout, see blackbox.c
+// every record starts with a type byte, fields are zigzag varints
+#define BLACKBOX_HEADER 'H'		// session start: 'B' 'B' version, then looptime , rate , field count
+#define BLACKBOX_IFRAME 'I'		// all fields as values
+#define BLACKBOX_PFRAME 'P'		// all fields as the difference to the last record
+#define BLACKBOX_END 'E'			// disarm
+#define BLACKBOX_VERSION 1
+
+// fields in record order and the scale of the stored integers
+enum blackbox_fields
+{
+	BB_ITERATION = 0,			// pid loop count
+	BB_LOOPTIME,					// uS
+	BB_GYRO,							// 3 axes , rad/s * 1000
+	BB_SETPOINT = BB_GYRO + 3,	// rad/s * 1000
+	BB_PID = BB_SETPOINT + 3,		// pidoutput * 1000
+	BB_MOTOR = BB_PID + 3,			// mixer output * 1000
+	BB_VBATT = BB_MOTOR + 4,		// vbattfilt mV
+	BB_FIELDS
+};
+
+void blackbox_init( void);
+void blackbox_log( uint32_t looptime_us );
+void blackbox_write( void);
+void blackbox_erase( void);
+
@@ -17,6 +17,13 @@
 //#define RX_DSMX_2048                         // Define EXTERNAL_RX in hardware.c
 //#define RX_DSM2_1024                         // Define EXTERNAL_RX in hardware.c
 
+// *************serial rx protocols above: usart dma and the idle line, one interrupt per frame instead of one per byte
+// *************uses dma channel 3, or channel 5 with SIXAXIS_READ_DMA
+//#define SERIAL_RX_DMA
+// *************crsf telemetry on the rx pin ( half duplex ): attitude, battery, flight mode and loop load, needs SERIAL_RX_DMA
+// *************sent by dma channel 2, not with the dshot dma driver, rgb led dma or SOFTI2C_READ_DMA
+//#define CRSF_TELEMETRY
+
 // ------------- Rate in deg/sec
 #define MAX_RATE 720.0
 #define MAX_RATEYAW 720.0
@@ -201,6 +208,25 @@
 #endif
 
 
+// ------------- Dynamic gyro notch, follows the strongest motor noise peak between the min and max frequency
+// ************* it runs before the gyro filters above, so they can be set to a higher frequency for less delay
+//#define GYRO_DYN_NOTCH
+#define GYRO_DYN_NOTCH_MIN_HZ 100
+#define GYRO_DYN_NOTCH_MAX_HZ 480
+#define GYRO_DYN_NOTCH_Q 3
+
+// ------------- RPM filter, gyro notches on each motor frequency ( and harmonics ) from bidirectional dshot telemetry
+// ************* needs USE_DSHOT_DMA_DRIVER and esc firmware with bidirectional dshot ( bluejay , blheli_32 )
+// ************* not related to BIDIRECTIONAL ( 3D ) in the dshot driver
+//#define RPM_FILTER
+#define RPM_FILTER_HARMONICS 1
+#define RPM_FILTER_MIN_HZ 80
+#define RPM_FILTER_Q 5
+#define MOTOR_POLES 12
+// dshot_erpm ( 100 eRPM ) to motor Hz
+#define ERPM_TO_HZ ( 100.0f / 60.0f / ( MOTOR_POLES / 2 ) )
+
+
 //**********************************************************************************************************************
 //***********************************************MOTOR OUTPUT SETTINGS**************************************************
 
@@ -249,6 +275,22 @@
 // ------------- Markus Gritsch's Brushless motor curve. Creates a motor curve to compensate for the PID controller
 // and nonlinearity of motor thrust
 //#define THRUST_LINEARISATION
+#define AA_motorCurve 0.5f // 0 .. linear, 1 .. quadratic
+
+// ------------- Motor curve from a thrust measurement: the motor output ( 0.0 - 1.0 ) at thrust 0 , 1/32 .. 1 , 33 values
+// ************* the first is the idle output. "make -C gcc/sil thrust_fit" makes this line from bench or logged ( output , thrust ) pairs
+// ************* used instead of the MOTOR_CURVE_ of the misc settings and of THRUST_LINEARISATION ( which fills the same table at startup )
+// ************* the example is the THRUST_LINEARISATION curve of AA_motorCurve 0.5
+//#define MOTOR_CURVE_TABLE 0.000 , 0.059 , 0.112 , 0.161 , 0.207 , 0.250 , 0.291 , 0.329 , 0.366 , 0.401 , 0.435 , 0.468 , 0.500 , 0.531 , 0.561 , 0.590 , 0.618 , 0.646 , 0.673 , 0.699 , 0.725 , 0.750 , 0.775 , 0.799 , 0.823 , 0.846 , 0.869 , 0.892 , 0.914 , 0.936 , 0.958 , 0.979 , 1.000
+
+// ------------- Dynamic idle raises the low end of the motor curve while the slowest motor turns below DYNAMIC_IDLE_HZ in the air
+// ************* needs RPM_FILTER ( esc telemetry ) and MOTOR_CURVE_TABLE or THRUST_LINEARISATION. The boost is held while a motor
+// ************* has no telemetry. Its lowpass ( last 2s of flight ) corrects a learned offset on top of the table when the settings
+// ************* are saved ( DDD gesture ), offset and boost together stay within DYNAMIC_IDLE_MAX
+// ************* Start values, not tuned on a quad
+//#define DYNAMIC_IDLE_HZ 40
+#define DYNAMIC_IDLE_GAIN 0.002f	// boost per Hz of error and second
+#define DYNAMIC_IDLE_MAX 0.1f
 
 // ------------- Throttle angle compensation in level mode
 //#define AUTO_THROTTLE
@@ -306,6 +348,16 @@
 // ------------- Enable inverted flight code ( brushless only ). Comment in //#define BIDIRECTIONAL in drv_dshot.c file
 //#define INVERTED_ENABLE
 //#define FN_INVERTED CH_OFF //for brushless only
+// ************* or reverse normal ( not 3D ) escs with the dshot spin direction commands , no BIDIRECTIONAL
+// ************* the escs take them only with the motors stopped , the direction changes on the ground
+//#define INVERTED_DSHOT_COMMANDS
+
+// ------------- RC smoothing for low rate rx links ( bayang , dsm , sbus ) , the sticks ramp between rx frames instead of stepping
+// ************* the frame interval is measured , adds one frame of delay but no d term kicks from the stick steps
+// ************* RC_FEEDFORWARD adds the setpoint rate of change to the pid output in acro , 1.0 = as strong as the d term on the gyro
+// ************* yaw has no feed forward while its D is 0
+//#define RC_SMOOTHING
+//#define RC_FEEDFORWARD 0.5
 
 // ------------- Transmitter stick adjustable deadband for roll/pitch/yaw
 // ************* .01f = 1% of stick range - comment out to disable
@@ -332,6 +384,49 @@
 // ************* Only works with bayang_protocol_telemetry, bayang_protocol_telemetry_autobind and nrf24_bayang_telemetry
 //#define CPU_LOAD_WATCH CHAN_OFF
 
+// ------------- Main loop profiler
+// ************* Times every stage of the main loop ( sixaxis, gyro, pid, control, imu, battery, leds, rx ) with the systick counter
+// ************* and keeps min / max / mean ( also in cpu cycles ) and a histogram per stage in ram ( profile[] in profiler.c )
+// ************* The table is printed over serial if SERIAL_ENABLE is also defined
+//#define LOOP_PROFILER
+
+// ------------- Timer driven loop scheduler
+// ************* Starts the control loop from the gyro dma interrupt ( SIXAXIS_READ_DMA ) or a TIM17 tick instead of busy waiting
+// ************* Battery, leds, gestures and rx run as tasks in the spare time of each loop, see scheduler.c for rates
+//#define USE_SCHEDULER
+
+// ------------- Blackbox flight recorder
+// ************* Records gyro, setpoint, pid output, motors, battery and loop time every BLACKBOX_RATE pid loops while armed
+// ************* BLACKBOX_FLASH: to the free flash after the program, sessions are kept until full, DDD gesture erases the log
+// ************* the flash takes 2 bytes/ms ( 50uS cpu stall per halfword ), BLACKBOX_RATE * LOOPTIME must be 12000uS or more
+// ************* BLACKBOX_SERIAL: streamed to the serial port, needs SERIAL_ENABLE
+// ************* Convert the log to csv with gcc/sil/blackbox_decode
+//#define BLACKBOX
+#define BLACKBOX_FLASH
+//#define BLACKBOX_SERIAL
+#define BLACKBOX_RATE 16
+
+// ------------- Fixed point control path
+// ************* Gyro filters, pid, d term filter and mixer in Q16.16 integer math instead of software float
+// ************* Supports PT1 / KALMAN gyro filters, DTERM_LPF_2ND_HZ and the basic pid ( no ADVANCED_PID_CONTROLLER )
+// ************* Check against the float build on a pc with "make -C gcc/sil crosscheck", the saving shows in the gyro and pid cycles of LOOP_PROFILER
+//#define FIXED_POINT
+
+// ------------- Quaternion attitude estimator
+// ************* Mahony filter on a quaternion instead of the small angle gravity vector update in imu.c, renormalised every loop
+// ************* Accel trust falls off as the accel magnitude moves away from 1G, a slow integral learns the gyro bias
+// ************* Compare against the default estimator with "make -C gcc/sil imucompare"
+//#define IMU_QUATERNION
+
+// ------------- Accel read every ACCEL_DECIMATION th loop, the loops between read only the 6 gyro bytes instead of 14
+// ************* imu_calc() corrects the attitude with the time since the last accel sample, the dma reads only skip the accel decode
+//#define ACCEL_DECIMATION 4
+
+// ------------- Crc of the rx protocols, blheli 4way and the settings store with 256 entry tables, one lookup per byte
+// ************* Default is 16 entry tables, two lookups per byte, up to 1.7k less flash
+// ************* Check and benchmark against the bit by bit crcs with "make -C gcc/sil crccheck"
+//#define CRC_BYTE_TABLE
+
 
 //**********************************************************************************************************************
 //********************************************************BETA TESTING**************************************************
@@ -371,9 +466,16 @@
 #define TRIM_ROLL 0.0
 
 // ------------- Loop time in uS
-// This affects soft gyro lpf frequency if used
+// 1000 ( 1kHz ), 500 ( 2kHz ), 250 ( 4kHz ) or 125 ( 8kHz )
+// Filter, integrator and d term coefficients are calculated for it at compile time
+// A faster loop needs a cpu that can finish the loop in time, check with LOOP_PROFILER
 #define LOOPTIME 1000
 
+// ------------- Gyro and dshot rate as a multiple of the pid rate
+// The gyro is read and filtered and a dshot frame is sent GYRO_RATE_MULTIPLIER times per pid loop ( LOOPTIME )
+// Gyro rate max 8kHz, gyro filters are calculated for the gyro rate
+//#define GYRO_RATE_MULTIPLIER 2
+
 // ------------- Failsafe time in uS
 #define FAILSAFETIME 1000000  // one second
 
@@ -393,6 +495,16 @@
 // ------------- Overclock to 64Mhz
 //#define ENABLE_OVERCLOCK
 
+// ------------- 1MHz time base on TIM2 ( 32 bits ) instead of the systick
+// ************* gettime() is a register read and has no need to be called every 16ms, gettime64() does not wrap
+// ************* Not with a pwm motor on PA0 - PA3 or PA5 , or with SOFTI2C_READ_DMA. Not flown yet, check the loop time with LOOP_PROFILER
+//#define TIM2_TIME_BASE
+
+// ------------- Run the gyro filters, pid, imu and dshot packet code from ram
+// ************* Flash has a wait state at 48 and 64Mhz, ram does not. The code of these functions takes ram out of the 4k,
+// ************* check the budget with "make ramreport" in gcc/ and compare the loop stages with LOOP_PROFILER
+//#define RAM_FUNCTIONS
+
 #define PWMFREQ 32000
 #define MOTOR_CURVE_NONE
 
@@ -413,6 +525,40 @@
 #define SYS_CLOCK_FREQ_HZ 48000000
 #endif
 
+// time_ticks() rate, TIM2 counts uS, the systick runs at SYS_CLOCK_FREQ_HZ / 8
+#ifdef TIM2_TIME_BASE
+#define TIME_TICKS_PER_US 1
+#else
+#define TIME_TICKS_PER_US ( SYS_CLOCK_FREQ_HZ / 8000000 )
+#endif
+
+// hot path functions to the .ramfunc section, copied to ram at startup ( gcc/flash.ld , silverware.sct )
+// not inlined into callers that stay in flash
+#ifdef RAM_FUNCTIONS
+#define RAMFUNC __attribute__ ((section(".ramfunc"), noinline))
+#else
+#define RAMFUNC
+#endif
+
+#ifndef GYRO_RATE_MULTIPLIER
+#define GYRO_RATE_MULTIPLIER 1
+#endif
+
+// gyro loop in uS, the main loop runs at this rate and the pid every GYRO_RATE_MULTIPLIER loops
+#define GYRO_LOOPTIME ( LOOPTIME / GYRO_RATE_MULTIPLIER )
+
+#if LOOPTIME != 1000 && LOOPTIME != 500 && LOOPTIME != 250 && LOOPTIME != 125
+#error "LOOPTIME must be 1000, 500, 250 or 125"
+#endif
+
+#if GYRO_RATE_MULTIPLIER < 1 || LOOPTIME % GYRO_RATE_MULTIPLIER || GYRO_LOOPTIME < 125
+#error "GYRO_RATE_MULTIPLIER must divide LOOPTIME and give a gyro rate of 8kHz or less"
+#endif
+
+#if GYRO_RATE_MULTIPLIER > 1 && ( defined MOTOR_KAL || defined MOTOR_KAL_2ND )
+#error "MOTOR_KAL filters are calculated for the gyro rate, use MOTOR_FILTER2_ALPHA with GYRO_RATE_MULTIPLIER"
+#endif
+
 #ifdef WEAK_FILTERING
 #define KALMAN_GYRO
 #define GYRO_FILTER_PASS1 HZ_90
@@ -445,4 +591,103 @@
 #define GYRO_LOW_PASS_FILTER 0
 #endif
 
+#if defined FIXED_POINT && defined MOTOR_FILTER2_ALPHA && !defined MOTOR_FILTER
+// the motor lpf runs in the fixed point mixer, with MOTOR_FILTER it has to stay after the hanning filter
+#define MOTOR_FILTER2_FIXED
+#endif
+
+#if defined FIXED_POINT && defined MOTOR_CURVE_NONE && !( defined MOTOR_FILTER || defined MOTOR_KAL || defined MOTOR_KAL_2ND || defined TORQUE_BOOST || defined CLIP_FF \
+	|| defined MIX_LOWER_THROTTLE || defined MIX_INCREASE_THROTTLE || defined MIX_LOWER_THROTTLE_3 || defined MIX_INCREASE_THROTTLE_3 || defined MIX_SCALING \
+	|| defined MOTOR_CURVE_TABLE || defined THRUST_LINEARISATION || defined MOTORS_TO_THROTTLE || defined MOTORS_TO_THROTTLE_MODE || defined NOMOTORS )
+// the fixed point mixer output goes to the motor driver in Q16 ( pwm_set_q ), the options above need the float mix
+#define MIXER_FIXED
+#endif
+
+#if defined BLACKBOX && defined BLACKBOX_FLASH && defined BLACKBOX_SERIAL
+#error "BLACKBOX_FLASH and BLACKBOX_SERIAL can not be used together"
+#endif
+
+#if defined BLACKBOX && !defined BLACKBOX_FLASH && !defined BLACKBOX_SERIAL
+#error "BLACKBOX needs BLACKBOX_FLASH or BLACKBOX_SERIAL"
+#endif
+
+#if defined BLACKBOX && defined BLACKBOX_FLASH && BLACKBOX_RATE * LOOPTIME < 12000
+#error "BLACKBOX_FLASH writes 2 bytes/ms , BLACKBOX_RATE * LOOPTIME must be 12000uS or more"
+#endif
+
+#if defined BLACKBOX && defined BLACKBOX_SERIAL && !defined SERIAL_ENABLE
+#error "BLACKBOX_SERIAL needs SERIAL_ENABLE"
+#endif
+
+#if defined RPM_FILTER && !defined USE_DSHOT_DMA_DRIVER
+#error "RPM_FILTER needs the eRPM telemetry of USE_DSHOT_DMA_DRIVER"
+#endif
+
+#if defined RPM_FILTER && ( RPM_FILTER_HARMONICS < 1 || RPM_FILTER_HARMONICS > 3 )
+#error "RPM_FILTER_HARMONICS must be 1 - 3"
+#endif
+
+#if defined ACCEL_DECIMATION && ACCEL_DECIMATION < 1
+#error "ACCEL_DECIMATION has to be 1 or more"
+#endif
+
+#if defined SOFTI2C_READ_DMA && ( defined SIXAXIS_READ_DMA || !defined USE_SOFTWARE_I2C )
+#error "SOFTI2C_READ_DMA needs a software i2c board and SIXAXIS_READ_DMA off"
+#endif
+
+#if defined SOFTI2C_READ_DMA && ( defined USE_DSHOT_DMA_DRIVER || defined RGB_LED_DMA )
+#error "SOFTI2C_READ_DMA uses dma channels 2 - 5 like USE_DSHOT_DMA_DRIVER and RGB_LED_DMA"
+#endif
+
+#if defined SOFTI2C_READ_DMA && ( defined PWM_PA0 || defined PWM_PA1 || defined PWM_PA2 || defined PWM_PA3 || defined PWM_PA5 )
+#error "SOFTI2C_READ_DMA uses TIM2, no motor pin can be on TIM2"
+#endif
+
+#if defined TIM2_TIME_BASE && defined SOFTI2C_READ_DMA
+#error "TIM2_TIME_BASE and SOFTI2C_READ_DMA both use TIM2"
+#endif
+
+#if defined TIM2_TIME_BASE && ( defined PWM_PA0 || defined PWM_PA1 || defined PWM_PA2 || defined PWM_PA3 || defined PWM_PA5 )
+#error "TIM2_TIME_BASE uses TIM2, no motor pin can be on TIM2"
+#endif
+
+#if defined INVERTED_DSHOT_COMMANDS && !( defined INVERTED_ENABLE && ( defined USE_DSHOT_DMA_DRIVER || defined USE_DSHOT_DRIVER_BETA ) )
+#error "INVERTED_DSHOT_COMMANDS needs INVERTED_ENABLE and a dshot driver"
+#endif
+
+#define MOTOR_CURVE_POINTS 33
+
+#if defined DYNAMIC_IDLE_HZ && !( defined RPM_FILTER && ( defined MOTOR_CURVE_TABLE || defined THRUST_LINEARISATION ) )
+#error "DYNAMIC_IDLE_HZ needs RPM_FILTER and MOTOR_CURVE_TABLE or THRUST_LINEARISATION"
+#endif
+
+#if defined RC_FEEDFORWARD && !defined RC_SMOOTHING
+#error "RC_FEEDFORWARD needs RC_SMOOTHING , the feed forward of the stick steps is all kicks"
+#endif
+
+#if defined SERIAL_RX_DMA && !( defined RX_SBUS || defined RX_CRSF || defined RX_SUMD || defined RX_DSMX_2048 || defined RX_DSM2_1024 )
+#error "SERIAL_RX_DMA is for the serial rx protocols"
+#endif
+
+#if defined SERIAL_RX_DMA && defined SOFTI2C_READ_DMA
+#error "SERIAL_RX_DMA and SOFTI2C_READ_DMA both use dma channel 3 or 5"
+#endif
+
+#if defined SERIAL_RX_DMA && defined SIXAXIS_READ_DMA && ( defined USE_DSHOT_DMA_DRIVER || ( defined RGB_LED_DMA && RGB_LED_NUMBER > 0 ) )
+#error "SERIAL_RX_DMA needs dma channel 5 when SIXAXIS_READ_DMA has channel 3 , but dshot dma or rgb led dma use it"
+#endif
+
+#if defined CRSF_TELEMETRY && !( defined RX_CRSF && defined SERIAL_RX_DMA )
+#error "CRSF_TELEMETRY needs RX_CRSF and SERIAL_RX_DMA"
+#endif
+
+#if defined CRSF_TELEMETRY && ( defined USE_DSHOT_DMA_DRIVER || ( defined RGB_LED_DMA && RGB_LED_NUMBER > 0 ) || defined SOFTI2C_READ_DMA )
+#error "CRSF_TELEMETRY sends on dma channel 2 , it is used by the dshot dma driver , rgb led dma or SOFTI2C_READ_DMA"
+#endif
+
+// gyro dlpf settings 1 - 6 lower the gyro output rate to 1kHz
+#if GYRO_LOOPTIME < 1000 && GYRO_LOW_PASS_FILTER > 0 && GYRO_LOW_PASS_FILTER < 7
+#error "GYRO_LOW_PASS_FILTER 1 - 6 limits the gyro to 1kHz, use 0 for faster loops"
+#endif
+
 
@@ -39,6 +39,8 @@ THE SOFTWARE.
 #include "gestures.h"
 #include "defines.h"
 #include "led.h"
+#include "fixed.h"
+#include "profiler.h"
 
 float	throttle;
 int idle_state;
@@ -65,6 +67,8 @@ float thrsum;
 
 float error[PIDNUMBER];
 float motormap( float input);
+float motor_curve_map( float thrust );
+void motor_curve_update( void);
 
 float yawangle;
 
@@ -124,18 +128,34 @@ float rate_multiplier = 1.0;
 	
 #ifdef INVERTED_ENABLE	
     extern int pwmdir;
+#ifdef INVERTED_DSHOT_COMMANDS
+	// the escs change direction when the motors stop , pwmdir follows
+	extern void dshot_dir( int dir );
+	dshot_dir( aux[FN_INVERTED] ? REVERSE : FORWARD );
+#else
 	if ( aux[FN_INVERTED]  )		
         pwmdir = REVERSE;
     else
         pwmdir = FORWARD;    
+#endif
 #endif	
 	
+#ifdef RC_SMOOTHING
+	// sticks interpolated between rx frames
+	extern void rc_smoothing( void);
+	extern float rx_smooth[3];
+	rc_smoothing();
+	float * rxin = rx_smooth;
+#else
+	float * rxin = rx;
+#endif
+
 	for ( int i = 0 ; i < 3 ; i++)
 	{
 		#ifdef STOCK_TX_AUTOCENTER
-		rxcopy[i] = (rx[i] - autocenter[i])* rate_multiplier;
+		rxcopy[i] = (rxin[i] - autocenter[i])* rate_multiplier;
 		#else
-		rxcopy[i] = rx[i] * rate_multiplier;
+		rxcopy[i] = rxin[i] * rate_multiplier;
 		#endif
 		#ifdef STICKS_DEADBAND
 		if ( fabsf( rxcopy[ i ] ) <= STICKS_DEADBAND ) {
@@ -173,6 +193,16 @@ float rate_multiplier = 1.0;
 
 pid_precalc();	
 
+#ifdef RC_FEEDFORWARD
+	// setpoint change per loop for the feed forward , acro only
+	extern float setpoint_step[3];
+	extern float rx_smooth_step[3];
+	setpoint_step[0] = setpoint_step[1] = setpoint_step[2] = 0;
+#ifdef FIXED_POINT
+	extern int32_t setpoint_step_q[3];
+	setpoint_step_q[0] = setpoint_step_q[1] = setpoint_step_q[2] = 0;
+#endif
+#endif
 
 	// flight control
 	        
@@ -303,26 +333,64 @@ if (aux[LEVELMODE]&&!acro_override){
 					// Set ierror to zero, otherwise it builds up and causes bounce back.
 		extern float ierror[3];
 		ierror[0] = 0.0; ierror[1] = 0.0;
+		#ifdef FIXED_POINT
+		extern int32_t ierror_q[3];
+		ierror_q[0] = 0; ierror_q[1] = 0;
+		#endif
 			
 		} 
+#ifdef FIXED_POINT
+	// the rate target of the float angle pid , the pid takes the error against gyro_q
+	extern int32_t setpoint_q[3];
+	for ( int i = 0 ; i < 3 ; i++) setpoint_q[i] = FLOAT_TO_FIXED( error[i] + gyro[i] );
+#endif
 }else{	// rate mode
       
     setpoint[0] = rxcopy[0] * (float) MAX_RATE * DEGTORAD;
 		setpoint[1] = rxcopy[1] * (float) MAX_RATE * DEGTORAD;
 		setpoint[2] = rxcopy[2] * (float) MAX_RATEYAW * DEGTORAD;
+
+#ifdef RC_FEEDFORWARD
+		if ( !controls_override )
+		{
+#ifdef FIXED_POINT
+			// the ramp slope changes with the rx frames only , converted then
+			// ( a rate switch follows with the next frame )
+			extern int rx_smooth_changed;
+			static int32_t step_q[3];
+			if ( rx_smooth_changed )
+			{
+				rx_smooth_changed = 0;
+				step_q[0] = FLOAT_TO_FIXED( rx_smooth_step[0] * rate_multiplier * (float) MAX_RATE * DEGTORAD );
+				step_q[1] = FLOAT_TO_FIXED( rx_smooth_step[1] * rate_multiplier * (float) MAX_RATE * DEGTORAD );
+				step_q[2] = FLOAT_TO_FIXED( rx_smooth_step[2] * rate_multiplier * (float) MAX_RATEYAW * DEGTORAD );
+			}
+			for ( int i = 0; i < 3; i++ ) setpoint_step_q[i] = step_q[i];
+#else
+			setpoint_step[0] = rx_smooth_step[0] * rate_multiplier * (float) MAX_RATE * DEGTORAD;
+			setpoint_step[1] = rx_smooth_step[1] * rate_multiplier * (float) MAX_RATE * DEGTORAD;
+			setpoint_step[2] = rx_smooth_step[2] * rate_multiplier * (float) MAX_RATEYAW * DEGTORAD;
+#endif
+		}
+#endif
           
+#ifdef FIXED_POINT
+		// the pid takes the error against gyro_q
+		extern int32_t setpoint_q[3];
+		for ( int i = 0; i < 3; i++ ) setpoint_q[i] = FLOAT_TO_FIXED( setpoint[i] );
+#else
 		for ( int i = 0; i < 3; i++ ) {
 			error[i] = setpoint[i] - gyro[i];
 		}
+#endif
 		
 		
 	}
 
 
 	rotateErrors();
-	pid(0);
-	pid(1);
-	pid(2);	
+	pid_calc();
+	PROFILE_MARK( PROFILE_PID );
 
 		
 
@@ -381,7 +449,6 @@ if (aux[LEVELMODE]&&!acro_override){
 	}
 
 	#ifdef THRUST_LINEARISATION
-#define AA_motorCurve 0.5f // 0 .. linear, 1 .. quadratic
 	const float aa = AA_motorCurve;
 	throttle = throttle * ( throttle * aa + 1 - aa ); // invert the motor curve correction applied further below
 #endif
@@ -411,11 +478,18 @@ if (aux[CH_AUX1]){
 		for ( int i = 0 ; i <= 3 ; i++)
 		{
 			pwm_set( i , 0 );	
-			#ifdef MOTOR_FILTER	
-			// reset the motor filter
-			motorfilter( 0 , i);
+			#ifdef BLACKBOX
+			extern float blackbox_motor[4];
+			blackbox_motor[i] = 0;
 			#endif
 		}	
+		// reset the motor filter
+		motor_filter_reset();
+
+		#ifdef DYNAMIC_IDLE_HZ
+		extern float idle_boost;
+		idle_boost = 0;
+		#endif
 		
 		#ifdef MOTOR_BEEPS
 		extern void motorbeep( void);
@@ -424,8 +498,8 @@ if (aux[CH_AUX1]){
 
 		#ifdef MIX_LOWER_THROTTLE
 		// reset the overthrottle filter
-		lpf(&overthrottlefilt, 0.0f, 0.72f);	// 50hz 1khz sample rate
-		lpf(&underthrottlefilt, 0.0f, 0.72f);	// 50hz 1khz sample rate
+		lpf(&overthrottlefilt, 0.0f, LPF_COEFF_1KHZ( 0.72f ));	// 50hz 1khz sample rate
+		lpf(&underthrottlefilt, 0.0f, LPF_COEFF_1KHZ( 0.72f ));	// 50hz 1khz sample rate
 		#endif				
 		
 		#ifdef STOCK_TX_AUTOCENTER
@@ -455,7 +529,9 @@ if (aux[CH_AUX1]){
 		onground = 0;
 		onground_long = gettime();
 		
+#ifndef MIXER_FIXED
 		float mix[4];	
+#endif
 
 #ifdef 	THROTTLE_TRANSIENT_COMPENSATION
         
@@ -530,6 +606,80 @@ if ( throttle_i < 0.0f) throttle_i = 0.0f;
 throttle -= throttle_p + throttle_i;
 #endif
 
+#ifdef FIXED_POINT
+{
+	// mixer in Q16 from the fixed point pid outputs
+	extern int32_t pidoutput_q[PIDNUMBER];
+	// the throttle changes with the rx frames , converted then
+	static uint32_t throttle_bits;
+	static int32_t thr;
+	if ( float_bits( throttle ) != throttle_bits )
+	{
+		throttle_bits = float_bits( throttle );
+		thr = FLOAT_TO_FIXED( throttle );
+	}
+	int32_t roll = pidoutput_q[ROLL];
+	int32_t pitch = pidoutput_q[PITCH];
+	int32_t yaw = pidoutput_q[YAW];
+	int32_t mix_q[4];
+
+#ifdef INVERT_YAW_PID
+	yaw = -yaw;
+#endif
+
+#ifdef INVERTED_ENABLE
+	if (pwmdir == REVERSE)
+	{
+		mix_q[MOTOR_FR] = thr + roll + pitch - yaw;
+		mix_q[MOTOR_FL] = thr - roll + pitch + yaw;
+		mix_q[MOTOR_BR] = thr + roll - pitch + yaw;
+		mix_q[MOTOR_BL] = thr - roll - pitch - yaw;
+	}
+	else
+#endif
+	{
+		mix_q[MOTOR_FR] = thr - roll - pitch + yaw;
+		mix_q[MOTOR_FL] = thr + roll - pitch - yaw;
+		mix_q[MOTOR_BR] = thr - roll + pitch - yaw;
+		mix_q[MOTOR_BL] = thr + roll + pitch + yaw;
+	}
+
+#ifdef MOTOR_FILTER2_FIXED
+	motor_filter_q( mix_q );
+#endif
+
+#ifdef MIXER_FIXED
+	// Q16 up to the motor driver
+	int32_t thrsum_q = 0;
+	for ( int i = 0 ; i <= 3 ; i++)
+	{
+		#ifdef MOTOR_MIN_ENABLE
+		if ( mix_q[i] < FIXED( MOTOR_MIN_VALUE ) ) mix_q[i] = FIXED( MOTOR_MIN_VALUE );
+		#endif
+
+		pwm_set_q( i , mix_q[i] );
+
+		#ifdef BLACKBOX
+		// before the clip, so saturation shows in the log
+		extern float blackbox_motor[4];
+		blackbox_motor[i] = FIXED_TO_FLOAT( mix_q[i] );
+		#endif
+
+		if ( mix_q[i] < 0 ) mix_q[i] = 0;
+		if ( mix_q[i] > FIXED_ONE ) mix_q[i] = FIXED_ONE;
+		thrsum_q += mix_q[i];
+	}
+	// for the battery compensation
+	thrsum = FIXED_TO_FLOAT( thrsum_q >> 2 );
+#else
+	// the float mixer options below
+	for ( int i = 0 ; i <= 3 ; i++)
+	{
+		mix[i] = FIXED_TO_FLOAT( mix_q[i] );
+	}
+#endif
+}
+#else
 #ifdef INVERT_YAW_PID
 pidoutput[2] = -pidoutput[2];			
 #endif
@@ -560,33 +710,18 @@ else
 // we invert again cause it's used by the pid internally (for limit)
 pidoutput[2] = -pidoutput[2];			
 #endif
+#endif
 
-		for ( int i = 0 ; i <= 3 ; i++)
-		{			
-		#ifdef MOTOR_FILTER		
-		mix[i] = motorfilter(  mix[i] , i);
-		#endif	
-		
-       		#ifdef MOTOR_FILTER2_ALPHA	
-       		 float motorlpf( float in , int x) ;           
-		mix[i] = motorlpf(  mix[i] , i);
-		#endif
-			
-		#ifdef MOTOR_KAL
-      		float motor_kalman( float in , int x);
-       		mix[i] = motor_kalman(  mix[i] , i);  
-       		#endif 
-			
-		#ifdef MOTOR_KAL_2ND
-      		float  motor_kalman_2nd( float in , int x) ;
-    mix[i] = motor_kalman_2nd(  mix[i] , i);  
-    #endif    
+#ifndef MIXER_FIXED
+		motor_filter( mix );
 			
 		#ifdef TORQUE_BOOST
+		for ( int i = 0 ; i <= 3 ; i++)
+		{			
        		float motord( float in , int x);           
 		mix[i] = motord(  mix[i] , i);
-		#endif
        		}
+		#endif
 
 
 #if ( defined MIX_LOWER_THROTTLE || defined MIX_INCREASE_THROTTLE)
@@ -634,9 +769,9 @@ pidoutput[2] = -pidoutput[2];
 
 #ifdef MIX_THROTTLE_FILTER_LPF
 		  if (overthrottle > overthrottlefilt)
-			  lpf(&overthrottlefilt, overthrottle, 0.82);	// 20hz 1khz sample rate
+			  lpf(&overthrottlefilt, overthrottle, LPF_COEFF_1KHZ( 0.82 ));	// 20hz 1khz sample rate
 		  else
-			  lpf(&overthrottlefilt, overthrottle, 0.72);	// 50hz 1khz sample rate
+			  lpf(&overthrottlefilt, overthrottle, LPF_COEFF_1KHZ( 0.72 ));	// 50hz 1khz sample rate
 #else
 		  if (overthrottle > overthrottlefilt)
 			  overthrottlefilt += 0.005f;
@@ -655,9 +790,9 @@ overthrottle = 0.0f;
 			
 #ifdef MIX_THROTTLE_FILTER_LPF
 		  if (underthrottle < underthrottlefilt)
-			  lpf(&underthrottlefilt, underthrottle, 0.82);	// 20hz 1khz sample rate
+			  lpf(&underthrottlefilt, underthrottle, LPF_COEFF_1KHZ( 0.82 ));	// 20hz 1khz sample rate
 		  else
-			  lpf(&underthrottlefilt, underthrottle, 0.72);	// 50hz 1khz sample rate
+			  lpf(&underthrottlefilt, underthrottle, LPF_COEFF_1KHZ( 0.72 ));	// 50hz 1khz sample rate
 #else
 		  if (underthrottle < underthrottlefilt)
 			  underthrottlefilt -= 0.005f;
@@ -803,6 +938,11 @@ if ( overthrottle > 0.1f) ledcommand = 1;
             
             
 thrsum = 0;		
+
+#ifdef DYNAMIC_IDLE_HZ
+		// idle boost from the slowest motor , for all 4 in the loop below
+		motor_curve_update();
+#endif
 				
 		for ( int i = 0 ; i <= 3 ; i++)
 		{			
@@ -844,24 +984,9 @@ thrsum = 0;
 		#ifndef MOTORS_TO_THROTTLE
 		//normal mode
 
-#ifdef THRUST_LINEARISATION
-				// Computationally quite expensive:
-				static float a, a_reci, b, b_sq;
-				extern float aux_analog[];
-				if ( a != AA_motorCurve ) {
-					a = AA_motorCurve;
-					if ( a > 0.0f ) {
-						a_reci = 1 / a;
-						b = ( 1 - a ) / ( 2 * a );
-						b_sq = b * b;
-					}
-				}
-				float test = mix[i];
-				if ( test > 0.0f && a > 0.0f ) {
-					extern float Q_rsqrt( float number );
-					test = 1 / Q_rsqrt( mix[i] * a_reci + b_sq ) - b;
-				}
-				pwm_set( i, test );
+#if defined(MOTOR_CURVE_TABLE) || defined(THRUST_LINEARISATION)
+		// measured or THRUST_LINEARISATION table , motorcurve.c
+		pwm_set( i , motor_curve_map( mix[i] ) );
 #else
 		pwm_set( i ,motormap( mix[i] ) );
 #endif
@@ -878,11 +1003,18 @@ thrsum = 0;
 		#endif
 		
 		
+		#ifdef BLACKBOX
+		// before the clip, so saturation shows in the log
+		extern float blackbox_motor[4];
+		blackbox_motor[i] = mix[i];
+		#endif
+
 		if ( mix[i] < 0 ) mix[i] = 0;
 		if ( mix[i] > 1 ) mix[i] = 1;
 		thrsum+= mix[i];
 		}	
 		thrsum = thrsum / 4;
+#endif
 		
 	}// end motors on
   
@@ -890,81 +1022,6 @@ thrsum = 0;
 }
 
 
-#ifndef MOTOR_FILTER2_ALPHA
-#define MOTOR_FILTER2_ALPHA 0.3
-#endif
-
-
-float motor_filt[4];
-
-float motorlpf( float in , int x)
-{ 
-    
-    lpf(&motor_filt[x] , in , 1 - MOTOR_FILTER2_ALPHA);
-       
-    return motor_filt[x];
-}
-
-
-float hann_lastsample[4];
-float hann_lastsample2[4];
-
-// hanning 3 sample filter
-float motorfilter( float motorin ,int number)
-{
- 	float ans = motorin*0.25f + hann_lastsample[number] * 0.5f +   hann_lastsample2[number] * 0.25f ;
-	
-	hann_lastsample2[number] = hann_lastsample[number];
-	hann_lastsample[number] = motorin;
-	
-	return ans;
-}
-
-
-    //initial values for the kalman filter 
-    float x_est_last[4]={0};
-    float P_last[4]={0}; 
-    const float Q = 0.02;
-		
-		    #ifdef MOTOR_KAL_2ND
-    #undef MOTOR_KAL
-    const float R = Q/(float)MOTOR_KAL_2ND;
-    #endif
-    
-
-   
-    #ifdef MOTOR_KAL
-    const float R = Q/(float)MOTOR_KAL;
-#endif
-    
-    #if ( !defined MOTOR_KAL_2ND  && ! defined MOTOR_KAL )
-    float R = 0.1; 
-    #endif
-
-float  motor_kalman( float in , int x)   
-{    
-    float P_temp = P_last[x] + Q; 
-    float K = P_temp/(P_temp + R);
-     x_est_last[x] = x_est_last[x] + K * (in - x_est_last[x]);  
-    P_last[x] = (1- K) * P_temp; 
-
-    
-return x_est_last[x];
-}	
-	
-float x_est_last2[4] ;
- float  motor_kalman_2nd( float in , int x)   
-{  
-    
-    float P_temp = P_last[x] + Q; 
-    float K = P_temp/(P_temp + R);
-    float oneminusK = 1.0f - K;   
-     x_est_last[x] = oneminusK * x_est_last[x] + K * (in );  
-     float ans = x_est_last2[x] = oneminusK * x_est_last2[x] + K * (x_est_last[x]); 
-     P_last[x] = oneminusK * P_temp; 
- return ans;
-}	
-
 float clip_feedforward[4];
 // clip feedforward adds the amount of thrust exceeding 1.0 ( max) 
 // to the next iteration(s) of the loop
@@ -2,7 +2,12 @@
 
 void control( void);
 float clip_ff(float motorin, int number);
-float motorfilter( float motorin ,int number);
+// motor filters in filter.cpp
+void motor_filter( float *mix );
+void motor_filter_reset( void );
+#ifdef FIXED_POINT
+void motor_filter_q( int32_t *mix );
+#endif
 
 
 
@@ -0,0 +1,183 @@
+// crc for the rx protocols , the blheli 4way interface and the settings store
+// table driven , CRC_BYTE_TABLE: a 256 entry table and one lookup per byte
+// default: a 16 entry table and two lookups per byte , about half the time of the bit loop for 1/16 of the flash
+// the tables are the crc of each byte ( nibble ) value , unused crcs are removed by the linker
+// check and benchmark against the bit loops with "make -C gcc/sil crccheck"
+
+#include "config.h"
+#include "crc.h"
+
+#ifdef CRC_BYTE_TABLE
+
+static const uint8_t crc8_table[256] =
+{
+	0x00 , 0xD5 , 0x7F , 0xAA , 0xFE , 0x2B , 0x81 , 0x54 , 0x29 , 0xFC , 0x56 , 0x83 , 0xD7 , 0x02 , 0xA8 , 0x7D ,
+	0x52 , 0x87 , 0x2D , 0xF8 , 0xAC , 0x79 , 0xD3 , 0x06 , 0x7B , 0xAE , 0x04 , 0xD1 , 0x85 , 0x50 , 0xFA , 0x2F ,
+	0xA4 , 0x71 , 0xDB , 0x0E , 0x5A , 0x8F , 0x25 , 0xF0 , 0x8D , 0x58 , 0xF2 , 0x27 , 0x73 , 0xA6 , 0x0C , 0xD9 ,
+	0xF6 , 0x23 , 0x89 , 0x5C , 0x08 , 0xDD , 0x77 , 0xA2 , 0xDF , 0x0A , 0xA0 , 0x75 , 0x21 , 0xF4 , 0x5E , 0x8B ,
+	0x9D , 0x48 , 0xE2 , 0x37 , 0x63 , 0xB6 , 0x1C , 0xC9 , 0xB4 , 0x61 , 0xCB , 0x1E , 0x4A , 0x9F , 0x35 , 0xE0 ,
+	0xCF , 0x1A , 0xB0 , 0x65 , 0x31 , 0xE4 , 0x4E , 0x9B , 0xE6 , 0x33 , 0x99 , 0x4C , 0x18 , 0xCD , 0x67 , 0xB2 ,
+	0x39 , 0xEC , 0x46 , 0x93 , 0xC7 , 0x12 , 0xB8 , 0x6D , 0x10 , 0xC5 , 0x6F , 0xBA , 0xEE , 0x3B , 0x91 , 0x44 ,
+	0x6B , 0xBE , 0x14 , 0xC1 , 0x95 , 0x40 , 0xEA , 0x3F , 0x42 , 0x97 , 0x3D , 0xE8 , 0xBC , 0x69 , 0xC3 , 0x16 ,
+	0xEF , 0x3A , 0x90 , 0x45 , 0x11 , 0xC4 , 0x6E , 0xBB , 0xC6 , 0x13 , 0xB9 , 0x6C , 0x38 , 0xED , 0x47 , 0x92 ,
+	0xBD , 0x68 , 0xC2 , 0x17 , 0x43 , 0x96 , 0x3C , 0xE9 , 0x94 , 0x41 , 0xEB , 0x3E , 0x6A , 0xBF , 0x15 , 0xC0 ,
+	0x4B , 0x9E , 0x34 , 0xE1 , 0xB5 , 0x60 , 0xCA , 0x1F , 0x62 , 0xB7 , 0x1D , 0xC8 , 0x9C , 0x49 , 0xE3 , 0x36 ,
+	0x19 , 0xCC , 0x66 , 0xB3 , 0xE7 , 0x32 , 0x98 , 0x4D , 0x30 , 0xE5 , 0x4F , 0x9A , 0xCE , 0x1B , 0xB1 , 0x64 ,
+	0x72 , 0xA7 , 0x0D , 0xD8 , 0x8C , 0x59 , 0xF3 , 0x26 , 0x5B , 0x8E , 0x24 , 0xF1 , 0xA5 , 0x70 , 0xDA , 0x0F ,
+	0x20 , 0xF5 , 0x5F , 0x8A , 0xDE , 0x0B , 0xA1 , 0x74 , 0x09 , 0xDC , 0x76 , 0xA3 , 0xF7 , 0x22 , 0x88 , 0x5D ,
+	0xD6 , 0x03 , 0xA9 , 0x7C , 0x28 , 0xFD , 0x57 , 0x82 , 0xFF , 0x2A , 0x80 , 0x55 , 0x01 , 0xD4 , 0x7E , 0xAB ,
+	0x84 , 0x51 , 0xFB , 0x2E , 0x7A , 0xAF , 0x05 , 0xD0 , 0xAD , 0x78 , 0xD2 , 0x07 , 0x53 , 0x86 , 0x2C , 0xF9
+};
+
+static const uint16_t crc16_table[256] =
+{
+	0x0000 , 0x1021 , 0x2042 , 0x3063 , 0x4084 , 0x50A5 , 0x60C6 , 0x70E7 ,
+	0x8108 , 0x9129 , 0xA14A , 0xB16B , 0xC18C , 0xD1AD , 0xE1CE , 0xF1EF ,
+	0x1231 , 0x0210 , 0x3273 , 0x2252 , 0x52B5 , 0x4294 , 0x72F7 , 0x62D6 ,
+	0x9339 , 0x8318 , 0xB37B , 0xA35A , 0xD3BD , 0xC39C , 0xF3FF , 0xE3DE ,
+	0x2462 , 0x3443 , 0x0420 , 0x1401 , 0x64E6 , 0x74C7 , 0x44A4 , 0x5485 ,
+	0xA56A , 0xB54B , 0x8528 , 0x9509 , 0xE5EE , 0xF5CF , 0xC5AC , 0xD58D ,
+	0x3653 , 0x2672 , 0x1611 , 0x0630 , 0x76D7 , 0x66F6 , 0x5695 , 0x46B4 ,
+	0xB75B , 0xA77A , 0x9719 , 0x8738 , 0xF7DF , 0xE7FE , 0xD79D , 0xC7BC ,
+	0x48C4 , 0x58E5 , 0x6886 , 0x78A7 , 0x0840 , 0x1861 , 0x2802 , 0x3823 ,
+	0xC9CC , 0xD9ED , 0xE98E , 0xF9AF , 0x8948 , 0x9969 , 0xA90A , 0xB92B ,
+	0x5AF5 , 0x4AD4 , 0x7AB7 , 0x6A96 , 0x1A71 , 0x0A50 , 0x3A33 , 0x2A12 ,
+	0xDBFD , 0xCBDC , 0xFBBF , 0xEB9E , 0x9B79 , 0x8B58 , 0xBB3B , 0xAB1A ,
+	0x6CA6 , 0x7C87 , 0x4CE4 , 0x5CC5 , 0x2C22 , 0x3C03 , 0x0C60 , 0x1C41 ,
+	0xEDAE , 0xFD8F , 0xCDEC , 0xDDCD , 0xAD2A , 0xBD0B , 0x8D68 , 0x9D49 ,
+	0x7E97 , 0x6EB6 , 0x5ED5 , 0x4EF4 , 0x3E13 , 0x2E32 , 0x1E51 , 0x0E70 ,
+	0xFF9F , 0xEFBE , 0xDFDD , 0xCFFC , 0xBF1B , 0xAF3A , 0x9F59 , 0x8F78 ,
+	0x9188 , 0x81A9 , 0xB1CA , 0xA1EB , 0xD10C , 0xC12D , 0xF14E , 0xE16F ,
+	0x1080 , 0x00A1 , 0x30C2 , 0x20E3 , 0x5004 , 0x4025 , 0x7046 , 0x6067 ,
+	0x83B9 , 0x9398 , 0xA3FB , 0xB3DA , 0xC33D , 0xD31C , 0xE37F , 0xF35E ,
+	0x02B1 , 0x1290 , 0x22F3 , 0x32D2 , 0x4235 , 0x5214 , 0x6277 , 0x7256 ,
+	0xB5EA , 0xA5CB , 0x95A8 , 0x8589 , 0xF56E , 0xE54F , 0xD52C , 0xC50D ,
+	0x34E2 , 0x24C3 , 0x14A0 , 0x0481 , 0x7466 , 0x6447 , 0x5424 , 0x4405 ,
+	0xA7DB , 0xB7FA , 0x8799 , 0x97B8 , 0xE75F , 0xF77E , 0xC71D , 0xD73C ,
+	0x26D3 , 0x36F2 , 0x0691 , 0x16B0 , 0x6657 , 0x7676 , 0x4615 , 0x5634 ,
+	0xD94C , 0xC96D , 0xF90E , 0xE92F , 0x99C8 , 0x89E9 , 0xB98A , 0xA9AB ,
+	0x5844 , 0x4865 , 0x7806 , 0x6827 , 0x18C0 , 0x08E1 , 0x3882 , 0x28A3 ,
+	0xCB7D , 0xDB5C , 0xEB3F , 0xFB1E , 0x8BF9 , 0x9BD8 , 0xABBB , 0xBB9A ,
+	0x4A75 , 0x5A54 , 0x6A37 , 0x7A16 , 0x0AF1 , 0x1AD0 , 0x2AB3 , 0x3A92 ,
+	0xFD2E , 0xED0F , 0xDD6C , 0xCD4D , 0xBDAA , 0xAD8B , 0x9DE8 , 0x8DC9 ,
+	0x7C26 , 0x6C07 , 0x5C64 , 0x4C45 , 0x3CA2 , 0x2C83 , 0x1CE0 , 0x0CC1 ,
+	0xEF1F , 0xFF3E , 0xCF5D , 0xDF7C , 0xAF9B , 0xBFBA , 0x8FD9 , 0x9FF8 ,
+	0x6E17 , 0x7E36 , 0x4E55 , 0x5E74 , 0x2E93 , 0x3EB2 , 0x0ED1 , 0x1EF0
+};
+
+static const uint32_t crc24_table[256] =
+{
+	0x000000 , 0x01B4C0 , 0x036980 , 0x02DD40 , 0x06D300 , 0x0767C0 , 0x05BA80 , 0x040E40 ,
+	0x0DA600 , 0x0C12C0 , 0x0ECF80 , 0x0F7B40 , 0x0B7500 , 0x0AC1C0 , 0x081C80 , 0x09A840 ,
+	0x1B4C00 , 0x1AF8C0 , 0x182580 , 0x199140 , 0x1D9F00 , 0x1C2BC0 , 0x1EF680 , 0x1F4240 ,
+	0x16EA00 , 0x175EC0 , 0x158380 , 0x143740 , 0x103900 , 0x118DC0 , 0x135080 , 0x12E440 ,
+	0x369800 , 0x372CC0 , 0x35F180 , 0x344540 , 0x304B00 , 0x31FFC0 , 0x332280 , 0x329640 ,
+	0x3B3E00 , 0x3A8AC0 , 0x385780 , 0x39E340 , 0x3DED00 , 0x3C59C0 , 0x3E8480 , 0x3F3040 ,
+	0x2DD400 , 0x2C60C0 , 0x2EBD80 , 0x2F0940 , 0x2B0700 , 0x2AB3C0 , 0x286E80 , 0x29DA40 ,
+	0x207200 , 0x21C6C0 , 0x231B80 , 0x22AF40 , 0x26A100 , 0x2715C0 , 0x25C880 , 0x247C40 ,
+	0x6D3000 , 0x6C84C0 , 0x6E5980 , 0x6FED40 , 0x6BE300 , 0x6A57C0 , 0x688A80 , 0x693E40 ,
+	0x609600 , 0x6122C0 , 0x63FF80 , 0x624B40 , 0x664500 , 0x67F1C0 , 0x652C80 , 0x649840 ,
+	0x767C00 , 0x77C8C0 , 0x751580 , 0x74A140 , 0x70AF00 , 0x711BC0 , 0x73C680 , 0x727240 ,
+	0x7BDA00 , 0x7A6EC0 , 0x78B380 , 0x790740 , 0x7D0900 , 0x7CBDC0 , 0x7E6080 , 0x7FD440 ,
+	0x5BA800 , 0x5A1CC0 , 0x58C180 , 0x597540 , 0x5D7B00 , 0x5CCFC0 , 0x5E1280 , 0x5FA640 ,
+	0x560E00 , 0x57BAC0 , 0x556780 , 0x54D340 , 0x50DD00 , 0x5169C0 , 0x53B480 , 0x520040 ,
+	0x40E400 , 0x4150C0 , 0x438D80 , 0x423940 , 0x463700 , 0x4783C0 , 0x455E80 , 0x44EA40 ,
+	0x4D4200 , 0x4CF6C0 , 0x4E2B80 , 0x4F9F40 , 0x4B9100 , 0x4A25C0 , 0x48F880 , 0x494C40 ,
+	0xDA6000 , 0xDBD4C0 , 0xD90980 , 0xD8BD40 , 0xDCB300 , 0xDD07C0 , 0xDFDA80 , 0xDE6E40 ,
+	0xD7C600 , 0xD672C0 , 0xD4AF80 , 0xD51B40 , 0xD11500 , 0xD0A1C0 , 0xD27C80 , 0xD3C840 ,
+	0xC12C00 , 0xC098C0 , 0xC24580 , 0xC3F140 , 0xC7FF00 , 0xC64BC0 , 0xC49680 , 0xC52240 ,
+	0xCC8A00 , 0xCD3EC0 , 0xCFE380 , 0xCE5740 , 0xCA5900 , 0xCBEDC0 , 0xC93080 , 0xC88440 ,
+	0xECF800 , 0xED4CC0 , 0xEF9180 , 0xEE2540 , 0xEA2B00 , 0xEB9FC0 , 0xE94280 , 0xE8F640 ,
+	0xE15E00 , 0xE0EAC0 , 0xE23780 , 0xE38340 , 0xE78D00 , 0xE639C0 , 0xE4E480 , 0xE55040 ,
+	0xF7B400 , 0xF600C0 , 0xF4DD80 , 0xF56940 , 0xF16700 , 0xF0D3C0 , 0xF20E80 , 0xF3BA40 ,
+	0xFA1200 , 0xFBA6C0 , 0xF97B80 , 0xF8CF40 , 0xFCC100 , 0xFD75C0 , 0xFFA880 , 0xFE1C40 ,
+	0xB75000 , 0xB6E4C0 , 0xB43980 , 0xB58D40 , 0xB18300 , 0xB037C0 , 0xB2EA80 , 0xB35E40 ,
+	0xBAF600 , 0xBB42C0 , 0xB99F80 , 0xB82B40 , 0xBC2500 , 0xBD91C0 , 0xBF4C80 , 0xBEF840 ,
+	0xAC1C00 , 0xADA8C0 , 0xAF7580 , 0xAEC140 , 0xAACF00 , 0xAB7BC0 , 0xA9A680 , 0xA81240 ,
+	0xA1BA00 , 0xA00EC0 , 0xA2D380 , 0xA36740 , 0xA76900 , 0xA6DDC0 , 0xA40080 , 0xA5B440 ,
+	0x81C800 , 0x807CC0 , 0x82A180 , 0x831540 , 0x871B00 , 0x86AFC0 , 0x847280 , 0x85C640 ,
+	0x8C6E00 , 0x8DDAC0 , 0x8F0780 , 0x8EB340 , 0x8ABD00 , 0x8B09C0 , 0x89D480 , 0x886040 ,
+	0x9A8400 , 0x9B30C0 , 0x99ED80 , 0x985940 , 0x9C5700 , 0x9DE3C0 , 0x9F3E80 , 0x9E8A40 ,
+	0x972200 , 0x9696C0 , 0x944B80 , 0x95FF40 , 0x91F100 , 0x9045C0 , 0x929880 , 0x932C40
+};
+
+uint8_t crc8_dvb_s2( uint8_t crc , const uint8_t *data , int bytes )
+{
+	unsigned int c = crc;
+	while ( bytes-- ) c = crc8_table[ ( c ^ *data++ ) & 0xFF ];
+	return c;
+}
+
+uint16_t crc16_ccitt( uint16_t crc , const uint8_t *data , int bytes )
+{
+	unsigned int c = crc;
+	while ( bytes-- ) c = ( c << 8 ) ^ crc16_table[ ( ( c >> 8 ) ^ *data++ ) & 0xFF ];
+	return c;
+}
+
+uint32_t crc24_ble( uint32_t crc , const uint8_t *data , int bytes )
+{
+	while ( bytes-- ) crc = ( crc >> 8 ) ^ crc24_table[ ( crc ^ *data++ ) & 0xFF ];
+	return crc;
+}
+
+#else
+
+static const uint8_t crc8_table[16] =
+{
+	0x00 , 0xD5 , 0x7F , 0xAA , 0xFE , 0x2B , 0x81 , 0x54 , 0x29 , 0xFC , 0x56 , 0x83 , 0xD7 , 0x02 , 0xA8 , 0x7D
+};
+
+static const uint16_t crc16_table[16] =
+{
+	0x0000 , 0x1021 , 0x2042 , 0x3063 , 0x4084 , 0x50A5 , 0x60C6 , 0x70E7 ,
+	0x8108 , 0x9129 , 0xA14A , 0xB16B , 0xC18C , 0xD1AD , 0xE1CE , 0xF1EF
+};
+
+static const uint32_t crc24_table[16] =
+{
+	0x000000 , 0x1B4C00 , 0x369800 , 0x2DD400 , 0x6D3000 , 0x767C00 , 0x5BA800 , 0x40E400 ,
+	0xDA6000 , 0xC12C00 , 0xECF800 , 0xF7B400 , 0xB75000 , 0xAC1C00 , 0x81C800 , 0x9A8400
+};
+
+uint8_t crc8_dvb_s2( uint8_t crc , const uint8_t *data , int bytes )
+{
+	unsigned int c = crc;
+	while ( bytes-- )
+	{
+		c ^= *data++;
+		c = ( c << 4 ) ^ crc8_table[ ( c >> 4 ) & 15 ];
+		c = ( c << 4 ) ^ crc8_table[ ( c >> 4 ) & 15 ];
+	}
+	return c;
+}
+
+uint16_t crc16_ccitt( uint16_t crc , const uint8_t *data , int bytes )
+{
+	unsigned int c = crc;
+	while ( bytes-- )
+	{
+		c ^= *data++ << 8;
+		c = ( c << 4 ) ^ crc16_table[ ( c >> 12 ) & 15 ];
+		c = ( c << 4 ) ^ crc16_table[ ( c >> 12 ) & 15 ];
+	}
+	return c;
+}
+
+uint32_t crc24_ble( uint32_t crc , const uint8_t *data , int bytes )
+{
+	while ( bytes-- )
+	{
+		crc ^= *data++;
+		crc = ( crc >> 4 ) ^ crc24_table[ crc & 15 ];
+		crc = ( crc >> 4 ) ^ crc24_table[ crc & 15 ];
+	}
+	return crc;
+}
+
+#endif
+
+uint16_t crc16_ccitt_byte( uint16_t crc , uint8_t data )
+{
+	return crc16_ccitt( crc , &data , 1 );
+}
@@ -0,0 +1,13 @@
+
+#include <inttypes.h>
+
+// crc8 dvb-s2 , poly 0xD5 , msb first ( crsf )
+uint8_t crc8_dvb_s2( uint8_t crc , const uint8_t *data , int bytes );
+
+// crc16 ccitt / xmodem , poly 0x1021 , msb first ( sumd , bayang telemetry , blheli 4way , settings store )
+uint16_t crc16_ccitt( uint16_t crc , const uint8_t *data , int bytes );
+uint16_t crc16_ccitt_byte( uint16_t crc , uint8_t data );
+
+// crc24 ble , poly 0x00065B sent lsb first , computed reflected ( 0xDA6000 )
+// the initial value 0x555555 is 0xAAAAAA reflected , the result is sent low byte first
+uint32_t crc24_ble( uint32_t crc , const uint8_t *data , int bytes );
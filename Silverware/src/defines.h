@@ -21,6 +21,18 @@
 // this should be precalculated by the compiler as it's a constant
 #define FILTERCALC( sampleperiod, filtertime) (1.0f - ( 6.0f*(float)sampleperiod) / ( 3.0f *(float)sampleperiod + (float)filtertime))
 
+// 1st order lpf gain ( new sample weight ) measured at 1000Hz, rescaled to another loop time in uS
+// keeps the FILTERCALC filter time, so it returns k unchanged at 1000uS
+#define LPF_GAIN_RESCALE( k , looptime ) ( 6.0f * (float)(looptime) / ( 3.0f * (float)(looptime) + 6000.0f / (float)(k) - 3000.0f ) )
+
+// gyro filters run at the gyro loop rate, the motor filter at the pid loop rate
+#define KALMAN_GAIN( k ) LPF_GAIN_RESCALE( k , GYRO_LOOPTIME )
+#define KALMAN_RATIO( k ) ( KALMAN_GAIN( k ) * KALMAN_GAIN( k ) / ( 1.0f - KALMAN_GAIN( k ) ) )
+#define MFILT1( k ) LPF_GAIN_RESCALE( k , LOOPTIME )
+
+// lpf() coefficient ( old value weight ) tuned at 1000Hz, for the pid loop rate
+#define LPF_COEFF_1KHZ( c ) ( 1.0f - LPF_GAIN_RESCALE( 1.0f - (c) , LOOPTIME ) )
+
 
 #define RXMODE_BIND 0
 #define RXMODE_NORMAL (!RXMODE_BIND)
@@ -144,37 +156,38 @@
 
 #ifdef KALMAN_GYRO
 // kalman Q/R ratio for Q = 0.02
-// loop time 1000Hz
-#define	HZ_10	0.004078
-#define	HZ_20	0.015952
-#define	HZ_30	0.035546
-#define	HZ_40	0.062984
-#define	HZ_50	0.097857
-#define	HZ_60	0.139957
-#define	HZ_70	0.190992
-#define	HZ_80	0.249072
-#define	HZ_90	0.308894
-#define	HZ_100	0.397188
-#define	HZ_120	0.542488
-#define	HZ_140	0.719026
-#define	HZ_160	0.928746
-#define	HZ_180	1.144837
-#define	HZ_200	1.354386
-#define	HZ_220	1.611742
-#define	HZ_240	1.87532
-#define	HZ_260	2.123421
-#define	HZ_280	2.377006
-#define	HZ_300	2.595641
-#define	HZ_320	2.864404
-#define	HZ_340	3.052077
-#define	HZ_360	3.272997
-#define	HZ_380	3.44942
-#define	HZ_400	3.679173
-#define	HZ_420	3.721861
-#define	HZ_440	3.880844
-#define	HZ_460	3.908564
-#define	HZ_480	3.984022
-#define	HZ_500	4.100000
+// steady state gain K measured at 1000Hz loop time, Q/R = K*K/(1-K)
+// rescaled to the gyro loop rate at compile time
+#define	HZ_10	KALMAN_RATIO( 0.061853 )
+#define	HZ_20	KALMAN_RATIO( 0.118577 )
+#define	HZ_30	KALMAN_RATIO( 0.171599 )
+#define	HZ_40	KALMAN_RATIO( 0.221442 )
+#define	HZ_50	KALMAN_RATIO( 0.267696 )
+#define	HZ_60	KALMAN_RATIO( 0.310618 )
+#define	HZ_70	KALMAN_RATIO( 0.351842 )
+#define	HZ_80	KALMAN_RATIO( 0.389839 )
+#define	HZ_90	KALMAN_RATIO( 0.422396 )
+#define	HZ_100	KALMAN_RATIO( 0.462184 )
+#define	HZ_120	KALMAN_RATIO( 0.513652 )
+#define	HZ_140	KALMAN_RATIO( 0.561506 )
+#define	HZ_160	KALMAN_RATIO( 0.605388 )
+#define	HZ_180	KALMAN_RATIO( 0.641048 )
+#define	HZ_200	KALMAN_RATIO( 0.669275 )
+#define	HZ_220	KALMAN_RATIO( 0.697848 )
+#define	HZ_240	KALMAN_RATIO( 0.722017 )
+#define	HZ_260	KALMAN_RATIO( 0.741245 )
+#define	HZ_280	KALMAN_RATIO( 0.758172 )
+#define	HZ_300	KALMAN_RATIO( 0.770991 )
+#define	HZ_320	KALMAN_RATIO( 0.784915 )
+#define	HZ_340	KALMAN_RATIO( 0.793632 )
+#define	HZ_360	KALMAN_RATIO( 0.802994 )
+#define	HZ_380	KALMAN_RATIO( 0.809860 )
+#define	HZ_400	KALMAN_RATIO( 0.818091 )
+#define	HZ_420	KALMAN_RATIO( 0.819540 )
+#define	HZ_440	KALMAN_RATIO( 0.824733 )
+#define	HZ_460	KALMAN_RATIO( 0.825607 )
+#define	HZ_480	KALMAN_RATIO( 0.827941 )
+#define	HZ_500	KALMAN_RATIO( 0.831406 )
 #endif
 
 #ifdef PT1_GYRO
@@ -211,35 +224,35 @@
 #endif
 
 // 1st order lpf alpha
-// for 1000Hz loop frequency
-#define	MFILT1_HZ_10	0.056677
-#define	MFILT1_HZ_20	0.109243
-#define	MFILT1_HZ_30	0.15976
-#define	MFILT1_HZ_40	0.207311
-#define	MFILT1_HZ_50	0.250878
-#define	MFILT1_HZ_60	0.292612
-#define	MFILT1_HZ_70	0.331242
-#define	MFILT1_HZ_80	0.366444
-#define	MFILT1_HZ_90	0.406108
-#define	MFILT1_HZ_100	0.434536
-#define	MFILT1_HZ_120	0.49997
-#define	MFILT1_HZ_140	0.543307
-#define	MFILT1_HZ_160	0.582436
-#define	MFILT1_HZ_180	0.631047
-#define	MFILT1_HZ_200	0.67169
-#define	MFILT1_HZ_220	0.697849
-#define	MFILT1_HZ_240	0.714375
-#define	MFILT1_HZ_260	0.725199
-#define	MFILT1_HZ_280	0.740312
-#define	MFILT1_HZ_300	0.758612
-#define	MFILT1_HZ_320	0.773861
-#define	MFILT1_HZ_340	0.79364
-#define	MFILT1_HZ_360	0.803003
-#define	MFILT1_HZ_380	0.809752
-#define	MFILT1_HZ_400	0.817944
-#define	MFILT1_HZ_420	0.81943
-#define	MFILT1_HZ_440	0.824737
-#define	MFILT1_HZ_460	0.825618
-#define	MFILT1_HZ_480	0.827956
-#define	MFILT1_HZ_500	0.836544
+// measured at 1000Hz loop frequency, rescaled to the pid loop rate at compile time
+#define	MFILT1_HZ_10	MFILT1( 0.056677 )
+#define	MFILT1_HZ_20	MFILT1( 0.109243 )
+#define	MFILT1_HZ_30	MFILT1( 0.15976 )
+#define	MFILT1_HZ_40	MFILT1( 0.207311 )
+#define	MFILT1_HZ_50	MFILT1( 0.250878 )
+#define	MFILT1_HZ_60	MFILT1( 0.292612 )
+#define	MFILT1_HZ_70	MFILT1( 0.331242 )
+#define	MFILT1_HZ_80	MFILT1( 0.366444 )
+#define	MFILT1_HZ_90	MFILT1( 0.406108 )
+#define	MFILT1_HZ_100	MFILT1( 0.434536 )
+#define	MFILT1_HZ_120	MFILT1( 0.49997 )
+#define	MFILT1_HZ_140	MFILT1( 0.543307 )
+#define	MFILT1_HZ_160	MFILT1( 0.582436 )
+#define	MFILT1_HZ_180	MFILT1( 0.631047 )
+#define	MFILT1_HZ_200	MFILT1( 0.67169 )
+#define	MFILT1_HZ_220	MFILT1( 0.697849 )
+#define	MFILT1_HZ_240	MFILT1( 0.714375 )
+#define	MFILT1_HZ_260	MFILT1( 0.725199 )
+#define	MFILT1_HZ_280	MFILT1( 0.740312 )
+#define	MFILT1_HZ_300	MFILT1( 0.758612 )
+#define	MFILT1_HZ_320	MFILT1( 0.773861 )
+#define	MFILT1_HZ_340	MFILT1( 0.79364 )
+#define	MFILT1_HZ_360	MFILT1( 0.803003 )
+#define	MFILT1_HZ_380	MFILT1( 0.809752 )
+#define	MFILT1_HZ_400	MFILT1( 0.817944 )
+#define	MFILT1_HZ_420	MFILT1( 0.81943 )
+#define	MFILT1_HZ_440	MFILT1( 0.824737 )
+#define	MFILT1_HZ_460	MFILT1( 0.825618 )
+#define	MFILT1_HZ_480	MFILT1( 0.827956 )
+#define	MFILT1_HZ_500	MFILT1( 0.836544 )
 
@@ -2,15 +2,25 @@
 // Dshot driver for H101_dual firmware. Written by Markus Gritsch.
 // No throttle jitter, no min/max calibration, just pure digital goodness :)
 
-// Dshot150 would be fast enough for up to 8 kHz main loop frequency. But
-// since this implementation does simple bit banging, Dshot150 takes a lot of
-// our 1 ms main loop time. Dshot300 takes less time for bit banging, which
-// leaves more idle time. Implementing the driver using DMA (like Betaflight
-// does) is left as an excercise for the reader ;)
+// All 4 motors go out in one frame. dshot_send() bit slices the 4 packets
+// into a stream of port words, 3 symbols per bit and 2 gpio ports per
+// symbol: all pins high ( BSRR ), the pins of the 0 bits low ( BRR ), all
+// pins low ( BRR ). dshot_output() writes one symbol at each update flag of
+// TIM14, which runs at a third of the bit time, so the timing follows the
+// timer and not the compiler or the clock. The interrupts are off for one
+// frame: Dshot600 - 27uS , Dshot300 - 53uS , Dshot150 - 107uS. Boards that
+// can give TIM1 and dma channels to the motors should use
+// USE_DSHOT_DMA_DRIVER instead.
+
+// Cycle budget: a symbol is 27 cycles at Dshot600 and 48MHz , 35 with
+// ENABLE_OVERCLOCK. A symbol is the flag poll , the flag clear and one
+// halfword load and store per port. The longest one , with the loop branch ,
+// is about 19 cycles of thumb code ( llc -mcpu=cortex-m0 , not measured on
+// hardware ), a late symbol shifts its edges but the next one stays on the
+// timer. Anything added to the loop in dshot_output() must keep this margin.
 
 // The ESC signal must be taken before the FET, i.e. non-inverted. The
 // signal after the FET with a pull-up resistor is not good enough.
-// Bit-bang timing tested only with Keil compiler.
 
 // Dshot capable ESCs required. Consider removing the input filter cap,
 // especially if you get drop outs. Tested on "Racerstar MS Series 15A ESC
@@ -24,13 +34,9 @@
 // be set to 'Bidirectional' (or 'Bidirectional Rev.') accordingly:
 //#define BIDIRECTIONAL
 
-// Select Dshot150 or Dshot300. Dshot150 consumes quite some main loop time.
+// Select Dshot150, Dshot300 or Dshot600.
 // DShot300 may require removing the input filter cap on the ESC:
 
-// timing: 600 - 115 uS
-// timing: 300 - 78uS bitbang
-// timing: 150 - 150uS bitbang
-
 #define DSHOT600
 //#define DSHOT300
 //#define DSHOT150
@@ -40,21 +46,17 @@
 // still spin at minimum throttle.
 #define IDLE_OFFSET 32
 
-// if using 3 gpio A and 1 b enable "less delay" (for dshot300 only)
-#define LESS_DELAY
-
 // READ THIS:
 
 // Test the whole throttle range before flight!
 // If motors don't stop, turn off TX and wait 2 seconds
 
-// Dshot600 is sensitive to capacitance from wires,
-// but should be insensitive to gpio combinations
+// Dshot600 is sensitive to capacitance from wires
 
-// Dshot300 is most sensitive to mixes of gpioA
-// it has fastest send time in this implementation
+// All pins of a port change in the same write, so pin mixes of gpioA and
+// gpioB only differ by the one store between the two ports
 
-// Dshot150 is pretty insensitive to pin mixes and wire capacitance
+// Dshot150 is pretty insensitive to wire capacitance
 
 #include "project.h"
 
@@ -65,6 +67,7 @@
 #include "hardware.h"
 #include "util.h"
 #include "drv_dshot.h"
+#include "dshot_command.h"
 #include "config.h"
 
 #ifdef USE_DSHOT_DRIVER_BETA
@@ -74,15 +77,6 @@
 #error "Not tested with THREE_D_THROTTLE config option"
 #endif
 
-// #ifdef __GNUC__
-// #error "Bit-bang timing not tested with GCC"
-// #endif
-
-
-#ifdef ENABLE_OVERCLOCK
-#error "Overclock timing not implemented"
-#endif
-
 #ifdef DSHOT150
 #ifdef RX_SBUS
 #warning "DSHOT150 may impair sbus performance"
@@ -90,22 +84,53 @@
 #endif
 
 
-#ifdef INVERTED_ENABLE
+#if defined(INVERTED_ENABLE) && !defined(INVERTED_DSHOT_COMMANDS)
 #ifndef BIDIRECTIONAL
 #error INVERTED_ENABLE is on but not BIDIRECTIONAL in dshot driver
 #endif
 #endif
 
+#if defined(INVERTED_DSHOT_COMMANDS) && defined(BIDIRECTIONAL)
+#error INVERTED_DSHOT_COMMANDS reverses the escs by command, BIDIRECTIONAL is for 3D escs
+#endif
+
 extern int failsafe;
 extern int onground;
 
 int pwmdir = 0;
 static unsigned long pwm_failsafe_time = 1;
-static int motor_data[ 48 ] = { 0 };
+
+#ifdef DSHOT150
+	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/150)-1)
+#endif
+#ifdef DSHOT300
+	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/300)-1)
+#endif
+#ifdef DSHOT600
+	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/600)-1)
+#endif
+
+// timer period of one third of a bit, rounded to the nearest
+#define DSHOT_SYMBOL_TIME 	( ( DSHOT_BIT_TIME + 2 ) / 3 - 1 )
+
+static uint16_t dshot_packet[ 4 ];					// 16bits dshot data for 4 motors
+
+// motors with a 0 bit ( bit 0 - 3 ) to their pins
+static uint16_t dshot_zero_A[ 16 ];
+static uint16_t dshot_zero_B[ 16 ];
+// the frame for dshot_output() , per bit msb first: BSRR A , B ( all pins ) , BRR A , B ( the 0 bits ) , BRR A , B ( all pins )
+// only the middle symbol changes , dshot_send() writes it
+#define DSHOT_STREAM_SIZE ( 16 * 6 )
+static uint16_t dshot_stream[ DSHOT_STREAM_SIZE ];
 
 typedef enum { false, true } bool;
 void make_packet( uint8_t number, uint16_t value, bool telemetry );
 
+#if GYRO_RATE_MULTIPLIER > 1
+static uint16_t dshot_value[ 4 ];
+static int dshot_repeat = 0;
+#endif
+
 
 
 
@@ -122,14 +147,7 @@ void make_packet( uint8_t number, uint16_t value, bool telemetry );
 //#define gpioset( port , pin) port->BRR = pin
 //#define gpioreset( port , pin) port->BSRR = pin
 
-#ifdef DSHOT600
-void bitbang_data1(void);
-void bitbang_data2(void);
-void bitbang_data3(void);
-void bitbang_data4(void);
-#else
-void bitbang_data( void );
-#endif
+static void dshot_output( void );
 
 
 void pwm_init()
@@ -155,43 +173,73 @@ void pwm_init()
 	GPIO_InitStructure.GPIO_Pin = DSHOT_PIN_3 ;
 	GPIO_Init( DSHOT_PORT_3, &GPIO_InitStructure );
 
+	GPIO_TypeDef * const dshot_port[4] = { DSHOT_PORT_0, DSHOT_PORT_1, DSHOT_PORT_2, DSHOT_PORT_3 };
+	const uint16_t dshot_pin[4] = { DSHOT_PIN_0, DSHOT_PIN_1, DSHOT_PIN_2, DSHOT_PIN_3 };
+
+	for ( int n = 0; n < 16; n++ ) {
+		for ( int m = 0; m < 4; m++ ) {
+			if ( !( n & ( 1 << m ) ) ) continue;
+			if ( dshot_port[ m ] == GPIOA )	dshot_zero_A[ n ] |= dshot_pin[ m ];
+			else														dshot_zero_B[ n ] |= dshot_pin[ m ];
+		}
+	}
+	for ( int i = 0; i < DSHOT_STREAM_SIZE; i += 6 ) {
+		dshot_stream[ i ] = dshot_stream[ i + 4 ] = dshot_zero_A[ 15 ];
+		dshot_stream[ i + 1 ] = dshot_stream[ i + 5 ] = dshot_zero_B[ 15 ];
+	}
+
+	// TIM14 as the symbol clock , polled , no interrupt
+	RCC_APB1PeriphClockCmd( RCC_APB1Periph_TIM14 , ENABLE );
+	TIM14->CR1 = 0;
+	TIM14->PSC = 0;
+	TIM14->ARR = DSHOT_SYMBOL_TIME;
+	TIM14->EGR = TIM_EGR_UG;
+
 	// set failsafetime so signal is off at start
 	pwm_failsafe_time = gettime() - 100000;
 
 	pwmdir = FORWARD;
 }
 
-void pwm_set( uint8_t number, float pwm )
+// bits 0 - 7 to bits 0 , 4 .. 28
+static inline uint32_t dshot_spread( uint32_t x )
 {
-    // if ( number > 3 ) failloop(5);
-    if ( number > 3 ) return;
+	x = ( x | ( x << 12 ) ) & 0x000f000f;
+	x = ( x | ( x << 6 ) ) & 0x03030303;
+	x = ( x | ( x << 3 ) ) & 0x11111111;
+	return x;
+}
 
-	if ( pwm < 0.0f ) {
-		pwm = 0.0;
-	}
-	if ( pwm > 0.999f ) {
-		pwm = 0.999;
+static void dshot_send( void)
+{
+	// transpose the 4 packets: nibble n of hi / lo holds bit 7 - n of the high / low bytes
+	// with motor 0 - 3 at bit 0 - 3 of the nibble, the packets are inverted for the 0 bits
+	uint32_t hi = 0;
+	uint32_t lo = 0;
+	for ( int m = 0; m < 4; m++ ) {
+		uint32_t packet = ~dshot_packet[ m ];
+		hi |= dshot_spread( ( packet >> 8 ) & 0xff ) << m;
+		lo |= dshot_spread( packet & 0xff ) << m;
 	}
 
-	uint16_t value = 0;
-
-#ifdef BIDIRECTIONAL
-
-	if ( pwmdir == FORWARD ) {
-		// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET .. 1047
-		value = 48 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
-	} else if ( pwmdir == REVERSE ) {
-		// maps 0.0 .. 0.999 to 1048 + IDLE_OFFSET .. 2047
-		value = 1048 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
+	for ( int i = 0; i < 8; i++ ) {
+		int shift = 28 - i * 4;
+		uint16_t * const bit_hi = dshot_stream + i * 6 + 2;
+		uint16_t * const bit_lo = bit_hi + 8 * 6;
+		bit_hi[ 0 ] = dshot_zero_A[ ( hi >> shift ) & 0x0f ];
+		bit_hi[ 1 ] = dshot_zero_B[ ( hi >> shift ) & 0x0f ];
+		bit_lo[ 0 ] = dshot_zero_A[ ( lo >> shift ) & 0x0f ];
+		bit_lo[ 1 ] = dshot_zero_B[ ( lo >> shift ) & 0x0f ];
 	}
 
-#else
-
-	// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET * 2 .. 2047
-	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( pwm * ( 2001 - IDLE_OFFSET * 2 ) );
-
-#endif
+	__disable_irq();
+	dshot_output();
+	__enable_irq();
+}
 
+// onground , failsafe and the queued commands , then the frame
+static void dshot_set( uint8_t number, uint16_t value )
+{
 	if ( onground ) {
 		value = 0; // stop the motors
 	}
@@ -205,13 +253,19 @@ void pwm_set( uint8_t number, float pwm )
             // usually the quad should be gone by then
 			if ( gettime() - pwm_failsafe_time > 1000000 ) {
 				value = 0;
+				// but for the queued commands ( motor beeps )
+				if ( !dshot_command_busy( DSHOT_ALL_MOTORS ) ) {
 
                 gpioreset( DSHOT_PORT_0, DSHOT_PIN_0 );
                 gpioreset( DSHOT_PORT_1, DSHOT_PIN_1 );
                 gpioreset( DSHOT_PORT_2, DSHOT_PIN_2 );
                 gpioreset( DSHOT_PORT_3, DSHOT_PIN_3 );
                 //////
+#if GYRO_RATE_MULTIPLIER > 1
+                dshot_repeat = 0;
+#endif
                 return;
+				}
 
 			}
 		}
@@ -219,311 +273,178 @@ void pwm_set( uint8_t number, float pwm )
 		pwm_failsafe_time = 0;
 	}
 
-	make_packet( number, value, false );
+	// a queued command instead of the stop frame
+	uint8_t command = dshot_command_frame( number, value );
 
-	if ( number == 3 ) {
+#if GYRO_RATE_MULTIPLIER > 1
+	// commands are not repeated , stop frames in between
+	dshot_value[ number ] = value;
+	if ( number == 3 ) dshot_repeat = 1;
+#endif
 
-        #ifdef DSHOT600
-        __disable_irq();
-        bitbang_data1();
-        __enable_irq();
-        __ISB();
-        __disable_irq();
-        bitbang_data2();
-        __enable_irq();
-        __ISB();
-        __disable_irq();
-        bitbang_data3();
-        __enable_irq();
-        __ISB();
-        __disable_irq();
-        bitbang_data4();
-        __enable_irq();
-        #else
-        __disable_irq();
-		bitbang_data();
-        __enable_irq();
-        #endif
-       for ( uint8_t i = 0; i < 48; ++i )
-       {
-		motor_data[ i ] = 0;
-       }
+	if ( command ) {
+		make_packet( number, command, true );
+	} else {
+		make_packet( number, value, false );
 	}
 
-}
-
-void make_packet( uint8_t number, uint16_t value, bool telemetry )
-{
-	uint16_t packet = ( value << 1 ) | ( telemetry ? 1 : 0 ); // Here goes telemetry bit
-	// compute checksum
-	uint16_t csum = 0;
-	uint16_t csum_data = packet;
-	for ( uint8_t i = 0; i < 3; ++i ) {
-		csum ^= csum_data; // xor data by nibbles
-		csum_data >>= 4;
+	if ( number == 3 ) {
+		dshot_send();
 	}
 
-	csum &= 0xf;
-	// append checksum
-	packet = ( packet << 4 ) | csum;
-
-	// generate pulses for whole packet
-	for ( uint8_t i = 0; i < 16; ++i ) {
-		if ( packet & 0x8000 ) { // MSB first
-			motor_data[ i * 3 + 0 ] |= 1 << number;
-			motor_data[ i * 3 + 1 ] |= 1 << number;
-			motor_data[ i * 3 + 2 ] |= 0 << number;
-		} else {
-			motor_data[ i * 3 + 0 ] |= 1 << number;
-			motor_data[ i * 3 + 1 ] |= 0 << number;
-			motor_data[ i * 3 + 2 ] |= 0 << number;
-		}
-		packet <<= 1;
-	}
 }
 
-// Do not change anything between #pragma push and #pragma pop
-// without redoing thorough timing measurements.
-#pragma push
-#pragma O2
-
-#ifdef __GNUC__
-#define D600_DELAY asm("nop;nop;nop;nop;nop;nop;nop;nop")
-#else
-#define D600_DELAY   __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP} \
-    __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP} \
-    //__asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-#endif
-
-void bitbang_data1()
+void pwm_set( uint8_t number, float pwm )
 {
-	for ( uint8_t i = 0; i < 48; ++i ) {
-
-		if ( motor_data[ i ] & 0x01 ) {
-
-			gpioset( DSHOT_PORT_0, DSHOT_PIN_0 ); // FL
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
-#endif
-			gpioreset( DSHOT_PORT_0, DSHOT_PIN_0 );
-		}
-
-
-  D600_DELAY;
-
+    // if ( number > 3 ) failloop(5);
+    if ( number > 3 ) return;
 
+	if ( pwm < 0.0f ) {
+		pwm = 0.0;
+	}
+	if ( pwm > 0.999f ) {
+		pwm = 0.999;
 	}
-}
-
-
-void bitbang_data2()
-{
-	for ( uint8_t i = 0; i < 48; ++i ) {
 
-		if (  motor_data[ i ] & 0x02 ) {
-			gpioset( DSHOT_PORT_1, DSHOT_PIN_1 );  // BL
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
-#endif
-			gpioreset( DSHOT_PORT_1, DSHOT_PIN_1 );
-		}
+	uint16_t value = 0;
 
-  D600_DELAY;
+#ifdef BIDIRECTIONAL
 
+	if ( pwmdir == FORWARD ) {
+		// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET .. 1047
+		value = 48 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
+	} else if ( pwmdir == REVERSE ) {
+		// maps 0.0 .. 0.999 to 1048 + IDLE_OFFSET .. 2047
+		value = 1048 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
 	}
-}
 
+#else
 
-void bitbang_data3()
-{
-	for ( uint8_t i = 0; i < 48; ++i ) {
+	// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET * 2 .. 2047
+	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( pwm * ( 2001 - IDLE_OFFSET * 2 ) );
 
-		if ( motor_data[ i ] & 0x04 ) {
-			gpioset( DSHOT_PORT_2, DSHOT_PIN_2 ); // FR
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
 #endif
-			gpioreset( DSHOT_PORT_2, DSHOT_PIN_2 );
-		}
-
-  D600_DELAY;
 
-	}
+	dshot_set( number, value );
 }
 
-
-void bitbang_data4()
+#ifdef MIXER_FIXED
+// the same from the Q16 mixer , 65470 is 0.999
+void pwm_set_q( uint8_t number, int32_t pwm )
 {
-	for ( uint8_t i = 0; i < 48; ++i ) {
-
-        if ( motor_data[ i ] & 0x08 ) {
+    if ( number > 3 ) return;
 
-			gpioset( DSHOT_PORT_3, DSHOT_PIN_3 ); // BR
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
-#endif
-			gpioreset( DSHOT_PORT_3, DSHOT_PIN_3 );
+	if ( pwm < 0 ) {
+		pwm = 0;
+	}
+	if ( pwm > 65470 ) {
+		pwm = 65470;
+	}
 
-		}
+	uint16_t value = 0;
 
-  D600_DELAY;
+#ifdef BIDIRECTIONAL
 
+	if ( pwmdir == FORWARD ) {
+		value = 48 + IDLE_OFFSET + (uint16_t)( ( pwm * ( 1000 - IDLE_OFFSET ) ) >> 16 );
+	} else if ( pwmdir == REVERSE ) {
+		value = 1048 + IDLE_OFFSET + (uint16_t)( ( pwm * ( 1000 - IDLE_OFFSET ) ) >> 16 );
 	}
-}
-
 
-void bitbang_data()
-{
-	for ( uint8_t i = 0; i < 48; ++i ) {
-
-		if ( motor_data[ i ] & 0x01 ) {
-			gpioset( DSHOT_PORT_0, DSHOT_PIN_0 ); // FL
-		} else {
-#ifdef __GNUC__
-            asm("nop");
 #else
-			__asm{NOP}
-#endif
-			gpioreset( DSHOT_PORT_0, DSHOT_PIN_0 );
-		}
 
-		if ( motor_data[ i ] & 0x02 ) {
-			gpioset( DSHOT_PORT_1, DSHOT_PIN_1 );  // BL
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
-#endif
-			gpioreset( DSHOT_PORT_1, DSHOT_PIN_1 );
-		}
+	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( ( pwm * ( 2001 - IDLE_OFFSET * 2 ) ) >> 16 );
 
-		if ( motor_data[ i ] & 0x04 ) {
-			gpioset( DSHOT_PORT_2, DSHOT_PIN_2 ); // FR
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
 #endif
-			gpioreset( DSHOT_PORT_2, DSHOT_PIN_2 );
-		}
 
-        if ( motor_data[ i ] & 0x08 ) {
-			gpioset( DSHOT_PORT_3, DSHOT_PIN_3 ); // BR
-		} else {
-#ifdef __GNUC__
-            asm("nop");
-#else
-			__asm{NOP}
+	dshot_set( number, value );
+}
 #endif
-			gpioreset( DSHOT_PORT_3, DSHOT_PIN_3 );
 
 
-		}
+#if GYRO_RATE_MULTIPLIER > 1
+// send the last values again, for the gyro loops without a pid update
+void pwm_repeat( void)
+{
+	if ( !dshot_repeat ) return;
 
-#if defined( DSHOT300 ) && ! defined( DSHOT150 )
-    #ifdef __GNUC__
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-    #else
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-    #endif
-
-#ifndef LESS_DELAY
-    #ifdef __GNUC__
-            asm("nop;nop;nop;nop");
-    #else
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-    #endif
-#endif
-#elif defined( DSHOT150 ) && ! defined( DSHOT300 )
-    #ifdef __GNUC__
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop;nop");
-            asm("nop;nop;nop;nop;nop;nop;nop");
-    #else
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-            __asm{NOP} __asm{NOP} __asm{NOP}
-    //		__asm{NOP} __asm{NOP} __asm{NOP} __asm{NOP}
-    #endif
-#else
-//#error "Either define DSHOT150 or DSHOT300"
+	for ( uint8_t i = 0; i < 4; i++ ) {
+		make_packet( i, dshot_value[ i ], false );
+	}
+	dshot_send();
+}
 #endif
 
+void make_packet( uint8_t number, uint16_t value, bool telemetry )
+{
+	uint16_t packet = ( value << 1 ) | ( telemetry ? 1 : 0 ); // Here goes telemetry bit
+	// compute checksum
+	uint16_t csum = 0;
+	uint16_t csum_data = packet;
+	for ( uint8_t i = 0; i < 3; ++i ) {
+		csum ^= csum_data; // xor data by nibbles
+		csum_data >>= 4;
 	}
+
+	csum &= 0xf;
+	// append checksum
+	dshot_packet[ number ] = ( packet << 4 ) | csum;
 }
 
-#pragma pop
+// one symbol at every timer update , the pins change a few cycles after it whatever the compiler
+// keep the loop short , a symbol is 27 cycles at DShot600 and 48MHz , see the budget at the top
+#define DSHOT_SYMBOL_WAIT() while ( !( TIM14->SR & TIM_SR_UIF ) ); TIM14->SR = 0
 
-#define DSHOT_CMD_BEEP1 1
-#define DSHOT_CMD_BEEP2 2
-#define DSHOT_CMD_BEEP3 3
-#define DSHOT_CMD_BEEP4 4
-#define DSHOT_CMD_BEEP5 5 // 5 currently uses the same tone as 4 in BLHeli_S.
+static RAMFUNC void dshot_output( void )
+{
+	GPIO_TypeDef * const portA = GPIOA;
+	GPIO_TypeDef * const portB = GPIOB;
+	const uint16_t * p = dshot_stream;
+	const uint16_t * const end = dshot_stream + DSHOT_STREAM_SIZE;
+
+	TIM14->CNT = 0;
+	TIM14->SR = 0;
+	TIM14->CR1 = TIM_CR1_CEN;
+
+	// one load and store per port and symbol , no computation between the edges
+	while ( p < end ) {
+		DSHOT_SYMBOL_WAIT();
+		portA->BSRR = p[ 0 ];
+		portB->BSRR = p[ 1 ];
+		DSHOT_SYMBOL_WAIT();
+		portA->BRR = p[ 2 ];
+		portB->BRR = p[ 3 ];
+		DSHOT_SYMBOL_WAIT();
+		portA->BRR = p[ 4 ];
+		portB->BRR = p[ 5 ];
+		p += 6;
+	}
+
+	TIM14->CR1 = 0;
+}
 
 #ifndef MOTOR_BEEPS_TIMEOUT
 #define MOTOR_BEEPS_TIMEOUT 5e6
 #endif
 
+// the 4 beeps every 2s go through the command queue , the signal stays off in between
 void motorbeep()
 {
 	static unsigned long motor_beep_time = 0;
+	static unsigned long motor_beep_last = 0;
 	if ( failsafe ) {
 		unsigned long time = gettime();
 		if ( motor_beep_time == 0 ) {
 			motor_beep_time = time;
+			motor_beep_last = time - 2000000;
 		}
 		const unsigned long delta_time = time - motor_beep_time;
-		if ( delta_time > MOTOR_BEEPS_TIMEOUT ) {
-			uint8_t beep_command = 0;
-			if ( delta_time % 2000000 < 250000 ) {
-				beep_command = DSHOT_CMD_BEEP1;
-			} else if ( delta_time % 2000000 < 500000 ) {
-				beep_command = DSHOT_CMD_BEEP3;
-			} else if ( delta_time % 2000000 < 750000 ) {
-				beep_command = DSHOT_CMD_BEEP2;
-			} else if ( delta_time % 2000000 < 1000000 ) {
-				beep_command = DSHOT_CMD_BEEP4;
-			}
-			if ( beep_command != 0 ) {
-				make_packet( 0, beep_command, true );
-				make_packet( 1, beep_command, true );
-				make_packet( 2, beep_command, true );
-				make_packet( 3, beep_command, true );
-				bitbang_data();
-			}
+		if ( delta_time > MOTOR_BEEPS_TIMEOUT && time - motor_beep_last >= 2000000 && !dshot_command_busy( DSHOT_ALL_MOTORS ) ) {
+			motor_beep_last = time;
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP1 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP3 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP2 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP4 , 0 );
 		}
 	} else {
 		motor_beep_time = 0;
@@ -1,11 +1,13 @@
-
 // Dshot driver for H101_dual firmware. Written by Markus Gritsch.
 // Modified by JazzMac to support DMA transfer
 
-	// DShot timer/DMA init
-	// TIM1_UP  DMA_CH5: set all output to HIGH		at TIM1 update
-	// TIM1_CH1 DMA_CH2: reset output if data=0		at T0H timing
-	// TIM1_CH4 DMA_CH4: reset all output					at T1H timing  
+	// DShot timer/DMA
+	// every bit is 3 TIM1 periods ( symbols ): all pins high, pins of the 0 bits low, all pins low
+	// which gives the 33% / 67% high time of a 0 / 1 bit
+	// TIM1_UP  DMA_CH5: 32 bit BSRR word of port A	at every symbol
+	// TIM1_CH4 DMA_CH4: 32 bit BSRR word of port B	half a symbol later
+	// both ports go out in the same timer run, the frame ends with the transfer complete
+	// interrupt of the last channel
 
 // this DMA driver is done with the reference to http://www.cnblogs.com/shangdawei/p/4762035.html
 
@@ -42,20 +44,19 @@
 
 #ifdef DSHOT150
 	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/150)-1)
-	#define DSHOT_T0H_TIME 		(DSHOT_BIT_TIME*0.30 + 0.05 )
-  #define DSHOT_T1H_TIME 		(DSHOT_BIT_TIME*0.60 + 0.05 )
 #endif
 #ifdef DSHOT300
 	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/300)-1)
-	#define DSHOT_T0H_TIME 		(DSHOT_BIT_TIME*0.30 + 0.05 )
-  #define DSHOT_T1H_TIME 		(DSHOT_BIT_TIME*0.60 + 0.05 )
 #endif
 #ifdef DSHOT600
 	#define DSHOT_BIT_TIME 		((SYS_CLOCK_FREQ_HZ/1000/600)-1)
-	#define DSHOT_T0H_TIME 		(DSHOT_BIT_TIME*0.30 + 0.05 )
-  #define DSHOT_T1H_TIME 		(DSHOT_BIT_TIME*0.60 + 0.05 )
 #endif
 
+// timer period of one third of a bit, rounded to the nearest
+#define DSHOT_SYMBOL_TIME 	( ( DSHOT_BIT_TIME + 2 ) / 3 - 1 )
+// 16 bits of 3 symbols
+#define DSHOT_SYMBOLS 			48
+
 // IDLE_OFFSET is added to the throttle. Adjust its value so that the motors
 // still spin at minimum throttle.
 #define IDLE_OFFSET 32
@@ -82,6 +83,7 @@
 #include "hardware.h"
 #include "util.h"
 #include "drv_dshot.h"
+#include "dshot_command.h"
 #include "config.h"
 
 #ifdef USE_DSHOT_DMA_DRIVER
@@ -90,12 +92,16 @@
 #error "Not tested with THREE_D_THROTTLE config option"
 #endif
 
-#ifdef INVERTED_ENABLE
+#if defined(INVERTED_ENABLE) && !defined(INVERTED_DSHOT_COMMANDS)
 #ifndef BIDIRECTIONAL
 #error INVERTED_ENABLE is on but not BIDIRECTIONAL in dshot driver
 #endif
 #endif
 
+#if defined(INVERTED_DSHOT_COMMANDS) && defined(BIDIRECTIONAL)
+#error INVERTED_DSHOT_COMMANDS reverses the escs by command, BIDIRECTIONAL is for 3D escs
+#endif
+
 #if defined(MOTOR0_PIN_PB0) || defined(MOTOR0_PIN_PB1) || defined(MOTOR1_PIN_PB0) || defined(MOTOR1_PIN_PB1) ||defined(MOTOR2_PIN_PB0) || defined(MOTOR2_PIN_PB1) || defined(MOTOR3_PIN_PB0) || defined(MOTOR3_PIN_PB1)
 	#define DSHOT_DMA_PHASE	2												// motor pins at both portA and portB
 #else
@@ -108,11 +114,28 @@ extern int onground;
 int pwmdir = 0;
 static unsigned long pwm_failsafe_time = 1;
 
-volatile int dshot_dma_phase = 0;									// 1:portA  2:portB	 0:idle
+volatile int dshot_dma_phase = 0;									// 1:frame  3:telemetry  0:idle
 volatile uint16_t dshot_packet[4];								// 16bits dshot data for 4 motors
 
-volatile uint16_t motor_data_portA[ 16 ] = { 0 };	// DMA buffer: reset output when bit data=0 at TOH timing
-volatile uint16_t motor_data_portB[ 16 ] = { 0 };	//
+// DMA buffers, 3 BSRR words per bit, one is sent while the other is made
+static uint32_t dshot_dma_portA[ 2 ][ DSHOT_SYMBOLS ];
+#if DSHOT_DMA_PHASE == 2
+static uint32_t dshot_dma_portB[ 2 ][ DSHOT_SYMBOLS ];
+#endif
+// 32 bit BSRR writes from the incremented buffer, one word per symbol
+#define DSHOT_DMA_CCR ( DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_PeripheralDataSize_Word \
+	| DMA_MemoryDataSize_Word | DMA_Priority_High )
+// port B runs half a symbol after port A, so the two dma requests do not meet
+#define DSHOT_PORTB_DELAY ( ( DSHOT_SYMBOL_TIME + 1 ) / 2 )
+
+static volatile int dshot_dma_sending = 0;				// buffer of the current or last frame
+static volatile int dshot_dma_pending = 0;				// the other buffer waits for TIM1
+
+// motors with a 0 bit ( bit 0 - 3 ) to the BSRR word that ends their pulse
+static uint32_t dshot_zero_portA[ 16 ];
+#if DSHOT_DMA_PHASE == 2
+static uint32_t dshot_zero_portB[ 16 ];
+#endif
 
 volatile uint16_t dshot_portA[1] = { 0 };					// sum of all motor pins at portA 								
 volatile uint16_t dshot_portB[1] = { 0 };					// sum of all motor pins at portB
@@ -120,6 +143,56 @@ volatile uint16_t dshot_portB[1] = { 0 };					// sum of all motor pins at portB
 typedef enum { false, true } bool;
 void make_packet( uint8_t number, uint16_t value, bool telemetry );
 
+#ifdef RPM_FILTER
+// bidirectional dshot, the esc answers every frame with its eRPM
+// the frame is sent inverted ( idle high ) with an inverted checksum, then the motor pins are
+// switched to input and TIM1 / DMA sample the port input registers, 3 samples per telemetry bit
+// the samples are decoded at the next dshot_dma_start() and the result goes to dshot_erpm[]
+// phase 3 is the sampling
+
+// inverted output, the frame starts with a falling edge
+#define DSHOT_BIT_START( pins ) ( (uint32_t)(pins) << 16 )
+#define DSHOT_BIT_END( pins ) ( (uint32_t)(pins) )
+
+// telemetry bits are at 5/4 of the dshot bit rate
+#define DSHOT_TLM_SAMPLE_TIME ( ( DSHOT_BIT_TIME + 1 ) * 4 / 5 / 3 - 1 )
+// the answer starts about 30uS after the frame, sampling starts a bit before
+#define DSHOT_TLM_DELAY ( SYS_CLOCK_FREQ_HZ / 1000000 * 25 )
+// 21 bit frame and margin for the turnaround time
+#define DSHOT_TLM_SAMPLES ( 21 * 3 + 30 )
+
+// motor eRPM / 100 , 0 when stopped or without telemetry
+uint16_t dshot_erpm[4];
+uint16_t dshot_telemetry_errors = 0;
+// bad telemetry frames in a row , dshot_erpm[] is from the last frame while 0
+// starts failed , there is no telemetry before the first good frame
+uint8_t dshot_erpm_fails[4] = { 10 , 10 , 10 , 10 };
+static volatile int dshot_capture_ready = 0;
+
+static volatile uint16_t dshot_capture_A[ DSHOT_TLM_SAMPLES ];
+#if DSHOT_DMA_PHASE == 2
+static volatile uint16_t dshot_capture_B[ DSHOT_TLM_SAMPLES ];
+#define DSHOT_CAPTURE( port ) ( (port) == GPIOA ? dshot_capture_A : dshot_capture_B )
+#else
+#define DSHOT_CAPTURE( port ) dshot_capture_A
+#endif
+
+// GPIO MODER output bits of the motor pins
+static uint32_t dshot_moder_A;
+static uint32_t dshot_moder_B;
+
+static void dshot_capture_start( void);
+#else
+// BSRR words, set in the low half and reset in the high half
+#define DSHOT_BIT_START( pins ) ( (uint32_t)(pins) )
+#define DSHOT_BIT_END( pins ) ( (uint32_t)(pins) << 16 )
+#endif
+
+#if GYRO_RATE_MULTIPLIER > 1
+static uint16_t dshot_value[ 4 ];
+static int dshot_repeat = 0;
+#endif
+
 #ifndef FORWARD
 #define FORWARD 0
 #define REVERSE 1
@@ -142,6 +215,11 @@ void pwm_init()
   GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
 
+#ifdef RPM_FILTER
+	// holds the line high while the pins are inputs
+  GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+#endif
+
 	GPIO_InitStructure.GPIO_Pin = DSHOT_PIN_0 ;
 	GPIO_Init( DSHOT_PORT_0, &GPIO_InitStructure );
 
@@ -166,10 +244,52 @@ void pwm_init()
 	if( DSHOT_PORT_3 == GPIOA )	*dshot_portA |= DSHOT_PIN_3;
 	else												*dshot_portB |= DSHOT_PIN_3;
 
+#ifdef RPM_FILTER
+	for ( int i = 0; i < 16; i++ ) {
+		if ( *dshot_portA & ( 1 << i ) ) dshot_moder_A |= 1 << ( i * 2 );
+		if ( *dshot_portB & ( 1 << i ) ) dshot_moder_B |= 1 << ( i * 2 );
+	}
+	// idle level of inverted dshot
+	GPIOA->BSRR = *dshot_portA;
+	GPIOB->BSRR = *dshot_portB;
+#endif
+
+	// BSRR words of the 0 bits for every combination of motors ( bit 0 - 3 )
+	GPIO_TypeDef * const dshot_port[4] = { DSHOT_PORT_0, DSHOT_PORT_1, DSHOT_PORT_2, DSHOT_PORT_3 };
+	const uint16_t dshot_pin[4] = { DSHOT_PIN_0, DSHOT_PIN_1, DSHOT_PIN_2, DSHOT_PIN_3 };
+
+	for ( int n = 0; n < 16; n++ ) {
+		uint16_t pins_A = 0;
+		uint16_t pins_B = 0;
+		for ( int m = 0; m < 4; m++ ) {
+			if ( !( n & ( 1 << m ) ) ) continue;
+			if ( dshot_port[ m ] == GPIOA )	pins_A |= dshot_pin[ m ];
+			else														pins_B |= dshot_pin[ m ];
+		}
+		dshot_zero_portA[ n ] = DSHOT_BIT_END( pins_A );
+#if DSHOT_DMA_PHASE == 2
+		dshot_zero_portB[ n ] = DSHOT_BIT_END( pins_B );
+#else
+		(void) pins_B;
+#endif
+	}
+
+	// the first and the last symbol of a bit are the same for all bits
+	for ( int b = 0; b < 2; b++ ) {
+		for ( int i = 0; i < DSHOT_SYMBOLS; i += 3 ) {
+			dshot_dma_portA[ b ][ i ] = DSHOT_BIT_START( *dshot_portA );
+			dshot_dma_portA[ b ][ i + 2 ] = DSHOT_BIT_END( *dshot_portA );
+#if DSHOT_DMA_PHASE == 2
+			dshot_dma_portB[ b ][ i ] = DSHOT_BIT_START( *dshot_portB );
+			dshot_dma_portB[ b ][ i + 2 ] = DSHOT_BIT_END( *dshot_portB );
+#endif
+		}
+	}
+
 // DShot timer/DMA init
-	// TIM1_UP  DMA_CH5: set all output to HIGH		at TIM1 update
-	// TIM1_CH1 DMA_CH2: reset output if data=0		at T0H timing
-	// TIM1_CH4 DMA_CH4: reset all output					at T1H timing  
+	// TIM1_UP  DMA_CH5: port A symbols
+	// TIM1_CH4 DMA_CH4: port B symbols
+	// TIM1_CH1 is used by the rgb led dma and the telemetry capture
 	
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
 	TIM_OCInitTypeDef TIM_OCInitStructure;
@@ -180,7 +300,7 @@ void pwm_init()
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
 	
 	/* Time base configuration */
-	TIM_TimeBaseStructure.TIM_Period = 						DSHOT_BIT_TIME;
+	TIM_TimeBaseStructure.TIM_Period = 						DSHOT_SYMBOL_TIME;
 	TIM_TimeBaseStructure.TIM_Prescaler = 				0;
 	TIM_TimeBaseStructure.TIM_ClockDivision = 		0;
 	TIM_TimeBaseStructure.TIM_CounterMode = 			TIM_CounterMode_Up;
@@ -190,139 +310,229 @@ void pwm_init()
 	/* Timing Mode configuration: Channel 1 */
 	TIM_OCInitStructure.TIM_OCMode = 							TIM_OCMode_Timing;
 	TIM_OCInitStructure.TIM_OutputState = 				TIM_OutputState_Disable;
-	TIM_OCInitStructure.TIM_Pulse = 							DSHOT_T0H_TIME;
+	TIM_OCInitStructure.TIM_Pulse = 							0;
 	TIM_OC1Init(TIM1, &TIM_OCInitStructure);
 	TIM_OC1PreloadConfig(TIM1, TIM_OCPreload_Disable);	
 
 	/* Timing Mode configuration: Channel 4 */
 	TIM_OCInitStructure.TIM_OCMode = 							TIM_OCMode_Timing;
 	TIM_OCInitStructure.TIM_OutputState = 				TIM_OutputState_Disable;
-	TIM_OCInitStructure.TIM_Pulse = 							DSHOT_T1H_TIME;
+	TIM_OCInitStructure.TIM_Pulse = 							DSHOT_PORTB_DELAY;
 	TIM_OC4Init(TIM1, &TIM_OCInitStructure);
 	TIM_OC4PreloadConfig(TIM1, TIM_OCPreload_Disable);
 	
-	DMA_InitTypeDef DMA_InitStructure;
-	
-	DMA_StructInit(&DMA_InitStructure);
+	// the channels are set up by register for every transfer
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
-	
-	/* DMA1 Channe5 configuration ----------------------------------------------*/
-	DMA_DeInit(DMA1_Channel3);
-	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t)&GPIOA->BSRR;
-	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t)dshot_portA;
-	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralDST;
-	DMA_InitStructure.DMA_BufferSize = 						16;
-	DMA_InitStructure.DMA_PeripheralInc = 				DMA_PeripheralInc_Disable;
-	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Disable;
-	DMA_InitStructure.DMA_PeripheralDataSize = 		DMA_PeripheralDataSize_HalfWord;
-	DMA_InitStructure.DMA_MemoryDataSize = 				DMA_MemoryDataSize_HalfWord;
-	DMA_InitStructure.DMA_Mode = 									DMA_Mode_Normal;
-	DMA_InitStructure.DMA_Priority = 							DMA_Priority_High;
-	DMA_InitStructure.DMA_M2M = 									DMA_M2M_Disable;
-	DMA_Init(DMA1_Channel5, &DMA_InitStructure);
-	
-	/* DMA1 Channel2 configuration ----------------------------------------------*/
 	DMA_DeInit(DMA1_Channel2);
-	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t)&GPIOA->BRR;
-	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t)motor_data_portA;
-	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralDST;
-	DMA_InitStructure.DMA_BufferSize = 						16;
-	DMA_InitStructure.DMA_PeripheralInc = 				DMA_PeripheralInc_Disable;
-	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Enable;
-	DMA_InitStructure.DMA_PeripheralDataSize = 		DMA_PeripheralDataSize_HalfWord;
-	DMA_InitStructure.DMA_MemoryDataSize = 				DMA_MemoryDataSize_HalfWord;
-	DMA_InitStructure.DMA_Mode = 									DMA_Mode_Normal;
-	DMA_InitStructure.DMA_Priority = 							DMA_Priority_High;
-	DMA_InitStructure.DMA_M2M = 									DMA_M2M_Disable;
-	DMA_Init(DMA1_Channel2, &DMA_InitStructure);
-	
-	/* DMA1 Channel4 configuration ----------------------------------------------*/
 	DMA_DeInit(DMA1_Channel4);
-	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t)&GPIOA->BRR;
-	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t)dshot_portA;
-	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralDST;
-	DMA_InitStructure.DMA_BufferSize = 						16;
-	DMA_InitStructure.DMA_PeripheralInc = 				DMA_PeripheralInc_Disable;
-	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Disable;
-	DMA_InitStructure.DMA_PeripheralDataSize = 		DMA_PeripheralDataSize_HalfWord;
-	DMA_InitStructure.DMA_MemoryDataSize = 				DMA_MemoryDataSize_HalfWord;
-	DMA_InitStructure.DMA_Mode = 									DMA_Mode_Normal;
-	DMA_InitStructure.DMA_Priority = 							DMA_Priority_High;
-	DMA_InitStructure.DMA_M2M = 									DMA_M2M_Disable;
-	DMA_Init(DMA1_Channel4, &DMA_InitStructure);
-	
-	TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4 | TIM_DMA_CC1, ENABLE);
+	DMA_DeInit(DMA1_Channel5);
 	
 	NVIC_InitTypeDef NVIC_InitStructure;
-	/* configure DMA1 Channel4 interrupt */
+	/* configure DMA1 Channel4 / 5 interrupt */
 	NVIC_InitStructure.NVIC_IRQChannel = 					DMA1_Channel4_5_IRQn;
 	NVIC_InitStructure.NVIC_IRQChannelPriority = 	(uint8_t)DMA_Priority_High;
 	NVIC_InitStructure.NVIC_IRQChannelCmd = 			ENABLE;
 	NVIC_Init(&NVIC_InitStructure);
-	/* enable DMA1 Channel4 transfer complete interrupt */
-	DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
 	
 	// set failsafetime so signal is off at start
 	pwm_failsafe_time = gettime() - 100000;
 	pwmdir = FORWARD;
 }
 
-void dshot_dma_portA()
-{		
+// one frame of both ports from the buffer, TIM1 must be idle
+static void dshot_dma_trigger( int buffer )
+{
+	TIM1->ARR 	= DSHOT_SYMBOL_TIME;
+	TIM1->CCR4 	= DSHOT_PORTB_DELAY;
+
 	DMA1_Channel5->CPAR = (uint32_t)&GPIOA->BSRR;
-	DMA1_Channel5->CMAR = (uint32_t)dshot_portA;
-	DMA1_Channel2->CPAR = (uint32_t)&GPIOA->BRR;
-	DMA1_Channel2->CMAR = (uint32_t)motor_data_portA;
-	DMA1_Channel4->CPAR = (uint32_t)&GPIOA->BRR;
-	DMA1_Channel4->CMAR = (uint32_t)dshot_portA;
-	
-	DMA_ClearFlag( DMA1_FLAG_GL2 | DMA1_FLAG_GL4 | DMA1_FLAG_GL5 );
-	
-	DMA1_Channel5->CNDTR = 16;
-	DMA1_Channel2->CNDTR = 16;
-	DMA1_Channel4->CNDTR = 16;
+	DMA1_Channel5->CMAR = (uint32_t)dshot_dma_portA[ buffer ];
+	DMA1_Channel5->CNDTR = DSHOT_SYMBOLS;
+#if DSHOT_DMA_PHASE == 2
+	// port B ends last
+	DMA1_Channel5->CCR = DSHOT_DMA_CCR;
+	DMA1_Channel4->CCR = DSHOT_DMA_CCR | DMA_IT_TC;
+	DMA1_Channel4->CPAR = (uint32_t)&GPIOB->BSRR;
+	DMA1_Channel4->CMAR = (uint32_t)dshot_dma_portB[ buffer ];
+	DMA1_Channel4->CNDTR = DSHOT_SYMBOLS;
+#else
+	DMA1_Channel5->CCR = DSHOT_DMA_CCR | DMA_IT_TC;
+#endif
+
+	DMA_ClearFlag( DMA1_FLAG_GL4 | DMA1_FLAG_GL5 );
 	
 	TIM1->SR = 0;
-		
-	DMA_Cmd(DMA1_Channel2, ENABLE);
+
+	DMA_Cmd(DMA1_Channel5, ENABLE);
+#if DSHOT_DMA_PHASE == 2
 	DMA_Cmd(DMA1_Channel4, ENABLE);
-	DMA_Cmd(DMA1_Channel5, ENABLE);	
-	
-	TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4 | TIM_DMA_CC1, ENABLE);
-	
-	TIM_SetCounter( TIM1, DSHOT_BIT_TIME );
+	TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4, ENABLE);
+#else
+	TIM_DMACmd(TIM1, TIM_DMA_Update, ENABLE);
+#endif
+
+	// first update at the next timer clock
+	TIM_SetCounter( TIM1, DSHOT_SYMBOL_TIME );
 	TIM_Cmd( TIM1, ENABLE );
 }
 
-void dshot_dma_portB()
-{		
-	DMA1_Channel5->CPAR = (uint32_t)&GPIOB->BSRR;
-	DMA1_Channel5->CMAR = (uint32_t)dshot_portB;
-	DMA1_Channel2->CPAR = (uint32_t)&GPIOB->BRR;
-	DMA1_Channel2->CMAR = (uint32_t)motor_data_portB;
-	DMA1_Channel4->CPAR = (uint32_t)&GPIOB->BRR;
-	DMA1_Channel4->CMAR = (uint32_t)dshot_portB;
-	
-	DMA_ClearFlag( DMA1_FLAG_GL2 | DMA1_FLAG_GL4 | DMA1_FLAG_GL5 );
-	
-	DMA1_Channel5->CNDTR = 16;
-	DMA1_Channel2->CNDTR = 16;
-	DMA1_Channel4->CNDTR = 16;
-	
+// sends the pending buffer
+static void dshot_dma_next( void)
+{
+	dshot_dma_pending = 0;
+	dshot_dma_sending ^= 1;
+	dshot_dma_phase = 1;
+	dshot_dma_trigger( dshot_dma_sending );
+}
+
+#ifdef RPM_FILTER
+// gcr 5 bit code to nibble, 0xff for invalid codes
+static const uint8_t gcr_decode[32] =
+{
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 9, 10, 11, 0xff, 13, 14, 15,
+	0xff, 0xff, 2, 3, 0xff, 5, 6, 7, 0xff, 0, 8, 1, 0xff, 4, 12, 0xff
+};
+
+// eRPM / 100 from the samples of one pin, -1 if there is no valid frame
+static int dshot_erpm_decode( volatile uint16_t *samples , uint16_t pin )
+{
+	int i = 0;
+
+	// the start bit is the first low sample
+	while ( i < DSHOT_TLM_SAMPLES && ( samples[i] & pin ) ) i++;
+	if ( i >= DSHOT_TLM_SAMPLES ) return -1;
+
+	// each level change is a 1 followed by the 0s of the run length
+	uint32_t value = 0;
+	int bits = 0;
+	int last = i;
+	uint16_t level = 0;
+
+	for ( i++ ; i < DSHOT_TLM_SAMPLES ; i++ ) {
+		if ( ( samples[i] & pin ) == level ) continue;
+		int len = ( i - last + 1 ) / 3;
+		if ( len < 1 ) len = 1;
+		bits += len;
+		if ( bits > 21 ) return -1;
+		value = ( value << len ) | ( 1 << ( len - 1 ) );
+		last = i;
+		level ^= pin;
+	}
+
+	// the line stays high after the last bit, so the last run fills the frame
+	if ( bits < 18 ) return -1;
+	if ( bits < 21 ) {
+		int len = 21 - bits;
+		value = ( value << len ) | ( 1 << ( len - 1 ) );
+	}
+
+	// drop the start bit, 4 gcr codes to 16 bits
+	uint32_t data = 0;
+	for ( int n = 3; n >= 0; n-- ) {
+		uint8_t nibble = gcr_decode[ ( value >> ( n * 5 ) ) & 0x1f ];
+		if ( nibble == 0xff ) return -1;
+		data = ( data << 4 ) | nibble;
+	}
+
+	uint32_t csum = data ^ ( data >> 8 );
+	csum ^= csum >> 4;
+	if ( ( csum & 0xf ) != 0xf ) return -1;
+
+	// eeem mmmm mmmm , period in uS is m << e
+	data >>= 4;
+	if ( data == 0xfff ) return 0;
+	uint32_t period = ( data & 0x1ff ) << ( data >> 9 );
+	if ( !period ) return -1;
+
+	return ( 600000 + period / 2 ) / period;
+}
+
+static void dshot_erpm_update( uint8_t number , volatile uint16_t *samples , uint16_t pin )
+{
+	int erpm = dshot_erpm_decode( samples , pin );
+
+	if ( erpm >= 0 ) {
+		dshot_erpm[ number ] = erpm;
+		dshot_erpm_fails[ number ] = 0;
+		return;
+	}
+
+	// keep the last value over a few bad frames
+	dshot_telemetry_errors++;
+	if ( dshot_erpm_fails[ number ] < 10 ) dshot_erpm_fails[ number ]++;
+	else dshot_erpm[ number ] = 0;
+}
+
+static void dshot_telemetry_decode( void)
+{
+	dshot_erpm_update( 0 , DSHOT_CAPTURE( DSHOT_PORT_0 ) , DSHOT_PIN_0 );
+	dshot_erpm_update( 1 , DSHOT_CAPTURE( DSHOT_PORT_1 ) , DSHOT_PIN_1 );
+	dshot_erpm_update( 2 , DSHOT_CAPTURE( DSHOT_PORT_2 ) , DSHOT_PIN_2 );
+	dshot_erpm_update( 3 , DSHOT_CAPTURE( DSHOT_PORT_3 ) , DSHOT_PIN_3 );
+}
+
+// after the frame, from the dma interrupt
+static void dshot_capture_start( void)
+{
+	// motor pins to input
+	GPIOA->MODER &= ~( dshot_moder_A * 3 );
+
+	// TIM1_UP DMA_CH5 reads port A, TIM1_CH1 DMA_CH2 port B
+	DMA1_Channel5->CCR = DMA_DIR_PeripheralSRC | DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord
+		| DMA_MemoryDataSize_HalfWord | DMA_Priority_High | DMA_IT_TC;
+	DMA1_Channel5->CPAR = (uint32_t)&GPIOA->IDR;
+	DMA1_Channel5->CMAR = (uint32_t)dshot_capture_A;
+	DMA1_Channel5->CNDTR = DSHOT_TLM_SAMPLES;
+
+#if DSHOT_DMA_PHASE == 2
+	GPIOB->MODER &= ~( dshot_moder_B * 3 );
+
+	DMA1_Channel2->CCR = DMA_DIR_PeripheralSRC | DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord
+		| DMA_MemoryDataSize_HalfWord | DMA_Priority_High;
+	DMA1_Channel2->CPAR = (uint32_t)&GPIOB->IDR;
+	DMA1_Channel2->CMAR = (uint32_t)dshot_capture_B;
+	DMA1_Channel2->CNDTR = DSHOT_TLM_SAMPLES;
+#endif
+
+	DMA_ClearFlag( DMA1_FLAG_GL2 | DMA1_FLAG_GL5 );
+
+	// first update after the turnaround delay, then every sample time from the preload
+	// CC1 at 0 comes with the update, the count starts at 1 so it does not fire at the start
+	TIM1->ARR = DSHOT_TLM_DELAY;
+	TIM1->CCR1 = 0;
+	TIM1->CNT = 1;
+	TIM1->CR1 |= TIM_CR1_ARPE;
+	TIM1->ARR = DSHOT_TLM_SAMPLE_TIME;
 	TIM1->SR = 0;
-		
-	DMA_Cmd(DMA1_Channel2, ENABLE);
-	DMA_Cmd(DMA1_Channel4, ENABLE);
-	DMA_Cmd(DMA1_Channel5, ENABLE);	
-	
-	TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4 | TIM_DMA_CC1, ENABLE);
-	
-	TIM_SetCounter( TIM1, DSHOT_BIT_TIME );
+
+	DMA_Cmd( DMA1_Channel5, ENABLE );
+#if DSHOT_DMA_PHASE == 2
+	DMA_Cmd( DMA1_Channel2, ENABLE );
+#endif
+	TIM_DMACmd( TIM1, TIM_DMA_Update | TIM_DMA_CC1, ENABLE );
 	TIM_Cmd( TIM1, ENABLE );
 }
 
+static void dshot_capture_end( void)
+{
+	TIM_Cmd( TIM1, DISABLE );
+	TIM_DMACmd( TIM1, TIM_DMA_Update | TIM_DMA_CC1, DISABLE );
+	TIM1->CR1 &= ~TIM_CR1_ARPE;
+
+	DMA_Cmd( DMA1_Channel5, DISABLE );
+	DMA_Cmd( DMA1_Channel2, DISABLE );
+	DMA_ClearITPendingBit( DMA1_IT_GL5 );
+
+	// the next frame or rgb transfer sets up the channels again
+	GPIOA->MODER |= dshot_moder_A;
+	GPIOB->MODER |= dshot_moder_B;
+
+	dshot_capture_ready = 1;
+}
+#endif
+
 // make dshot packet
-void make_packet( uint8_t number, uint16_t value, bool telemetry )
+RAMFUNC void make_packet( uint8_t number, uint16_t value, bool telemetry )
 {
 	uint16_t packet = ( value << 1 ) | ( telemetry ? 1 : 0 ); // Here goes telemetry bit
 	// compute checksum
@@ -334,104 +544,80 @@ void make_packet( uint8_t number, uint16_t value, bool telemetry )
 		csum_data >>= 4;
 	}
 
+#ifdef RPM_FILTER
+	// inverted checksum asks the esc for telemetry
+	csum = ~csum;
+#endif
 	csum &= 0xf;	
 	// append checksum
 	dshot_packet[ number ] = ( packet << 4 ) | csum;
 }
 
-// make dshot dma packet, then fire
-void dshot_dma_start()
+// bits 0 - 7 to bits 0 , 4 .. 28
+static inline uint32_t dshot_spread( uint32_t x )
 {
-	uint32_t	time=gettime();
-	while( dshot_dma_phase != 0 && (gettime()-time) < LOOPTIME ) { } 	// wait maximum a LOOPTIME for dshot dma to complete
-	if( dshot_dma_phase != 0 ) return;																// skip this dshot command
-	
-#if	defined(RGB_LED_DMA) && (RGB_LED_NUMBER>0)
-	/// terminate current RGB transfer
-	extern int	rgb_dma_phase;
-	
-	time=gettime();
-	while( rgb_dma_phase ==1 && (gettime()-time) < LOOPTIME ) { } 		// wait maximum a LOOPTIME for RGB dma to complete
-	
-	if( rgb_dma_phase ==1 ) {																					// terminate current RGB dma transfer, proceed dshot 
-		rgb_dma_phase =0;
-		DMA_Cmd(DMA1_Channel5, DISABLE);
-		DMA_Cmd(DMA1_Channel2, DISABLE);
-		DMA_Cmd(DMA1_Channel4, DISABLE);		
-	
-		TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4 | TIM_DMA_CC1, DISABLE);	
-		TIM_Cmd( TIM1, DISABLE );
-		extern void failloop();
-		failloop(9);
-	}	
-#endif		
-		
-		// generate dshot dma packet
-	for ( uint8_t i = 0; i < 16; i++ ) {
-		motor_data_portA[ i ] = 0;
-		motor_data_portB[ i ] = 0;
-			
-	  if ( !( dshot_packet[0] & 0x8000 ) ) {
-			if( DSHOT_PORT_0 == GPIOA )	motor_data_portA[ i ] |= DSHOT_PIN_0;
-			else 												motor_data_portB[ i ] |= DSHOT_PIN_0; }
-	  if ( !( dshot_packet[1] & 0x8000 ) ) {
-			if( DSHOT_PORT_1 == GPIOA )	motor_data_portA[ i ] |= DSHOT_PIN_1;
-			else 												motor_data_portB[ i ] |= DSHOT_PIN_1; }
-	  if ( !( dshot_packet[2] & 0x8000 ) ) {
-			if( DSHOT_PORT_2 == GPIOA )	motor_data_portA[ i ] |= DSHOT_PIN_2;
-			else 												motor_data_portB[ i ] |= DSHOT_PIN_2; }
-	  if ( !( dshot_packet[3] & 0x8000 ) ) {
-			if( DSHOT_PORT_3 == GPIOA )	motor_data_portA[ i ] |= DSHOT_PIN_3;
-			else 												motor_data_portB[ i ] |= DSHOT_PIN_3; }
-		
-	  dshot_packet[0] <<= 1;
-	  dshot_packet[1] <<= 1;
-	  dshot_packet[2] <<= 1;
-	  dshot_packet[3] <<= 1;
-	}	
-	
-	dshot_dma_phase = DSHOT_DMA_PHASE;	
-		
-	TIM1->ARR 	= DSHOT_BIT_TIME;
-	TIM1->CCR1 	= DSHOT_T0H_TIME;
-	TIM1->CCR4 	= DSHOT_T1H_TIME;
-	
-	DMA1_Channel2->CCR |= DMA_MemoryDataSize_HalfWord|DMA_PeripheralDataSize_HalfWord;	// switch from byte to halfword
-	
-	dshot_dma_portA();
+	x = ( x | ( x << 12 ) ) & 0x000f000f;
+	x = ( x | ( x << 6 ) ) & 0x03030303;
+	x = ( x | ( x << 3 ) ) & 0x11111111;
+	return x;
 }
 
-void pwm_set( uint8_t number, float pwm )
+// 8 bit planes ( msb first ) to the middle symbols of 8 bits
+static RAMFUNC uint32_t * dshot_dma_planes( uint32_t * buffer , uint32_t planes , const uint32_t * zero )
 {
-    // if ( number > 3 ) failloop(5);
-    if ( number > 3 ) return;
-
-	if ( pwm < 0.0f ) {
-		pwm = 0.0;
-	}
-	if ( pwm > 0.999f ) {
-		pwm = 0.999;
+	for ( int i = 28; i >= 0; i -= 4 ) {
+		*buffer = zero[ ( planes >> i ) & 0x0f ];
+		buffer += 3;
 	}
+	return buffer;
+}
 
-	uint16_t value = 0;
-
-#ifdef BIDIRECTIONAL
-
-	if ( pwmdir == FORWARD ) {
-		// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET .. 1047
-		value = 48 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
-	} else if ( pwmdir == REVERSE ) {
-		// maps 0.0 .. 0.999 to 1048 + IDLE_OFFSET .. 2047
-		value = 1048 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
+// make dshot dma packet, then fire
+// if a frame or rgb transfer is still running it goes out from the dma interrupt right after
+RAMFUNC void dshot_dma_start()
+{
+#ifdef RPM_FILTER
+	if ( dshot_capture_ready ) {
+		dshot_capture_ready = 0;
+		dshot_telemetry_decode();
 	}
+#endif
 
-#else
+	// the interrupt does not take the other buffer while it is made
+	dshot_dma_pending = 0;
+	int buffer = !dshot_dma_sending;
+
+	// transpose the 4 packets: nibble n of hi / lo holds bit 7 - n of the high / low bytes
+	// with motor 0 - 3 at bit 0 - 3 of the nibble, the packets are inverted for the 0 bits
+	uint32_t hi = 0;
+	uint32_t lo = 0;
+	for ( int m = 0; m < 4; m++ ) {
+		uint32_t packet = ~dshot_packet[ m ];
+		hi |= dshot_spread( ( packet >> 8 ) & 0xff ) << m;
+		lo |= dshot_spread( packet & 0xff ) << m;
+	}
 
-	// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET * 2 .. 2047
-	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( pwm * ( 2001 - IDLE_OFFSET * 2 ) );
+	uint32_t * next = dshot_dma_planes( &dshot_dma_portA[ buffer ][ 1 ] , hi , dshot_zero_portA );
+	dshot_dma_planes( next , lo , dshot_zero_portA );
+#if DSHOT_DMA_PHASE == 2
+	next = dshot_dma_planes( &dshot_dma_portB[ buffer ][ 1 ] , hi , dshot_zero_portB );
+	dshot_dma_planes( next , lo , dshot_zero_portB );
+#endif
 
+	__disable_irq();
+	dshot_dma_pending = 1;
+#if	defined(RGB_LED_DMA) && (RGB_LED_NUMBER>0)
+	extern int rgb_dma_phase;
+	if ( !dshot_dma_phase && rgb_dma_phase != 1 ) dshot_dma_next();
+#else
+	if ( !dshot_dma_phase ) dshot_dma_next();
 #endif
+	__enable_irq();
+}
 
+// onground , failsafe and the queued commands , then the frame
+static void dshot_set( uint8_t number, uint16_t value )
+{
 	if ( onground ) {
 		value = 0; // stop the motors
 	}
@@ -445,6 +631,8 @@ void pwm_set( uint8_t number, float pwm )
             // usually the quad should be gone by then
 			if ( gettime() - pwm_failsafe_time > 4000000 ) {
 				value = 0;
+				// but for the queued commands ( motor beeps )
+				if ( !dshot_command_busy( DSHOT_ALL_MOTORS ) ) {
 								/*
                 gpioreset( DSHOT_PORT_0, DSHOT_PIN_0 );
                 gpioreset( DSHOT_PORT_1, DSHOT_PIN_1 );
@@ -452,58 +640,140 @@ void pwm_set( uint8_t number, float pwm )
                 gpioreset( DSHOT_PORT_3, DSHOT_PIN_3 );
 								*/
                 //////
+#if GYRO_RATE_MULTIPLIER > 1
+                dshot_repeat = 0;
+#endif
                 return;
+				}
 			}
 		}
 	} else {
 		pwm_failsafe_time = 0;
 	}
 
-	make_packet( number, value, false );
+	// a queued command instead of the stop frame
+	uint8_t command = dshot_command_frame( number, value );
+
+#if GYRO_RATE_MULTIPLIER > 1
+	// commands are not repeated , stop frames in between
+	dshot_value[ number ] = value;
+	if ( number == 3 ) dshot_repeat = 1;
+#endif
+
+	if ( command ) {
+		make_packet( number, command, true );
+	} else {
+		make_packet( number, value, false );
+	}
 	
 	if ( number == 3 ) {	
 			dshot_dma_start();
 	}
 }
 
-#define DSHOT_CMD_BEEP1 1
-#define DSHOT_CMD_BEEP2 2
-#define DSHOT_CMD_BEEP3 3
-#define DSHOT_CMD_BEEP4 4
-#define DSHOT_CMD_BEEP5 5 // 5 currently uses the same tone as 4 in BLHeli_S.
+void pwm_set( uint8_t number, float pwm )
+{
+    // if ( number > 3 ) failloop(5);
+    if ( number > 3 ) return;
+
+	if ( pwm < 0.0f ) {
+		pwm = 0.0;
+	}
+	if ( pwm > 0.999f ) {
+		pwm = 0.999;
+	}
+
+	uint16_t value = 0;
+
+#ifdef BIDIRECTIONAL
+
+	if ( pwmdir == FORWARD ) {
+		// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET .. 1047
+		value = 48 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
+	} else if ( pwmdir == REVERSE ) {
+		// maps 0.0 .. 0.999 to 1048 + IDLE_OFFSET .. 2047
+		value = 1048 + IDLE_OFFSET + (uint16_t)( pwm * ( 1000 - IDLE_OFFSET ) );
+	}
+
+#else
+
+	// maps 0.0 .. 0.999 to 48 + IDLE_OFFSET * 2 .. 2047
+	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( pwm * ( 2001 - IDLE_OFFSET * 2 ) );
+
+#endif
+
+	dshot_set( number, value );
+}
+
+#ifdef MIXER_FIXED
+// the same from the Q16 mixer , 65470 is 0.999
+void pwm_set_q( uint8_t number, int32_t pwm )
+{
+    if ( number > 3 ) return;
+
+	if ( pwm < 0 ) {
+		pwm = 0;
+	}
+	if ( pwm > 65470 ) {
+		pwm = 65470;
+	}
+
+	uint16_t value = 0;
+
+#ifdef BIDIRECTIONAL
+
+	if ( pwmdir == FORWARD ) {
+		value = 48 + IDLE_OFFSET + (uint16_t)( ( pwm * ( 1000 - IDLE_OFFSET ) ) >> 16 );
+	} else if ( pwmdir == REVERSE ) {
+		value = 1048 + IDLE_OFFSET + (uint16_t)( ( pwm * ( 1000 - IDLE_OFFSET ) ) >> 16 );
+	}
+
+#else
+
+	value = 48 + IDLE_OFFSET * 2 + (uint16_t)( ( pwm * ( 2001 - IDLE_OFFSET * 2 ) ) >> 16 );
+
+#endif
+
+	dshot_set( number, value );
+}
+#endif
+
+
+#if GYRO_RATE_MULTIPLIER > 1
+// send the last values again, for the gyro loops without a pid update
+void pwm_repeat( void)
+{
+	if ( !dshot_repeat ) return;
+
+	for ( uint8_t i = 0; i < 4; i++ ) {
+		make_packet( i, dshot_value[ i ], false );
+	}
+	dshot_dma_start();
+}
+#endif
 
 #ifndef MOTOR_BEEPS_TIMEOUT
 #define MOTOR_BEEPS_TIMEOUT 1e6
 #endif
 
+// the 4 beeps every 2s go through the command queue , the signal stays off in between
 void motorbeep()
 {
 	static unsigned long motor_beep_time = 0;
+	static unsigned long motor_beep_last = 0;
 	if ( failsafe ) {
 		unsigned long time = gettime();
 		if ( motor_beep_time == 0 ) {
 			motor_beep_time = time;
+			motor_beep_last = time - 2000000;
 		}
 		const unsigned long delta_time = time - motor_beep_time;
-		if ( delta_time > MOTOR_BEEPS_TIMEOUT ) {
-			uint8_t beep_command = 0;
-			if ( delta_time % 2000000 < 250000 ) {
-				beep_command = DSHOT_CMD_BEEP1;
-			} else if ( delta_time % 2000000 < 500000 ) {
-				beep_command = DSHOT_CMD_BEEP3;
-			} else if ( delta_time % 2000000 < 750000 ) {
-				beep_command = DSHOT_CMD_BEEP2;
-			} else if ( delta_time % 2000000 < 1000000 ) {
-				beep_command = DSHOT_CMD_BEEP4;
-			}			
-	
-			if ( beep_command != 0 ) {
-				make_packet( 0, beep_command, true );
-				make_packet( 1, beep_command, true );
-				make_packet( 2, beep_command, true );
-				make_packet( 3, beep_command, true );
-				dshot_dma_start();
-			}
+		if ( delta_time > MOTOR_BEEPS_TIMEOUT && time - motor_beep_last >= 2000000 && !dshot_command_busy( DSHOT_ALL_MOTORS ) ) {
+			motor_beep_last = time;
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP1 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP3 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP2 , 0 );
+			dshot_command( DSHOT_ALL_MOTORS , DSHOT_CMD_BEEP4 , 0 );
 		}
 	} else {
 		motor_beep_time = 0;
@@ -520,17 +790,26 @@ void DMA1_Channel4_5_IRQHandler(void)
 	DMA_Cmd(DMA1_Channel4, DISABLE);		
 	
 	TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC4 | TIM_DMA_CC1, DISABLE);
-	DMA_ClearITPendingBit(DMA1_IT_TC4);		
+	DMA_ClearITPendingBit( DMA1_IT_GL4 | DMA1_IT_GL5 );		
 	TIM_Cmd( TIM1, DISABLE );
 	
 
 	switch( dshot_dma_phase ) {
-		case 2:
-			dshot_dma_phase =1;
-			dshot_dma_portB();
-			return;
 		case 1:
+			#ifdef RPM_FILTER
+				dshot_dma_phase =3;
+				dshot_capture_start();
+				return;
+		case 3:
+				// telemetry samples complete
+				dshot_capture_end();
+			#endif
 			dshot_dma_phase =0;
+			// a newer frame was made while this one was sent
+			if ( dshot_dma_pending ) {
+				dshot_dma_next();
+				return;
+			}
 			#if defined(RGB_LED_DMA) && (RGB_LED_NUMBER>0)
 				extern int rgb_dma_phase;
 				extern void rgb_dma_trigger();
@@ -552,6 +831,8 @@ void DMA1_Channel4_5_IRQHandler(void)
 	rgb_dma_phase = 0;
 #endif
 	
+	// the frame waited for the rgb transfer
+	if ( dshot_dma_pending ) dshot_dma_next();
 }
 #endif
 
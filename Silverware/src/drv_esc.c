@@ -2,6 +2,7 @@
 #include "project.h"
 #include "drv_pwm.h"
 #include "config.h"
+#include "fixed.h"
 #include "drv_time.h"
 
 #ifdef USE_ESC_DRIVER
@@ -675,15 +676,12 @@ void init_timer( TIM_TypeDef* TIMx , int period)
 
 extern int onground;
 
-void pwm_set( uint8_t number , float pwmf)
+// the pulse in uS on the ground or after a failsafe , -1 for the throttle
+static int esc_override( void)
 {
+	int us = -1;
 
-if ( pwmf < 0.0f ) pwmf = 0.0f;
-if ( pwmf > 1.0f ) pwmf = 1.0f;
-	
-pwmf = mapf( pwmf , 0.0 , 1.0 , (float)ESC_MIN /ESC_uS , (float) ESC_MAX/ESC_uS);
-
-if (onground) pwmf = (float)ESC_OFF / ESC_uS;
+if (onground) us = ESC_OFF;
 
 	if ( failsafe ) 
 	{
@@ -696,7 +694,7 @@ if (onground) pwmf = (float)ESC_OFF / ESC_uS;
 			// 100mS after failsafe we turn off the signal (for safety while flashing)
 			if ( gettime() - pwm_failsafe_time > 100000 )
 			{
-				pwmf = (float) ESC_FAILSAFE / ESC_uS;
+				us = ESC_FAILSAFE;
 			}
 		}
 		
@@ -705,18 +703,11 @@ if (onground) pwmf = (float)ESC_OFF / ESC_uS;
 	{
 		pwm_failsafe_time = 0;
 	}
+	return us;
+}
 
-	
-#ifdef ENABLE_ONESHOT
-pwmf = pwmf/8;
-#endif
-
-#ifdef ENABLE_ONESHOT42
-pwmf = pwmf/24;
-#endif
-	
-int pwm = pwmf * PWMTOP ;
-	
+static void pwm_set_count( uint8_t number , int pwm )
+{
 if ( pwm < 0 ) pwm = 0;
 if ( pwm > PWMTOP ) pwm = PWMTOP;
 
@@ -924,6 +915,54 @@ if ( pwm > PWMTOP ) pwm = PWMTOP;
 	
 }
 
+void pwm_set( uint8_t number , float pwmf)
+{
+
+if ( pwmf < 0.0f ) pwmf = 0.0f;
+if ( pwmf > 1.0f ) pwmf = 1.0f;
+	
+pwmf = mapf( pwmf , 0.0 , 1.0 , (float)ESC_MIN /ESC_uS , (float) ESC_MAX/ESC_uS);
+
+int us = esc_override();
+if ( us >= 0 ) pwmf = (float) us / ESC_uS;
+	
+#ifdef ENABLE_ONESHOT
+pwmf = pwmf/8;
+#endif
+
+#ifdef ENABLE_ONESHOT42
+pwmf = pwmf/24;
+#endif
+	
+pwm_set_count( number , pwmf * PWMTOP );
+}
+
+#ifdef MIXER_FIXED
+#if defined ENABLE_ONESHOT42
+#define ESC_PULSE_DIV 24
+#elif defined ENABLE_ONESHOT
+#define ESC_PULSE_DIV 8
+#else
+#define ESC_PULSE_DIV 1
+#endif
+
+// timer counts per uS in Q16
+#define ESC_COUNTS_PER_US_Q16 ( (int32_t) ( PWMTOP * 65536.0f / ESC_uS / ESC_PULSE_DIV ) )
+
+// the same from the Q16 mixer , the pulse in Q16 uS
+void pwm_set_q( uint8_t number , int32_t pwm)
+{
+	if ( pwm < 0 ) pwm = 0;
+	if ( pwm > FIXED_ONE ) pwm = FIXED_ONE;
+
+	int32_t us = ESC_MIN * FIXED_ONE + pwm * ( ESC_MAX - ESC_MIN );
+	int override = esc_override();
+	if ( override >= 0 ) us = override * FIXED_ONE;
+
+	pwm_set_count( number , ( (int64_t) us * ESC_COUNTS_PER_US_Q16 ) >> 32 );
+}
+#endif
+
 
 
 
@@ -940,6 +979,12 @@ void pwm_set( uint8_t number , float pwm)
 {
 }
 
+#ifdef MIXER_FIXED
+void pwm_set_q( uint8_t number , int32_t pwm)
+{
+}
+#endif
+
 #endif
 
 #endif // end USE_ESC_DRIVER
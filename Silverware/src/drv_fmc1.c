@@ -2,33 +2,7 @@
 
 #include "project.h"
 #include "drv_fmc.h"
-
-// address 32768 - 1024 = 31k - last flash block
-// yes it's true, it has 32k
-#define FLASH_ADDR 0x08007C00
-
-extern void failloop( int);
-
-// address 0 - 255 ( for current block FLASH_ADDR )
-// value 32 bit to write
-void writeword( unsigned long address, unsigned long value)
-{
-	int test = FLASH_ProgramWord( FLASH_ADDR + (address<<2), value);	
-	if ( test != FLASH_COMPLETE )
-	{
-		FLASH_Lock();
-		failloop(5);
-	}
-}
-
-void fmc_write_float(unsigned long address, float float_to_write) {
-	writeword(address, *(unsigned long *) &float_to_write);
-}
-
-float fmc_read_float(unsigned long address) {
-	unsigned long result = fmc_read(address);
-	return *(float*)&result;
-}
+#include "flash_kv.h"
 
 void fmc_unlock() {
 	FLASH_Unlock();
@@ -38,20 +12,36 @@ void fmc_lock() {
 	FLASH_Lock();
 }
 
-int fmc_erase( void )
-{	
-	int test = FLASH_ErasePage( FLASH_ADDR );
-	if ( test != FLASH_COMPLETE ) FLASH_Lock();
-    else return 0;
-	return 1;// error occured
+// program end, the free flash starts at the next page
+#if defined(__CC_ARM)
+extern unsigned int Load$$LR$$LR_IROM1$$Limit;
+#define FLASH_IMAGE_END ( (unsigned long) &Load$$LR$$LR_IROM1$$Limit )
+#else
+// gcc/flash.ld, the initialised data is stored after the code
+extern unsigned int _sidata , _sdata , _edata;
+#define FLASH_IMAGE_END ( (unsigned long) &_sidata + ( (unsigned long) &_edata - (unsigned long) &_sdata ) )
+#endif
+
+#define FLASH_PAGE_SIZE 1024
+
+// pages between the program and the settings store
+unsigned long fmc_free_start( void)
+{
+	return ( FLASH_IMAGE_END + FLASH_PAGE_SIZE - 1 ) & ~( FLASH_PAGE_SIZE - 1 );
 }
 
-// reads 32 bit value
-unsigned long fmc_read(unsigned long address)
+unsigned long fmc_free_end( void)
 {
-	address = address * 4 + FLASH_ADDR;
-	unsigned int *addressptr = (unsigned int *)address;
-	return (*addressptr);
+	return FLASH_KV_BASE;
 }
 
+// absolute address, 0 if ok
+int fmc_erase_page( unsigned long address )
+{
+	return FLASH_ErasePage( address ) != FLASH_COMPLETE;
+}
 
+int fmc_write_halfword( unsigned long address , uint16_t value )
+{
+	return FLASH_ProgramHalfWord( address , value ) != FLASH_COMPLETE;
+}
@@ -30,6 +30,7 @@ THE SOFTWARE.
 #include "drv_i2c.h"
 #include "drv_softi2c.h"
 #include "drv_hw_i2c.h"
+#include "drv_softi2c_dma.h"
 
 #include "config.h"
 
@@ -67,6 +68,9 @@ void i2c_writereg( int reg ,int data)
 	#endif
 	
 	#ifdef USE_SOFTWARE_I2C
+	#ifdef SOFTI2C_READ_DMA
+	softi2c_dma_stop();
+	#endif
 	softi2c_write( SOFTI2C_GYRO_ADDRESS , reg , data);
 	#endif
 	
@@ -83,6 +87,9 @@ int i2c_readdata( int reg, int *data, int size )
 	#endif
 	
 	#ifdef USE_SOFTWARE_I2C
+	#ifdef SOFTI2C_READ_DMA
+	softi2c_dma_stop();
+	#endif
 	softi2c_readdata( SOFTI2C_GYRO_ADDRESS , reg , data, size );
 	return 1;
 	#endif
@@ -99,6 +106,9 @@ int i2c_readreg( int reg )
 	#endif
 	
 	#ifdef USE_SOFTWARE_I2C
+	#ifdef SOFTI2C_READ_DMA
+	softi2c_dma_stop();
+	#endif
 	return softi2c_read( SOFTI2C_GYRO_ADDRESS , reg);
 	#endif
 	
@@ -2,6 +2,7 @@
 #include "project.h"
 #include "drv_pwm.h"
 #include "config.h"
+#include "fixed.h"
 
 #ifdef USE_PWM_DRIVER
 
@@ -667,11 +668,8 @@ void motorbeep( void)
 
 #include  <math.h>
 
-void pwm_set( uint8_t number , float pwmf)
+static void pwm_set_count( uint8_t number , int pwm )
 {
-	
-int pwm = pwmf * PWMTOP ;
-	
 if ( pwm < 0 ) pwm = 0;
 if ( pwm > PWMTOP ) pwm = PWMTOP;
 
@@ -879,6 +877,22 @@ if ( pwm > PWMTOP ) pwm = PWMTOP;
 	
 }
 
+void pwm_set( uint8_t number , float pwmf)
+{
+	pwm_set_count( number , pwmf * PWMTOP );
+}
+
+#ifdef MIXER_FIXED
+// the same from the Q16 mixer
+void pwm_set_q( uint8_t number , int32_t pwm)
+{
+	if ( pwm < 0 ) pwm = 0;
+	if ( pwm > FIXED_ONE ) pwm = FIXED_ONE;
+	// 65536 * 65535 still fits unsigned
+	pwm_set_count( number , ( (uint32_t) pwm * PWMTOP ) >> 16 );
+}
+#endif
+
 
 
 
@@ -895,6 +909,12 @@ void pwm_set( uint8_t number , float pwm)
 {
 }
 
+#ifdef MIXER_FIXED
+void pwm_set_q( uint8_t number , int32_t pwm)
+{
+}
+#endif
+
 #endif 
 
 #endif // end USE_PWM_DRIVER
@@ -3,6 +3,10 @@
 
 void pwm_init(void);
 void pwm_set( uint8_t number , float pwm);
+// duty 0 - 1.0 in Q16 from the fixed point mixer ( MIXER_FIXED )
+void pwm_set_q( uint8_t number , int32_t pwm);
+// dshot drivers, resend the last frame ( GYRO_RATE_MULTIPLIER )
+void pwm_repeat( void);
 
 
 
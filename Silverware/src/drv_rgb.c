@@ -96,7 +96,7 @@ void rgb_init()
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 	
 	/* DMA1 Channe5 configuration ----------------------------------------------*/
-	DMA_DeInit(DMA1_Channel3);
+	DMA_DeInit(DMA1_Channel5);
 	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t)&RGB_PORT->BSRR;
 	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t)rgb_portX;
 	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralDST;
@@ -203,8 +203,13 @@ void rgb_dma_trigger()
 	DMA1_Channel4->CPAR = (uint32_t)&RGB_PORT->BRR;
 	DMA1_Channel4->CMAR = (uint32_t)rgb_portX;
 	
-	DMA1_Channel2->CCR &= ~(DMA_CCR_MSIZE_0 | DMA_CCR_MSIZE_1 
-                            | DMA_CCR_PSIZE_0 | DMA_CCR_PSIZE_1);		// switch from halfword to byte
+	// the setup of rgb_init, the dshot dma driver runs the channels in its own format
+	DMA1_Channel5->CCR = DMA_DIR_PeripheralDST | DMA_PeripheralDataSize_HalfWord
+		| DMA_MemoryDataSize_HalfWord | DMA_Priority_High;
+	DMA1_Channel2->CCR = DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_PeripheralDataSize_Byte
+		| DMA_MemoryDataSize_Byte | DMA_Priority_High;
+	DMA1_Channel4->CCR = DMA_DIR_PeripheralDST | DMA_PeripheralDataSize_HalfWord
+		| DMA_MemoryDataSize_HalfWord | DMA_Priority_High | DMA_IT_TC;
 	
 	DMA_ClearFlag( DMA1_FLAG_GL2 | DMA1_FLAG_GL4 | DMA1_FLAG_GL5 );
 	
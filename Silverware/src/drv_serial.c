@@ -101,6 +101,12 @@ void buffer_add(int val )
 	return;
 }
 
+// bytes that can be added without overwriting unsent data
+int serial_free(void)
+{
+	return SERIAL_BUFFER_SIZE - 1 - ( ( buffer_end - buffer_start + SERIAL_BUFFER_SIZE ) % SERIAL_BUFFER_SIZE );
+}
+
 #else
 // serial disabled - dummy functions
 void serial_init(void)
@@ -113,6 +119,11 @@ void buffer_add(int val )
 	
 }
 
+int serial_free(void)
+{
+	return 0;
+}
+
 #endif
 
 
@@ -1,3 +1,4 @@
 void serial_init(void);
+int serial_free(void);
 
 
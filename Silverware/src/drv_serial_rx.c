@@ -0,0 +1,236 @@
+// serial receiver engine for sbus, crsf, sumd and dsm
+// usart1 rx runs into a circular dma buffer, the idle line interrupt marks the end of each frame
+// so there is one interrupt per frame instead of one per byte, and the protocols decode the frame
+// where the dma put it
+//
+// at each idle line the buffer is restarted from the beginning if a full frame might not fit
+// behind the last one, so frames are always contiguous ( the line is idle, no byte is lost )
+// a frame stays valid until SERIAL_RX_FRAME_MAX more bytes arrived, the newest frame is kept
+// if the previous one was not taken yet
+//
+// the interrupt only keeps the systick count, serial_rx_frame() turns it into a gettime() stamp
+// for latency measurements ( frame end to motor output )
+//
+// SERIAL_RX_HALF_DUPLEX sends replies ( crsf telemetry ) on the rx pin from a dma channel, the receiver
+// is off while the reply goes out so it does not see its own bytes
+
+#include "project.h"
+#include "config.h"
+#include "drv_time.h"
+#include "drv_serial_rx.h"
+
+#ifdef SERIAL_RX_DMA
+
+// room for two frames
+#define SERIAL_RX_BUFFER ( 2 * SERIAL_RX_FRAME_MAX )
+
+#ifdef SIXAXIS_READ_DMA
+// channel 3 is the i2c rx, usart1 rx remapped to channel 5
+#define SERIAL_RX_DMA_CHANNEL DMA1_Channel5
+#else
+#define SERIAL_RX_DMA_CHANNEL DMA1_Channel3
+#endif
+
+#ifdef CRSF_TELEMETRY
+// only the crsf telemetry takes the tx dma channel
+#define SERIAL_RX_REPLY_CHANNEL DMA1_Channel2
+static int reply_busy;
+#endif
+
+static uint8_t serial_rx_buffer[ SERIAL_RX_BUFFER ];
+
+// end of the last frame in the buffer
+static int rx_end;
+
+// last frame, written by the interrupt
+static volatile int frame_start;
+static volatile int frame_length;
+static volatile unsigned long frame_ticks;
+
+unsigned long serial_rx_frame_time;
+unsigned long serial_rx_frames;
+unsigned long serial_rx_dropped;
+
+void serial_rx_init( uint32_t baudrate , int format )
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_OD;
+	// an inverted line idles low
+	GPIO_InitStructure.GPIO_PuPd = ( format & SERIAL_RX_INVERT ) ? GPIO_PuPd_NOPULL : GPIO_PuPd_UP;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_Pin = SERIAL_RX_PIN;
+	GPIO_Init( SERIAL_RX_PORT , &GPIO_InitStructure );
+	GPIO_PinAFConfig( SERIAL_RX_PORT , SERIAL_RX_SOURCE , SERIAL_RX_CHANNEL );
+
+	RCC_APB2PeriphClockCmd( RCC_APB2Periph_USART1 , ENABLE );
+	RCC_AHBPeriphClockCmd( RCC_AHBPeriph_DMA1 , ENABLE );
+
+#ifdef SIXAXIS_READ_DMA
+	RCC_APB2PeriphClockCmd( RCC_APB2Periph_SYSCFG , ENABLE );
+	SYSCFG_DMAChannelRemapConfig( SYSCFG_DMARemap_USART1Rx , ENABLE );
+#endif
+
+	DMA_InitTypeDef DMA_InitStructure;
+	DMA_StructInit( &DMA_InitStructure );
+	DMA_DeInit( SERIAL_RX_DMA_CHANNEL );
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &USART1->RDR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) serial_rx_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = SERIAL_RX_BUFFER;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init( SERIAL_RX_DMA_CHANNEL , &DMA_InitStructure );
+	DMA_Cmd( SERIAL_RX_DMA_CHANNEL , ENABLE );
+
+	USART_InitTypeDef USART_InitStructure;
+	USART_InitStructure.USART_BaudRate = baudrate;
+	// the parity bit is the 9th bit, the dma reads the 8 data bits
+	USART_InitStructure.USART_WordLength = ( format & SERIAL_RX_PARITY_EVEN ) ? USART_WordLength_9b : USART_WordLength_8b;
+	USART_InitStructure.USART_Parity = ( format & SERIAL_RX_PARITY_EVEN ) ? USART_Parity_Even : USART_Parity_No;
+	USART_InitStructure.USART_StopBits = ( format & SERIAL_RX_STOP2 ) ? USART_StopBits_2 : USART_StopBits_1;
+	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+	USART_InitStructure.USART_Mode = ( format & SERIAL_RX_HALF_DUPLEX ) ? USART_Mode_Rx | USART_Mode_Tx : USART_Mode_Rx;
+	USART_Init( USART1 , &USART_InitStructure );
+
+	if ( format & SERIAL_RX_HALF_DUPLEX )
+	{
+		// single wire on the tx pin of the usart, the rx pin is the tx pin without the swap
+#ifdef Alienwhoop_ZERO
+		USART_SWAPPinCmd( USART1 , ENABLE );
+#endif
+		USART_HalfDuplexCmd( USART1 , ENABLE );
+	}
+	else
+	{
+// swap rx/tx pins
+#ifndef Alienwhoop_ZERO
+		USART_SWAPPinCmd( USART1 , ENABLE );
+#endif
+	}
+	if ( format & SERIAL_RX_INVERT ) USART_InvPinCmd( USART1 , USART_InvPin_Rx | USART_InvPin_Tx , ENABLE );
+
+	// an overrun would stop the dma requests
+	USART_OverrunDetectionConfig( USART1 , USART_OVRDetection_Disable );
+
+	rx_end = 0;
+	frame_length = 0;
+
+#ifdef CRSF_TELEMETRY
+	if ( format & SERIAL_RX_HALF_DUPLEX )
+	{
+		DMA_StructInit( &DMA_InitStructure );
+		DMA_DeInit( SERIAL_RX_REPLY_CHANNEL );
+		DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &USART1->TDR;
+		DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+		DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+		DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+		DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+		DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+		DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+		DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+		DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+		DMA_Init( SERIAL_RX_REPLY_CHANNEL , &DMA_InitStructure );
+		USART_DMACmd( USART1 , USART_DMAReq_Tx , ENABLE );
+		reply_busy = 0;
+	}
+#endif
+
+	USART_DMACmd( USART1 , USART_DMAReq_Rx , ENABLE );
+	USART_ClearITPendingBit( USART1 , USART_IT_IDLE );
+	USART_ITConfig( USART1 , USART_IT_IDLE , ENABLE );
+	USART_Cmd( USART1 , ENABLE );
+
+	NVIC_InitTypeDef NVIC_InitStructure;
+	NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init( &NVIC_InitStructure );
+}
+
+// idle line, the bytes since the last idle line are a frame
+void USART1_IRQHandler( void)
+{
+	if ( !( USART1->ISR & USART_ISR_IDLE ) ) return;
+	USART1->ICR = USART_ICR_IDLECF;
+
+	int end = SERIAL_RX_BUFFER - SERIAL_RX_DMA_CHANNEL->CNDTR;
+
+	// a frame that ends on the last byte has reloaded the counter
+	if ( end == 0 && rx_end ) end = SERIAL_RX_BUFFER;
+
+	if ( end > rx_end )
+	{
+		frame_start = rx_end;
+		frame_length = end - rx_end;
+		frame_ticks = time_ticks();
+		serial_rx_frames++;
+	}
+	else if ( end < rx_end )
+	{
+		// wrapped around, longer than a frame
+		serial_rx_dropped++;
+	}
+	rx_end = end;
+
+	// the next frame starts from the beginning if it might not fit
+	if ( SERIAL_RX_BUFFER - end < SERIAL_RX_FRAME_MAX )
+	{
+		SERIAL_RX_DMA_CHANNEL->CCR &= ~DMA_CCR_EN;
+		SERIAL_RX_DMA_CHANNEL->CNDTR = SERIAL_RX_BUFFER;
+		SERIAL_RX_DMA_CHANNEL->CCR |= DMA_CCR_EN;
+		rx_end = 0;
+	}
+}
+
+uint8_t * serial_rx_frame( int *length )
+{
+	if ( !frame_length ) return 0;
+
+	__disable_irq();
+	int start = frame_start;
+	*length = frame_length;
+	unsigned long ticks = frame_ticks;
+	frame_length = 0;
+	__enable_irq();
+
+	// frame age from the idle line stamp
+	unsigned long time = gettime();
+	unsigned long age = time_ticks_since( ticks , time_ticks() );
+	serial_rx_frame_time = time - age / TIME_TICKS_PER_US;
+
+	return serial_rx_buffer + start;
+}
+
+#ifdef CRSF_TELEMETRY
+int serial_rx_reply_busy( void)
+{
+	if ( !reply_busy ) return 0;
+
+	// the last stop bit is out, listen again
+	if ( !( USART1->ISR & USART_ISR_TC ) ) return 1;
+	USART1->CR1 |= USART_CR1_RE;
+	reply_busy = 0;
+	return 0;
+}
+
+void serial_rx_reply( const uint8_t *data , int length )
+{
+	SERIAL_RX_REPLY_CHANNEL->CCR &= ~DMA_CCR_EN;
+	SERIAL_RX_REPLY_CHANNEL->CMAR = (uint32_t) data;
+	SERIAL_RX_REPLY_CHANNEL->CNDTR = length;
+
+	USART1->CR1 &= ~USART_CR1_RE;
+	USART1->ICR = USART_ICR_TCCF;
+	reply_busy = 1;
+
+	SERIAL_RX_REPLY_CHANNEL->CCR |= DMA_CCR_EN;
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+#include <inttypes.h>
+
+// serial_rx_init() format flags
+#define SERIAL_RX_INVERT 1
+#define SERIAL_RX_PARITY_EVEN 2
+#define SERIAL_RX_STOP2 4
+// tx and rx on the rx pin
+#define SERIAL_RX_HALF_DUPLEX 8
+
+// largest frame of the serial protocols ( crsf )
+#define SERIAL_RX_FRAME_MAX 64
+
+void serial_rx_init( uint32_t baudrate , int format );
+
+// the newest frame since the last call, 0 if there is none
+// the frame is contiguous in the dma buffer and stays there until SERIAL_RX_FRAME_MAX more bytes came in
+uint8_t * serial_rx_frame( int *length );
+
+// gettime() at the end of the frame returned last ( idle line )
+extern unsigned long serial_rx_frame_time;
+// frames seen and frames dropped because they wrapped around the buffer
+extern unsigned long serial_rx_frames;
+extern unsigned long serial_rx_dropped;
+
+// half duplex replies ( CRSF_TELEMETRY ), the data has to stay valid until the reply is out
+// busy also turns the receiver back on when the last reply is out, poll it before each reply
+int serial_rx_reply_busy( void);
+void serial_rx_reply( const uint8_t *data , int length );
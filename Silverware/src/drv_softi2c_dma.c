@@ -0,0 +1,352 @@
+// background gyro read for the software i2c boards
+// the 14 byte burst from register 59 is clocked out by TIM2 and 4 DMA channels instead of bit banging
+// with the cpu, sixaxis_read() only decodes the finished samples and schedules the next read
+//
+// one timer period is one i2c bit
+//	TIM2_CH1 DMA_CH5: sda from the waveform table	at 1/4 bit
+//	TIM2_CH4 DMA_CH4: scl high											at 1/2 bit
+//	TIM2_CH2 DMA_CH3: sample the sda port						at 3/4 bit
+//	TIM2_UP  DMA_CH2: scl low												at the end of the bit
+//
+// the burst is two runs, address + register and address + 14 bytes, the start, restart and stop
+// conditions between them are set by the DMA_CH2 interrupt
+// the read starts from a TIM2 delay so it ends just before the next sixaxis_read()
+//
+// sda is open drain, the table writes 1 ( released ) for the bits the gyro sends
+// cpu time per read ( estimated from the instruction count, measure with LOOP_PROFILER ):
+// drv_softi2c.c with SOFTI2C_SPEED_FAST about 30 cycles per bit, 153 bits = 4600 cycles ( 95uS at 48MHz )
+// this driver 3 interrupts and the decode, about 1000 cycles ( 20uS at 48MHz )
+
+#include "project.h"
+#include "config.h"
+#include "drv_time.h"
+#include "drv_softi2c_dma.h"
+
+#ifdef SOFTI2C_READ_DMA
+
+#ifndef SOFTI2C_DMA_KHZ
+#define SOFTI2C_DMA_KHZ 1000
+#endif
+
+// timer ticks per bit
+#define SOFTI2C_DMA_BIT ( SYS_CLOCK_FREQ_HZ / 1000 / SOFTI2C_DMA_KHZ )
+
+// address write + register , address read + 14 bytes, 9 bits with the ack
+#define RUN1_BITS ( 2 * 9 )
+#define RUN2_BITS ( 15 * 9 )
+
+// read time in uS including the restart and stop
+#define SOFTI2C_DMA_READ_TIME ( ( RUN1_BITS + RUN2_BITS ) * 1000 / SOFTI2C_DMA_KHZ + 10 )
+
+// the read ends this long before the next sixaxis_read()
+#define SOFTI2C_DMA_MARGIN 30
+
+#if GYRO_LOOPTIME < SOFTI2C_DMA_READ_TIME + SOFTI2C_DMA_MARGIN
+#error "SOFTI2C_READ_DMA gyro read is too slow for the gyro loop time"
+#endif
+
+#define SDA_SET ( (uint32_t) SOFTI2C_SDAPIN )
+#define SDA_RESET ( (uint32_t) SOFTI2C_SDAPIN << 16 )
+
+#define SDA_BIT( value , bit ) ( ( ( value ) >> ( bit ) ) & 1 ? SDA_SET : SDA_RESET )
+
+// 8 bits msb first, then release sda for the ack of the gyro
+#define SDA_BYTE( value ) SDA_BIT( value , 7 ) , SDA_BIT( value , 6 ) , SDA_BIT( value , 5 ) , SDA_BIT( value , 4 ) , \
+	SDA_BIT( value , 3 ) , SDA_BIT( value , 2 ) , SDA_BIT( value , 1 ) , SDA_BIT( value , 0 ) , SDA_SET
+
+// 8 bits from the gyro , then ack or nack
+#define SDA_READ( ack ) SDA_SET , SDA_SET , SDA_SET , SDA_SET , SDA_SET , SDA_SET , SDA_SET , SDA_SET , ( ack ) ? SDA_RESET : SDA_SET
+
+static const uint32_t sda_wave[ RUN1_BITS + RUN2_BITS ] =
+{
+	SDA_BYTE( SOFTI2C_GYRO_ADDRESS << 1 ) , SDA_BYTE( 59 ) ,
+	SDA_BYTE( ( SOFTI2C_GYRO_ADDRESS << 1 ) | 1 ) ,
+	SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) ,
+	SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 1 ) , SDA_READ( 0 )
+};
+
+static const uint32_t scl_low[1] = { (uint32_t) SOFTI2C_SCLPIN << 16 };
+static const uint32_t scl_high[1] = { SOFTI2C_SCLPIN };
+
+// the byte of the port input register with the sda pin
+#define SDA_SAMPLE_ADDRESS ( (uint32_t) &SOFTI2C_SDAPORT->IDR + ( SOFTI2C_SDAPIN > 0xFF ) )
+#define SDA_SAMPLE_MASK ( SOFTI2C_SDAPIN > 0xFF ? SOFTI2C_SDAPIN >> 8 : SOFTI2C_SDAPIN )
+
+static volatile uint8_t sda_samples[ RUN2_BITS ];
+
+#define I2C_DMA_IDLE 0
+#define I2C_DMA_DELAY 1
+#define I2C_DMA_RUN1 2
+#define I2C_DMA_RUN2 3
+#define I2C_DMA_DONE 4
+
+static volatile int i2c_dma_state = I2C_DMA_IDLE;
+
+extern int liberror;
+
+#define SCL_HIGH() SOFTI2C_SCLPORT->BSRR = SOFTI2C_SCLPIN
+#define SCL_LOW() SOFTI2C_SCLPORT->BRR = SOFTI2C_SCLPIN
+#define SDA_HIGH() SOFTI2C_SDAPORT->BSRR = SOFTI2C_SDAPIN
+#define SDA_LOW() SOFTI2C_SDAPORT->BRR = SOFTI2C_SDAPIN
+
+// a few hundred nS between the start / stop edges
+static void bus_delay( void)
+{
+	volatile uint8_t count = 4;
+	while ( count-- );
+}
+
+static void softi2c_dma_run( const uint32_t *wave , int bits , int sample )
+{
+	TIM_Cmd( TIM2, DISABLE );
+	TIM_DMACmd( TIM2, TIM_DMA_Update | TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC4, DISABLE );
+	TIM_ITConfig( TIM2, TIM_IT_Update, DISABLE );
+
+	DMA_Cmd( DMA1_Channel2, DISABLE );
+	DMA_Cmd( DMA1_Channel3, DISABLE );
+	DMA_Cmd( DMA1_Channel4, DISABLE );
+	DMA_Cmd( DMA1_Channel5, DISABLE );
+	DMA_ClearFlag( DMA1_FLAG_GL2 | DMA1_FLAG_GL3 | DMA1_FLAG_GL4 | DMA1_FLAG_GL5 );
+
+	DMA1_Channel5->CMAR = (uint32_t) wave;
+	DMA1_Channel5->CNDTR = bits;
+	DMA1_Channel4->CNDTR = bits;
+	DMA1_Channel2->CNDTR = bits;
+	DMA1_Channel3->CNDTR = bits;
+
+	DMA_Cmd( DMA1_Channel2, ENABLE );
+	DMA_Cmd( DMA1_Channel4, ENABLE );
+	DMA_Cmd( DMA1_Channel5, ENABLE );
+	if ( sample ) DMA_Cmd( DMA1_Channel3, ENABLE );
+
+	TIM2->ARR = SOFTI2C_DMA_BIT - 1;
+	TIM_SetCounter( TIM2, 0 );
+	TIM2->SR = 0;
+	TIM_DMACmd( TIM2, TIM_DMA_Update | TIM_DMA_CC1 | TIM_DMA_CC4 | ( sample ? TIM_DMA_CC2 : 0 ), ENABLE );
+	TIM_Cmd( TIM2, ENABLE );
+}
+
+static void softi2c_dma_start( void)
+{
+	// start , scl goes low with the first timer update
+	SDA_LOW();
+	bus_delay();
+	SCL_LOW();
+
+	i2c_dma_state = I2C_DMA_RUN1;
+	softi2c_dma_run( sda_wave , RUN1_BITS , 0 );
+}
+
+void softi2c_dma_init( void)
+{
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	DMA_InitTypeDef DMA_InitStructure;
+
+	// sda stays an open drain output, released it reads the line
+	GPIO_InitTypeDef GPIO_InitStructure;
+	GPIO_InitStructure.GPIO_Pin = SOFTI2C_SDAPIN;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
+	GPIO_InitStructure.GPIO_OType = GPIO_OType_OD;
+	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	SDA_HIGH();
+	SCL_HIGH();
+	GPIO_Init( SOFTI2C_SDAPORT, &GPIO_InitStructure );
+
+	TIM_TimeBaseStructInit( &TIM_TimeBaseStructure );
+	TIM_OCStructInit( &TIM_OCInitStructure );
+	RCC_APB1PeriphClockCmd( RCC_APB1Periph_TIM2, ENABLE );
+
+	TIM_TimeBaseStructure.TIM_Period = 						SOFTI2C_DMA_BIT - 1;
+	TIM_TimeBaseStructure.TIM_Prescaler = 				0;
+	TIM_TimeBaseStructure.TIM_ClockDivision = 		0;
+	TIM_TimeBaseStructure.TIM_CounterMode = 			TIM_CounterMode_Up;
+	TIM_TimeBaseInit( TIM2, &TIM_TimeBaseStructure );
+	TIM_ARRPreloadConfig( TIM2, DISABLE );
+	TIM_Cmd( TIM2, DISABLE );
+
+	TIM_OCInitStructure.TIM_OCMode = 							TIM_OCMode_Timing;
+	TIM_OCInitStructure.TIM_OutputState = 				TIM_OutputState_Disable;
+	TIM_OCInitStructure.TIM_Pulse = 							SOFTI2C_DMA_BIT / 4;
+	TIM_OC1Init( TIM2, &TIM_OCInitStructure );
+	TIM_OC1PreloadConfig( TIM2, TIM_OCPreload_Disable );
+
+	TIM_OCInitStructure.TIM_Pulse = 							SOFTI2C_DMA_BIT / 2;
+	TIM_OC4Init( TIM2, &TIM_OCInitStructure );
+	TIM_OC4PreloadConfig( TIM2, TIM_OCPreload_Disable );
+
+	TIM_OCInitStructure.TIM_Pulse = 							SOFTI2C_DMA_BIT * 3 / 4;
+	TIM_OC2Init( TIM2, &TIM_OCInitStructure );
+	TIM_OC2PreloadConfig( TIM2, TIM_OCPreload_Disable );
+
+	DMA_StructInit( &DMA_InitStructure );
+	RCC_AHBPeriphClockCmd( RCC_AHBPeriph_DMA1, ENABLE );
+
+	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_BufferSize = 						RUN1_BITS;
+	DMA_InitStructure.DMA_PeripheralInc = 				DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_PeripheralDataSize = 		DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = 				DMA_MemoryDataSize_Word;
+	DMA_InitStructure.DMA_Mode = 									DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = 							DMA_Priority_High;
+	DMA_InitStructure.DMA_M2M = 									DMA_M2M_Disable;
+
+	/* DMA1 Channel5 sda ----------------------------------------------*/
+	DMA_DeInit( DMA1_Channel5 );
+	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t) &SOFTI2C_SDAPORT->BSRR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t) sda_wave;
+	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Enable;
+	DMA_Init( DMA1_Channel5, &DMA_InitStructure );
+
+	/* DMA1 Channel4 scl high ----------------------------------------------*/
+	DMA_DeInit( DMA1_Channel4 );
+	DMA_InitStructure.DMA_PeripheralBaseAddr = 		(uint32_t) &SOFTI2C_SCLPORT->BSRR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t) scl_high;
+	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Disable;
+	DMA_Init( DMA1_Channel4, &DMA_InitStructure );
+
+	/* DMA1 Channel2 scl low ----------------------------------------------*/
+	DMA_DeInit( DMA1_Channel2 );
+	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t) scl_low;
+	DMA_Init( DMA1_Channel2, &DMA_InitStructure );
+
+	/* DMA1 Channel3 sda samples ----------------------------------------------*/
+	DMA_DeInit( DMA1_Channel3 );
+	DMA_InitStructure.DMA_PeripheralBaseAddr = 		SDA_SAMPLE_ADDRESS;
+	DMA_InitStructure.DMA_MemoryBaseAddr = 				(uint32_t) sda_samples;
+	DMA_InitStructure.DMA_DIR = 									DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_MemoryInc = 						DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = 		DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = 				DMA_MemoryDataSize_Byte;
+	DMA_Init( DMA1_Channel3, &DMA_InitStructure );
+
+	// end of a run , the scl low of the last bit
+	NVIC_InitStructure.NVIC_IRQChannel = 					DMA1_Channel2_3_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPriority = 	(uint8_t) DMA_Priority_High;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = 			ENABLE;
+	NVIC_Init( &NVIC_InitStructure );
+	DMA_ITConfig( DMA1_Channel2, DMA_IT_TC, ENABLE );
+
+	// read start delay
+	NVIC_InitStructure.NVIC_IRQChannel = 					TIM2_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPriority = 	(uint8_t) DMA_Priority_High;
+	NVIC_Init( &NVIC_InitStructure );
+
+	i2c_dma_state = I2C_DMA_IDLE;
+}
+
+void DMA1_Channel2_3_IRQHandler( void)
+{
+	DMA_ClearITPendingBit( DMA1_IT_TC2 );
+	TIM_Cmd( TIM2, DISABLE );
+
+	if ( i2c_dma_state == I2C_DMA_RUN1 )
+	{
+		// restart
+		SDA_HIGH();
+		bus_delay();
+		SCL_HIGH();
+		bus_delay();
+		SDA_LOW();
+		bus_delay();
+		SCL_LOW();
+
+		i2c_dma_state = I2C_DMA_RUN2;
+		softi2c_dma_run( sda_wave + RUN1_BITS , RUN2_BITS , 1 );
+		return;
+	}
+
+	// stop
+	TIM_DMACmd( TIM2, TIM_DMA_Update | TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC4, DISABLE );
+	SDA_LOW();
+	bus_delay();
+	SCL_HIGH();
+	bus_delay();
+	SDA_HIGH();
+
+	i2c_dma_state = I2C_DMA_DONE;
+}
+
+void TIM2_IRQHandler( void)
+{
+	TIM_ClearITPendingBit( TIM2, TIM_IT_Update );
+	if ( i2c_dma_state == I2C_DMA_DELAY ) softi2c_dma_start();
+	else TIM_Cmd( TIM2, DISABLE );
+}
+
+// next read in delay uS , 0 or less starts it now
+static void softi2c_dma_schedule( int delay )
+{
+	if ( delay < 2 )
+	{
+		softi2c_dma_start();
+		return;
+	}
+	TIM_Cmd( TIM2, DISABLE );
+	TIM_DMACmd( TIM2, TIM_DMA_Update | TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC4, DISABLE );
+	i2c_dma_state = I2C_DMA_DELAY;
+	TIM2->ARR = delay * ( SYS_CLOCK_FREQ_HZ / 1000000 ) - 1;
+	TIM_SetCounter( TIM2, 0 );
+	TIM2->SR = 0;
+	TIM_ITConfig( TIM2, TIM_IT_Update, ENABLE );
+	TIM_Cmd( TIM2, ENABLE );
+}
+
+// waits for a running read and cancels a scheduled one, the bit banged functions can use the bus after it
+void softi2c_dma_stop( void)
+{
+	uint32_t time = gettime();
+
+	__disable_irq();
+	if ( i2c_dma_state == I2C_DMA_DELAY )
+	{
+		TIM_Cmd( TIM2, DISABLE );
+		TIM_ITConfig( TIM2, TIM_IT_Update, DISABLE );
+		i2c_dma_state = I2C_DMA_IDLE;
+	}
+	__enable_irq();
+
+	while ( ( i2c_dma_state == I2C_DMA_RUN1 || i2c_dma_state == I2C_DMA_RUN2 ) && gettime() - time < 1000 );
+
+	if ( i2c_dma_state == I2C_DMA_DONE ) i2c_dma_state = I2C_DMA_IDLE;
+	else if ( i2c_dma_state != I2C_DMA_IDLE ) softi2c_dma_init();
+}
+
+// the 14 bytes from register 59
+void softi2c_dma_read( uint8_t *data )
+{
+	uint32_t time = gettime();
+
+	if ( i2c_dma_state == I2C_DMA_IDLE ) softi2c_dma_start();
+
+	// a read runs late only if the loop was late, a stuck one is restarted
+	while ( i2c_dma_state != I2C_DMA_DONE )
+	{
+		if ( gettime() - time > SOFTI2C_DMA_READ_TIME * 2 )
+		{
+			liberror++;
+			softi2c_dma_init();
+			softi2c_dma_start();
+			time = gettime();
+		}
+	}
+
+	const volatile uint8_t *sample = sda_samples + 9;
+	for ( int i = 0 ; i < 14 ; i++)
+	{
+		uint8_t byte = 0;
+		for ( int bit = 0 ; bit < 8 ; bit++)
+		{
+			byte <<= 1;
+			if ( sample[bit] & SDA_SAMPLE_MASK ) byte |= 1;
+		}
+		data[i] = byte;
+		sample += 9;
+	}
+
+	softi2c_dma_schedule( GYRO_LOOPTIME - SOFTI2C_DMA_READ_TIME - SOFTI2C_DMA_MARGIN - (int) ( gettime() - time ) );
+}
+
+#endif
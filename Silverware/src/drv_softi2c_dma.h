@@ -0,0 +1,11 @@
+
+#include <inttypes.h>
+
+void softi2c_dma_init( void);
+
+// waits for the background read of the 14 bytes from register 59 and schedules the next one
+void softi2c_dma_read( uint8_t *data );
+
+// frees the bus for the bit banged functions
+void softi2c_dma_stop( void);
+
@@ -31,6 +31,77 @@ static __INLINE uint32_t SysTick_Config2(uint32_t ticks)
 }
 
 
+#ifdef TIM2_TIME_BASE
+
+// TIM2 counts uS on all 32 bits, it wraps after 71 minutes
+// the update interrupt extends it to 64 bits
+static volatile unsigned long time_high = 0;
+
+void time_init()
+{
+	// systick still runs for the loop profiler
+	  if (SysTick_Config2( SYS_CLOCK_FREQ_HZ /8 ))
+    {// not able to set divider
+			  failloop(5);
+    }
+
+	RCC_APB1PeriphClockCmd( RCC_APB1Periph_TIM2 , ENABLE );
+
+	TIM2->PSC = SYS_CLOCK_FREQ_HZ / 1000000 - 1;
+	TIM2->ARR = 0xFFFFFFFF;
+	// load the prescaler now, not at the first wrap
+	TIM2->EGR = TIM_EGR_UG;
+	TIM2->SR = 0;
+	TIM2->DIER = TIM_DIER_UIE;
+	TIM2->CR1 = TIM_CR1_CEN;
+
+	NVIC_SetPriority( TIM2_IRQn , 0 );
+	NVIC_EnableIRQ( TIM2_IRQn );
+}
+
+void TIM2_IRQHandler( void)
+{
+	TIM2->SR = ~TIM_SR_UIF;
+	time_high++;
+}
+
+// return time in uS from start ( micros())
+unsigned long gettime()
+{
+	return TIM2->CNT;
+}
+
+// 64 bit time in uS from start, also in interrupts
+unsigned long long gettime64( void)
+{
+	unsigned long high;
+	unsigned long low;
+
+	do {
+		high = time_high;
+		low = TIM2->CNT;
+	} while ( high != time_high );
+
+	// wrapped while the update interrupt can not run yet
+	if ( ( TIM2->SR & TIM_SR_UIF ) && low < 0x80000000 ) high++;
+
+	return ( (unsigned long long) high << 32 ) | low;
+}
+
+unsigned long time_ticks( void)
+{
+	return TIM2->CNT;
+}
+
+unsigned long time_ticks_since( unsigned long stamp , unsigned long now )
+{
+	return now - stamp;
+}
+
+#else
+
+static unsigned long time_high = 0;
+
 void time_init()
 {
 	  if (SysTick_Config2( SYS_CLOCK_FREQ_HZ /8 ))
@@ -72,6 +143,7 @@ unsigned long time_update(void)
 	quotient = elapsedticks*43691>>18; 
 	remainder = elapsedticks - quotient*6;
 #endif	
+	if ( globalticks + quotient < globalticks ) time_high++;
 	globalticks = globalticks + quotient; 
 
 	return globalticks;	
@@ -83,6 +155,28 @@ unsigned long gettime()
 {
 	return time_update();
 }
+
+// 64 bit time in uS from start, not from interrupts
+unsigned long long gettime64( void)
+{
+	unsigned long low = time_update();
+	return ( (unsigned long long) time_high << 32 ) | low;
+}
+
+// systick counts down from LOAD, the stamps count up
+unsigned long time_ticks( void)
+{
+	return SysTick->LOAD - SysTick->VAL;
+}
+
+unsigned long time_ticks_since( unsigned long stamp , unsigned long now )
+{
+	if ( now >= stamp ) return now - stamp;
+	return now + SysTick->LOAD + 1 - stamp;
+}
+
+#endif
+
 #ifdef ENABLE_OVERCLOCK
 // delay in uS
 void delay(uint32_t data)
@@ -2,6 +2,12 @@
 
 void time_init(void);
 unsigned long gettime(void);
+unsigned long long gettime64(void);
+
+// interrupt safe timestamps for short intervals, TIME_TICKS_PER_US ticks per uS
+// up to a second apart with the systick time base
+unsigned long time_ticks(void);
+unsigned long time_ticks_since( unsigned long stamp , unsigned long now );
 
 void delay(uint32_t data);
 
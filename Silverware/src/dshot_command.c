@@ -0,0 +1,162 @@
+// dshot command queue , one per motor
+// pwm_set asks for a command frame at every motor update , so the commands go out at loop rate
+// between the throttle frames. Escs take commands only at zero throttle, a queued command
+// waits until the motor is stopped, then some stop frames, then the repeats of the command
+// and a delay for the esc before the next one
+
+#include "project.h"
+
+#include "config.h"
+#include "defines.h"
+#include "drv_time.h"
+#include "hardware.h"
+#include "dshot_command.h"
+
+#if defined(USE_DSHOT_DMA_DRIVER) || defined(USE_DSHOT_DRIVER_BETA)
+
+#ifndef DSHOT_COMMAND_QUEUE
+#define DSHOT_COMMAND_QUEUE 4
+#endif
+
+// stop frames before the first command , in uS
+#define DSHOT_COMMAND_STOP_DELAY 10000
+// after a command / a beep , the esc ignores commands while it beeps
+#define DSHOT_COMMAND_DELAY 1000
+#define DSHOT_BEEP_DELAY 250000
+
+typedef struct {
+	uint8_t command[ DSHOT_COMMAND_QUEUE ];
+	dshot_command_callback done[ DSHOT_COMMAND_QUEUE ];
+	uint8_t head;
+	uint8_t count;
+	uint8_t frames;				// frames of the head command still to send , 0 if not started
+	uint8_t stopped;			// motor at zero throttle since wait - DSHOT_COMMAND_STOP_DELAY
+	unsigned long wait;			// no command frame before this time
+} dshot_queue_t;
+
+static dshot_queue_t dshot_queue[ 4 ];
+
+// the settings commands need 6 frames in a row or more
+static int dshot_command_repeats( uint8_t command )
+{
+	switch ( command ) {
+		case DSHOT_CMD_SPIN_DIRECTION_1:
+		case DSHOT_CMD_SPIN_DIRECTION_2:
+		case DSHOT_CMD_3D_MODE_OFF:
+		case DSHOT_CMD_3D_MODE_ON:
+		case DSHOT_CMD_SAVE_SETTINGS:
+		case DSHOT_CMD_SPIN_DIRECTION_NORMAL:
+		case DSHOT_CMD_SPIN_DIRECTION_REVERSED:
+			return 10;
+		default:
+			return 1;
+	}
+}
+
+static unsigned long dshot_command_delay( uint8_t command )
+{
+	if ( command >= DSHOT_CMD_BEEP1 && command <= DSHOT_CMD_BEEP5 ) return DSHOT_BEEP_DELAY;
+	return DSHOT_COMMAND_DELAY;
+}
+
+int dshot_command( uint8_t motor , uint8_t command , dshot_command_callback done )
+{
+	if ( command == 0 || command > 47 ) return 0;
+
+	if ( motor == DSHOT_ALL_MOTORS ) {
+		// all or none , with the command and the space checked the 4 calls below can not fail
+		for ( int i = 0; i < 4; i++ ) {
+			if ( dshot_queue[ i ].count >= DSHOT_COMMAND_QUEUE ) return 0;
+		}
+		for ( uint8_t i = 0; i < 4; i++ ) {
+			dshot_command( i , command , done );
+		}
+		return 1;
+	}
+
+	if ( motor > 3 ) return 0;
+
+	dshot_queue_t * q = &dshot_queue[ motor ];
+	if ( q->count >= DSHOT_COMMAND_QUEUE ) return 0;
+
+	int tail = ( q->head + q->count ) % DSHOT_COMMAND_QUEUE;
+	q->command[ tail ] = command;
+	q->done[ tail ] = done;
+	q->count++;
+	return 1;
+}
+
+int dshot_command_busy( uint8_t motor )
+{
+	if ( motor == DSHOT_ALL_MOTORS ) {
+		return dshot_queue[ 0 ].count || dshot_queue[ 1 ].count || dshot_queue[ 2 ].count || dshot_queue[ 3 ].count;
+	}
+	if ( motor > 3 ) return 0;
+	return dshot_queue[ motor ].count;
+}
+
+uint8_t dshot_command_frame( uint8_t motor , uint16_t value )
+{
+	dshot_queue_t * q = &dshot_queue[ motor ];
+
+	if ( value ) {
+		// spinning , the commands wait
+		// a command cut off by the throttle starts again with all its repeats
+		q->stopped = 0;
+		q->frames = 0;
+		return 0;
+	}
+
+	unsigned long time = gettime();
+	if ( !q->stopped ) {
+		q->stopped = 1;
+		q->wait = time + DSHOT_COMMAND_STOP_DELAY;
+	}
+
+	if ( !q->count || (long)( time - q->wait ) < 0 ) return 0;
+
+	uint8_t command = q->command[ q->head ];
+	if ( !q->frames ) q->frames = dshot_command_repeats( command );
+
+	if ( --q->frames == 0 ) {
+		// last frame , the next command waits for the esc
+		dshot_command_callback done = q->done[ q->head ];
+		q->head = ( q->head + 1 ) % DSHOT_COMMAND_QUEUE;
+		q->count--;
+		q->wait = time + dshot_command_delay( command );
+		if ( done ) done( motor , command );
+	}
+
+	return command;
+}
+
+#ifdef INVERTED_DSHOT_COMMANDS
+// motor direction with the spin direction commands instead of the 3D throttle range
+// the escs take them only at zero throttle , pwmdir ( the mix ) changes when the escs have it
+extern int pwmdir;
+static int dshot_dir_wanted = FORWARD;
+static uint8_t dshot_dir_motors;
+
+static void dshot_dir_done( uint8_t motor , uint8_t command )
+{
+	int dir = command == DSHOT_CMD_SPIN_DIRECTION_REVERSED ? REVERSE : FORWARD;
+	// a switch back was queued since
+	if ( dir != dshot_dir_wanted ) return;
+
+	dshot_dir_motors |= 1 << motor;
+	if ( dshot_dir_motors == 0x0f ) pwmdir = dir;
+}
+
+void dshot_dir( int dir )
+{
+	if ( dir == dshot_dir_wanted ) return;
+
+	// queue full , again next loop
+	if ( !dshot_command( DSHOT_ALL_MOTORS , dir == REVERSE ? DSHOT_CMD_SPIN_DIRECTION_REVERSED : DSHOT_CMD_SPIN_DIRECTION_NORMAL , dshot_dir_done ) ) return;
+
+	dshot_dir_wanted = dir;
+	dshot_dir_motors = 0;
+}
+#endif
+
+#endif
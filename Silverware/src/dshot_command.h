@@ -0,0 +1,43 @@
+
+#include <inttypes.h>
+
+// dshot special commands , sent as throttle values 1 - 47 with the telemetry bit
+#define DSHOT_CMD_BEEP1 1
+#define DSHOT_CMD_BEEP2 2
+#define DSHOT_CMD_BEEP3 3
+#define DSHOT_CMD_BEEP4 4
+#define DSHOT_CMD_BEEP5 5 // 5 currently uses the same tone as 4 in BLHeli_S.
+#define DSHOT_CMD_ESC_INFO 6
+#define DSHOT_CMD_SPIN_DIRECTION_1 7
+#define DSHOT_CMD_SPIN_DIRECTION_2 8
+#define DSHOT_CMD_3D_MODE_OFF 9
+#define DSHOT_CMD_3D_MODE_ON 10
+#define DSHOT_CMD_SAVE_SETTINGS 12
+#define DSHOT_CMD_SPIN_DIRECTION_NORMAL 20
+#define DSHOT_CMD_SPIN_DIRECTION_REVERSED 21
+#define DSHOT_CMD_LED0_ON 22
+#define DSHOT_CMD_LED1_ON 23
+#define DSHOT_CMD_LED2_ON 24
+#define DSHOT_CMD_LED3_ON 25
+#define DSHOT_CMD_LED0_OFF 26
+#define DSHOT_CMD_LED1_OFF 27
+#define DSHOT_CMD_LED2_OFF 28
+#define DSHOT_CMD_LED3_OFF 29
+
+#define DSHOT_ALL_MOTORS 0xff
+
+// called from pwm_set with the last frame of the command , once per motor
+// a DSHOT_ALL_MOTORS command calls it for each of the 4 motors as its esc gets the command , in no fixed order
+typedef void (*dshot_command_callback)( uint8_t motor , uint8_t command );
+
+// queue a command for one motor ( 0 - 3 ) or DSHOT_ALL_MOTORS , never waits
+// it goes out once the motor is stopped , returns 0 if the queue is full or for a command other than 1 - 47
+int dshot_command( uint8_t motor , uint8_t command , dshot_command_callback done );
+// commands left in the queue of the motor , or of any motor , 0 for a motor other than 0 - 3
+int dshot_command_busy( uint8_t motor );
+
+// dshot drivers: the command to send instead of the throttle value , or 0
+uint8_t dshot_command_frame( uint8_t motor , uint16_t value );
+
+// INVERTED_DSHOT_COMMANDS: reverse the escs , pwmdir follows when all 4 have the command
+void dshot_dir( int dir );
@@ -0,0 +1,178 @@
+// dynamic gyro notch analysis
+// finds the strongest gyro noise peak per axis with a goertzel filter bank
+//
+// the gyro is decimated to 2kHz or less and cut into blocks of DYN_NOTCH_N samples ( hann window )
+// each block runs the goertzel recursion for DYN_NOTCH_BINS of the bins on all axes,
+// so the spectrum between GYRO_DYN_NOTCH_MIN_HZ and GYRO_DYN_NOTCH_MAX_HZ is refreshed
+// over a few blocks at a small fixed cost per loop and with no sample buffer
+// after each block the peak bin is interpolated and the notch centre follows it
+// the notch itself runs in filter.cpp
+
+#include "config.h"
+#include "defines.h"
+#include "fixed.h"
+
+#ifdef GYRO_DYN_NOTCH
+
+#ifndef GYRO_DYN_NOTCH_MIN_HZ
+#define GYRO_DYN_NOTCH_MIN_HZ 100
+#endif
+
+#ifndef GYRO_DYN_NOTCH_MAX_HZ
+#define GYRO_DYN_NOTCH_MAX_HZ 450
+#endif
+
+// block length, the window and coefficient tables are for 32
+#define DYN_NOTCH_N 32
+
+// bins run per block, 3 axes of 64 bit multiply accumulates each per sample
+#define DYN_NOTCH_BINS 4
+
+// peak to band average power ratio needed to move the notch
+#define DYN_NOTCH_THRESHOLD 3.0f
+
+// notch centre smoothing per block
+#define DYN_NOTCH_SMOOTH 0.5f
+
+#if GYRO_LOOPTIME < 500
+#define DYN_NOTCH_DECIMATE ( 500 / GYRO_LOOPTIME )
+#else
+#define DYN_NOTCH_DECIMATE 1
+#endif
+
+// analysis sample rate, bin k is at k * DYN_NOTCH_FS_HZ / DYN_NOTCH_N
+#define DYN_NOTCH_FS_HZ ( 1000000 / ( GYRO_LOOPTIME * DYN_NOTCH_DECIMATE ) )
+
+// bins 0 and 1 see the leakage of the flight movement through the window
+#if ( GYRO_DYN_NOTCH_MIN_HZ * DYN_NOTCH_N + DYN_NOTCH_FS_HZ / 2 ) / DYN_NOTCH_FS_HZ < 2
+#define DYN_NOTCH_KMIN 2
+#else
+#define DYN_NOTCH_KMIN ( ( GYRO_DYN_NOTCH_MIN_HZ * DYN_NOTCH_N + DYN_NOTCH_FS_HZ / 2 ) / DYN_NOTCH_FS_HZ )
+#endif
+
+#if ( GYRO_DYN_NOTCH_MAX_HZ * DYN_NOTCH_N + DYN_NOTCH_FS_HZ / 2 ) / DYN_NOTCH_FS_HZ > DYN_NOTCH_N / 2 - 1
+#define DYN_NOTCH_KMAX ( DYN_NOTCH_N / 2 - 1 )
+#else
+#define DYN_NOTCH_KMAX ( ( GYRO_DYN_NOTCH_MAX_HZ * DYN_NOTCH_N + DYN_NOTCH_FS_HZ / 2 ) / DYN_NOTCH_FS_HZ )
+#endif
+
+#define DYN_NOTCH_K ( DYN_NOTCH_KMAX - DYN_NOTCH_KMIN + 1 )
+
+#if DYN_NOTCH_K < 3
+#error "GYRO_DYN_NOTCH_MIN_HZ to GYRO_DYN_NOTCH_MAX_HZ is too narrow"
+#endif
+
+// 2 cos( 2 pi k / N ) in Q16
+static const int32_t goertzel_coeff[ DYN_NOTCH_N / 2 + 1 ] =
+{
+	131072 , 128553 , 121095 , 108982 , 92682 , 72820 , 50159 , 25571 , 0 ,
+	-25571 , -50159 , -72820 , -92682 , -108982 , -121095 , -128553 , -131072
+};
+
+// first half of the periodic hann window in Q16, the second half is the mirror image
+static const int32_t hann_window[ DYN_NOTCH_N / 2 + 1 ] =
+{
+	0 , 630 , 2494 , 5522 , 9598 , 14563 , 20228 , 26375 , 32768 ,
+	39161 , 45308 , 50973 , 55938 , 60014 , 63042 , 64906 , 65536
+};
+
+// notch centres in Hz, 0 until a peak was found
+float dyn_notch_hz[3];
+
+static int32_t goertzel_s1[3][DYN_NOTCH_BINS];
+static int32_t goertzel_s2[3][DYN_NOTCH_BINS];
+static float bin_power[3][DYN_NOTCH_K];
+
+static int32_t decimate_sum[3];
+static int decimate_count;
+static int block_count;
+static int first_bin;
+
+// returns a bit per axis whose notch centre was updated
+static int dyn_notch_peak( void)
+{
+	int updated = 0;
+
+	for ( int a = 0 ; a < 3 ; a++)
+	{
+		float *power = bin_power[a];
+		float sum = 0;
+		int peak = 0;
+
+		for ( int k = 0 ; k < DYN_NOTCH_K ; k++)
+		{
+			sum += power[k];
+			if ( power[k] > power[peak] ) peak = k;
+		}
+
+		if ( power[peak] * DYN_NOTCH_K <= sum * DYN_NOTCH_THRESHOLD ) continue;
+
+		// parabola through the peak and its neighbours
+		float offset = 0;
+		if ( peak > 0 && peak < DYN_NOTCH_K - 1 )
+		{
+			float d = power[peak - 1] - 2.0f * power[peak] + power[peak + 1];
+			if ( d < 0 ) offset = 0.5f * ( power[peak - 1] - power[peak + 1] ) / d;
+		}
+
+		float hz = ( DYN_NOTCH_KMIN + peak + offset ) * ( (float) DYN_NOTCH_FS_HZ / DYN_NOTCH_N );
+		if ( hz < GYRO_DYN_NOTCH_MIN_HZ ) hz = GYRO_DYN_NOTCH_MIN_HZ;
+		if ( hz > GYRO_DYN_NOTCH_MAX_HZ ) hz = GYRO_DYN_NOTCH_MAX_HZ;
+
+		if ( dyn_notch_hz[a] == 0 ) dyn_notch_hz[a] = hz;
+		else dyn_notch_hz[a] += ( hz - dyn_notch_hz[a] ) * DYN_NOTCH_SMOOTH;
+
+		updated |= 1 << a;
+	}
+	return updated;
+}
+
+// gyro in Q16 rad/s, every gyro loop before the notch
+int dyn_notch_update( const int32_t *gyro )
+{
+	for ( int a = 0 ; a < 3 ; a++) decimate_sum[a] += gyro[a];
+	if ( ++decimate_count < DYN_NOTCH_DECIMATE ) return 0;
+	decimate_count = 0;
+
+	int bins = DYN_NOTCH_K - first_bin;
+	if ( bins > DYN_NOTCH_BINS ) bins = DYN_NOTCH_BINS;
+
+	int32_t w = hann_window[ block_count <= DYN_NOTCH_N / 2 ? block_count : DYN_NOTCH_N - block_count ];
+	const int32_t *coeff = &goertzel_coeff[ DYN_NOTCH_KMIN + first_bin ];
+
+	for ( int a = 0 ; a < 3 ; a++)
+	{
+		int32_t x = fixed_mul( decimate_sum[a] / DYN_NOTCH_DECIMATE , w );
+		decimate_sum[a] = 0;
+
+		for ( int b = 0 ; b < bins ; b++)
+		{
+			int32_t s = x + fixed_mul( coeff[b] , goertzel_s1[a][b] ) - goertzel_s2[a][b];
+			goertzel_s2[a][b] = goertzel_s1[a][b];
+			goertzel_s1[a][b] = s;
+		}
+	}
+
+	if ( ++block_count < DYN_NOTCH_N ) return 0;
+	block_count = 0;
+
+	// end of block, power of this group of bins
+	for ( int a = 0 ; a < 3 ; a++)
+	{
+		for ( int b = 0 ; b < bins ; b++)
+		{
+			float s1 = FIXED_TO_FLOAT( goertzel_s1[a][b] );
+			float s2 = FIXED_TO_FLOAT( goertzel_s2[a][b] );
+			bin_power[a][first_bin + b] = s1 * s1 + s2 * s2 - FIXED_TO_FLOAT( coeff[b] ) * s1 * s2;
+			goertzel_s1[a][b] = 0;
+			goertzel_s2[a][b] = 0;
+		}
+	}
+
+	first_bin += bins;
+	if ( first_bin >= DYN_NOTCH_K ) first_bin = 0;
+
+	return dyn_notch_peak();
+}
+
+#endif
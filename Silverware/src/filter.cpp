@@ -1,265 +1,259 @@
 
 #include "config.h"
 #include "defines.h"
+#include "filters.h"
 
+// filter instances for the c code, built from the filters.h templates
+// each wrapper filters all axes / motors of an array in one call
 
 
-#ifndef GYRO_FILTER_PASS1
-  #define SOFT_LPF1_NONE
+// gyro filters run every gyro loop
+
+#if defined PT1_GYRO && defined GYRO_FILTER_PASS1
+FILTER_PT1_HZ( gyro_pass1_coeff , GYRO_FILTER_PASS1 , GYRO_LOOPTIME );
+#define GYRO_PASS1_FILTER filter_pt1
+#define GYRO_PASS1_FILTER_Q filter_pt1_q
 #endif
 
-#ifndef GYRO_FILTER_PASS2
-  #define SOFT_LPF2_NONE
+#if defined PT1_GYRO && defined GYRO_FILTER_PASS2
+FILTER_PT1_HZ( gyro_pass2_coeff , GYRO_FILTER_PASS2 , GYRO_LOOPTIME );
+#define GYRO_PASS2_FILTER filter_pt1
+#define GYRO_PASS2_FILTER_Q filter_pt1_q
 #endif
 
+#if defined KALMAN_GYRO && defined GYRO_FILTER_PASS1
+FILTER_KALMAN( gyro_pass1_coeff , 0.02f , 0.02f / (float) GYRO_FILTER_PASS1 );
+#define GYRO_PASS1_FILTER filter_kalman
+#define GYRO_PASS1_FILTER_Q filter_kalman_q
+#endif
 
-#if defined PT1_GYRO && defined GYRO_FILTER_PASS1
-	#define SOFT_LPF_1ST_PASS1 GYRO_FILTER_PASS1
-extern "C" float lpfcalc( float sampleperiod , float filtertime);
-extern "C" float lpfcalc_hz(float sampleperiod, float filterhz);
-extern "C" void lpf( float *out, float in , float coeff);
+#if defined KALMAN_GYRO && defined GYRO_FILTER_PASS2
+FILTER_KALMAN( gyro_pass2_coeff , 0.02f , 0.02f / (float) GYRO_FILTER_PASS2 );
+#define GYRO_PASS2_FILTER filter_kalman
+#define GYRO_PASS2_FILTER_Q filter_kalman_q
+#endif
 
-static float alpha = 0.5;
-extern float looptime;
+#ifdef GYRO_DYN_NOTCH
+// centre from the goertzel bank in dyn_notch.c
+extern "C" int dyn_notch_update( const int32_t *gyro );
+extern "C" float dyn_notch_hz[3];
 
-void lpf_coeff()
-{
- alpha = FILTERCALC( looptime , (1.0f/SOFT_LPF_1ST_PASS1) );       
-}
+#ifndef GYRO_DYN_NOTCH_Q
+#define GYRO_DYN_NOTCH_Q 3
+#endif
+#endif
+
+#ifdef RPM_FILTER
+// notches on the motor frequencies from the dshot telemetry, one per motor and harmonic
+extern "C" uint16_t dshot_erpm[4];
+
+#define RPM_NOTCHES ( 4 * RPM_FILTER_HARMONICS )
+
+#define RPM_NOTCH_MAX_HZ ( 0.45e6f / GYRO_LOOPTIME )
 
+static int rpm_notch_next;
 
-class  filter_lpf1
+// one notch centre per loop, all of them would be too much soft float sin / cos
+template < class F > static void rpm_notch_update( F *notch )
 {
-    private:
-		float lpf_last;
-    public:
-        filter_lpf1()
-    {
-      lpf_last = 0;   
-    }
-     float step( float in)
-     {
-       lpf ( &lpf_last , in , alpha); 
-         
-       return lpf_last;
-     }
-};
+	float hz = dshot_erpm[ rpm_notch_next & 3 ] * ERPM_TO_HZ * ( rpm_notch_next / 4 + 1 );
 
-filter_lpf1 filter[3];
+	// held below nyquist, a bypass there would switch on and off around the limit
+	if ( hz > RPM_NOTCH_MAX_HZ ) hz = RPM_NOTCH_MAX_HZ;
+
+	if ( hz < RPM_FILTER_MIN_HZ ) notch[rpm_notch_next].bypass();
+	else notch[rpm_notch_next].set( hz , RPM_FILTER_Q , GYRO_LOOPTIME );
+
+	if ( ++rpm_notch_next >= RPM_NOTCHES ) rpm_notch_next = 0;
+}
 #endif
 
+#ifndef FIXED_POINT
 
+#ifdef RPM_FILTER
+filter_notch_shared < 3 > rpm_notch[ RPM_NOTCHES ];
+#endif
 
-#if defined PT1_GYRO && defined GYRO_FILTER_PASS2
-	#define SOFT_LPF_1ST_PASS2 GYRO_FILTER_PASS2
-extern "C" float lpfcalc( float sampleperiod , float filtertime);
-extern "C" float lpfcalc_hz(float sampleperiod, float filterhz);
-extern "C" void lpf( float *out, float in , float coeff);
+#ifdef GYRO_DYN_NOTCH
+filter_notch_dyn < 3 > gyro_notch;
+#endif
 
-static float alpha2 = 0.5;
-extern float looptime;
+#ifdef GYRO_PASS1_FILTER
+GYRO_PASS1_FILTER < 3 , gyro_pass1_coeff > gyro_pass1;
+#endif
+
+#ifdef GYRO_PASS2_FILTER
+GYRO_PASS2_FILTER < 3 , gyro_pass2_coeff > gyro_pass2;
+#endif
 
-void lpf_coeff_pass2()
+extern "C" RAMFUNC void gyro_filter( float *gyro )
 {
- alpha2 = FILTERCALC( looptime , (1.0f/SOFT_LPF_1ST_PASS2) );       
+#ifdef RPM_FILTER
+	rpm_notch_update( rpm_notch );
+	for ( int i = 0 ; i < RPM_NOTCHES ; i++ ) rpm_notch[i].step( gyro );
+#endif
+#ifdef GYRO_DYN_NOTCH
+	// the analysis sees the gyro before the notch
+	int32_t sample[3];
+	for ( int i = 0 ; i < 3 ; i++ ) sample[i] = FLOAT_TO_FIXED( gyro[i] );
+	int updated = dyn_notch_update( sample );
+	for ( int i = 0 ; i < 3 ; i++ )
+		if ( updated & ( 1 << i ) ) gyro_notch.set( i , dyn_notch_hz[i] , GYRO_DYN_NOTCH_Q , GYRO_LOOPTIME );
+	gyro_notch.step( gyro );
+#endif
+#ifdef GYRO_PASS1_FILTER
+	gyro_pass1.step( gyro );
+#endif
+#ifdef GYRO_PASS2_FILTER
+	gyro_pass2.step( gyro );
+#endif
 }
 
+#else
 
-class  filter_lpf2
-{
-    private:
-		float lpf_last;
-    public:
-        filter_lpf2()
-    
-{
-      lpf_last = 0;   
-    }
-     float step( float in)
-     {
-       lpf ( &lpf_last , in , alpha2); 
-
-       return lpf_last;
-     }
-};
+// fixed point gyro filters for the FIXED_POINT control path, Q16 in and out
 
-filter_lpf2 filter2[3];
+#ifdef RPM_FILTER
+filter_notch_shared_q < 3 > rpm_notch_q[ RPM_NOTCHES ];
 #endif
 
+#ifdef GYRO_DYN_NOTCH
+filter_notch_dyn_q < 3 > gyro_notch_q;
+#endif
 
+#ifdef GYRO_PASS1_FILTER
+GYRO_PASS1_FILTER_Q < 3 , gyro_pass1_coeff > gyro_pass1_q;
+#endif
 
-#if defined KALMAN_GYRO && defined GYRO_FILTER_PASS1
- #define SOFT_KALMAN_GYRO_PASS1 GYRO_FILTER_PASS1
-class  filter_kalman
-{
-    private:
-        float x_est_last ;
-        float P_last ; 
-        float Q;
-        float R;
-    public:
-        filter_kalman()
-        {
-            Q = 0.02; 
-            R = 0.1;
-
-            #ifdef SOFT_KALMAN_GYRO_PASS1
-            R = Q/(float)SOFT_KALMAN_GYRO_PASS1;
-            #endif
-        }
-        float  step( float in )   
-        {    
-
-            //do a prediction 
-            float x_temp_est = x_est_last; 
-            float P_temp = P_last + Q; 
-
-            float K = P_temp * (1.0f/(P_temp + R));
-            float x_est = x_temp_est + K * (in - x_temp_est);  
-            float P = (1- K) * P_temp; 
-           
-            //update our last's 
-            P_last= P; 
-            x_est_last = x_est; 
-
-            return x_est;
-        }
-};       
-filter_kalman filter[3];       
+#ifdef GYRO_PASS2_FILTER
+GYRO_PASS2_FILTER_Q < 3 , gyro_pass2_coeff > gyro_pass2_q;
 #endif
 
-#if defined KALMAN_GYRO && defined GYRO_FILTER_PASS2
-	#define SOFT_KALMAN_GYRO_PASS2 GYRO_FILTER_PASS2
-class  filter_kalman2
+extern "C" RAMFUNC void gyro_filter_q( int32_t *gyro )
 {
-    private:
-        float x_est_last ;
-        float P_last ; 
-        float Q;
-        float R;
-    public:
-        filter_kalman2()
-        {
-            Q = 0.02; 
-            R = 0.1;
+#ifdef RPM_FILTER
+	rpm_notch_update( rpm_notch_q );
+	for ( int i = 0 ; i < RPM_NOTCHES ; i++ ) rpm_notch_q[i].step( gyro );
+#endif
+#ifdef GYRO_DYN_NOTCH
+	int updated = dyn_notch_update( gyro );
+	for ( int i = 0 ; i < 3 ; i++ )
+		if ( updated & ( 1 << i ) ) gyro_notch_q.set( i , dyn_notch_hz[i] , GYRO_DYN_NOTCH_Q , GYRO_LOOPTIME );
+	gyro_notch_q.step( gyro );
+#endif
+#ifdef GYRO_PASS1_FILTER
+	gyro_pass1_q.step( gyro );
+#endif
+#ifdef GYRO_PASS2_FILTER
+	gyro_pass2_q.step( gyro );
+#endif
+}
 
-						#ifdef SOFT_KALMAN_GYRO_PASS2
-					  R = Q/(float)SOFT_KALMAN_GYRO_PASS2;
-            #endif
-        }
-        float  step( float in )   
-        {    
+#endif
 
-            //do a prediction 
-            float x_temp_est = x_est_last; 
-            float P_temp = P_last + Q; 
 
-            float K = P_temp * (1.0f/(P_temp + R));
-            float x_est = x_temp_est + K * (in - x_temp_est);  
-            float P = (1- K) * P_temp; 
+// d term filters, per axis
 
-            //update our last's 
-            P_last= P; 
-            x_est_last = x_est; 
+#ifdef DTERM_LPF_1ST_HZ
+FILTER_PT1_HZ( dterm_lpf1_coeff , DTERM_LPF_1ST_HZ , LOOPTIME );
+filter_pt1 < 3 , dterm_lpf1_coeff > dterm_lpf1;
 
-            return x_est;
-        }
-};       
-filter_kalman2 filter2[3];       
+extern "C" float lpf1( float in , int num )
+{
+	return dterm_lpf1.step( in , num );
+}
 #endif
 
+#ifdef DTERM_LPF_2ND_HZ
+FILTER_PT1_HZ( dterm_lpf2_coeff , DTERM_LPF_2ND_HZ , LOOPTIME );
 
+#ifndef FIXED_POINT
+filter_pt2 < 3 , dterm_lpf2_coeff > dterm_lpf2;
 
-extern "C" float lpffilter( float in,int num )
+extern "C" float lpf2( float in , int num )
 {
-#ifdef SOFT_LPF1_NONE
-	return in;
-	#else
-    
-   #ifdef SOFT_LPF_1ST_PASS1
-    if ( num == 0 ) lpf_coeff();
-    #endif
-    
-	      return filter[num].step(in );   
-	      #endif
-	
+	return dterm_lpf2.step( in , num );
 }
+#else
+filter_pt2_q < 3 , dterm_lpf2_coeff > dterm_lpf2_q;
 
-
- extern "C" float lpffilter2( float in,int num )
+extern "C" int32_t lpf2_q( int32_t in , int num )
 {
-	#ifdef SOFT_LPF2_NONE
-	return in;
-	#else
+	return dterm_lpf2_q.step( in , num );
+}
+#endif
+#endif
 
-    #ifdef SOFT_LPF_1ST_PASS2
-    if ( num == 0 ) lpf_coeff_pass2();
-    #endif
 
-	return filter2[num].step(in );   
-	#endif
+// motor filters, in the order the mixer used to call them
 
-} 
+#ifdef MOTOR_FILTER
+filter_hann < 4 > motor_hann;
+#endif
 
-// 16Hz hpf filter for throttle compensation
-//High pass bessel filter order=1 alpha1=0.016 
-class  FilterBeHp1
-{
-	public:
-		FilterBeHp1()
-		{
-			v[0]=0.0;
-		}
-	private:
-		float v[2];
-	public:
-		float step(float x) //class II 
-		{
-			v[0] = v[1];
-			v[1] = (9.521017968695103528e-1f * x)
-				 + (0.90420359373902081668f * v[0]);
-			return 
-				 (v[1] - v[0]);
-		}
-};
-
-FilterBeHp1 throttlehpf1;
+#ifdef MOTOR_FILTER2_ALPHA
+FILTER_PT1( motor_lpf_coeff , 1 - MOTOR_FILTER2_ALPHA );
+#ifdef MOTOR_FILTER2_FIXED
+filter_pt1_q < 4 , motor_lpf_coeff > motor_lpf_q;
+#else
+filter_pt1 < 4 , motor_lpf_coeff > motor_lpf;
+#endif
+#endif
 
-extern "C" float throttlehpf( float in )
+#ifdef MOTOR_KAL_2ND
+FILTER_KALMAN( motor_kal_coeff , 0.02f , 0.02f / (float) MOTOR_KAL_2ND );
+filter_kalman_2nd < 4 , motor_kal_coeff > motor_kal;
+#elif defined MOTOR_KAL
+FILTER_KALMAN( motor_kal_coeff , 0.02f , 0.02f / (float) MOTOR_KAL );
+filter_kalman < 4 , motor_kal_coeff > motor_kal;
+#endif
+
+extern "C" RAMFUNC void motor_filter( float *mix )
 {
-	return throttlehpf1.step(in );
+#ifdef MOTOR_FILTER
+	motor_hann.step( mix );
+#endif
+#if defined MOTOR_FILTER2_ALPHA && !defined MOTOR_FILTER2_FIXED
+	motor_lpf.step( mix );
+#endif
+#if defined MOTOR_KAL || defined MOTOR_KAL_2ND
+	motor_kal.step( mix );
+#endif
 }
 
- 
-// for TRANSIENT_WINDUP_PROTECTION feature
-//Low pass bessel filter order=1 alpha1=0.023
-class  FilterSP
+// motors off
+extern "C" void motor_filter_reset( void )
 {
-	public:
-		FilterSP()
-		{
-			v[0]=0.0;
-		}
-	private:
-		float v[2];
-	public:
-		float step(float x) //class II
-		{
-			v[0] = v[1];
-			v[1] = (6.749703162983405891e-2f * x)
-				 + (0.86500593674033188218f * v[0]);
-			return
-				 (v[0] + v[1]);
-		}
-};
-
-FilterSP spfilter[3];
-
-extern "C" float splpf( float in,int num )
+#ifdef MOTOR_FILTER
+	motor_hann.reset();
+#endif
+}
+
+#ifdef MOTOR_FILTER2_FIXED
+extern "C" RAMFUNC void motor_filter_q( int32_t *mix )
 {
+	motor_lpf_q.step( mix );
+}
+#endif
 
-	return spfilter[num].step(in );
+
+// 16Hz hpf filter for throttle compensation
+FILTER_BILINEAR( throttle_hpf_coeff , 16 , LOOPTIME );
+filter_bilinear_hpf < 1 , throttle_hpf_coeff > throttle_hpf;
+
+extern "C" float throttlehpf( float in )
+{
+	return throttle_hpf.step( in , 0 );
 }
 
 
+// for TRANSIENT_WINDUP_PROTECTION feature
+// 11.5Hz, pid.c runs it every 2nd loop
+FILTER_BILINEAR( sp_lpf_coeff , 11.5f , 2 * LOOPTIME );
+filter_bilinear_lpf < 3 , sp_lpf_coeff > sp_lpf;
+
+extern "C" float splpf( float in , int num )
+{
+	return sp_lpf.step( in , num );
+}
 
@@ -0,0 +1,556 @@
+
+// compile time filter library, c++ header for filter.cpp ( the c code uses the wrappers there )
+//
+// coefficients live in coefficient classes made with the FILTER_xxx macros below,
+// they are inline functions of compile time constants so the compiler folds them
+// to literals like FILTERCALC, they take no ram and no run time math
+// ( functions in place of constexpr, armcc builds c++ as c++03 )
+//
+// a filter is a template on the channel count and the coefficient class,
+// the state is kept as structure of arrays ( one array per state variable, indexed by channel )
+// step( data ) filters all channels of an array in place in one loop,
+// step( in , i ) filters one channel
+
+#include <inttypes.h>
+#include "defines.h"
+#include "fixed.h"
+
+#define FILTER_PI 3.14159265f
+
+// series sin / cos for the coefficient classes, good to 1e-7 for |x| <= pi/2
+static inline float filter_sin( float x )
+{
+	float x2 = x * x;
+	return x * ( 1.0f - x2 / 6.0f * ( 1.0f - x2 / 20.0f * ( 1.0f - x2 / 42.0f * ( 1.0f - x2 / 72.0f * ( 1.0f - x2 / 110.0f ) ) ) ) );
+}
+
+static inline float filter_cos( float x )
+{
+	float x2 = x * x;
+	return 1.0f - x2 / 2.0f * ( 1.0f - x2 / 12.0f * ( 1.0f - x2 / 30.0f * ( 1.0f - x2 / 56.0f * ( 1.0f - x2 / 90.0f * ( 1.0f - x2 / 132.0f ) ) ) ) );
+}
+
+
+// coefficient classes
+
+// 1st order lpf in the lpf() form, alpha is the weight of the last output
+#define FILTER_PT1( name , a ) \
+	struct name { static float alpha() { return (a); } }
+
+// same from a cutoff in Hz and the sample time in uS
+#define FILTER_PT1_HZ( name , hz , us ) \
+	FILTER_PT1( name , FILTERCALC( (us) * 1e-6f , 1.0f / (hz) ) )
+
+// kalman with process noise q and measurement noise r
+#define FILTER_KALMAN( name , q , r ) \
+	struct name { static float Q() { return (q); } static float R() { return (r); } }
+
+// 1st order bilinear ( bessel ) lpf / hpf from a cutoff in Hz and the sample time in uS
+// t is tan( pi * fc / fs ), through the half angle sin / cos
+#define FILTER_BILINEAR( name , hz , us ) \
+	struct name { static float t() \
+		{ return filter_sin( FILTER_PI * (hz) * (us) * 1e-6f ) / filter_cos( FILTER_PI * (hz) * (us) * 1e-6f ); } }
+
+// biquads, rbj cookbook, normalised to a0 = 1
+// s and c are sin and cos of half the angular frequency w0 = 2 pi fc / fs
+#define FILTER_BIQUAD_BODY( hz , q , us ) \
+	static float s() { return filter_sin( FILTER_PI * (hz) * (us) * 1e-6f ); } \
+	static float c() { return filter_cos( FILTER_PI * (hz) * (us) * 1e-6f ); } \
+	static float cosw() { return 1.0f - 2.0f * s() * s(); } \
+	static float alpha() { return s() * c() / (q); } \
+	static float a0() { return 1.0f + alpha(); } \
+	static float a1() { return -2.0f * cosw() / a0(); } \
+	static float a2() { return ( 1.0f - alpha() ) / a0(); }
+
+#define FILTER_BIQUAD_LPF( name , hz , q , us ) \
+	struct name { FILTER_BIQUAD_BODY( hz , q , us ) \
+		static float b0() { return ( 1.0f - cosw() ) * 0.5f / a0(); } \
+		static float b1() { return ( 1.0f - cosw() ) / a0(); } \
+		static float b2() { return b0(); } }
+
+#define FILTER_BIQUAD_NOTCH( name , hz , q , us ) \
+	struct name { FILTER_BIQUAD_BODY( hz , q , us ) \
+		static float b0() { return 1.0f / a0(); } \
+		static float b1() { return a1(); } \
+		static float b2() { return b0(); } }
+
+
+// float filters
+
+// 1st order lpf
+template < int N , class C > class filter_pt1
+{
+	private:
+		float last[N];
+	public:
+		filter_pt1()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			last[i] = last[i] * C::alpha() + in * ( 1 - C::alpha() );
+			return last[i];
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// 2 cascaded 1st order lpfs with the same cutoff, as one 2nd order section
+template < int N , class C > class filter_pt2
+{
+	private:
+		float last[N];
+		float last2[N];
+	public:
+		filter_pt2()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = last2[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			float ans = in * ( ( 1 - C::alpha() ) * ( 1 - C::alpha() ) ) + ( 2 * C::alpha() ) * last[i]
+				- ( C::alpha() * C::alpha() ) * last2[i];
+			last2[i] = last[i];
+			last[i] = ans;
+			return ans;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// kalman lpf, the gain does not depend on the samples so one covariance is shared by all channels
+// it only steps with the whole array
+template < int N , class C > class filter_kalman
+{
+	private:
+		float x_est_last[N];
+		float P_last;
+	public:
+		filter_kalman()
+		{
+			for ( int i = 0 ; i < N ; i++ ) x_est_last[i] = 0;
+			P_last = 0;
+		}
+		float gain()
+		{
+			float P_temp = P_last + C::Q();
+			float K = P_temp * ( 1.0f / ( P_temp + C::R() ) );
+			P_last = ( 1 - K ) * P_temp;
+			return K;
+		}
+		void step( float *data )
+		{
+			float K = gain();
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				x_est_last[i] = x_est_last[i] + K * ( data[i] - x_est_last[i] );
+				data[i] = x_est_last[i];
+			}
+		}
+};
+
+// 2 kalman stages in series sharing the gain
+template < int N , class C > class filter_kalman_2nd
+{
+	private:
+		float x_est_last[N];
+		float x_est_last2[N];
+		float P_last;
+	public:
+		filter_kalman_2nd()
+		{
+			for ( int i = 0 ; i < N ; i++ ) x_est_last[i] = x_est_last2[i] = 0;
+			P_last = 0;
+		}
+		void step( float *data )
+		{
+			float P_temp = P_last + C::Q();
+			float K = P_temp / ( P_temp + C::R() );
+			float oneminusK = 1.0f - K;
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				x_est_last[i] = oneminusK * x_est_last[i] + K * data[i];
+				data[i] = x_est_last2[i] = oneminusK * x_est_last2[i] + K * x_est_last[i];
+			}
+			P_last = oneminusK * P_temp;
+		}
+};
+
+// hanning 3 sample filter
+template < int N > class filter_hann
+{
+	private:
+		float last[N];
+		float last2[N];
+	public:
+		filter_hann()
+		{
+			reset();
+		}
+		void reset()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = last2[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			float ans = in * 0.25f + last[i] * 0.5f + last2[i] * 0.25f;
+			last2[i] = last[i];
+			last[i] = in;
+			return ans;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// moving average of the last LEN samples
+template < int N , int LEN > class filter_average
+{
+	private:
+		float buffer[LEN][N];
+		float sum[N];
+		int index;
+	public:
+		filter_average()
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				sum[i] = 0;
+				for ( int j = 0 ; j < LEN ; j++ ) buffer[j][i] = 0;
+			}
+			index = 0;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				sum[i] += data[i] - buffer[index][i];
+				buffer[index][i] = data[i];
+				data[i] = sum[i] * ( 1.0f / LEN );
+			}
+			if ( ++index >= LEN ) index = 0;
+		}
+};
+
+// biquad, transposed direct form 2
+template < int N , class C > class filter_biquad
+{
+	private:
+		float s1[N];
+		float s2[N];
+	public:
+		filter_biquad()
+		{
+			for ( int i = 0 ; i < N ; i++ ) s1[i] = s2[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			float out = C::b0() * in + s1[i];
+			s1[i] = C::b1() * in - C::a1() * out + s2[i];
+			s2[i] = C::b2() * in - C::a2() * out;
+			return out;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// notch coefficients for a centre set at run time, same as FILTER_BIQUAD_NOTCH
+static inline void filter_notch_coeff( float hz , float q , float us , float *b0 , float *a1 , float *a2 )
+{
+	float s = filter_sin( FILTER_PI * hz * us * 1e-6f );
+	float c = filter_cos( FILTER_PI * hz * us * 1e-6f );
+	float alpha = s * c / q;
+	float a0inv = 1.0f / ( 1.0f + alpha );
+	*b0 = a0inv;
+	*a1 = -2.0f * ( 1.0f - 2.0f * s * s ) * a0inv;
+	*a2 = ( 1.0f - alpha ) * a0inv;
+}
+
+// biquad notch with the centre set at run time ( b1 = a1 , b2 = b0 )
+// it passes the signal unchanged until the first set(), b0 = a2 = 1 with zero state
+// is the infinite Q notch, its output is exactly the input
+template < int N > class filter_notch_dyn
+{
+	private:
+		float b0[N];
+		float a1[N];
+		float a2[N];
+		float s1[N];
+		float s2[N];
+	public:
+		filter_notch_dyn()
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				b0[i] = a2[i] = 1;
+				a1[i] = s1[i] = s2[i] = 0;
+			}
+		}
+		void set( int i , float hz , float q , float us )
+		{
+			filter_notch_coeff( hz , q , us , &b0[i] , &a1[i] , &a2[i] );
+		}
+		float step( float in , int i )
+		{
+			float out = b0[i] * in + s1[i];
+			s1[i] = a1[i] * ( in - out ) + s2[i];
+			s2[i] = b0[i] * in - a2[i] * out;
+			return out;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// biquad notch with one run time centre for all channels, for the rpm filter bank
+// bypass() sets the infinite Q notch with zero state, which passes the signal unchanged
+template < int N > class filter_notch_shared
+{
+	private:
+		float b0;
+		float a1;
+		float a2;
+		float s1[N];
+		float s2[N];
+	public:
+		filter_notch_shared()
+		{
+			bypass();
+		}
+		void bypass()
+		{
+			b0 = a2 = 1;
+			a1 = 0;
+			for ( int i = 0 ; i < N ; i++ ) s1[i] = s2[i] = 0;
+		}
+		void set( float hz , float q , float us )
+		{
+			filter_notch_coeff( hz , q , us , &b0 , &a1 , &a2 );
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				float out = b0 * data[i] + s1[i];
+				s1[i] = a1 * ( data[i] - out ) + s2[i];
+				s2[i] = b0 * data[i] - a2 * out;
+				data[i] = out;
+			}
+		}
+};
+
+// 1st order bilinear lpf
+template < int N , class C > class filter_bilinear_lpf
+{
+	private:
+		float last[N];
+	public:
+		filter_bilinear_lpf()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			float v = ( C::t() / ( 1.0f + C::t() ) ) * in + ( ( 1.0f - C::t() ) / ( 1.0f + C::t() ) ) * last[i];
+			float ans = last[i] + v;
+			last[i] = v;
+			return ans;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+// 1st order bilinear hpf
+template < int N , class C > class filter_bilinear_hpf
+{
+	private:
+		float last[N];
+	public:
+		filter_bilinear_hpf()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = 0;
+		}
+		float step( float in , int i )
+		{
+			float v = ( 1.0f / ( 1.0f + C::t() ) ) * in + ( ( 1.0f - C::t() ) / ( 1.0f + C::t() ) ) * last[i];
+			float ans = v - last[i];
+			last[i] = v;
+			return ans;
+		}
+		void step( float *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+
+// fixed point filters, Q16 in and out, same coefficient classes
+
+template < int N , class C > class filter_pt1_q
+{
+	private:
+		int32_t last[N];
+	public:
+		filter_pt1_q()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = 0;
+		}
+		int32_t step( int32_t in , int i )
+		{
+			last[i] += fixed_mul( FIXED_ONE - FIXED( C::alpha() ) , in - last[i] );
+			return last[i];
+		}
+		void step( int32_t *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+template < int N , class C > class filter_pt2_q
+{
+	private:
+		int32_t last[N];
+		int32_t last2[N];
+	public:
+		filter_pt2_q()
+		{
+			for ( int i = 0 ; i < N ; i++ ) last[i] = last2[i] = 0;
+		}
+		int32_t step( int32_t in , int i )
+		{
+			int32_t ans = fixed_mul( in , FIXED( ( 1 - C::alpha() ) * ( 1 - C::alpha() ) ) )
+				+ fixed_mul( FIXED( 2 * C::alpha() ) , last[i] )
+				- fixed_mul( FIXED( C::alpha() * C::alpha() ) , last2[i] );
+			last2[i] = last[i];
+			last[i] = ans;
+			return ans;
+		}
+		void step( int32_t *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+template < int N > class filter_notch_dyn_q
+{
+	private:
+		int32_t b0[N];
+		int32_t a1[N];
+		int32_t a2[N];
+		int32_t s1[N];
+		int32_t s2[N];
+	public:
+		filter_notch_dyn_q()
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				b0[i] = a2[i] = FIXED_ONE;
+				a1[i] = s1[i] = s2[i] = 0;
+			}
+		}
+		void set( int i , float hz , float q , float us )
+		{
+			float fb0 , fa1 , fa2;
+			filter_notch_coeff( hz , q , us , &fb0 , &fa1 , &fa2 );
+			b0[i] = FIXED( fb0 );
+			a1[i] = FIXED( fa1 );
+			a2[i] = FIXED( fa2 );
+		}
+		int32_t step( int32_t in , int i )
+		{
+			int32_t out = fixed_mul( b0[i] , in ) + s1[i];
+			s1[i] = fixed_mul( a1[i] , in - out ) + s2[i];
+			s2[i] = fixed_mul( b0[i] , in ) - fixed_mul( a2[i] , out );
+			return out;
+		}
+		void step( int32_t *data )
+		{
+			for ( int i = 0 ; i < N ; i++ ) data[i] = step( data[i] , i );
+		}
+};
+
+template < int N > class filter_notch_shared_q
+{
+	private:
+		int32_t b0;
+		int32_t a1;
+		int32_t a2;
+		int32_t s1[N];
+		int32_t s2[N];
+	public:
+		filter_notch_shared_q()
+		{
+			bypass();
+		}
+		void bypass()
+		{
+			b0 = a2 = FIXED_ONE;
+			a1 = 0;
+			for ( int i = 0 ; i < N ; i++ ) s1[i] = s2[i] = 0;
+		}
+		void set( float hz , float q , float us )
+		{
+			float fb0 , fa1 , fa2;
+			filter_notch_coeff( hz , q , us , &fb0 , &fa1 , &fa2 );
+			b0 = FIXED( fb0 );
+			a1 = FIXED( fa1 );
+			a2 = FIXED( fa2 );
+		}
+		void step( int32_t *data )
+		{
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				int32_t out = fixed_mul( b0 , data[i] ) + s1[i];
+				s1[i] = fixed_mul( a1 , data[i] - out ) + s2[i];
+				s2[i] = fixed_mul( b0 , data[i] ) - fixed_mul( a2 , out );
+				data[i] = out;
+			}
+		}
+};
+
+// the gain is stepped in float until it settles, the state update is fixed point
+template < int N , class C > class filter_kalman_q
+{
+	private:
+		int32_t x_est_last[N];
+		float P_last;
+		int32_t K;
+		int settled;
+	public:
+		filter_kalman_q()
+		{
+			for ( int i = 0 ; i < N ; i++ ) x_est_last[i] = 0;
+			P_last = 0;
+			K = 0;
+			settled = 0;
+		}
+		void step( int32_t *data )
+		{
+			if ( !settled )
+			{
+				float P_temp = P_last + C::Q();
+				float k = P_temp * ( 1.0f / ( P_temp + C::R() ) );
+				float P = ( 1 - k ) * P_temp;
+
+				if ( P == P_last ) settled = 1;
+				P_last = P;
+				K = FLOAT_TO_FIXED( k );
+			}
+			for ( int i = 0 ; i < N ; i++ )
+			{
+				x_est_last[i] += fixed_mul( K , data[i] - x_est_last[i] );
+				data[i] = x_est_last[i];
+			}
+		}
+};
@@ -0,0 +1,56 @@
+
+#include <inttypes.h>
+
+// fixed point helpers for the FIXED_POINT control path
+// signals and filter coefficients are Q16.16 ( 1.0 = 65536 )
+// small gains ( ki * looptime ) are Q31 to keep the resolution
+// products go through 64 bit so rates up to 2000 deg/s and coefficients above 1 ( biquad ) fit
+
+#define FIXED_ONE 65536
+#define FIXED31_ONE 2147483648.0f
+
+// compile time conversion, also usable in static initializers
+#define FIXED( x ) ( (int32_t) ( (x) * 65536.0f + ( (x) >= 0 ? 0.5f : -0.5f ) ) )
+
+#define FLOAT_TO_FIXED( x ) ( (int32_t) ( (x) * 65536.0f ) )
+#define FIXED_TO_FLOAT( x ) ( (float) (x) * ( 1.0f / 65536.0f ) )
+
+#define FLOAT_TO_FIXED31( x ) ( (int32_t) ( (x) * FIXED31_ONE ) )
+
+// scales below 0.5 in Q32, for the gyro lsb to Q16 rad/s
+#define FIXED32( x ) ( (int32_t) ( (x) * 4294967296.0 + 0.5 ) )
+
+// products are rounded, truncation would bias the integrators towards -inf
+
+// Q16 * Q16
+static inline int32_t fixed_mul( int32_t a , int32_t b )
+{
+	return (int32_t) ( ( (int64_t) a * b + ( 1 << 15 ) ) >> 16 );
+}
+
+// Q16 * Q31
+static inline int32_t fixed_mul31( int32_t a , int32_t b )
+{
+	return (int32_t) ( ( (int64_t) a * b + ( 1 << 30 ) ) >> 31 );
+}
+
+// integer * Q32
+static inline int32_t fixed_mul32( int32_t a , int32_t b )
+{
+	return (int32_t) ( ( (int64_t) a * b + ( 1u << 31 ) ) >> 32 );
+}
+
+static inline int32_t fixed_limit( int32_t x , int32_t limit )
+{
+	if ( x > limit ) return limit;
+	if ( x < -limit ) return -limit;
+	return x;
+}
+
+// a float changed if its bits did, compared without float math
+static inline uint32_t float_bits( float f )
+{
+	union { float f; uint32_t u; } v;
+	v.f = f;
+	return v.u;
+}
@@ -1,253 +1,208 @@
-
 #include "project.h"
-#include "drv_fmc.h"
 #include "config.h"
+#include "flash_kv.h"
+#include "crc.h"
 
-extern int fmc_erase( void );
-extern void fmc_unlock(void);
-extern void fmc_lock(void);
+// settings saved with the DDD gesture, one flash_kv record per group
+// flash_save() only programs the groups that changed
 
 extern float accelcal[];
 extern float * pids_array[3];
 extern float * pids_array2[3]; // dual PIDs code
 
-extern float hardcoded_pid_identifier;
+// crc of the pid.c values, saved pids are only loaded while pid.c is unchanged
+uint32_t initial_pid_identifier;
+uint32_t initial_pid_identifier2; // dual PIDs code
 
+static uint32_t float_to_word( float value )
+{
+	union { float f; uint32_t w; } u;
+	u.f = value;
+	return u.w;
+}
 
-#define FMC_HEADER 0x12AA0001
+static float word_to_float( uint32_t value )
+{
+	union { float f; uint32_t w; } u;
+	u.w = value;
+	return u.f;
+}
 
-float initial_pid_identifier = -10;
-float initial_pid_identifier2 = -10; // dual PIDs code
-float saved_pid_identifier;
-float saved_pid_identifier2; // dual PIDs code
+static uint32_t flash_pid_crc( float * pids[3] )
+{
+	uint16_t crc = 0xFFFF;
+	for (int i=0;  i<3 ; i++) {
+		crc = crc16_ccitt( crc , (const uint8_t *) pids[i] , 3 * sizeof( float ) );
+	}
+	return crc;
+}
+
+void flash_hard_coded_pid_identifier( void)
+{
+	initial_pid_identifier = flash_pid_crc( pids_array );
+}
 
+// ----- DUAL PIDS CODE ---------
+void flash_hard_coded_pid_identifier2( void)
+{
+	initial_pid_identifier2 = flash_pid_crc( pids_array2 );
+}
+// ------- END OF DUAL PIDS CODE ---------
 
-float flash_get_hard_coded_pid_identifier( void) {
-	float result = 0;
+static void flash_save_pids( int key , uint32_t identifier , float * pids[3] )
+{
+	uint32_t data[10];
 
+	data[0] = identifier;
 	for (int i=0;  i<3 ; i++) {
 		for (int j=0; j<3 ; j++) {
-			result += pids_array[i][j] * (i+1) * (j+1) * 0.932f;
+			data[1 + i * 3 + j] = float_to_word( pids[i][j] );
 		}
 	}
-	return result;
+	flash_kv_write( key , data , 10 );
 }
 
-// ----- DUAL PIDS CODE ---------
-float flash_get_hard_coded_pid_identifier2( void) {
-	float result = 0;
+static void flash_load_pids( int key , uint32_t identifier , float * pids[3] )
+{
+	uint32_t data[10];
+
+	if ( flash_kv_read( key , data , 10 ) != 10 || data[0] != identifier ) return;
 
 	for (int i=0;  i<3 ; i++) {
 		for (int j=0; j<3 ; j++) {
-			result += pids_array2[i][j] * (i+1) * (j+1) * 0.932f;
+			pids[i][j] = word_to_float( data[1 + i * 3 + j] );
 		}
 	}
-	return result;
 }
-// ------- END OF DUAL PIDS CODE ---------
-void flash_hard_coded_pid_identifier( void)
+
+#ifdef DYNAMIC_IDLE_HZ
+extern float idle_offset;
+extern uint32_t motor_curve_identifier;
+extern void motor_curve_save( void);
+
+// the dynamic idle offset learned in flight , loaded while the compiled motor curve is unchanged
+static void flash_save_idle_offset( void)
 {
- initial_pid_identifier = flash_get_hard_coded_pid_identifier();
+	uint32_t data[2];
+
+	motor_curve_save();
+	data[0] = motor_curve_identifier;
+	data[1] = float_to_word( idle_offset );
+	flash_kv_write( FLASH_KEY_IDLE_OFFSET , data , 2 );
 }
 
-// ----- DUAL PIDS CODE ---------
-void flash_hard_coded_pid_identifier2( void)
+static void flash_load_idle_offset( void)
 {
- initial_pid_identifier2 = flash_get_hard_coded_pid_identifier2();
-}
-// ------- END OF DUAL PIDS CODE ---------
+	// one word more , a longer record is the older whole table layout
+	uint32_t data[3];
 
+	if ( flash_kv_read( FLASH_KEY_IDLE_OFFSET , data , 3 ) != 2 || data[0] != motor_curve_identifier ) return;
+
+	idle_offset = word_to_float( data[1] );
+}
+#endif
 
 void flash_save( void) {
 
-    fmc_unlock();
-	fmc_erase();
-	
-	unsigned long addresscount = 0;
+	uint32_t data[3];
 
-    writeword(addresscount++, FMC_HEADER);
-   
-	fmc_write_float(addresscount++, initial_pid_identifier );
-	
-	for (int i=0;  i<3 ; i++) {
-		for (int j=0; j<3 ; j++) {
-            fmc_write_float(addresscount++, pids_array[i][j]);
-		}
-	}
- 
+	flash_save_pids( FLASH_KEY_PIDS , initial_pid_identifier , pids_array );
 
-    fmc_write_float(addresscount++, accelcal[0]);
-    fmc_write_float(addresscount++, accelcal[1]);
-    fmc_write_float(addresscount++, accelcal[2]);
+	for ( int i = 0 ; i < 3 ; i++) data[i] = float_to_word( accelcal[i] );
+	flash_kv_write( FLASH_KEY_ACCELCAL , data , 3 );
 
 	// ------- DUAL PIDS CODE ---------
- 	fmc_write_float(addresscount++, initial_pid_identifier2 );
-	
-	for (int i=0;  i<3 ; i++) {
-		for (int j=0; j<3 ; j++) {
-            fmc_write_float(addresscount++, pids_array2[i][j]);
-		}
-	}
-// ------- END OF DUAL PIDS CODE ------------
-   
+	flash_save_pids( FLASH_KEY_PIDS2 , initial_pid_identifier2 , pids_array2 );
+	// ------- END OF DUAL PIDS CODE ------------
+
 #if (defined RX_BAYANG_PROTOCOL_TELEMETRY_AUTOBIND || defined RX_NRF24_BAYANG_TELEMETRY )
-// autobind info     
+// autobind info
 extern char rfchannel[4];
 extern char rxaddress[5];
 extern int telemetry_enabled;
 extern int rx_bind_enable;
-    
- // save radio bind info  
+
+ // save radio bind info, deleted when bind is disabled
     if ( rx_bind_enable )
     {
-    writeword(50, rxaddress[4]|telemetry_enabled<<8);
-    writeword(51, rxaddress[0]|(rxaddress[1]<<8)|(rxaddress[2]<<16)|(rxaddress[3]<<24));
-    writeword(52, rfchannel[0]|(rfchannel[1]<<8)|(rfchannel[2]<<16)|(rfchannel[3]<<24));
+    data[0] = rxaddress[4]|telemetry_enabled<<8;
+    data[1] = rxaddress[0]|(rxaddress[1]<<8)|(rxaddress[2]<<16)|(rxaddress[3]<<24);
+    data[2] = rfchannel[0]|(rfchannel[1]<<8)|(rfchannel[2]<<16)|(rfchannel[3]<<24);
+    flash_kv_write( FLASH_KEY_BIND , data , 3 );
     }
     else
     {
-      // this will leave 255's so it will be picked up as disabled  
-	
+    flash_kv_write( FLASH_KEY_BIND , data , 0 );
     }
-#endif    
+#endif
 
 #ifdef SWITCHABLE_FEATURE_1
 extern int flash_feature_1;
- //save filter cut info
- if (flash_feature_1)
-{
-	fmc_write_float (53,1);	
-}else{
-	fmc_write_float (53,0);	
-}
- #endif
+	data[0] = flash_feature_1 != 0;
+	flash_kv_write( FLASH_KEY_FEATURE1 , data , 1 );
+#endif
 
 #if defined(RX_DSMX_2048) || defined(RX_DSM2_1024)
 extern int rx_bind_enable;
-if ( rx_bind_enable ){
-		fmc_write_float (56,1);
-	}else{
-		fmc_write_float (56,0);	
-	}
+	data[0] = rx_bind_enable != 0;
+	flash_kv_write( FLASH_KEY_DSM_BIND , data , 1 );
+#endif
+
+#ifdef DYNAMIC_IDLE_HZ
+	flash_save_idle_offset();
 #endif
-		
-		
-    writeword(255, FMC_HEADER);
-    
-	fmc_lock();
 }
 
 
 
 void flash_load( void) {
 
-	unsigned long addresscount = 0;
-// check if saved data is present
-    if (FMC_HEADER == fmc_read(addresscount++)&& FMC_HEADER == fmc_read(255))
-    {
+	uint32_t data[3];
 
-     saved_pid_identifier = fmc_read_float(addresscount++);
-// load pids from flash if pid.c values are still the same       
-     if (  saved_pid_identifier == initial_pid_identifier )
-     {
-         for (int i=0;  i<3 ; i++) {
-            for (int j=0; j<3 ; j++) {
-                pids_array[i][j] = fmc_read_float(addresscount++);
-            }
-        }
-     }
-     else{
-         addresscount+=9; 
-     }    
+	flash_load_pids( FLASH_KEY_PIDS , initial_pid_identifier , pids_array );
 
-    accelcal[0] = fmc_read_float(addresscount++ );
-    accelcal[1] = fmc_read_float(addresscount++ );
-    accelcal[2] = fmc_read_float(addresscount++ );  
+	if ( flash_kv_read( FLASH_KEY_ACCELCAL , data , 3 ) == 3 )
+	{
+		for ( int i = 0 ; i < 3 ; i++) accelcal[i] = word_to_float( data[i] );
+	}
 
 // ------- DUAL PIDS CODE ----------
-	saved_pid_identifier2 = fmc_read_float(addresscount++);
-     if (  saved_pid_identifier2 == initial_pid_identifier2 )
-     {
-         for (int i=0;  i<3 ; i++) {
-            for (int j=0; j<3 ; j++) {
-                pids_array2[i][j] = fmc_read_float(addresscount++);
-            }
-        }
-     }
-/*     else{
-         addresscount+=9;  // not needed because there is no data after this, but in case something is added later, need to be used
-     }    */
-// ------- END OF DUAL PIDS CODE -------    
-		 
-#if (defined RX_BAYANG_PROTOCOL_TELEMETRY_AUTOBIND || defined RX_NRF24_BAYANG_TELEMETRY ) 
+	flash_load_pids( FLASH_KEY_PIDS2 , initial_pid_identifier2 , pids_array2 );
+// ------- END OF DUAL PIDS CODE -------
+
+#if (defined RX_BAYANG_PROTOCOL_TELEMETRY_AUTOBIND || defined RX_NRF24_BAYANG_TELEMETRY )
 extern char rfchannel[4];
 extern char rxaddress[5];
 extern int telemetry_enabled;
 extern int rx_bind_load;
 extern int rx_bind_enable;
-     
- // save radio bind info   
 
-    int temp = fmc_read(52);
-    int error = 0;
-    for ( int i = 0 ; i < 4; i++)
-    {
-        if ( ((temp>>(i*8))&0xff  ) > 127)
-        {
-            error = 1;
-        }   
-    }
-    
-    if( !error )   
+ // load radio bind info
+    if ( flash_kv_read( FLASH_KEY_BIND , data , 3 ) == 3 )
     {
-        rx_bind_load = rx_bind_enable = 1; 
-        
-        rxaddress[4] = fmc_read(50);
+        rx_bind_load = rx_bind_enable = 1;
 
-        telemetry_enabled = fmc_read(50)>>8;
-        int temp = fmc_read(51);
+        rxaddress[4] = data[0];
+        telemetry_enabled = data[0]>>8;
         for ( int i = 0 ; i < 4; i++)
         {
-            rxaddress[i] =  temp>>(i*8);        
-        }
-        
-        temp = fmc_read(52);  
-        for ( int i = 0 ; i < 4; i++)
-        {
-            rfchannel[i] =  temp>>(i*8);  
+            rxaddress[i] = data[1]>>(i*8);
+            rfchannel[i] = data[2]>>(i*8);
         }
     }
 #endif
-    
-		#ifdef SWITCHABLE_FEATURE_1
+
+#ifdef SWITCHABLE_FEATURE_1
  extern int flash_feature_1;
- flash_feature_1 = fmc_read_float(53);
- #endif
+	if ( flash_kv_read( FLASH_KEY_FEATURE1 , data , 1 ) ) flash_feature_1 = data[0];
+#endif
 
-	#if defined(RX_DSMX_2048) || defined(RX_DSM2_1024)
+#if defined(RX_DSMX_2048) || defined(RX_DSM2_1024)
 	extern int rx_bind_enable;
-	rx_bind_enable = fmc_read_float(56);
+	if ( flash_kv_read( FLASH_KEY_DSM_BIND , data , 1 ) ) rx_bind_enable = data[0];
 #endif
 
-		
-		
-    }
-    else
-    {
-        
-    }
-    
+#ifdef DYNAMIC_IDLE_HZ
+	flash_load_idle_offset();
+#endif
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -0,0 +1,190 @@
+// key-value settings store
+// records are appended to the active page, a save only programs the records that changed
+// when the page is full the newest record of each key is copied to the next page ( garbage collection )
+// so a page is erased once per page full of saves instead of once per save, and the pages wear evenly
+//
+// page: magic | schema , sequence , records
+// record: key | words << 8 | crc16 << 16 , data words
+// the page with the highest sequence is active, its magic is programmed last so an interrupted
+// collection leaves the old page active, the record crc is programmed last so an interrupted save is skipped
+
+#include <string.h>
+
+#include "flash_kv.h"
+#include "crc.h"
+
+#define FLASH_KV_MAGIC ( 0x564B0000 | FLASH_KV_SCHEMA )
+
+#define KV_ERASED 0xFFFFFFFF
+
+extern int fmc_erase_page( unsigned long address );
+extern int fmc_write_halfword( unsigned long address , uint16_t value );
+extern void fmc_unlock( void);
+extern void fmc_lock( void);
+
+#define KV_WORD( address ) ( *(volatile uint32_t *) ( address ) )
+#define KV_PAGE( page ) ( FLASH_KV_BASE + ( page ) * FLASH_KV_PAGE_SIZE )
+#define KV_PAGE_END( page ) ( KV_PAGE( page ) + FLASH_KV_PAGE_SIZE )
+
+static uint16_t kv_record_crc( uint32_t header , const uint32_t *data , int words )
+{
+	uint16_t id = header;
+	uint16_t crc = crc16_ccitt( 0xFFFF , (const uint8_t *) &id , 2 );
+	crc = crc16_ccitt( crc , (const uint8_t *) data , words * 4 );
+
+	// an erased crc means not written
+	if ( crc == 0xFFFF ) crc = 0;
+	return crc;
+}
+
+// the active page, -1 if there is none
+static int kv_active( void)
+{
+	int active = -1;
+	uint32_t sequence = 0;
+
+	for ( int page = 0 ; page < FLASH_KV_PAGES ; page++)
+	{
+		if ( KV_WORD( KV_PAGE( page ) ) != FLASH_KV_MAGIC ) continue;
+		uint32_t s = KV_WORD( KV_PAGE( page ) + 4 );
+		if ( active < 0 || s > sequence )
+		{
+			active = page;
+			sequence = s;
+		}
+	}
+	return active;
+}
+
+// walks the records of a page
+// returns the newest valid record of key ( or 0 ) and the first free address ( 0 if the page can not take more )
+static unsigned long kv_scan( int page , int key , unsigned long *free )
+{
+	unsigned long address = KV_PAGE( page ) + 8;
+	unsigned long end = KV_PAGE_END( page );
+	unsigned long found = 0;
+
+	*free = 0;
+	while ( address < end )
+	{
+		uint32_t header = KV_WORD( address );
+		if ( header == KV_ERASED )
+		{
+			*free = address;
+			break;
+		}
+
+		int words = ( header >> 8 ) & 0xff;
+		if ( address + 4 + words * 4 > end ) break;
+
+		if ( ( header & 0xff ) == key && ( header >> 16 ) == kv_record_crc( header , (const uint32_t *) ( address + 4 ) , words ) )
+			found = address;
+
+		address += 4 + words * 4;
+	}
+	return found;
+}
+
+static int kv_program( unsigned long address , uint32_t value )
+{
+	if ( fmc_write_halfword( address , value ) ) return 1;
+	return fmc_write_halfword( address + 2 , value >> 16 );
+}
+
+// key and length, the data, then the crc
+static int kv_append( unsigned long address , int key , const uint32_t *data , int words )
+{
+	uint32_t header = key | ( words << 8 );
+
+	if ( fmc_write_halfword( address , header ) ) return 1;
+	for ( int i = 0 ; i < words ; i++)
+		if ( kv_program( address + 4 + i * 4 , data[i] ) ) return 1;
+	return fmc_write_halfword( address + 2 , kv_record_crc( header , data , words ) );
+}
+
+static int kv_erase( int page )
+{
+	for ( unsigned long a = KV_PAGE( page ) ; a < KV_PAGE_END( page ) ; a += 4 )
+	{
+		if ( KV_WORD( a ) != KV_ERASED ) return fmc_erase_page( KV_PAGE( page ) );
+	}
+	return 0;
+}
+
+// newest records of the other keys and the new one to the next page
+static int kv_collect( int active , int key , const uint32_t *data , int words )
+{
+	int page = ( active + 1 ) % FLASH_KV_PAGES;
+	uint32_t sequence = 1;
+	unsigned long address = KV_PAGE( page ) + 8;
+	unsigned long end = KV_PAGE_END( page );
+	unsigned long free;
+
+	if ( kv_erase( page ) ) return 1;
+
+	if ( active >= 0 )
+	{
+		sequence = KV_WORD( KV_PAGE( active ) + 4 ) + 1;
+
+		for ( int k = 1 ; k < FLASH_KV_KEYS ; k++)
+		{
+			if ( k == key ) continue;
+			unsigned long record = kv_scan( active , k , &free );
+			if ( !record ) continue;
+
+			int n = ( KV_WORD( record ) >> 8 ) & 0xff;
+			if ( !n ) continue;
+			if ( address + 4 + n * 4 > end ) return 1;
+			if ( kv_append( address , k , (const uint32_t *) ( record + 4 ) , n ) ) return 1;
+			address += 4 + n * 4;
+		}
+	}
+
+	if ( words )
+	{
+		if ( address + 4 + words * 4 > end ) return 1;
+		if ( kv_append( address , key , data , words ) ) return 1;
+	}
+
+	if ( kv_program( KV_PAGE( page ) + 4 , sequence ) ) return 1;
+	return kv_program( KV_PAGE( page ) , FLASH_KV_MAGIC );
+}
+
+int flash_kv_read( int key , uint32_t *data , int words )
+{
+	unsigned long free;
+	int active = kv_active();
+	if ( active < 0 ) return 0;
+
+	unsigned long record = kv_scan( active , key , &free );
+	if ( !record ) return 0;
+
+	int n = ( KV_WORD( record ) >> 8 ) & 0xff;
+	if ( n > words ) n = words;
+	for ( int i = 0 ; i < n ; i++) data[i] = KV_WORD( record + 4 + i * 4 );
+	return n;
+}
+
+int flash_kv_write( int key , const uint32_t *data , int words )
+{
+	unsigned long free = 0;
+	unsigned long record = 0;
+	int active = kv_active();
+
+	if ( active >= 0 )
+	{
+		record = kv_scan( active , key , &free );
+
+		// unchanged, nothing to program
+		if ( record && ( ( KV_WORD( record ) >> 8 ) & 0xff ) == words && !memcmp( (const void *) ( record + 4 ) , data , words * 4 ) ) return 0;
+		if ( !record && !words ) return 0;
+	}
+
+	int error;
+	fmc_unlock();
+	if ( free && free + 4 + words * 4 <= KV_PAGE_END( active ) ) error = kv_append( free , key , data , words );
+	else error = kv_collect( active , key , data , words );
+	fmc_lock();
+
+	return error;
+}
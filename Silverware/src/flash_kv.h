@@ -0,0 +1,31 @@
+
+#include <inttypes.h>
+
+// settings store in the last FLASH_KV_PAGES pages of flash, the program has to end before FLASH_KV_BASE
+#define FLASH_KV_PAGES 2
+#define FLASH_KV_PAGE_SIZE 1024
+#define FLASH_KV_BASE ( 0x08008000 - FLASH_KV_PAGES * FLASH_KV_PAGE_SIZE )
+
+// change when the layout of a record changes, older pages are not loaded
+#define FLASH_KV_SCHEMA 1
+
+// record keys, 1 - 254
+enum flash_kv_keys
+{
+	FLASH_KEY_PIDS = 1,			// crc of the pid.c values , 9 floats
+	FLASH_KEY_PIDS2,				// dual pids, same layout
+	FLASH_KEY_ACCELCAL,			// 3 floats
+	FLASH_KEY_BIND,					// bayang rx address , channels , telemetry flag
+	FLASH_KEY_FEATURE1,			// SWITCHABLE_FEATURE_1
+	FLASH_KEY_DSM_BIND,			// dsm bind flag
+	FLASH_KEY_IDLE_OFFSET,	// crc of the compiled motor curve , dynamic idle offset
+	FLASH_KV_KEYS
+};
+
+// words read, 0 if the key is not stored
+int flash_kv_read( int key , uint32_t *data , int words );
+
+// appends a record if the value changed, 0 if ok
+// words 0 deletes the key
+int flash_kv_write( int key , const uint32_t *data , int words );
+
@@ -63,6 +63,11 @@ void gestures( void)
                 #endif // USE_ANALOG_AUX
 
                 #endif // FLASH_SAVE1
+
+                #if defined BLACKBOX && defined BLACKBOX_FLASH
+                extern void blackbox_erase( void);
+                blackbox_erase();
+                #endif
 			    // reset loop time 
 			    extern unsigned long lastlooptime;
 			    lastlooptime = gettime();
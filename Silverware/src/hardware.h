@@ -21,7 +21,7 @@
 // ------------- ESC driver = servo type signal for brushless esc
 // ************* Dshot driver = esc signal from gate of FET only
 #define USE_DSHOT_DMA_DRIVER
-//#define USE_DSHOT_DRIVER_BETA // Can not use Overclock option in config.h 
+//#define USE_DSHOT_DRIVER_BETA // uses TIM14 , works with the Overclock option in config.h
 //#define USE_ESC_DRIVER
 
 
@@ -55,6 +55,10 @@
 #define GYRO_SYNC2 CHAN_OFF
 #define GYRO_SYNC3 CHAN_ON // works only when LEVELMODE off and not onground
 
+// ------------- Select this for a background gyro read on software i2c boards ( BWHOOP, E011 ) with SIXAXIS_READ_DMA off
+// ************* TIM2 and dma channels 2 - 5 clock the i2c pins, brushed motors only
+//#define SOFTI2C_READ_DMA
+
 // ------------- Select this for SPI radio.
 // ************* Buzzer GPIO may need to be reassigned to another pin
 //#define EXTERNAL_RX
@@ -298,6 +302,8 @@
 #define SOFTI2C_SPEED_FAST
 //#define SOFTI2C_SPEED_SLOW1
 //#define SOFTI2C_SPEED_SLOW2
+// SOFTI2C_READ_DMA bit rate in kHz
+#define SOFTI2C_DMA_KHZ 1000
 // hardware i2c speed ( 1000, 400 , 200 , 100Khz)
 #define HW_I2C_SPEED_FAST2
 //#define HW_I2C_SPEED_FAST
@@ -41,6 +41,111 @@ float attitude[3];
 extern float gyro[3];
 extern float accel[3];
 extern float accelcal[3];
+extern float looptime;
+extern int accel_new;
+
+// time since the last accel sample used, accel can be read every few loops ( ACCEL_DECIMATION )
+static float accel_time;
+
+float Q_rsqrt( float number );
+
+#ifdef IMU_QUATERNION
+// mahony filter on the quaternion of the quad attitude
+// the gyro turns the quaternion, the angle between the accel and the estimated gravity vector
+// turns it back at IMU_KP rad/s per rad and learns the gyro bias at IMU_KI
+// renormalised every loop so the estimate can not grow or shrink like the small angle update
+
+// 1 / FILTERTIME corrects as fast as the gravity vector filter
+#define IMU_KP ( 1.0f / (float) FILTERTIME )
+#define IMU_KI 0.05f
+// gyro bias limit in rad/s
+#define IMU_BIAS_MAX 0.05f
+
+// body to earth rotation , w x y z
+static float q[4] = { 1.0f , 0 , 0 , 0 };
+static float gyro_bias[3];
+
+static void quaternion_gravity( void)
+{
+	GEstG[0] = 2.0f * ( q[1] * q[3] - q[0] * q[2] );
+	GEstG[1] = 2.0f * ( q[0] * q[1] + q[2] * q[3] );
+	GEstG[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+static void quaternion_normalize( void)
+{
+	float mag = Q_rsqrt( q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3] );
+	for ( int i = 0 ; i < 4 ; i++) q[i] *= mag;
+}
+
+// shortest rotation from level to the gravity vector , no yaw
+static void quaternion_from_gravity( void)
+{
+	float mag = Q_rsqrt( GEstG[0] * GEstG[0] + GEstG[1] * GEstG[1] + GEstG[2] * GEstG[2] );
+	float g[3] = { GEstG[0] * mag , GEstG[1] * mag , GEstG[2] * mag };
+
+	if ( g[2] > -0.999f )
+	{
+		q[0] = 1.0f + g[2];
+		q[1] = g[1];
+		q[2] = -g[0];
+	}
+	else
+	{
+		// upside down
+		q[0] = 0;
+		q[1] = 1.0f;
+		q[2] = 0;
+	}
+	q[3] = 0;
+	quaternion_normalize();
+	quaternion_gravity();
+}
+
+// accel_dt is the time since the last accel sample, 0 if there is no new one
+static void quaternion_update( float accmag , float accel_dt )
+{
+	// the gyro axes in the frame of the gravity vector , same turn as the small angle update
+	float w[3] = { gyro[1] , -gyro[0] , -gyro[2] };
+
+	// accel trust , 1 at 1G down to 0 at ACC_MIN / ACC_MAX
+	float trust = ( accmag - ACC_1G ) * ( 2.0f / ( ( ACC_MAX - ACC_MIN ) * ACC_1G ) );
+	trust = 1.0f - trust * trust;
+
+	if ( accel_dt > 0 && trust > 0 && !DISABLE_ACC )
+	{
+		float scale = trust / accmag;
+		float a[3] = { accel[0] * scale , accel[1] * scale , accel[2] * scale };
+
+		// accel x estimated gravity , sine of the tilt error
+		float e[3];
+		e[0] = a[1] * GEstG[2] - a[2] * GEstG[1];
+		e[1] = a[2] * GEstG[0] - a[0] * GEstG[2];
+		e[2] = a[0] * GEstG[1] - a[1] * GEstG[0];
+
+		// the correction of accel_dt in this loop
+		float kp = IMU_KP * ( accel_dt / looptime );
+		for ( int i = 0 ; i < 3 ; i++)
+		{
+			gyro_bias[i] += IMU_KI * e[i] * accel_dt;
+			limitf( &gyro_bias[i] , IMU_BIAS_MAX );
+			w[i] += kp * e[i];
+		}
+	}
+
+	float h = 0.5f * looptime;
+	for ( int i = 0 ; i < 3 ; i++) w[i] = ( w[i] + gyro_bias[i] ) * h;
+
+	float q0 = q[0] , q1 = q[1] , q2 = q[2] , q3 = q[3];
+	q[0] += -q1 * w[0] - q2 * w[1] - q3 * w[2];
+	q[1] +=  q0 * w[0] + q2 * w[2] - q3 * w[1];
+	q[2] +=  q0 * w[1] - q1 * w[2] + q3 * w[0];
+	q[3] +=  q0 * w[2] + q1 * w[1] - q2 * w[0];
+
+	quaternion_normalize();
+	quaternion_gravity();
+}
+#endif
 
 
 void imu_init(void)
@@ -48,6 +153,7 @@ void imu_init(void)
 	// init the gravity vector with accel values
 	for (int xx = 0; xx < 100; xx++)
 	  {
+		  sixaxis_accel_request();
 		  sixaxis_read();
 
 		  for (int x = 0; x < 3; x++)
@@ -58,6 +164,11 @@ void imu_init(void)
 
 
 	  }
+#ifdef IMU_QUATERNION
+	quaternion_from_gravity();
+#endif
+	accel_new = 0;
+	accel_time = 0;
 }
 
 // from http://en.wikipedia.org/wiki/Fast_inverse_square_root
@@ -66,15 +177,15 @@ void imu_init(void)
 float Q_rsqrt( float number )
 {
 
-	long i;
+	// int32_t, long is 64 bit on a pc
+	union { float f; int32_t i; } u;
 	float x2, y;
 	const float threehalfs = 1.5F;
 
 	x2 = number * 0.5F;
-	y  = number;
-	i  = * ( long * ) &y;                       
-	i  = 0x5f3759df - ( i >> 1 );               
-	y  = * ( float * ) &i;
+	u.f = number;
+	u.i = 0x5f3759df - ( u.i >> 1 );
+	y  = u.f;
 	y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
 	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
 //	y  = y * ( threehalfs - ( x2 * y * y ) );   // 3nd iteration, this can be removed
@@ -108,14 +219,9 @@ void vectorcopy(float *vector1, float *vector2)
 	  }
 }
 
-extern float looptime;
-
-
-void imu_calc(void)
+// accel_dt is the time since the last accel sample
+static void imu_accel( float accel_dt )
 {
-
-
-
 // remove bias
     accel[0] = accel[0] - accelcal[0];
     accel[1] = accel[1] - accelcal[1];
@@ -126,26 +232,6 @@ void imu_calc(void)
 	  {
 		  accel[i] *= ( 1/ 2048.0f);
 	  }
-  
-      
-	float deltaGyroAngle[3];
-
-	for ( int i = 0 ; i < 3 ; i++)
-    {
-        deltaGyroAngle[i] = (gyro[i]) * looptime;
-    }
-	
-	
-	GEstG[2] = GEstG[2] - (deltaGyroAngle[0]) * GEstG[0];
-	GEstG[0] = (deltaGyroAngle[0]) * GEstG[2] +  GEstG[0];
-
-
-	GEstG[1] =  GEstG[1] + (deltaGyroAngle[1]) * GEstG[2];
-	GEstG[2] = -(deltaGyroAngle[1]) * GEstG[1] +  GEstG[2];
-
-
-	GEstG[0] = GEstG[0] - (deltaGyroAngle[2]) * GEstG[1];
-	GEstG[1] = (deltaGyroAngle[2]) * GEstG[0] +  GEstG[1];
 
 
 // calc acc mag
@@ -155,7 +241,7 @@ void imu_calc(void)
 		
 	#ifdef ACC_TELEMETRY
 		    static float accel2filt = 1.0;
-    lpf(&accel2filt, accel[2], FILTERCALC( 1000, 300000 ) );
+    lpf(&accel2filt, accel[2], FILTERCALC( accel_dt * 1e6f, 300000 ) );
     extern int tel1;
     static int max = 0;
     static unsigned long maxtime =0;
@@ -176,6 +262,9 @@ void imu_calc(void)
 #endif
 
 
+#ifdef IMU_QUATERNION
+	quaternion_update( accmag , accel_dt );
+#else
 	if ((accmag > ACC_MIN * ACC_1G) && (accmag < ACC_MAX * ACC_1G) && !DISABLE_ACC)
 	  {			 
         // normalize acc
@@ -183,14 +272,51 @@ void imu_calc(void)
         {
             accel[axis] = accel[axis] * ( ACC_1G / accmag);
         }       
-        float filtcoeff = lpfcalc_hz( looptime, 1.0f/(float)FILTERTIME);
+        float filtcoeff = lpfcalc_hz( accel_dt, 1.0f/(float)FILTERTIME);
         for (int x = 0; x < 3; x++)
           {
               lpf(&GEstG[x], accel[x], filtcoeff);
           }
 	  }
+#endif
+}
+
+RAMFUNC void imu_calc(void)
+{
+	accel_time += looptime;
+
+#ifndef IMU_QUATERNION
+	float deltaGyroAngle[3];
+
+	for ( int i = 0 ; i < 3 ; i++)
+    {
+        deltaGyroAngle[i] = (gyro[i]) * looptime;
+    }
+	
+	
+	GEstG[2] = GEstG[2] - (deltaGyroAngle[0]) * GEstG[0];
+	GEstG[0] = (deltaGyroAngle[0]) * GEstG[2] +  GEstG[0];
 
 
+	GEstG[1] =  GEstG[1] + (deltaGyroAngle[1]) * GEstG[2];
+	GEstG[2] = -(deltaGyroAngle[1]) * GEstG[1] +  GEstG[2];
+
+
+	GEstG[0] = GEstG[0] - (deltaGyroAngle[2]) * GEstG[1];
+	GEstG[1] = (deltaGyroAngle[2]) * GEstG[0] +  GEstG[1];
+#endif
+
+	if ( accel_new )
+	{
+		// accel[] is scaled in place, each sample is used once
+		accel_new = 0;
+		imu_accel( accel_time );
+		accel_time = 0;
+	}
+#ifdef IMU_QUATERNION
+	else quaternion_update( ACC_1G , 0 );
+#endif
+
 	attitude[0] = atan2approx(GEstG[0], GEstG[2]) ;
 
 	attitude[1] = atan2approx(GEstG[1], GEstG[2])  ;
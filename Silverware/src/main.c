@@ -52,6 +52,9 @@ THE SOFTWARE.
 #include "drv_fmc2.h"
 #include "gestures.h"
 #include "binary.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "blackbox.h"
 
 #include <stdio.h>
 #include <math.h>
@@ -85,7 +88,7 @@ extern void flash_load( void);
 extern void flash_hard_coded_pid_identifier(void);
 extern void flash_hard_coded_pid_identifier2(void); //dual PIDs code
 
-// looptime in seconds
+// pid looptime in seconds
 float looptime;
 float cpu_loading;
 // filtered battery in volts
@@ -97,6 +100,10 @@ float vreffilt = 1.0;
 float thrfilt = 0;
 
 unsigned int lastlooptime;
+#if GYRO_RATE_MULTIPLIER > 1
+// gyro loops since the last pid loop
+static int gyro_loop_count = 0;
+#endif
 // signal for lowbattery
 int lowbatt = 1;	
 
@@ -202,6 +209,12 @@ aux[CH_AUX1] = 1;
 #endif
     
     
+#if defined(MOTOR_CURVE_TABLE) || defined(THRUST_LINEARISATION)
+// motor curve table and its identifier , before the flash loading
+	extern void motor_curve_init( void);
+	motor_curve_init();
+#endif
+
     #ifdef FLASH_SAVE1
 // read pid identifier for values in file pid.c
     flash_hard_coded_pid_identifier();
@@ -211,6 +224,9 @@ aux[CH_AUX1] = 1;
     flash_load( );
 #endif
 
+  // working pids from set 1 , after flash loading
+	pid_set( 0 );
+
 #ifdef USE_ANALOG_AUX
   // saves initial pid values - after flash loading
   pid_init();
@@ -258,6 +274,10 @@ serial_init();
 
 imu_init();
 
+#ifdef BLACKBOX
+blackbox_init();
+#endif
+
 #ifdef FLASH_SAVE2
 // read accelerometer calibration values from option bytes ( 2* 8bit)
 extern float accelcal[3];
@@ -287,11 +307,23 @@ if ( liberror )
 	setup_4way_external_interrupt();
 #endif  
 
+#ifdef USE_SCHEDULER
+	scheduler_init();
+#endif
+
 	while(1)
 	{
+#ifdef USE_SCHEDULER
+		// run the low rate tasks in the slack until the next gyro sample
+		scheduler_wait();
+#endif
 		// gettime() needs to be called at least once per second 
 		unsigned long time = gettime(); 
+		PROFILE_START();
 		looptime = ((uint32_t)( time - lastlooptime));
+#ifdef BLACKBOX
+		uint32_t looptime_us = time - lastlooptime;
+#endif
 		looptime = LOOPTIME;
 		if ( looptime <= 0 ) looptime = 1;
 		looptime = looptime * 1e-6f;
@@ -315,21 +347,99 @@ if ( liberror )
 
         // read gyro and accelerometer data	
 		sixaxis_read();
-		
+		// sixaxis_read() marks the end of the sensor read
+		PROFILE_MARK( PROFILE_GYRO );
+
+#if GYRO_RATE_MULTIPLIER > 1
+		// gyro only loop, the pid runs on every GYRO_RATE_MULTIPLIER th gyro sample
+		if ( ++gyro_loop_count < GYRO_RATE_MULTIPLIER )
+		{
+#if defined(USE_DSHOT_DMA_DRIVER) || defined(USE_DSHOT_DRIVER_BETA)
+			pwm_repeat();
+#endif
+#ifndef USE_SCHEDULER
+			while ( (gettime() - time) < GYRO_LOOPTIME );
+#endif
+			continue;
+		}
+		gyro_loop_count = 0;
+#endif
 		
         // all flight calculations and motors
 		control();
+		PROFILE_MARK( PROFILE_CONTROL );
+
+#ifdef BLACKBOX
+		blackbox_log( looptime_us );
+#endif
 
         // attitude calculations for level mode
  		extern void imu_calc(void);		
 		imu_calc();          
+		PROFILE_MARK( PROFILE_IMU );
+#ifndef USE_SCHEDULER
+		task_battery();
+		PROFILE_MARK( PROFILE_BATTERY );
+
+		task_gestures();
+		PROFILE_MARK( PROFILE_GESTURES );
+
+		task_leds();
+		PROFILE_MARK( PROFILE_LEDS );
+#endif
+
+   // --------------------------- DUAL PIDS CODE -----------------
+#ifdef ENABLE_DUAL_PIDS
+	// the working set is only copied when the switch changes
+	static int pid_set_active;
+	if ( aux[PID_SET_CHANGE] != pid_set_active )
+	{
+		pid_set_active = aux[PID_SET_CHANGE];
+		pid_set( pid_set_active );
+	}
+#endif
+// --------------------------- END OF DUAL PIDS CODE -----------------
+
+#ifndef USE_SCHEDULER
+		task_misc();
+		PROFILE_MARK( PROFILE_MISC );
+// receiver function
+checkrx();
+		PROFILE_MARK( PROFILE_RX );
+#ifdef BLACKBOX
+		blackbox_write();
+#endif
+#endif
+		PROFILE_END();
+
+#ifdef LOOP_PROFILER
+		profiler_dump();
+#endif
+
+#if defined CPU_LOAD_WATCH || defined CRSF_TELEMETRY
+cpu_loading = (gettime() - lastlooptime )*1e-3f ;
+#endif
+
+#ifndef USE_SCHEDULER
+while ( (gettime() - time) < GYRO_LOOPTIME );	
+#endif
+
+
+		
+	}// end loop
 	
+
+}
+
+
 // battery low logic
+void task_battery( void)
+{
 
         // read acd and scale based on processor voltage
 		float battadc = adc_read(0)*vreffilt; 
         // read and filter internal reference
-        lpf ( &vreffilt , adc_read(1)  , 0.9968f);
+        lpf ( &vreffilt , adc_read(1)  , LPF_COEFF_1KHZ( 0.9968f ));
   
 		
 
@@ -339,13 +449,13 @@ if ( liberror )
 	
 		// filter motorpwm so it has the same delay as the filtered voltage
 		// ( or they can use a single filter)		
-		lpf ( &thrfilt , thrsum , 0.9968f);	// 0.5 sec at 1.6ms loop time	
+		lpf ( &thrfilt , thrsum , LPF_COEFF_1KHZ( 0.9968f ));	// 0.5 sec at 1.6ms loop time	
 
         static float vbattfilt_corr = 4.2;
         // li-ion battery model compensation time decay ( 18 seconds )
-        lpf ( &vbattfilt_corr , vbattfilt , FILTERCALC( 1000 , 18000e3) );
+        lpf ( &vbattfilt_corr , vbattfilt , FILTERCALC( LOOPTIME , 18000e3) );
 	
-        lpf ( &vbattfilt , battadc , 0.9968f);
+        lpf ( &vbattfilt , battadc , LPF_COEFF_1KHZ( 0.9968f ));
 
 
 // compensation factor for li-ion internal model
@@ -378,10 +488,10 @@ if( thrfilt > 0.1f )
 	//	y(n) = x(n) - x(n-1) + R * y(n-1) 
 	//  out = in - lastin + coeff*lastout
 		// hpf
-	ans = vcomp[z] - lastin[z] + FILTERCALC( 1000*12 , 6000e3) *lastout[z];
+	ans = vcomp[z] - lastin[z] + FILTERCALC( LOOPTIME*12 , 6000e3) *lastout[z];
 	lastin[z] = vcomp[z];
 	lastout[z] = ans;
-	lpf ( &score[z] , ans*ans , FILTERCALC( 1000*12 , 60e6 ) );	
+	lpf ( &score[z] , ans*ans , FILTERCALC( LOOPTIME*12 , 60e6 ) );	
 	z++;
        
     if ( z >= 12 )
@@ -421,11 +531,22 @@ if( thrfilt > 0.1f )
 #ifdef DEBUG
 	debug.vbatt_comp = vbatt_comp ;
 #endif		
+}
+
+
 // check gestures
+void task_gestures( void)
+{
     if ( onground )
 	{
 	 gestures( );
 	}
+}
+
+
+// led flash logic , rgb leds and buzzer
+void task_leds( void)
+{
 
         
 
@@ -508,43 +629,12 @@ rgb_dma_start();
 #ifdef BUZZER_ENABLE	
 	buzzer();
 #endif
+}
 
-   // --------------------------- DUAL PIDS CODE -----------------
-#ifdef ENABLE_DUAL_PIDS
-	extern float pidkp[];
-	extern float pidki[];
-	extern float pidkd[];
-	extern float pidkp1[];
-	extern float pidki1[];
-	extern float pidkd1[];
-	extern float pidkp2[];
-	extern float pidki2[];
-	extern float pidkd2[];
-	if (!aux[PID_SET_CHANGE])
-	{
-			pidkp[0]=pidkp1[0];pidki[0]=pidki1[0];pidkd[0]=pidkd1[0];
-			pidkp[1]=pidkp1[1];pidki[1]=pidki1[1];pidkd[1]=pidkd1[1];
-			pidkp[2]=pidkp1[2];pidki[2]=pidki1[2];pidkd[2]=pidkd1[2];
-	} else
-	{
-			pidkp[0]=pidkp2[0];pidki[0]=pidki2[0];pidkd[0]=pidkd2[0];
-			pidkp[1]=pidkp2[1];pidki[1]=pidki2[1];pidkd[1]=pidkd2[1];
-			pidkp[2]=pidkp2[2];pidki[2]=pidki2[2];pidkd[2]=pidkd2[2];
-	}
-#endif
-#ifndef ENABLE_DUAL_PIDS
-	extern float pidkp[];
-	extern float pidki[];
-	extern float pidkd[];
-	extern float pidkp1[];
-	extern float pidki1[];
-	extern float pidkd1[];
-	pidkp[0]=pidkp1[0];pidki[0]=pidki1[0];pidkd[0]=pidkd1[0];
-	pidkp[1]=pidkp1[1];pidki[1]=pidki1[1];pidkd[1]=pidkd1[1];
-	pidkp[2]=pidkp1[2];pidki[2]=pidki1[2];pidkd[2]=pidkd1[2];
-#endif	
-// --------------------------- END OF DUAL PIDS CODE -----------------
-         
+
+// fpv switch and blheli 4way interface
+void task_misc( void)
+{
 #ifdef FPV_ON
 // fpv switch
     static int fpv_init = 0;
@@ -585,21 +675,6 @@ rgb_dma_start();
 			NVIC_DisableIRQ(EXTI4_15_IRQn);
 		}
 #endif
-
-// receiver function
-checkrx();
-
-#ifdef CPU_LOAD_WATCH
-cpu_loading = (gettime() - lastlooptime )*1e-3f ;
-#endif
-
-while ( (gettime() - time) < LOOPTIME );	
-
-
-		
-	}// end loop
-	
-
 }
 
 // 2 - low battery at powerup - if enabled by config
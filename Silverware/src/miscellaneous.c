@@ -25,6 +25,8 @@
 //define SENSOR_ROTATE_90_CCW
 //define SENSOR_ROTATE_180
 //define SENSOR_FLIP_180
+// any other yaw angle in whole degrees, counter clockwise like SENSOR_ROTATE_45_CCW
+//define SENSOR_ROTATE_ANGLE 30
 
 //Filter defines
 //WEAK_FILTERING
@@ -1,4 +1,8 @@
+#include <math.h>
+
 #include "config.h"
+#include "crc.h"
+#include "util.h"
 
 #ifdef BOLDCLASH_716MM_8K
 
@@ -151,3 +155,102 @@ float motormap(float input)
 }
 #endif
 
+
+
+#if defined(MOTOR_CURVE_TABLE) || defined(THRUST_LINEARISATION)
+// motor output for thrust 0 , 1/32 .. 1 , linear in between
+// one table lookup per motor instead of a curve function , the first point is the idle output
+// MOTOR_CURVE_TABLE is measured ( make -C gcc/sil thrust_fit ) , THRUST_LINEARISATION fills it at startup
+
+#define MOTOR_CURVE_SEGMENTS ( MOTOR_CURVE_POINTS - 1 )
+
+float motor_curve[ MOTOR_CURVE_POINTS ];
+// crc of the compiled table , a saved idle offset is only loaded while it is unchanged
+uint32_t motor_curve_identifier;
+
+#ifdef MOTOR_CURVE_TABLE
+static const float motor_curve_table[ MOTOR_CURVE_POINTS ] = { MOTOR_CURVE_TABLE };
+#endif
+
+#ifdef DYNAMIC_IDLE_HZ
+// raised low end of the curve learned in earlier flights , saved by flash.c , the table itself is not changed
+float idle_offset;
+// correction of the offset in flight , towards the slowest motor at DYNAMIC_IDLE_HZ
+// offset and boost together stay in 0 .. DYNAMIC_IDLE_MAX , so the learned idle can go down again
+float idle_boost;
+// the boost of the last 2s in the air ( lowpass ) , added to the offset by motor_curve_save()
+static float idle_boost_lpf;
+#endif
+
+void motor_curve_init( void)
+{
+	for ( int i = 0 ; i < MOTOR_CURVE_POINTS ; i++) {
+#ifdef MOTOR_CURVE_TABLE
+		motor_curve[i] = motor_curve_table[i];
+#else
+		// inverse of thrust = a * out^2 + ( 1 - a ) * out , once here instead of a square root per motor and loop
+		const float a = AA_motorCurve;
+		float thrust = (float) i / MOTOR_CURVE_SEGMENTS;
+		motor_curve[i] = thrust;
+		if ( a > 0.0f ) {
+			const float b = ( 1 - a ) / ( 2 * a );
+			motor_curve[i] = sqrtf( thrust / a + b * b ) - b;
+		}
+#endif
+	}
+
+	motor_curve_identifier = crc16_ccitt( 0xFFFF , (const uint8_t *) motor_curve , sizeof( motor_curve ) );
+}
+
+float motor_curve_map( float thrust )
+{
+	if ( thrust < 0 ) thrust = 0;
+	if ( thrust > 1 ) thrust = 1;
+
+	float position = thrust * MOTOR_CURVE_SEGMENTS;
+	int i = (int) position;
+	if ( i > MOTOR_CURVE_SEGMENTS - 1 ) i = MOTOR_CURVE_SEGMENTS - 1;
+	float out = motor_curve[i] + ( motor_curve[i + 1] - motor_curve[i] ) * ( position - i );
+
+#ifdef DYNAMIC_IDLE_HZ
+	out += ( idle_offset + idle_boost ) * ( 1 - thrust );
+#endif
+	return out;
+}
+
+#ifdef DYNAMIC_IDLE_HZ
+// from control() once per loop , with the esc telemetry of the rpm filter
+extern uint16_t dshot_erpm[4];
+extern uint8_t dshot_erpm_fails[4];
+extern float looptime;
+
+// the motors are on , control() clears the boost while they are off
+// the boost is held while a motor has no good telemetry , its erpm reads 0 after a few bad frames
+void motor_curve_update( void)
+{
+	uint16_t erpm = dshot_erpm[0];
+	for ( int i = 0 ; i < 4 ; i++) {
+		if ( dshot_erpm_fails[i] ) return;
+		if ( dshot_erpm[i] < erpm ) erpm = dshot_erpm[i];
+	}
+
+	// integral only , per Hz and second
+	float error = DYNAMIC_IDLE_HZ - erpm * ERPM_TO_HZ;
+	idle_boost += error * DYNAMIC_IDLE_GAIN * looptime;
+	if ( idle_boost < -idle_offset ) idle_boost = -idle_offset;
+	if ( idle_boost > DYNAMIC_IDLE_MAX - idle_offset ) idle_boost = DYNAMIC_IDLE_MAX - idle_offset;
+
+	lpf( &idle_boost_lpf , idle_boost , FILTERCALC( LOOPTIME , 2e6f ) );
+}
+
+// flash.c: the offset to save , with the correction the last flight needed
+void motor_curve_save( void)
+{
+	idle_offset += idle_boost_lpf;
+	if ( idle_offset < 0 ) idle_offset = 0;
+	if ( idle_offset > DYNAMIC_IDLE_MAX ) idle_offset = DYNAMIC_IDLE_MAX;
+	idle_boost = 0;
+	idle_boost_lpf = 0;
+}
+#endif
+#endif
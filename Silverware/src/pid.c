@@ -29,6 +29,7 @@ THE SOFTWARE.
 #include "config.h"
 #include "led.h"
 #include "defines.h"
+#include "fixed.h"
 
 #include <math.h>
 
@@ -129,6 +130,11 @@ float pidoutput[PIDNUMBER];
 float setpoint[PIDNUMBER];
 float v_compensation = 1.00;
 
+#ifdef RC_FEEDFORWARD
+// setpoint change per loop from the rc smoothing ramp , set by control.c in acro
+float setpoint_step[PIDNUMBER];
+#endif
+
 #ifdef ANALOG_AUX_PIDS
 int analog_aux_pids_adjusted = 0;
 #endif
@@ -167,6 +173,9 @@ static float lasterror2[PIDNUMBER];
 
 float timefactor;
 
+// set when a gain, the looptime or the pid set changes, the folded gains are rebuilt on the next pid_calc()
+static int pid_gains_changed = 1;
+
 void apply_analog_aux_to_pids()
 {
     // aux_analog channels are in range 0 to 1. Shift to 0 to 2 so we can zero out or double selected PID value.
@@ -178,18 +187,21 @@ void apply_analog_aux_to_pids()
     if (aux_analogchange[ANALOG_R_P]) {
         pidkp[0] = pidkp_init[0] * (aux_analog[ANALOG_R_P] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_R_I
     if (aux_analogchange[ANALOG_R_I]) {
         pidki[0] = pidki_init[0] * (aux_analog[ANALOG_R_I] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_R_D
     if (aux_analogchange[ANALOG_R_D]) {
         pidkd[0] = pidkd_init[0] * (aux_analog[ANALOG_R_D] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 
@@ -198,18 +210,21 @@ void apply_analog_aux_to_pids()
     if (aux_analogchange[ANALOG_P_P]) {
         pidkp[1] = pidkp_init[1] * (aux_analog[ANALOG_P_P] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_P_I
     if (aux_analogchange[ANALOG_P_I]) {
         pidki[1] = pidki_init[1] * (aux_analog[ANALOG_P_I] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_P_D
     if (aux_analogchange[ANALOG_P_D]) {
         pidkd[1] = pidkd_init[1] * (aux_analog[ANALOG_P_D] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 
@@ -218,18 +233,21 @@ void apply_analog_aux_to_pids()
     if (aux_analogchange[ANALOG_Y_P]) {
         pidkp[2] = pidkp_init[2] * (aux_analog[ANALOG_Y_P] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_Y_I
     if (aux_analogchange[ANALOG_Y_I]) {
         pidki[2] = pidki_init[2] * (aux_analog[ANALOG_Y_I] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_Y_D
     if (aux_analogchange[ANALOG_Y_D]) {
         pidkd[2] = pidkd_init[2] * (aux_analog[ANALOG_Y_D] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 
@@ -239,6 +257,7 @@ void apply_analog_aux_to_pids()
         pidkp[0] = pidkp_init[0] * (aux_analog[ANALOG_RP_P] + 0.5f);
         pidkp[1] = pidkp_init[1] * (aux_analog[ANALOG_RP_P] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_RP_I
@@ -246,6 +265,7 @@ void apply_analog_aux_to_pids()
         pidki[0] = pidki_init[0] * (aux_analog[ANALOG_RP_I] + 0.5f);
         pidki[1] = pidki_init[1] * (aux_analog[ANALOG_RP_I] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 #ifdef ANALOG_RP_D
@@ -253,6 +273,7 @@ void apply_analog_aux_to_pids()
         pidkd[0] = pidkd_init[0] * (aux_analog[ANALOG_RP_D] + 0.5f);
         pidkd[1] = pidkd_init[1] * (aux_analog[ANALOG_RP_D] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 
@@ -264,6 +285,7 @@ void apply_analog_aux_to_pids()
         pidkd[0] = pidkd_init[0] * (aux_analog[ANALOG_RP_PD] + 0.5f);
         pidkd[1] = pidkd_init[1] * (aux_analog[ANALOG_RP_PD] + 0.5f);
         analog_aux_pids_adjusted = 1;
+        pid_gains_changed = 1;
     }
 #endif
 }
@@ -271,228 +293,421 @@ void apply_analog_aux_to_pids()
 
 
 
-// pid calculation for acro ( rate ) mode
-// input: error[x] = setpoint - gyro
-// output: pidoutput[x] = change required from motors
-float pid(int x )
-{ 
-    if ((aux[LEVELMODE]) && (!aux[RACEMODE])){
-				if ((onground) || (in_air == 0)){
-						ierror[x] *= 0.98f;}
+#ifdef MIDPOINT_RULE_INTEGRAL
+#define INTEGRAL_FACTOR 0.5f
+#endif
+
+#ifdef RECTANGULAR_RULE_INTEGRAL
+#define INTEGRAL_FACTOR 1.0f
+#endif
+
+#ifdef SIMPSON_RULE_INTEGRAL
+#define INTEGRAL_FACTOR 0.166666f
+#endif
+
+#ifndef FIXED_POINT
+// gains folded by pid_gains(), only when a gain, the looptime or the profile changes
+static float kp_error[PIDNUMBER];
+static float kp_gyro[PIDNUMBER];
+static float ki_step[PIDNUMBER];
+static float kd_step[PIDNUMBER];
+#ifdef RC_FEEDFORWARD
+static float ff_step[PIDNUMBER];
+#endif
+
+#ifdef ADVANCED_PID_CONTROLLER
+// setpoint weight = fabsf( rx ) * transition_slope + transition_offset
+static float kd_setpoint[PIDNUMBER];
+static float transition_slope[PIDNUMBER];
+static float transition_offset[PIDNUMBER];
+static int pid_profile = -1;
+#endif
+
+static void pid_gains( void)
+{
+	for ( int x = 0 ; x < PIDNUMBER ; x++)
+	{
+#ifdef ENABLE_SETPOINT_WEIGHTING
+		kp_error[x] = b[x] * pidkp[x];
+		kp_gyro[x] = ( 1.0f - b[x] ) * pidkp[x];
+#else
+		kp_error[x] = pidkp[x];
+		kp_gyro[x] = 0;
+#endif
+		ki_step[x] = INTEGRAL_FACTOR * pidki[x] * looptime;
+		kd_step[x] = pidkd[x] * timefactor;
+#ifdef RC_FEEDFORWARD
+		ff_step[x] = (float) RC_FEEDFORWARD * kd_step[x];
+#endif
+
+#ifdef ADVANCED_PID_CONTROLLER
+		float stickAccelerator , stickTransition;
+		if ( pid_profile ){
+			stickAccelerator = stickAcceleratorProfileB[x];
+			stickTransition = stickTransitionProfileB[x];
 		}else{
-			  if (onground) ierror[x] *= 0.98f;
+			stickAccelerator = stickAcceleratorProfileA[x];
+			stickTransition = stickTransitionProfileA[x];
 		}
-	
+		kd_setpoint[x] = kd_step[x] * stickAccelerator;
+		transition_slope[x] = stickAccelerator < 1 ? stickTransition : stickTransition / stickAccelerator;
+		transition_offset[x] = 1 - stickTransition;
+#endif
+	}
+	pid_gains_changed = 0;
+}
 
+// pid calculation for acro ( rate ) mode, all axes in one pass
+// input: error[x] = setpoint - gyro
+// output: pidoutput[x] = change required from motors
+RAMFUNC void pid_calc( void)
+{
 // pid tuning via analog aux channels
 #ifdef ANALOG_AUX_PIDS
-    apply_analog_aux_to_pids();
+	apply_analog_aux_to_pids();
+#endif
+
+#ifdef ADVANCED_PID_CONTROLLER
+	extern float rxcopy[4];
+	if ( aux[PIDPROFILE] != pid_profile )
+	{
+		pid_profile = aux[PIDPROFILE];
+		pid_gains_changed = 1;
+	}
+#endif
+
+	if ( pid_gains_changed ) pid_gains();
+
+	// integral decay on the ground
+	int idecay;
+	if ((aux[LEVELMODE]) && (!aux[RACEMODE])){
+		idecay = onground || in_air == 0;
+	}else{
+		idecay = onground;
+	}
+
+	for ( int x = 0 ; x < PIDNUMBER ; x++)
+	{
+		if ( idecay ) ierror[x] *= 0.98f;
 
-#endif		
-    
 #ifdef TRANSIENT_WINDUP_PROTECTION
-    static float avgSetpoint[3];
-    static int count[3];
-    extern float splpf( float in,int num );
-    
-    if ( x < 2 && (count[x]++ % 2) == 0 ) {
-        avgSetpoint[x] = splpf( setpoint[x], x );
-    }
+		static float avgSetpoint[3];
+		static int count[3];
+		extern float splpf( float in,int num );
+
+		if ( x < 2 && (count[x]++ % 2) == 0 ) {
+			avgSetpoint[x] = splpf( setpoint[x], x );
+		}
 #endif
-    	
-    int iwindup = 0;
-    if (( pidoutput[x] == outlimit[x] )&& ( error[x] > 0) )
-    {
-        iwindup = 1;		
-    }
-    
-    if (( pidoutput[x] == -outlimit[x])&& ( error[x] < 0) )
-    {
-        iwindup = 1;				
-    } 
-		
-    
-    #ifdef ANTI_WINDUP_DISABLE
-    iwindup = 0;
-    #endif
-		
 
-    #ifdef TRANSIENT_WINDUP_PROTECTION
-	  if ( x < 2 && fabsf( setpoint[x] - avgSetpoint[x] ) > 0.1f ) {
-		iwindup = 1;
+		int iwindup = 0;
+		if (( pidoutput[x] == outlimit[x] )&& ( error[x] > 0) )
+		{
+			iwindup = 1;
+		}
+
+		if (( pidoutput[x] == -outlimit[x])&& ( error[x] < 0) )
+		{
+			iwindup = 1;
+		}
+
+		#ifdef ANTI_WINDUP_DISABLE
+		iwindup = 0;
+		#endif
+
+		#ifdef TRANSIENT_WINDUP_PROTECTION
+		if ( x < 2 && fabsf( setpoint[x] - avgSetpoint[x] ) > 0.1f ) {
+			iwindup = 1;
+		}
+		#endif
+
+		if ( !iwindup)
+		{
+			#ifdef MIDPOINT_RULE_INTEGRAL
+			// trapezoidal rule instead of rectangular
+			ierror[x] = ierror[x] + (error[x] + lasterror[x]) * ki_step[x];
+			lasterror[x] = error[x];
+			#endif
+
+			#ifdef RECTANGULAR_RULE_INTEGRAL
+			ierror[x] = ierror[x] + error[x] * ki_step[x];
+			lasterror[x] = error[x];
+			#endif
+
+			#ifdef SIMPSON_RULE_INTEGRAL
+			// assuming similar time intervals
+			ierror[x] = ierror[x] + (lasterror2[x] + 4*lasterror[x] + error[x]) * ki_step[x];
+			lasterror2[x] = lasterror[x];
+			lasterror[x] = error[x];
+			#endif
+		}
+
+		limitf( &ierror[x] , integrallimit[x] );
+
+		// P term with setpoint weighting
+		pidoutput[x] = error[x] * kp_error[x] - gyro[x] * kp_gyro[x];
+
+		// I term
+		pidoutput[x] += ierror[x];
+
+		// D term
+		// skip yaw D term if not set
+		if ( kd_step[x] > 0 )
+		{
+			#ifdef NORMAL_DTERM
+			pidoutput[x] = pidoutput[x] - (gyro[x] - lastrate[x]) * kd_step[x];
+			lastrate[x] = gyro[x];
+			#endif
+
+			#ifdef NEW_DTERM
+			pidoutput[x] = pidoutput[x] - ( ( 0.5f) *gyro[x]
+						- (0.5f) * lastratexx[x][1] ) * kd_step[x];
+
+			lastratexx[x][1] = lastratexx[x][0];
+			lastratexx[x][0] = gyro[x];
+			#endif
+
+			#ifdef MAX_FLAT_LPF_DIFF_DTERM
+			pidoutput[x] = pidoutput[x] - ( + 0.125f *gyro[x] + 0.250f * lastratexx[x][0]
+						- 0.250f * lastratexx[x][2] - ( 0.125f) * lastratexx[x][3]) * kd_step[x];
+
+			lastratexx[x][3] = lastratexx[x][2];
+			lastratexx[x][2] = lastratexx[x][1];
+			lastratexx[x][1] = lastratexx[x][0];
+			lastratexx[x][0] = gyro[x];
+			#endif
+
+			#if defined DTERM_LPF_1ST_HZ || defined DTERM_LPF_2ND_HZ
+			float dterm;
+			static float lastrate[3];
+			#ifdef ADVANCED_PID_CONTROLLER
+			// stick accelerator and transition from the pid profile
+			static float lastsetpoint[3];
+			float transitionSetpointWeight = fabsf( rxcopy[x] ) * transition_slope[x] + transition_offset[x];
+			dterm = (setpoint[x] - lastsetpoint[x]) * kd_setpoint[x] * transitionSetpointWeight - (gyro[x] - lastrate[x]) * kd_step[x];
+			lastsetpoint[x] = setpoint[x];
+			#else
+			dterm = - (gyro[x] - lastrate[x]) * kd_step[x];
+			#endif
+			lastrate[x] = gyro[x];
+			#endif
+
+			#ifdef DTERM_LPF_1ST_HZ
+			float lpf1( float in, int num);
+			pidoutput[x] += lpf1( dterm, x );
+			#endif
+
+			#ifdef DTERM_LPF_2ND_HZ
+			float lpf2( float in, int num);
+			pidoutput[x] += lpf2( dterm, x );
+			#endif
+		}
+
+#ifdef RC_FEEDFORWARD
+		// feed forward of the smoothed setpoint , not through the d term filter
+		pidoutput[x] += setpoint_step[x] * ff_step[x];
+#endif
+
+		limitf(  &pidoutput[x] , outlimit[x]);
+
+#ifdef PID_VOLTAGE_COMPENSATION
+		pidoutput[x] *= v_compensation;
+#endif
 	}
-    #endif
-    
-    if ( !iwindup)
-    {
-        #ifdef MIDPOINT_RULE_INTEGRAL
-         // trapezoidal rule instead of rectangular
-        ierror[x] = ierror[x] + (error[x] + lasterror[x]) * 0.5f *  pidki[x] * looptime;
-        lasterror[x] = error[x];
-        #endif
-            
-        #ifdef RECTANGULAR_RULE_INTEGRAL
-        ierror[x] = ierror[x] + error[x] *  pidki[x] * looptime;
-        lasterror[x] = error[x];					
-        #endif
-            
-        #ifdef SIMPSON_RULE_INTEGRAL
-        // assuming similar time intervals
-        ierror[x] = ierror[x] + 0.166666f* (lasterror2[x] + 4*lasterror[x] + error[x]) *  pidki[x] * looptime;	
-        lasterror2[x] = lasterror[x];
-        lasterror[x] = error[x];
-        #endif					
-    }
-            
-    limitf( &ierror[x] , integrallimit[x] );
-    
-    
-    #ifdef ENABLE_SETPOINT_WEIGHTING
-    // P term
-    pidoutput[x] = error[x] * ( b[x])* pidkp[x];				
-    // b
-    pidoutput[x] +=  - ( 1.0f - b[x])* pidkp[x] * gyro[x];
-    #else
-    // P term with b disabled
-    pidoutput[x] = error[x] * pidkp[x];
-    #endif
-    
-    // I term	
-    pidoutput[x] += ierror[x];
-
-    // D term
-    // skip yaw D term if not set               
-    if ( pidkd[x] > 0 )
-    {
-        #ifdef NORMAL_DTERM
-        pidoutput[x] = pidoutput[x] - (gyro[x] - lastrate[x]) * pidkd[x] * timefactor  ;
-        lastrate[x] = gyro[x];
-        #endif
-
-        #ifdef NEW_DTERM
-        pidoutput[x] = pidoutput[x] - ( ( 0.5f) *gyro[x] 
-                    - (0.5f) * lastratexx[x][1] ) * pidkd[x] * timefactor  ;
-                        
-        lastratexx[x][1] = lastratexx[x][0];
-        lastratexx[x][0] = gyro[x];
-        #endif
-    
-        #ifdef MAX_FLAT_LPF_DIFF_DTERM 
-        pidoutput[x] = pidoutput[x] - ( + 0.125f *gyro[x] + 0.250f * lastratexx[x][0]
-                    - 0.250f * lastratexx[x][2] - ( 0.125f) * lastratexx[x][3]) * pidkd[x] * timefactor 						;
-
-        lastratexx[x][3] = lastratexx[x][2];
-        lastratexx[x][2] = lastratexx[x][1];
-        lastratexx[x][1] = lastratexx[x][0];
-        lastratexx[x][0] = gyro[x];
-        #endif 
-
-
-        #if (defined DTERM_LPF_1ST_HZ && !defined ADVANCED_PID_CONTROLLER)
-        float dterm;
-        static float lastrate[3];
-        static float dlpf[3] = {0};
-
-        dterm = - (gyro[x] - lastrate[x]) * pidkd[x] * timefactor;
-        lastrate[x] = gyro[x];
-
-        lpf( &dlpf[x], dterm, FILTERCALC( 0.001 , 1.0f/DTERM_LPF_1ST_HZ ) );
-
-        pidoutput[x] += dlpf[x];                   
-        #endif
-				
-        #if (defined DTERM_LPF_1ST_HZ && defined ADVANCED_PID_CONTROLLER)
-				extern float rxcopy[4];		
-        float dterm;		
-				float transitionSetpointWeight[3];
-				float stickAccelerator[3];
- 			float stickTransition[3];
-			if (aux[PIDPROFILE]){
-				stickAccelerator[x] = stickAcceleratorProfileB[x];
-				stickTransition[x] = stickTransitionProfileB[x];
-			}else{
-				stickAccelerator[x] = stickAcceleratorProfileA[x];
-				stickTransition[x] = stickTransitionProfileA[x];
-			}				
-				if (stickAccelerator[x] < 1){
-				transitionSetpointWeight[x] = (fabs(rxcopy[x]) * stickTransition[x]) + (1- stickTransition[x]);
-			}else{
-				transitionSetpointWeight[x] = (fabs(rxcopy[x]) * (stickTransition[x] / stickAccelerator[x])) + (1- stickTransition[x]);	
-				}
-        static float lastrate[3];
-				static float lastsetpoint[3];
-        static float dlpf[3] = {0};
-        if ( pidkd[x] > 0){
-						dterm = ((setpoint[x] - lastsetpoint[x]) * pidkd[x] * stickAccelerator[x] * transitionSetpointWeight[x] * timefactor) - ((gyro[x] - lastrate[x]) * pidkd[x] * timefactor);
-						lastsetpoint[x] = setpoint [x];
-						lastrate[x] = gyro[x];	
-						lpf( &dlpf[x], dterm, FILTERCALC( 0.001 , 1.0f/DTERM_LPF_1ST_HZ ) );
-						pidoutput[x] += dlpf[x]; }                   
-        #endif	
-     
-
-        
-        #if (defined DTERM_LPF_2ND_HZ && !defined ADVANCED_PID_CONTROLLER)
-        float dterm;
-        static float lastrate[3];			
-        float lpf2( float in, int num);
-        if ( pidkd[x] > 0)
-        {
-            dterm = - (gyro[x] - lastrate[x]) * pidkd[x] * timefactor;
-            lastrate[x] = gyro[x];
-            dterm = lpf2(  dterm, x );
-            pidoutput[x] += dterm;
-        }                       
-        #endif
-				
-				#if (defined DTERM_LPF_2ND_HZ && defined ADVANCED_PID_CONTROLLER)
-				extern float rxcopy[4];		
-        float dterm;		
-				float transitionSetpointWeight[3];
-				float stickAccelerator[3];
-				float stickTransition[3];
-			if (aux[PIDPROFILE]){
-				stickAccelerator[x] = stickAcceleratorProfileB[x];
-				stickTransition[x] = stickTransitionProfileB[x];
-			}else{
-				stickAccelerator[x] = stickAcceleratorProfileA[x];
-				stickTransition[x] = stickTransitionProfileA[x];
-			}
-				if (stickAccelerator[x] < 1){
-				transitionSetpointWeight[x] = (fabs(rxcopy[x]) * stickTransition[x]) + (1- stickTransition[x]);
-				}else{
-				transitionSetpointWeight[x] = (fabs(rxcopy[x]) * (stickTransition[x] / stickAccelerator[x])) + (1- stickTransition[x]);	
-				}
-        static float lastrate[3];
-				static float lastsetpoint[3];
-        float lpf2( float in, int num);
-        if ( pidkd[x] > 0){
-						dterm = ((setpoint[x] - lastsetpoint[x]) * pidkd[x] * stickAccelerator[x] * transitionSetpointWeight[x] * timefactor) - ((gyro[x] - lastrate[x]) * pidkd[x] * timefactor);
-						lastsetpoint[x] = setpoint [x];
-						lastrate[x] = gyro[x];	
-            dterm = lpf2(  dterm, x );
-            pidoutput[x] += dterm;}
-				#endif
-	
-    }
-   
+}
+#else
 
-		
-    limitf(  &pidoutput[x] , outlimit[x]);
-		
-		#ifdef PID_VOLTAGE_COMPENSATION
-	pidoutput[x] *= v_compensation;
+// fixed point pid, same terms as the float version above
+// gains are converted only when the float gains change ( gestures, dual pids, analog aux , looptime )
+
+#ifdef ADVANCED_PID_CONTROLLER
+#error "ADVANCED_PID_CONTROLLER is not supported with FIXED_POINT"
 #endif
 
-return pidoutput[x];		 		
+#ifdef TRANSIENT_WINDUP_PROTECTION
+#error "TRANSIENT_WINDUP_PROTECTION is not supported with FIXED_POINT"
+#endif
+
+#if defined NORMAL_DTERM || defined NEW_DTERM || defined MAX_FLAT_LPF_DIFF_DTERM || defined DTERM_LPF_1ST_HZ
+#error "FIXED_POINT only supports the DTERM_LPF_2ND_HZ d term"
+#endif
+
+#ifdef SIMPSON_RULE_INTEGRAL
+static int32_t lasterror2_q[PIDNUMBER];
+#endif
+
+extern int32_t gyro_q[3];
+
+// the integral is kept in Q30 ( limits are below 1 ), Q16 steps are too coarse for small errors
+#define IERROR_SHIFT 14
+
+int32_t ierror_q[PIDNUMBER];
+int32_t pidoutput_q[PIDNUMBER];
+
+// rate setpoint in Q16 , set by control.c , the error is taken against gyro_q here
+int32_t setpoint_q[PIDNUMBER];
+#ifdef RC_FEEDFORWARD
+int32_t setpoint_step_q[PIDNUMBER];
+#endif
+
+static int32_t lasterror_q[PIDNUMBER];
+static int32_t lastrate_q[PIDNUMBER];
+
+// Q16 except ki_q which is Q31 and integrallimit_q which is Q30
+static int32_t kp_error_q[PIDNUMBER];
+static int32_t kp_gyro_q[PIDNUMBER];
+static int32_t ki_q[PIDNUMBER];
+static int32_t kd_q[PIDNUMBER];
+#ifdef RC_FEEDFORWARD
+static int32_t ff_q[PIDNUMBER];
+#endif
+static int32_t outlimit_q[PIDNUMBER];
+static int32_t integrallimit_q[PIDNUMBER];
+static int32_t v_compensation_q = FIXED_ONE;
+
+int32_t lpf2_q( int32_t in , int num );
+
+// Q16 error * Q31 gain to Q30
+static int32_t ierror_step( int32_t error , int32_t ki )
+{
+	return (int32_t) ( ( (int64_t) error * ki + ( 1 << ( 30 - IERROR_SHIFT ) ) ) >> ( 31 - IERROR_SHIFT ) );
+}
+
+static void pid_gains_fixed( void)
+{
+	for ( int x = 0 ; x < PIDNUMBER ; x++)
+	{
+#ifdef ENABLE_SETPOINT_WEIGHTING
+		kp_error_q[x] = FLOAT_TO_FIXED( b[x] * pidkp[x] );
+		kp_gyro_q[x] = FLOAT_TO_FIXED( ( 1.0f - b[x] ) * pidkp[x] );
+#else
+		kp_error_q[x] = FLOAT_TO_FIXED( pidkp[x] );
+		kp_gyro_q[x] = 0;
+#endif
+		ki_q[x] = FLOAT_TO_FIXED31( INTEGRAL_FACTOR * pidki[x] * looptime );
+		kd_q[x] = FLOAT_TO_FIXED( pidkd[x] * timefactor );
+#ifdef RC_FEEDFORWARD
+		ff_q[x] = FLOAT_TO_FIXED( (float) RC_FEEDFORWARD * pidkd[x] * timefactor );
+#endif
+		outlimit_q[x] = FLOAT_TO_FIXED( outlimit[x] );
+		integrallimit_q[x] = FLOAT_TO_FIXED( integrallimit[x] ) << IERROR_SHIFT;
+	}
+	pid_gains_changed = 0;
+}
+
+// pid calculation for acro ( rate ) mode, all axes in one pass
+// input: setpoint_q[x] , gyro_q[x]
+// output: pidoutput_q[x] = change required from motors
+RAMFUNC void pid_calc( void)
+{
+// pid tuning via analog aux channels
+#ifdef ANALOG_AUX_PIDS
+	apply_analog_aux_to_pids();
+#endif
+
+	if ( pid_gains_changed ) pid_gains_fixed();
+
+#ifdef PID_VOLTAGE_COMPENSATION
+	v_compensation_q = FLOAT_TO_FIXED( v_compensation );
+#endif
+
+	// integral decay on the ground
+	int idecay;
+	if ((aux[LEVELMODE]) && (!aux[RACEMODE])){
+		idecay = onground || in_air == 0;
+	}else{
+		idecay = onground;
+	}
+
+	for ( int x = 0 ; x < PIDNUMBER ; x++)
+	{
+		if ( idecay ) ierror_q[x] = fixed_mul( ierror_q[x] , FIXED( 0.98f ) );
+
+		int32_t error_q = setpoint_q[x] - gyro_q[x];
+
+		int iwindup = 0;
+		if (( pidoutput_q[x] == outlimit_q[x] )&& ( error_q > 0) )
+		{
+			iwindup = 1;
+		}
+
+		if (( pidoutput_q[x] == -outlimit_q[x])&& ( error_q < 0) )
+		{
+			iwindup = 1;
+		}
+
+		#ifdef ANTI_WINDUP_DISABLE
+		iwindup = 0;
+		#endif
+
+		if ( !iwindup)
+		{
+			#ifdef MIDPOINT_RULE_INTEGRAL
+			ierror_q[x] += ierror_step( error_q + lasterror_q[x] , ki_q[x] );
+			#endif
+
+			#ifdef RECTANGULAR_RULE_INTEGRAL
+			ierror_q[x] += ierror_step( error_q , ki_q[x] );
+			#endif
+
+			#ifdef SIMPSON_RULE_INTEGRAL
+			ierror_q[x] += ierror_step( lasterror2_q[x] + 4 * lasterror_q[x] + error_q , ki_q[x] );
+			lasterror2_q[x] = lasterror_q[x];
+			#endif
+			lasterror_q[x] = error_q;
+		}
+
+		ierror_q[x] = fixed_limit( ierror_q[x] , integrallimit_q[x] );
+
+		// P term with setpoint weighting
+		int32_t out = fixed_mul( error_q , kp_error_q[x] ) - fixed_mul( gyro_q[x] , kp_gyro_q[x] );
+
+		// I term
+		out += ( ierror_q[x] + ( 1 << ( IERROR_SHIFT - 1 ) ) ) >> IERROR_SHIFT;
+
+		// D term
+		// skip yaw D term if not set
+		#ifdef DTERM_LPF_2ND_HZ
+		if ( kd_q[x] > 0 )
+		{
+			int32_t dterm = - fixed_mul( gyro_q[x] - lastrate_q[x] , kd_q[x] );
+			lastrate_q[x] = gyro_q[x];
+			out += lpf2_q( dterm , x );
+		}
+		#endif
+
+#ifdef RC_FEEDFORWARD
+		// feed forward of the smoothed setpoint , not through the d term filter
+		out += fixed_mul( setpoint_step_q[x] , ff_q[x] );
+#endif
+
+		out = fixed_limit( out , outlimit_q[x] );
+
+	#ifdef PID_VOLTAGE_COMPENSATION
+		out = fixed_mul( out , v_compensation_q );
+	#endif
+
+		pidoutput_q[x] = out;
+#if !defined MIXER_FIXED || defined BLACKBOX
+		// for the float mixer options and the log
+		pidoutput[x] = FIXED_TO_FLOAT( out );
+#endif
+	}
 }
+#endif
 
 // calculate change from ideal loop time
 // 0.0032f is there for legacy purposes, should be 0.001f = looptime
 // this is called in advance as an optimization because it has division
 void pid_precalc()
 {
-	timefactor = 0.0032f / looptime;
+	static float lastlooptime;
+	if ( looptime != lastlooptime )
+	{
+		lastlooptime = looptime;
+		timefactor = 0.0032f / looptime;
+		pid_gains_changed = 1;
+	}
 	#ifdef PID_VOLTAGE_COMPENSATION
 	v_compensation = mapf ( vbattfilt , 3.00 , 4.00 , PID_VC_FACTOR , 1.00);
 	if( v_compensation > PID_VC_FACTOR) v_compensation = PID_VC_FACTOR;
@@ -524,28 +739,20 @@ void pid_init()
 }
 
 
-#ifndef DTERM_LPF_2ND_HZ 
-#define DTERM_LPF_2ND_HZ 99
-#endif
-
-//the compiler calculates these
-static float two_one_minus_alpha = 2*FILTERCALC( 0.001 , (1.0f/DTERM_LPF_2ND_HZ) );
-static float one_minus_alpha_sqr = (FILTERCALC( 0.001 , (1.0f/DTERM_LPF_2ND_HZ) ) )*(FILTERCALC( 0.001 , (1.0f/DTERM_LPF_2ND_HZ) ));
-static float alpha_sqr = (1 - FILTERCALC( 0.001 , (1.0f/DTERM_LPF_2ND_HZ) ))*(1 - FILTERCALC( 0.001 , (1.0f/DTERM_LPF_2ND_HZ) ));
-
-static float last_out[3], last_out2[3];
-
-float lpf2( float in, int num)
- {
-
-  float ans = in * alpha_sqr + two_one_minus_alpha * last_out[num]
-      - one_minus_alpha_sqr * last_out2[num];   
+// selects the working pid set, 0: pidkp1.. 1: pidkp2..
+// called on a set change instead of copying the set every loop
+void pid_set( int set )
+{
+	float ** pids = set ? pids_array2 : pids_array;
+	for ( int x = 0 ; x < PIDNUMBER ; x++)
+	{
+		pidkp[x] = pids[0][x];
+		pidki[x] = pids[1][x];
+		pidkd[x] = pids[2][x];
+	}
+	pid_gains_changed = 1;
+}
 
-  last_out2[num] = last_out[num];
-  last_out[num] = ans;
-  
-  return ans;
- }
 
 // below are functions used with gestures for changing pids by a percentage
 
@@ -624,6 +831,7 @@ int change_pid_value(int increase)
 	}
     
 	current_pid_term_pointer[current_pid_axis] = current_pid_term_pointer[current_pid_axis] * multiplier;
+	pid_gains_changed = 1;
 	
 // -------------- DUAL PIDS CODE -------------
 #ifdef ENABLE_DUAL_PIDS
@@ -683,6 +891,7 @@ int decrease_pid()
 }
 
 
+#ifndef FIXED_POINT
 void rotateErrors()
 {
 
@@ -699,9 +908,32 @@ void rotateErrors()
 	ierror[1] += ierror[0] * gyro[2] * looptime;
 
 }
+#else
+void rotateErrors()
+{
+	static uint32_t looptime_bits;
+	static int32_t looptime_q;
 
+	// looptime scaled so that gyro_q * looptime_q gives the angle in Q31
+	if ( float_bits( looptime ) != looptime_bits )
+	{
+		looptime_bits = float_bits( looptime );
+		looptime_q = FLOAT_TO_FIXED( looptime * 32768.0f );
+	}
 
+	int32_t angle[3];
+	for ( int i = 0 ; i < 3 ; i++) angle[i] = fixed_mul( gyro_q[i] , looptime_q );
 
+	// rotation around x axis:
+	ierror_q[1] -= fixed_mul31( ierror_q[2] , angle[0] );
+	ierror_q[2] += fixed_mul31( ierror_q[1] , angle[0] );
 
+	// rotation around y axis:
+	ierror_q[2] -= fixed_mul31( ierror_q[0] , angle[1] );
+	ierror_q[0] += fixed_mul31( ierror_q[2] , angle[1] );
 
-
+	// rotation around z axis:
+	ierror_q[0] -= fixed_mul31( ierror_q[1] , angle[2] );
+	ierror_q[1] += fixed_mul31( ierror_q[0] , angle[2] );
+}
+#endif
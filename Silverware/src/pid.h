@@ -1,5 +1,6 @@
 
-float pid( int x );
+void pid_calc( void);
+void pid_set( int set ); // 0 - pid set 1, 1 - pid set 2
 int next_pid_term( void); // Return value : 0 - p, 1 - i, 2 - d
 int next_pid_axis( void); // Return value : 0 - Roll, 1 - Pitch, 2 - Yaw
 int increase_pid( void );
@@ -0,0 +1,166 @@
+// main loop profiler
+// timestamps each stage of the main loop with the SysTick counter ( 1/6 uS at 48MHz )
+// and keeps min / max / mean and a histogram per stage in profile[]
+// the table can be read with the debugger, or is printed over serial if SERIAL_ENABLE is set
+// ram use is about 40 bytes per stage
+
+#include "project.h"
+#include "config.h"
+#include "profiler.h"
+
+#ifdef LOOP_PROFILER
+
+// systick runs from hclk / 8 ( see drv_time.c )
+#define PROFILE_TICKS_PER_US ( SYS_CLOCK_FREQ_HZ / 8000000 )
+#define PROFILE_CYCLES_PER_TICK 8
+
+// histogram bucket upper limits in uS, the last bucket holds everything above
+// scaled to the gyro loop, 5 , 10 , 20 ... 500 , 980 , 1020 , 1100 at 1kHz
+static const uint16_t profile_limits[PROFILE_BUCKETS - 1] =
+{
+	GYRO_LOOPTIME / 200 , GYRO_LOOPTIME / 100 , GYRO_LOOPTIME / 50 , GYRO_LOOPTIME / 20 ,
+	GYRO_LOOPTIME / 10 , GYRO_LOOPTIME / 5 , GYRO_LOOPTIME * 3 / 10 , GYRO_LOOPTIME / 2 ,
+	GYRO_LOOPTIME - 20 , GYRO_LOOPTIME + 20 , GYRO_LOOPTIME + 100
+};
+
+profile_type profile[PROFILE_STAGES];
+
+static uint32_t loopstart;
+static uint32_t lastmark;
+static int started = 0;
+
+// systick counts down and reloads every second
+static uint32_t ticks_since( uint32_t then , uint32_t now )
+{
+	if ( now <= then ) return then - now;
+	return then + ( SysTick->LOAD + 1 ) - now;
+}
+
+static void profile_add( int stage , uint32_t ticks )
+{
+	profile_type *p = &profile[stage];
+
+	if ( !p->count || ticks < p->min ) p->min = ticks;
+	if ( ticks > p->max ) p->max = ticks;
+	p->sum += ticks;
+	p->count++;
+
+	uint32_t us = ticks / PROFILE_TICKS_PER_US;
+	int bucket = 0;
+	while ( bucket < PROFILE_BUCKETS - 1 && us > profile_limits[bucket] ) bucket++;
+	if ( p->histogram[bucket] < 0xFFFF ) p->histogram[bucket]++;
+}
+
+void profiler_start( void)
+{
+	uint32_t now = SysTick->VAL;
+
+	if ( started ) profile_add( PROFILE_LOOP , ticks_since( loopstart , now ) );
+	started = 1;
+
+	loopstart = now;
+	lastmark = now;
+}
+
+void profiler_mark( int stage)
+{
+	// sixaxis_read() also runs for the gyro calibration , before the loop
+	if ( !started ) return;
+
+	uint32_t now = SysTick->VAL;
+
+	profile_add( stage , ticks_since( lastmark , now ) );
+	lastmark = now;
+}
+
+void profiler_end( void)
+{
+	profile_add( PROFILE_BUSY , ticks_since( loopstart , SysTick->VAL ) );
+}
+
+void profiler_reset( void)
+{
+	for ( int i = 0 ; i < PROFILE_STAGES ; i++)
+	{
+		profile[i].min = 0;
+		profile[i].max = 0;
+		profile[i].sum = 0;
+		profile[i].count = 0;
+		for ( int j = 0 ; j < PROFILE_BUCKETS ; j++) profile[i].histogram[j] = 0;
+	}
+	started = 0;
+}
+
+#ifdef SERIAL_ENABLE
+
+extern void print_int( int val );
+extern void print_float( float val );
+extern void print_str( const char *str );
+extern int serial_free( void);
+
+static const char *profile_names[PROFILE_STAGES] =
+{
+	"sixaxis" , "gyro" , "pid" , "control" , "imu" , "battery" , "gestures" ,
+	"leds" , "misc" , "rx" , "busy" , "loop"
+};
+
+// prints one field per call when the serial buffer has room, so it never blocks the loop
+// line format: name min mean max ( uS ) mean cycles : histogram counts
+// the gyro and pid cycles are the ones to compare between the float and the FIXED_POINT build
+void profiler_dump( void)
+{
+	static int stage = 0;
+	static int field = 0;
+
+	if ( serial_free() < 16 ) return;
+
+	profile_type *p = &profile[stage];
+	float scale = 1.0f / PROFILE_TICKS_PER_US;
+
+	switch ( field )
+	{
+		case 0:
+			print_str( profile_names[stage] );
+			break;
+		case 1:
+			print_str( " " );
+			print_float( p->min * scale );
+			break;
+		case 2:
+			print_str( " " );
+			print_float( p->count ? (float) ( p->sum / p->count ) * scale : 0.0f );
+			break;
+		case 3:
+			print_str( " " );
+			print_float( p->max * scale );
+			break;
+		case 4:
+			print_str( " " );
+			print_int( p->count ? (int) ( p->sum * PROFILE_CYCLES_PER_TICK / p->count ) : 0 );
+			print_str( " :" );
+			break;
+		default:
+			if ( field - 5 < PROFILE_BUCKETS )
+			{
+				print_str( " " );
+				print_int( p->histogram[field - 5] );
+			}
+			else
+			{
+				print_str( "\r\n" );
+				field = -1;
+				stage++;
+				if ( stage >= PROFILE_STAGES ) stage = 0;
+			}
+			break;
+	}
+	field++;
+}
+#else
+void profiler_dump( void)
+{
+
+}
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+
+#include <inttypes.h>
+
+// main loop stages, in loop order
+enum profile_stages
+{
+	PROFILE_SIXAXIS = 0,	// the sensor read
+	PROFILE_GYRO,		// gyro decode and filters
+	PROFILE_PID,		// rx , setpoints and pid
+	PROFILE_CONTROL,	// mixer and motor output
+	PROFILE_IMU,
+	PROFILE_BATTERY,
+	PROFILE_GESTURES,
+	PROFILE_LEDS,
+	PROFILE_MISC,
+	PROFILE_RX,
+	PROFILE_BUSY,		// loop start to end of checkrx
+	PROFILE_LOOP,		// loop start to next loop start ( jitter )
+	PROFILE_STAGES
+};
+
+#define PROFILE_BUCKETS 12
+
+typedef struct profile
+{
+	uint32_t min;
+	uint32_t max;
+	unsigned long long sum;
+	uint32_t count;
+	uint16_t histogram[PROFILE_BUCKETS];
+} profile_type;
+
+void profiler_start( void);
+void profiler_mark( int stage);
+void profiler_end( void);
+void profiler_reset( void);
+void profiler_dump( void);
+
+#ifdef LOOP_PROFILER
+#define PROFILE_START() profiler_start()
+#define PROFILE_MARK( stage ) profiler_mark( stage )
+#define PROFILE_END() profiler_end()
+#else
+#define PROFILE_START()
+#define PROFILE_MARK( stage )
+#define PROFILE_END()
+#endif
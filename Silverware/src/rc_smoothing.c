@@ -0,0 +1,85 @@
+// rc smoothing for low rate rx links
+// the rx drivers call rc_smoothing_frame() when a frame is decoded, the frame interval is measured
+// in pid loops and the sticks ramp from where they are to the new frame over one interval
+// so the setpoint moves a little every loop instead of stepping at the frame rate ( one frame of delay )
+// the ramp slope is the stick rate of change, used for the feed forward in pid.c ( RC_FEEDFORWARD )
+// without frames ( failsafe , a driver without the call ) the sticks pass through unchanged
+
+#include "config.h"
+#include "defines.h"
+
+#ifdef RC_SMOOTHING
+
+// longer gaps are lost frames, not used for the interval ( 50ms )
+#define RC_FRAME_MAX_LOOPS ( 50000 / LOOPTIME )
+
+// frame interval filter
+#define RC_INTERVAL_SMOOTH 0.1f
+
+extern float rx[];
+
+// smoothed sticks and their change per loop
+float rx_smooth[3];
+float rx_smooth_step[3];
+// rx_smooth_step was written , for the fixed point feed forward in control.c
+int rx_smooth_changed;
+
+// measured frame interval in pid loops, 0 until the first one
+float rc_frame_loops;
+
+static volatile int rc_frame;
+static int rc_loops;
+static int rc_ramp;
+static int rc_step_zero = 1;
+
+void rc_smoothing_frame( void)
+{
+	rc_frame = 1;
+}
+
+// once per pid loop, before the sticks are used
+void rc_smoothing( void)
+{
+	if ( rc_loops < RC_FRAME_MAX_LOOPS ) rc_loops++;
+
+	if ( rc_frame )
+	{
+		rc_frame = 0;
+		if ( rc_loops < RC_FRAME_MAX_LOOPS )
+		{
+			if ( rc_frame_loops == 0 ) rc_frame_loops = rc_loops;
+			else rc_frame_loops += ( rc_loops - rc_frame_loops ) * RC_INTERVAL_SMOOTH;
+		}
+		rc_loops = 0;
+
+		rc_ramp = rc_frame_loops + 0.5f;
+		if ( rc_ramp < 1 ) rc_ramp = 1;
+		float ramp_inv = 1.0f / rc_ramp;
+		for ( int i = 0 ; i < 3 ; i++)
+		{
+			rx_smooth_step[i] = ( rx[i] - rx_smooth[i] ) * ramp_inv;
+		}
+		rc_step_zero = 0;
+		rx_smooth_changed = 1;
+	}
+
+	if ( rc_ramp > 1 )
+	{
+		rc_ramp--;
+		for ( int i = 0 ; i < 3 ; i++) rx_smooth[i] += rx_smooth_step[i];
+	}
+	else
+	{
+		// last step of the ramp lands on the frame
+		if ( !rc_ramp && !rc_step_zero )
+		{
+			for ( int i = 0 ; i < 3 ; i++) rx_smooth_step[i] = 0;
+			rc_step_zero = 1;
+			rx_smooth_changed = 1;
+		}
+		rc_ramp = 0;
+		for ( int i = 0 ; i < 3 ; i++) rx_smooth[i] = rx[i];
+	}
+}
+
+#endif
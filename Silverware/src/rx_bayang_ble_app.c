@@ -46,6 +46,7 @@ THE SOFTWARE.
 #include "rx_bayang.h"
 
 #include "util.h"
+#include "crc.h"
 #define RX_MODE_BIND RXMODE_BIND
 #define RX_MODE_NORMAL RXMODE_NORMAL
 
@@ -348,40 +349,6 @@ for ( int i = string_len ; i < 6; i++)
 
 
 
-void btLeCrc( uint8_t* buf ,uint8_t len, uint8_t* dst ) {
-
-union
-{
-  unsigned int int32;
-  uint8_t u8[4];
-} myint;
-
-myint.int32 = 0x00aaaaaa;
-
-while (len--) 
-	{
-	uint8_t d = *(buf++);
-	for ( int i=8 ; i>0 ; i--) 
-		{
-		uint8_t t = myint.int32&1;			
-		myint.int32>>=1;
-		if (t != (d & 1)) 
-			{
-			myint.u8[2] ^= 0xDA;
-			myint.u8[1] ^= 0x60;
-			}
-		 d >>=1;
-		}
-	}
-
-for ( int i = 0 ; i < 3 ; i++ )
-		dst[i] = (myint.u8[i]);
-
-}
-
-
-
-
 // scrambling sequence for xn297
 const uint8_t xn297_scramble[] = {
     0xe3, 0xb1, 0x4b, 0xea, 0x85, 0xbc, 0xe5, 0x66,
@@ -473,18 +440,14 @@ return swapbits(chLe[chan]) | 2;
 
 void btLePacketEncode(uint8_t* packet, uint8_t len, uint8_t chan){
 // Assemble the packet to be transmitted
-// Length is of packet, including crc. pre-populate crc in packet with initial crc value!
+// Length is of packet, including crc.
 uint8_t i, dataLen = len - 3;
 
-
-packet[len - 3] = 0x55; //CRC start value: 0x555555
-packet[len - 2] = 0x55;
-packet[len - 1] = 0x55;
-
-btLeCrc(packet, dataLen, packet + dataLen);
-
-//for(i = 0; i < 3; i++, dataLen++)
-//	packet[dataLen] = swapbits(packet[dataLen]);
+// CRC start value: 0x555555 , reflected
+uint32_t crc = crc24_ble( 0xAAAAAA , packet , dataLen );
+packet[dataLen] = crc;
+packet[dataLen + 1] = crc >> 8;
+packet[dataLen + 2] = crc >> 16;
 
 if (ONE_CHANNEL)
 {	
@@ -1199,6 +1162,10 @@ unsigned long temptime = gettime();
 							lastrxchan = rf_chan;
 							lastrxtime = temptime;
 				      failsafetime = temptime;
+#ifdef RC_SMOOTHING
+				      extern void rc_smoothing_frame( void);
+				      rc_smoothing_frame();
+#endif
 				      failsafe = 0;
 			      }
 			    else
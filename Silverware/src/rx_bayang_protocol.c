@@ -376,6 +376,10 @@ unsigned long temptime = gettime();
 							lastrxchan = chan;
 							lastrxtime = temptime;
 				      failsafetime = temptime;
+#ifdef RC_SMOOTHING
+				      extern void rc_smoothing_frame( void);
+				      rc_smoothing_frame();
+#endif
 				      failsafe = 0;
 			      }
 			    else
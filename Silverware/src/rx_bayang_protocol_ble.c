@@ -35,6 +35,7 @@ THE SOFTWARE.
 #include "rx_bayang.h"
 
 #include "util.h"
+#include "crc.h"
 
 #ifdef RX_BAYANG_PROTOCOL_BLE_BEACON
 
@@ -170,28 +171,6 @@ int	rxcheck = xn_readreg( 0x0f); // rx address pipe 5
 //  https://github.com/lijunhw/nRF24_BLE/blob/master/Arduino/nRF24_BLE_advertizer_demo/nRF24_BLE_advertizer_demo.ino
 
 
-void btLeCrc(const uint8_t* data, uint8_t len, uint8_t* dst){
-// implementing CRC with LFSR
-uint8_t v, t, d;
-while(len--){
-d = *data++;
-for(v = 0; v < 8; v++, d >>= 1){
-t = dst[0] >> 7;
-dst[0] <<= 1;
-if(dst[1] & 0x80) dst[0] |= 1;
-dst[1] <<= 1;
-if(dst[2] & 0x80) dst[1] |= 1;
-dst[2] <<= 1;
-if(t != (d & 1)){
-dst[2] ^= 0x5B;
-dst[1] ^= 0x06;
-}
-}
-}
-}
-
-
-
 // scrambling sequence for xn297
 const uint8_t xn297_scramble[] = {
     0xe3, 0xb1, 0x4b, 0xea, 0x85, 0xbc, 0xe5, 0x66,
@@ -269,18 +248,14 @@ return swapbits(chan) | 2;
 
 void btLePacketEncode(uint8_t* packet, uint8_t len, uint8_t chan){
 // Assemble the packet to be transmitted
-// Length is of packet, including crc. pre-populate crc in packet with initial crc value!
+// Length is of packet, including crc.
 uint8_t i, dataLen = len - 3;
 
-
-packet[len - 3] = 0x55; //CRC start value: 0x555555
-packet[len - 2] = 0x55;
-packet[len - 1] = 0x55;
-
-btLeCrc(packet, dataLen, packet + dataLen);
-
-for(i = 0; i < 3; i++, dataLen++)
-	packet[dataLen] = swapbits(packet[dataLen]);
+// CRC start value: 0x555555 , reflected
+uint32_t crc = crc24_ble( 0xAAAAAA , packet , dataLen );
+packet[dataLen] = crc;
+packet[dataLen + 1] = crc >> 8;
+packet[dataLen + 2] = crc >> 16;
 
 if (1)
 {	
@@ -781,6 +756,10 @@ unsigned long temptime = gettime();
 							lastrxchan = rf_chan;
 							lastrxtime = temptime;
 				      failsafetime = temptime;
+#ifdef RC_SMOOTHING
+				      extern void rc_smoothing_frame( void);
+				      rc_smoothing_frame();
+#endif
 				      failsafe = 0;
 			      }
 			    else
@@ -595,6 +595,10 @@ void checkrx(void)
                       lastrxchan = rf_chan;
                       lastrxtime = temptime;
                       failsafetime = temptime;
+#ifdef RC_SMOOTHING
+                      extern void rc_smoothing_frame( void);
+                      rc_smoothing_frame();
+#endif
                       failsafe = 0;
                       if (!telemetry_send)
                           nextchannel();
@@ -294,6 +294,10 @@ void checkrx( void)
 				if ( pass )
 				{ 	
 					failsafetime = gettime(); 
+#ifdef RC_SMOOTHING
+					extern void rc_smoothing_frame( void);
+					rc_smoothing_frame();
+#endif
 					failsafe = 0;
 					
 				}	
@@ -7,6 +7,8 @@
 #include "defines.h"
 #include "util.h"
 #include "drv_fmc.h"
+#include "drv_serial_rx.h"
+#include "crc.h"
 
 #ifdef RX_CRSF
 
@@ -86,6 +88,8 @@ typedef union crsfFrame_u {
 } crsfFrame_t; 
 
 crsfFrame_t crsfFrame;
+// the frame to decode, in the dma buffer with SERIAL_RX_DMA
+crsfFrameDef_t *crsf_frame = &crsfFrame.frame;
  
  
 typedef enum {
@@ -146,47 +150,130 @@ typedef struct crsfPayloadRcChannelsPacked_s crsfPayloadRcChannelsPacked_t;
 
 
 
-uint8_t crc8_dvb_s2(uint8_t crc, unsigned char a)
+uint8_t crsfFrameCRC(void)
 {
-    crc ^= a;
-    for (int ii = 0; ii < 8; ++ii) {
-        if (crc & 0x80) {
-            crc = (crc << 1) ^ 0xD5;
-        } else {
-            crc = crc << 1;
-        }
-    }
-    return crc;
+    // CRC includes type and payload
+    return crc8_dvb_s2(0, &crsf_frame->type, crsf_frame->frameLength - CRSF_FRAME_LENGTH_CRC);
 }
 
 
-uint8_t crsfFrameCRC(void)
+#ifdef CRSF_TELEMETRY
+// telemetry to the radio on the rx pin, one frame in the gap after each rc frame: attitude, battery, attitude, flight mode
+// the frames are 10 - 14 bytes ( under 0.35ms ) and only start up to CRSF_TELEMETRY_WINDOW_US after the end
+// of the rc frame, so they are out before the next rc frame even at 500Hz. the dma sends them, the loop only fills them in
+#define CRSF_SYNC_BYTE 0xC8
+#define CRSF_TELEMETRY_WINDOW_US 500
+
+extern float vbattfilt;
+extern float vbatt_comp;
+extern float attitude[3];
+extern float cpu_loading;
+
+static uint8_t crsf_telemetry_frame[CRSF_FRAME_SIZE_MAX];
+static uint8_t * const crsf_telemetry_payload = crsf_telemetry_frame + 3;
+static int crsf_telemetry_due;
+static int crsf_telemetry_next;
+
+static void crsf_put16( uint8_t *p , int value )
 {
-    // CRC includes type and payload
-    uint8_t crc = crc8_dvb_s2(0, crsfFrame.frame.type);
-    for (int ii = 0; ii < crsfFrame.frame.frameLength - CRSF_FRAME_LENGTH_TYPE_CRC; ++ii) {
-        crc = crc8_dvb_s2(crc, crsfFrame.frame.payload[ii]);
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+// address, length, type and crc around the payload
+static void crsf_telemetry_send( uint8_t type , int payload_size )
+{
+    crsf_telemetry_frame[0] = CRSF_SYNC_BYTE;
+    crsf_telemetry_frame[1] = payload_size + CRSF_FRAME_LENGTH_TYPE_CRC;
+    crsf_telemetry_frame[2] = type;
+    crsf_telemetry_payload[payload_size] = crc8_dvb_s2(0, crsf_telemetry_frame + 2, payload_size + CRSF_FRAME_LENGTH_TYPE);
+    serial_rx_reply( crsf_telemetry_frame , payload_size + 4 );
+}
+
+// voltage in 0.1V, no current sensor, remaining from the sag compensated voltage ( 3.3V - 4.2V )
+static void crsf_telemetry_battery( void)
+{
+    int remaining = ( vbatt_comp - 3.3f ) * ( 100 / 0.9f );
+    if ( remaining < 0 ) remaining = 0;
+    if ( remaining > 100 ) remaining = 100;
+
+    crsf_put16( crsf_telemetry_payload , vbattfilt * 10.0f + 0.5f );
+    crsf_put16( crsf_telemetry_payload + 2 , 0 );
+    crsf_telemetry_payload[4] = 0;
+    crsf_telemetry_payload[5] = 0;
+    crsf_telemetry_payload[6] = 0;
+    crsf_telemetry_payload[7] = remaining;
+    crsf_telemetry_send( CRSF_FRAMETYPE_BATTERY_SENSOR , CRSF_FRAME_BATTERY_SENSOR_PAYLOAD_SIZE );
+}
+
+// pitch, roll, yaw in radians * 10000, no yaw estimate
+static void crsf_telemetry_attitude( void)
+{
+    crsf_put16( crsf_telemetry_payload , attitude[1] * ( DEGTORAD * 10000.0f ) );
+    crsf_put16( crsf_telemetry_payload + 2 , attitude[0] * ( DEGTORAD * 10000.0f ) );
+    crsf_put16( crsf_telemetry_payload + 4 , 0 );
+    crsf_telemetry_send( CRSF_FRAMETYPE_ATTITUDE , CRSF_FRAME_ATTITUDE_PAYLOAD_SIZE );
+}
+
+// flight mode and the loop time used in percent, "ACRO 42%"
+static void crsf_telemetry_flight_mode( void)
+{
+    const char *mode = "ACRO";
+    if ( failsafe ) mode = "!FS!";
+    else if ( aux[LEVELMODE] ) {
+        if ( aux[RACEMODE] && aux[HORIZON] ) mode = "RHZN";
+        else if ( aux[RACEMODE] ) mode = "RACE";
+        else if ( aux[HORIZON] ) mode = "HRZN";
+        else mode = "ANGL";
     }
-    return crc;
+
+    int load = cpu_loading * ( 1000.0f * 100.0f / LOOPTIME ) + 0.5f;
+    if ( load > 999 ) load = 999;
+
+    uint8_t *p = crsf_telemetry_payload;
+    while ( *mode ) *p++ = *mode++;
+    *p++ = ' ';
+    if ( load >= 100 ) *p++ = '0' + load / 100;
+    if ( load >= 10 ) *p++ = '0' + load / 10 % 10;
+    *p++ = '0' + load % 10;
+    *p++ = '%';
+    *p++ = 0;
+    crsf_telemetry_send( CRSF_FRAMETYPE_FLIGHT_MODE , p - crsf_telemetry_payload );
 }
 
+// every checkrx(), also turns the receiver back on after a frame
+void crsf_telemetry( void)
+{
+    if ( serial_rx_reply_busy() || !crsf_telemetry_due ) return;
+    crsf_telemetry_due = 0;
+
+    // too late, it could run into the next rc frame
+    if ( gettime() - serial_rx_frame_time > CRSF_TELEMETRY_WINDOW_US ) return;
+
+    switch ( crsf_telemetry_next++ & 3 ) {
+        case 1:
+            crsf_telemetry_battery();
+            break;
+        case 3:
+            crsf_telemetry_flight_mode();
+            break;
+        default:
+            crsf_telemetry_attitude();
+    }
+}
+#endif
+
 
 
 
+#ifndef SERIAL_RX_DMA
 // Receive ISR callback, called back from serial port
 void USART1_IRQHandler(void)	
 {
     static uint8_t crsfFramePosition = 0;
-    unsigned long  maxticks = SysTick->LOAD;	
-    unsigned long ticks = SysTick->VAL;	
-    unsigned long crsfTimeInterval;	
+    unsigned long ticks = time_ticks();	
     static unsigned long lastticks;	
-    if (ticks < lastticks) 
-        crsfTimeInterval = lastticks - ticks;	
-    else
-        {// overflow ( underflow really)
-        crsfTimeInterval = lastticks + ( maxticks - ticks);	
-        }
+    unsigned long crsfTimeInterval = time_ticks_since( lastticks , ticks ) / TIME_TICKS_PER_US;	
 		lastticks = ticks;
 	
 		if ( USART_GetFlagStatus(USART1 , USART_FLAG_ORE ) ){
@@ -217,24 +304,34 @@ void USART1_IRQHandler(void)
         }
     }
 }
+#endif
 
 
 
 
 void crsfFrameStatus(void)
 {
+#ifdef SERIAL_RX_DMA
+    int length;
+    uint8_t *frame = serial_rx_frame( &length );
+    // the frame length byte counts the bytes after it
+    if ( frame && length >= 4 && frame[1] + CRSF_FRAME_LENGTH_ADDRESS + CRSF_FRAME_LENGTH_FRAMELENGTH == length ) {
+        crsf_frame = (crsfFrameDef_t *) frame;
+        crsfFrameDone = 1;
+    }
+#endif
 		if (crsfFrameDone == 0){
 				rx_frame_pending = 1;															//flags when last time through we had a frame and this time we dont
     }else{
         crsfFrameDone = 0;
-        if (crsfFrame.frame.type == CRSF_FRAMETYPE_RC_CHANNELS_PACKED) {
+        if (crsf_frame->type == CRSF_FRAMETYPE_RC_CHANNELS_PACKED) {
             // CRC includes type and payload of each frame
             const uint8_t crc = crsfFrameCRC();
-            if (crc != crsfFrame.frame.payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE]) {
+            if (crc != crsf_frame->payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE]) {
 						//              toss out bad frame
             }else{   
             // unpack the RC channels
-            const crsfPayloadRcChannelsPacked_t* const rcChannels = (crsfPayloadRcChannelsPacked_t*)&crsfFrame.frame.payload;
+            const crsfPayloadRcChannelsPacked_t* const rcChannels = (crsfPayloadRcChannelsPacked_t*)&crsf_frame->payload;
             crsfChannelData[0] = rcChannels->chan0;
             crsfChannelData[1] = rcChannels->chan1;
             crsfChannelData[2] = rcChannels->chan2;
@@ -251,6 +348,13 @@ void crsfFrameStatus(void)
             crsfChannelData[13] = rcChannels->chan13;
             crsfChannelData[14] = rcChannels->chan14;
             crsfChannelData[15] = rcChannels->chan15;
+#ifdef RC_SMOOTHING
+            extern void rc_smoothing_frame( void);
+            rc_smoothing_frame();
+#endif
+#ifdef CRSF_TELEMETRY
+            crsf_telemetry_due = 1;
+#endif
 						  	framestarted = 1;											
 								rx_frame_pending = 0;                    //flags when last time through we didn't have a frame and this time we do	
 				        bind_safety++;}                          // incriments up as good frames come in till we pass a safe point where aux channels are updated 
@@ -266,6 +370,14 @@ void crsf_init(void)
 {
     // make sure there is some time to program the board
     if ( gettime() < 2000000 ) return;    
+#ifdef SERIAL_RX_DMA
+    // 8N1, the idle line ends the frame
+#ifdef CRSF_TELEMETRY
+    serial_rx_init( SERIAL_BAUDRATE , SERIAL_RX_HALF_DUPLEX );
+#else
+    serial_rx_init( SERIAL_BAUDRATE , 0 );
+#endif
+#else
     GPIO_InitTypeDef  GPIO_InitStructure;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;   
     GPIO_InitStructure.GPIO_OType = GPIO_OType_OD;   
@@ -294,6 +406,7 @@ void crsf_init(void)
     NVIC_InitStructure.NVIC_IRQChannelPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
+#endif
 // set setup complete flag
  framestarted = 0;
 }
@@ -326,6 +439,9 @@ if ( framestarted == 0){ 																											// this is the failsafe cond
 
 rx_frame_pending_last = rx_frame_pending;
 crsfFrameStatus();		
+#ifdef CRSF_TELEMETRY
+crsf_telemetry();
+#endif
 if (rx_frame_pending != rx_frame_pending_last) flagged_time = gettime();  		//updates flag to current time only on changes of losing a frame or getting one back
 if (gettime() - flagged_time > FAILSAFETIME) framestarted = 0;            		//watchdog if more than 1 sec passes without a frame causes failsafe
 		
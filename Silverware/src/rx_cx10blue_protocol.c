@@ -279,6 +279,10 @@ void checkrx( void)
 					rxdebug.channelcount[chan]++;	
 					#endif
 					failsafetime = lastrxtime; 
+#ifdef RC_SMOOTHING
+					extern void rc_smoothing_frame( void);
+					rc_smoothing_frame();
+#endif
 					failsafe = 0;			
 					nextchannel();
 				
@@ -7,6 +7,8 @@
 #include "defines.h"
 #include "util.h"
 #include "drv_fmc.h"
+#include "flash_kv.h"
+#include "drv_serial_rx.h"
  #if defined(RX_DSMX_2048) || defined(RX_DSM2_1024)
  #ifndef BUZZER_ENABLE 																									// use the convenience macros from buzzer.c for bind pulses
 #define PIN_OFF( port , pin ) GPIO_ResetBits( port , pin)
@@ -55,26 +57,25 @@ int framestarted = -1;
 int rx_frame_pending;
 int rx_frame_pending_last;
 uint32_t flagged_time;
+#ifdef SERIAL_RX_DMA
+// the last frame in the dma buffer
+static volatile uint8_t *spekFrame;
+#else
 static volatile uint8_t spekFrame[SPEK_FRAME_SIZE];
+#endif
 
 float dsm2_scalefactor = (0.29354210f/DSM_SCALE_PERCENT);
 float dsmx_scalefactor = (0.14662756f/DSM_SCALE_PERCENT);
 
- // Receive ISR callback
+ #ifndef SERIAL_RX_DMA
+// Receive ISR callback
 void USART1_IRQHandler(void)
 { 
     static uint8_t spekFramePosition = 0;
 	
-    unsigned long  maxticks = SysTick->LOAD;	
-    unsigned long ticks = SysTick->VAL;	
-    unsigned long spekTimeInterval;	
+    unsigned long ticks = time_ticks();	
     static unsigned long lastticks;	
-    if (ticks < lastticks) 
-        spekTimeInterval = lastticks - ticks;	
-    else
-        {// overflow ( underflow really)
-        spekTimeInterval = lastticks + ( maxticks - ticks);	
-        }
+    unsigned long spekTimeInterval = time_ticks_since( lastticks , ticks ) / TIME_TICKS_PER_US;	
 		lastticks = ticks;
 	
 		if ( USART_GetFlagStatus(USART1 , USART_FLAG_ORE ) ){
@@ -94,8 +95,17 @@ void USART1_IRQHandler(void)
     }
 		spekFramePosition%=(SPEK_FRAME_SIZE);
 } 
+#endif
  void spektrumFrameStatus(void)
 {
+#ifdef SERIAL_RX_DMA
+    int length;
+    uint8_t *frame = serial_rx_frame( &length );
+    if ( frame && length == SPEK_FRAME_SIZE ) {
+        spekFrame = frame;
+        rcFrameComplete = 1;
+    }
+#endif
     if (rcFrameComplete == 0) {
 			rx_frame_pending = 1;															//flags when last time through we had a frame and this time we dont
     }else{
@@ -110,12 +120,20 @@ void USART1_IRQHandler(void)
 								
         }
 			}     
+#ifdef RC_SMOOTHING
+			extern void rc_smoothing_frame( void);
+			rc_smoothing_frame();
+#endif
 		}		
 }
  void dsm_init(void)
 {
     // make sure there is some time to program the board
     if ( gettime() < 2000000 ) return;    
+#ifdef SERIAL_RX_DMA
+    // 8N1, the idle line ends the frame
+    serial_rx_init( SERIAL_BAUDRATE , 0 );
+#else
     GPIO_InitTypeDef  GPIO_InitStructure;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;   
     GPIO_InitStructure.GPIO_OType = GPIO_OType_OD;   
@@ -144,6 +162,7 @@ void USART1_IRQHandler(void)
     NVIC_InitStructure.NVIC_IRQChannelPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
+#endif
 // set setup complete flag
  framestarted = 0;
 }
@@ -151,7 +170,9 @@ void USART1_IRQHandler(void)
 void rx_spektrum_bind(void)
 {
 #ifdef SERIAL_RX_SPEKBIND_RX_PIN
-	rx_bind_enable = fmc_read_float(56);
+	uint32_t bind = 0;
+	flash_kv_read( FLASH_KEY_DSM_BIND , &bind , 1 );
+	rx_bind_enable = bind;
 	if (rx_bind_enable == 0){
         GPIO_InitTypeDef    GPIO_InitStructure;
         GPIO_InitStructure.GPIO_Pin = SERIAL_RX_SPEKBIND_RX_PIN;
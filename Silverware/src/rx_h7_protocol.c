@@ -216,6 +216,10 @@ void checkrx(void) {
 			if ( decode_h7() )
 			{
 				failsafetime = time;
+#ifdef RC_SMOOTHING
+				extern void rc_smoothing_frame( void);
+				rc_smoothing_frame();
+#endif
 				lastrxtime = failsafetime;
 				failsafe = 0;
 				#ifdef DEBUG
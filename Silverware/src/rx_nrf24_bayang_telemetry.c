@@ -33,6 +33,7 @@ THE SOFTWARE.
 #include "defines.h"
 
 #include "rx_bayang.h"
+#include "crc.h"
 
 #include "util.h"
 
@@ -101,19 +102,6 @@ return b;
 }
 
 
-uint16_t crc16_update(uint16_t crc, uint8_t in)
-{
-    crc ^= in << 8;
-    for (uint8_t i = 0; i < 8; ++i) {
-        if (crc & 0x8000) {
-            crc = (crc << 1) ^ 0x1021;
-            } else {
-            crc = crc << 1;
-        }
-    }
-    return crc;
-}
- 
 // crc calculated over address field ( constant)
 uint16_t crc_addr = 0;
 
@@ -126,7 +114,7 @@ void nrf24_set_xn297_address( uint8_t* addr )
     crc_addr = 0xb5d2;
     for (int i = 5; i > 0; i--) {
         rxaddr[i] = addr[i - 1] ^ xn297_scramble[5-i];
-        if ( crc_en ) crc_addr = crc16_update(crc_addr, rxaddr[i]);
+        if ( crc_en ) crc_addr = crc16_ccitt_byte(crc_addr, rxaddr[i]);
     }
 
     // write rx address
@@ -151,7 +139,7 @@ int nrf24_read_xn297_payload(int * rxdata, int size)
     uint16_t crcx;
     crcx = crc_addr;    
     for (uint8_t i = 0; i < size-2; i++) {
-        crcx = crc16_update(crcx, rxdata[i]);
+        crcx = crc16_ccitt_byte(crcx, rxdata[i]);
     }
     uint16_t crcrx =  rxdata[size-2]<<8;
      crcrx |=  rxdata[size-1]&0xFF;
@@ -670,6 +658,10 @@ void checkrx(void)
                       lastrxchan = rf_chan;
                       lastrxtime = temptime;
                       failsafetime = temptime;
+#ifdef RC_SMOOTHING
+                      extern void rc_smoothing_frame( void);
+                      rc_smoothing_frame();
+#endif
                       failsafe = 0;
                       if (!telemetry_send)
                           nextchannel();
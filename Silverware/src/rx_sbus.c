@@ -7,6 +7,7 @@
 #include "drv_time.h"
 #include "defines.h"
 #include "util.h"
+#include "drv_serial_rx.h"
 #include <hardware.h>
 
 // sbus input ( pin SWCLK after calibration) 
@@ -52,7 +53,12 @@ unsigned long time_lastframe;
 int frame_received = 0;
 int rx_state = 0;
 int bind_safety = 0;
+#ifdef SERIAL_RX_DMA
+// the last frame in the dma buffer
+uint8_t *data;
+#else
 uint8_t data[25];
+#endif
 int channels[9];
 
 int failsafe_sbus_failsafe = 0;   
@@ -72,20 +78,14 @@ int stat_frames_second;
 int stat_overflow;
 
 
+#ifndef SERIAL_RX_DMA
 void USART1_IRQHandler(void)
 {
     rx_buffer[rx_end] = USART_ReceiveData(USART1);
     // calculate timing since last rx
-    unsigned long  maxticks = SysTick->LOAD;	
-    unsigned long ticks = SysTick->VAL;	
-    unsigned long elapsedticks;	
+    unsigned long ticks = time_ticks();	
     static unsigned long lastticks;
-    if (ticks < lastticks) 
-        elapsedticks = lastticks - ticks;	
-    else
-        {// overflow ( underflow really)
-        elapsedticks = lastticks + ( maxticks - ticks);	
-        }
+    unsigned long elapsedticks = time_ticks_since( lastticks , ticks );	
 
     if ( elapsedticks < 65536 ) rx_time[rx_end] = elapsedticks; //
     else rx_time[rx_end] = 65535;  //ffff
@@ -103,6 +103,7 @@ void USART1_IRQHandler(void)
     rx_end++;
     rx_end%=(RX_BUFF_SIZE);
 }
+#endif
 
 
 
@@ -110,7 +111,11 @@ void sbus_init(void)
 {
     // make sure there is some time to program the board
     if ( gettime() < 2000000 ) return;
-    
+
+#ifdef SERIAL_RX_DMA
+    // 8E2, the idle line ends the frame
+    serial_rx_init( SERIAL_BAUDRATE , SERIAL_RX_PARITY_EVEN | SERIAL_RX_STOP2 | ( SBUS_INVERT ? SERIAL_RX_INVERT : 0 ) );
+#else
     GPIO_InitTypeDef  GPIO_InitStructure;
 
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
@@ -152,7 +157,7 @@ void sbus_init(void)
     NVIC_InitStructure.NVIC_IRQChannelPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
-
+#endif
 
     rxmode = !RXMODE_BIND;
 
@@ -161,6 +166,36 @@ void sbus_init(void)
 }
 
 
+// frame lost and failsafe bits of the frame in data[]
+static void sbus_status(void)
+{
+      if (data[23] & (1<<2)) 
+      {       
+       // frame lost bit
+       if ( !time_siglost ) time_siglost = gettime();
+       if ( gettime() - time_siglost > 1000000 ) 
+       {
+           failsafe_siglost = 1;   
+       }
+      }
+      else
+      {
+        time_siglost = 0;  
+        failsafe_siglost = 0;
+      }
+
+      
+      if (data[23] & (1<<3)) 
+      {
+        // failsafe bit
+        failsafe_sbus_failsafe = 1;
+      }
+      else{
+          failsafe_sbus_failsafe = 0;
+      }
+}
+
+
 void rx_init(void)
 {
     
@@ -170,6 +205,27 @@ void rx_init(void)
 void checkrx()
 {
  
+#ifdef SERIAL_RX_DMA
+if ( framestarted < 0 )
+{
+    sbus_init();
+}
+else
+{
+    int length;
+    uint8_t *frame = serial_rx_frame( &length );
+    // 25 bytes, a frame with garbage in front is taken from its end
+    if ( frame && length >= 25 && frame[length - 25] == 0x0f )
+    {
+        data = frame + length - 25;
+        frame_received = 1;
+        sbus_status();
+        last_byte = data[24];
+        bind_safety++;
+    }
+    else if ( frame && sbus_stats ) stat_garbage++;
+}
+#else
 if ( framestarted == 0)
 {
     while (  rx_end != rx_start )
@@ -204,39 +260,13 @@ else if ( framestarted == 1)
       data[ i - framestart] = rx_buffer[i%(RX_BUFF_SIZE)];
       int symboltime = rx_time[i%(RX_BUFF_SIZE)];
       //stat_timing[ i - framestart] = symboltime;
-      if ( symboltime > 1024 &&  i - framestart > 0 ) timing_fail = 1;
+      if ( symboltime > 170 * TIME_TICKS_PER_US &&  i - framestart > 0 ) timing_fail = 1;
     }    
 
    if (!timing_fail) 
    {
        frame_received = 1;
-          
-      if (data[23] & (1<<2)) 
-      {       
-       // frame lost bit
-       if ( !time_siglost ) time_siglost = gettime();
-       if ( gettime() - time_siglost > 1000000 ) 
-       {
-           failsafe_siglost = 1;   
-       }
-      }
-      else
-      {
-        time_siglost = 0;  
-        failsafe_siglost = 0;
-      }
-
-      
-      if (data[23] & (1<<3)) 
-      {
-        // failsafe bit
-        failsafe_sbus_failsafe = 1;
-      }
-      else{
-          failsafe_sbus_failsafe = 0;
-      }
-      
-           
+       sbus_status();
    }else if (sbus_stats) stat_timing_fail++; 
     
    last_byte = data[24];
@@ -255,6 +285,7 @@ else
       sbus_init();
        // set in routine above "framestarted = 0;"    
     }
+#endif
       
 if ( frame_received )
 {
@@ -315,6 +346,10 @@ if ( frame_received )
         rx[3] = 0.000610128f * channels[2]; 
         
         if ( rx[3] > 1 ) rx[3] = 1;
+#ifdef RC_SMOOTHING
+        extern void rc_smoothing_frame( void);
+        rc_smoothing_frame();
+#endif
 				
 							if (aux[LEVELMODE]){
 								if (aux[RACEMODE] && !aux[HORIZON]){
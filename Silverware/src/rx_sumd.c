@@ -6,6 +6,8 @@
 #include "config.h"
 #include "drv_time.h"
 #include "util.h"
+#include "drv_serial_rx.h"
+#include "crc.h"
  // sumd input ( pin SWCLK after calibration) 
 // WILL DISABLE PROGRAMMING AFTER GYRO CALIBRATION - 2 - 3 seconds after powerup)
  #ifdef RX_SUMD
@@ -33,7 +35,14 @@ unsigned long time_siglost;
 int frame_received = 0;
 int rx_state = 0;
 int bind_safety = 0;
-uint8_t data[25];
+// header , 16 channels and crc
+#define SUMD_FRAME_MAX ( 3 + 16 * 2 + 2 )
+#ifdef SERIAL_RX_DMA
+// the last frame in the dma buffer
+uint8_t *data;
+#else
+uint8_t data[SUMD_FRAME_MAX];
+#endif
 //int channels[9];
  int failsafe_sumd_failsafe = 0;
 int failsafe_noframes = 0;
@@ -52,38 +61,20 @@ int stat_frames_accepted = 0;
 int stat_frames_second;
 int stat_overflow;
 int crcfail = 0;
- #define CRC_POLYNOME 0x1021
- uint16_t CRC16(uint16_t crc, uint8_t value)
-{
-crc = crc ^ ( int16_t )value<<8;
-for(int i=0; i<8; i++) {
- if (crc & 0x8000)
- crc = (crc << 1) ^ CRC_POLYNOME;
- else
- crc = (crc << 1);
-}
-return crc;
-}
  int mapint(int x, int in_min, int in_max, int out_min, int out_max)
 {
 return ((x - in_min) * (out_max - out_min)) / (in_max - in_min) + out_min;
 }
- void USART1_IRQHandler(void)
+ #ifndef SERIAL_RX_DMA
+void USART1_IRQHandler(void)
 {
     rx_buffer[rx_end] = USART_ReceiveData(USART1);
     // calculate timing since last rx
     if (serial_timing)
     {
-    unsigned long  maxticks = SysTick->LOAD;	
-    unsigned long ticks = SysTick->VAL;	
-    unsigned long elapsedticks;	
+    unsigned long ticks = time_ticks();	
     static unsigned long lastticks;
-     if (ticks < lastticks) 
-        elapsedticks = lastticks - ticks;	
-    else
-        {// overflow ( underflow really)
-        elapsedticks = lastticks + ( maxticks - ticks);	
-        }
+    unsigned long elapsedticks = time_ticks_since( lastticks , ticks );	
      if ( elapsedticks < 65536 ) rx_time[rx_end] = elapsedticks; 
     else rx_time[rx_end] = 65535;
      lastticks = ticks;
@@ -99,6 +90,7 @@ return ((x - in_min) * (out_max - out_min)) / (in_max - in_min) + out_min;
     rx_end++;
     rx_end%=(RX_BUFF_SIZE);
 }
+#endif
  void inject( int in)
 {
     rx_buffer[rx_end] = in;
@@ -109,7 +101,11 @@ return ((x - in_min) * (out_max - out_min)) / (in_max - in_min) + out_min;
 {
     // make sure there is some time to program the board
     if ( gettime() < 2000000 ) return;
-    
+
+#ifdef SERIAL_RX_DMA
+    // 8N1, the idle line ends the frame
+    serial_rx_init( SERIAL_BAUDRATE , SBUS_INVERT ? SERIAL_RX_INVERT : 0 );
+#else
     GPIO_InitTypeDef  GPIO_InitStructure;
      GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
     GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
@@ -140,6 +136,7 @@ return ((x - in_min) * (out_max - out_min)) / (in_max - in_min) + out_min;
     NVIC_InitStructure.NVIC_IRQChannelPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
+#endif
      rxmode = !RXMODE_BIND;
  // set setup complete flag
  framestarted = 0;
@@ -147,11 +144,52 @@ return ((x - in_min) * (out_max - out_min)) / (in_max - in_min) + out_min;
  void rx_init(void)
 {
     
+}
+ // crc and failsafe of the frame in data[]
+static void sumd_crc( int size )
+{
+       uint16_t crc = crc16_ccitt( 0 , data , size - 2 );
+       uint16_t receiverd_crc = (data[size - 2]<<8) + data[size - 1]; 
+       if ( receiverd_crc != crc)
+       {
+            crcfail++;
+            return;
+       }
+       else frame_received = 1;
+       
+      if (data[1] != 0x01) 
+      {
+        // failsafe bit
+        failsafe_sumd_failsafe = 1;
+      }
+      else
+      {
+        failsafe_sumd_failsafe = 0;
+      }
 }
  unsigned int auto_size = 4;
  void checkrx()
 {
  
+#ifdef SERIAL_RX_DMA
+if ( framestarted < 0 )
+{
+    sumd_init();
+}
+else
+{
+    int length;
+    uint8_t *frame = serial_rx_frame( &length );
+    // header and a length that matches the channel count
+    if ( frame && length >= 5 && length <= SUMD_FRAME_MAX && frame[0] == 0xA8 && length == frame[2] * 2 + 5 )
+    {
+        data = frame;
+        sumd_crc( length );
+        bind_safety++;
+    }
+    else if ( frame && sumd_stats ) stat_garbage++;
+}
+#else
 if ( framestarted == 0)
 {
     while (  rx_end != rx_start )
@@ -186,13 +224,13 @@ else if ( framestarted == 1)
       data[ i - framestart] = rx_buffer[i%(RX_BUFF_SIZE)];
       int symboltime = rx_time[i%(RX_BUFF_SIZE)];
       //stat_timing[ i - framestart] = symboltime;
-      if ( serial_timing && symboltime > 1024 &&  i - framestart > 0 ) timing_fail = 1;
+      if ( serial_timing && symboltime > 170 * TIME_TICKS_PER_US &&  i - framestart > 0 ) timing_fail = 1;
         else 
         {
             if ( i == framestart+ 2 )
             {
                 auto_size = data[ i - framestart]*2 + 3 + 2; 
-                if ( auto_size > 0x20 + 5 ) 
+                if ( auto_size > SUMD_FRAME_MAX ) 
                 {   timing_fail = 1;   
                    auto_size = 4; 
                 }  
@@ -203,40 +241,9 @@ else if ( framestarted == 1)
     }    
     if (!timing_fail) 
    {      
-       
-       uint16_t receiverd_crc = 0;
-       uint16_t crc = 0;
-       int i;
-       //crc = 0;
-       for (  i = 0 ; i < auto_size - 2; i++  ) 
-       {
-         crc = CRC16( crc , data[i]);
-       }
-       
-       receiverd_crc = (data[i]<<8) + data[i+1]; 
-       if ( receiverd_crc != crc)
-       {
-           // rx_start = rx_end;
-            //framestarted = 0;
-            crcfail++;
-           goto end;
-       }
-       else frame_received = 1;
-       
-      if (data[1] != 0x01) 
-      {
-        // failsafe bit
-        failsafe_sumd_failsafe = 1;
-      }
-      else
-      {
-        failsafe_sumd_failsafe = 0;
-      }
-      
-           
+       sumd_crc( auto_size );
    }else if (sumd_stats) stat_timing_fail++; 
     
- end:  
     rx_start = rx_end;
     framestarted = 0;
   bind_safety++;   
@@ -283,6 +290,7 @@ for ( int i = 0 ; i < sizeof(test) ; i++)
         }
               
     }
+#endif
       
 if ( frame_received )
 {
@@ -345,6 +353,10 @@ if ( bypass_safety)
         rx[3] = (float) channels[0] / 32768.0f + 0.5f;
                            
         if ( rx[3] > 1 ) rx[3] = 1;
+#ifdef RC_SMOOTHING
+        extern void rc_smoothing_frame( void);
+        rc_smoothing_frame();
+#endif
         
         aux[CH_FLIP] = (channels[4] > 0) ? 1 : 0;
 		aux[CH_EXPERT] = (channels[5] > 0) ? 1 : 0;
@@ -0,0 +1,167 @@
+// cooperative scheduler
+// the control loop is started by the gyro data ready event ( i2c dma complete ) with SIXAXIS_READ_DMA,
+// otherwise by a TIM17 interrupt every GYRO_LOOPTIME
+// the low rate tasks run in the slack between the end of the control loop and the next event,
+// if there is no task that fits in the slack the cpu sleeps ( wfi ) until the next interrupt
+// a task that has waited past its deadline runs first thing after the control loop
+// per task run time and misses are kept in tasks[] for the debugger
+
+#include "project.h"
+#include "config.h"
+#include "drv_time.h"
+#include "rx.h"
+#include "scheduler.h"
+#include "blackbox.h"
+
+#ifdef USE_SCHEDULER
+
+// period and deadline in pid loops, budget in uS
+// battery filters are tuned for 1 loop per run
+// leds need every loop for the software led pwm
+task_type tasks[] =
+{
+	{ checkrx , 1 , 0 , 100 },
+	{ task_battery , 1 , 2 , 50 },
+	{ task_leds , 1 , 4 , 40 },
+	{ task_gestures , 5 , 10 , 50 },
+	{ task_misc , 20 , 20 , 20 },
+#ifdef BLACKBOX
+	// a flash halfword stalls the cpu about 50uS
+	{ blackbox_write , 1 , 2 , 60 },
+#endif
+};
+
+#define TASK_COUNT ( sizeof( tasks ) / sizeof( tasks[0] ) )
+
+// loop started more than 1/4 loop late
+uint16_t loop_overrun = 0;
+
+static unsigned long ticktime;
+static int firsttick = 1;
+
+#ifdef SIXAXIS_READ_DMA
+
+extern volatile uint16_t i2c_dma_phase;
+
+// set by the i2c dma interrupt when a new sample is in the buffer
+#define tick_pending() ( i2c_dma_phase >= 2 )
+#define tick_clear()
+
+#else
+
+static volatile int loop_tick = 0;
+
+#define tick_pending() ( loop_tick )
+#define tick_clear() loop_tick = 0
+
+void TIM17_IRQHandler( void)
+{
+	TIM17->SR = 0;
+	loop_tick = 1;
+}
+
+#endif
+
+void scheduler_init( void)
+{
+#ifndef SIXAXIS_READ_DMA
+	// TIM17 as the loop timer, 1MHz count
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	RCC_APB2PeriphClockCmd( RCC_APB2Periph_TIM17 , ENABLE );
+
+	TIM_TimeBaseStructInit( &TIM_TimeBaseStructure );
+	TIM_TimeBaseStructure.TIM_Period = GYRO_LOOPTIME - 1;
+	TIM_TimeBaseStructure.TIM_Prescaler = SYS_CLOCK_FREQ_HZ / 1000000 - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = 0;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit( TIM17 , &TIM_TimeBaseStructure );
+
+	NVIC_InitStructure.NVIC_IRQChannel = TIM17_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPriority = 3;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init( &NVIC_InitStructure );
+
+	TIM17->SR = 0;
+	TIM_ITConfig( TIM17 , TIM_IT_Update , ENABLE );
+	TIM_Cmd( TIM17 , ENABLE );
+#endif
+	ticktime = gettime();
+}
+
+static void task_run( task_type *t )
+{
+	unsigned long start = gettime();
+
+	t->func();
+
+	unsigned long time = gettime() - start;
+	if ( time > t->budget ) t->overrun++;
+	if ( time > t->maxtime ) t->maxtime = time > 0xFFFF ? 0xFFFF : time;
+	t->pending = 0;
+}
+
+void scheduler_wait( void)
+{
+	// tasks past their deadline can not wait for slack any more
+	for ( unsigned int i = 0 ; i < TASK_COUNT ; i++)
+	{
+		task_type *t = &tasks[i];
+		if ( t->pending >= t->period + t->deadline )
+		{
+			if ( t->deadline ) t->late++;
+			task_run( t );
+		}
+	}
+
+	while ( !tick_pending() )
+	{
+		long slack = GYRO_LOOPTIME - (long) ( gettime() - ticktime );
+		task_type *next = 0;
+
+		// first due task in table order that fits
+		for ( unsigned int i = 0 ; i < TASK_COUNT ; i++)
+		{
+			task_type *t = &tasks[i];
+			if ( t->pending >= t->period && slack > t->budget )
+			{
+				next = t;
+				break;
+			}
+		}
+
+		if ( next )
+		{
+			task_run( next );
+		}
+		else
+		{
+			// wfi wakes on a pending interrupt even with interrupts masked
+			// so the event can not be missed between the check and the sleep
+			__disable_irq();
+			if ( !tick_pending() ) __WFI();
+			__enable_irq();
+		}
+	}
+	tick_clear();
+
+	unsigned long time = gettime();
+	if ( !firsttick && time - ticktime > GYRO_LOOPTIME + GYRO_LOOPTIME / 4 ) loop_overrun++;
+	firsttick = 0;
+	ticktime = time;
+
+#if GYRO_RATE_MULTIPLIER > 1
+	// ticks come every gyro loop, task periods count pid loops
+	static int gyro_ticks = 0;
+	if ( ++gyro_ticks < GYRO_RATE_MULTIPLIER ) return;
+	gyro_ticks = 0;
+#endif
+
+	for ( unsigned int i = 0 ; i < TASK_COUNT ; i++)
+	{
+		if ( tasks[i].pending < 255 ) tasks[i].pending++;
+	}
+}
+
+#endif
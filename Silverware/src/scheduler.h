@@ -0,0 +1,23 @@
+
+#include <inttypes.h>
+
+typedef struct task
+{
+	void (*func)( void);
+	uint8_t period;			// run every n loops
+	uint8_t deadline;		// loops a due task may wait for slack before it is forced to run
+	uint16_t budget;		// expected run time in uS, the slack needed to start the task
+	uint8_t pending;		// loops since the last run
+	uint16_t maxtime;		// longest run in uS
+	uint16_t late;			// times the deadline was missed
+	uint16_t overrun;		// times the task ran longer than its budget
+} task_type;
+
+void scheduler_init( void);
+void scheduler_wait( void);
+
+// low rate tasks in main.c
+void task_battery( void);
+void task_gestures( void);
+void task_leds( void);
+void task_misc( void);
@@ -34,6 +34,9 @@ THE SOFTWARE.
 #include "defines.h"
 
 #include "drv_i2c.h"
+#include "drv_softi2c_dma.h"
+#include "fixed.h"
+#include "profiler.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -46,6 +49,73 @@ THE SOFTWARE.
 #define ACC_LOW_PASS_FILTER		5
 #define TICK1US								(SYS_CLOCK_FREQ_HZ*1e-6f)
 
+// board orientation
+// the SENSOR_ROTATE options and SENSOR_ROTATE_ANGLE ( degrees ccw ) add up to one yaw angle, SENSOR_FLIP_180 turns the board over
+// as a 3x3 matrix of constants in 1/ORIENT_ONE applied to the raw samples, the compiler drops the zero terms of 90 degree angles
+#ifndef SENSOR_ROTATE_ANGLE
+#define SENSOR_ROTATE_ANGLE 0
+#endif
+#ifdef SENSOR_ROTATE_45_CCW
+#define ORIENT_45_CCW 45
+#else
+#define ORIENT_45_CCW 0
+#endif
+#ifdef SENSOR_ROTATE_45_CW
+#define ORIENT_45_CW -45
+#else
+#define ORIENT_45_CW 0
+#endif
+#ifdef SENSOR_ROTATE_90_CW
+#define ORIENT_90_CW -90
+#else
+#define ORIENT_90_CW 0
+#endif
+#ifdef SENSOR_ROTATE_90_CCW
+#define ORIENT_90_CCW 90
+#else
+#define ORIENT_90_CCW 0
+#endif
+#ifdef SENSOR_ROTATE_180
+#define ORIENT_180 180
+#else
+#define ORIENT_180 0
+#endif
+#ifdef SENSOR_FLIP_180
+#define ORIENT_FLIP -1
+#else
+#define ORIENT_FLIP 1
+#endif
+
+#define ORIENT_ANGLE ( SENSOR_ROTATE_ANGLE + ORIENT_45_CCW + ORIENT_45_CW + ORIENT_90_CW + ORIENT_90_CCW + ORIENT_180 )
+
+#if ORIENT_ANGLE > 360 || ORIENT_ANGLE < -360
+#error "SENSOR_ROTATE_ANGLE has to be whole degrees between -180 and 180"
+#endif
+
+// sine and cosine of a quarter of the angle ( under 90 degrees up to 360 ) by taylor series, doubled twice
+#define ORIENT_X ( ORIENT_ANGLE * ( 3.14159265358979 / 180 / 4 ) )
+#define ORIENT_X2 ( ORIENT_X * ORIENT_X )
+#define ORIENT_SIN0 ( ORIENT_X * ( 1 - ORIENT_X2 / 6 * ( 1 - ORIENT_X2 / 20 * ( 1 - ORIENT_X2 / 42 * ( 1 - ORIENT_X2 / 72 * ( 1 - ORIENT_X2 / 110 ) ) ) ) ) )
+#define ORIENT_COS0 ( 1 - ORIENT_X2 / 2 * ( 1 - ORIENT_X2 / 12 * ( 1 - ORIENT_X2 / 30 * ( 1 - ORIENT_X2 / 56 * ( 1 - ORIENT_X2 / 90 * ( 1 - ORIENT_X2 / 132 ) ) ) ) ) )
+#define ORIENT_SIN1 ( 2 * ORIENT_SIN0 * ORIENT_COS0 )
+#define ORIENT_COS1 ( 1 - 2 * ORIENT_SIN0 * ORIENT_SIN0 )
+#define ORIENT_SIN ( 2 * ORIENT_SIN1 * ORIENT_COS1 )
+#define ORIENT_COS ( 1 - 2 * ORIENT_SIN1 * ORIENT_SIN1 )
+
+#define ORIENT_SHIFT 10
+#define ORIENT_ONE ( 1 << ORIENT_SHIFT )
+#define ORIENT_Q( x ) ( (int32_t) ( (x) * ORIENT_ONE + ( (x) < 0 ? -0.5 : 0.5 ) ) )
+
+// rows of the sensor rotation
+#define ORIENT_M0 ORIENT_FLIP * ORIENT_Q( ORIENT_COS ) , ORIENT_FLIP * ORIENT_Q( ORIENT_SIN ) , 0
+#define ORIENT_M1 -ORIENT_Q( ORIENT_SIN ) , ORIENT_Q( ORIENT_COS ) , 0
+#define ORIENT_M2 0 , 0 , ORIENT_FLIP * ORIENT_ONE
+
+#define ORIENT_DOT( r , m0 , m1 , m2 ) ( (m0) * (r)[0] + (m1) * (r)[1] + (m2) * (r)[2] )
+#define ORIENT_ROW( r , m ) ORIENT_DOT( r , m )
+// rounded back to lsb
+#define ORIENT_LSB( x ) ( ( (x) + ORIENT_ONE / 2 ) >> ORIENT_SHIFT )
+
 #ifdef SIXAXIS_READ_DMA
 	
 	#ifndef USE_HARDWARE_I2C
@@ -68,9 +138,13 @@ THE SOFTWARE.
 		#warning "*** Only 1Mbps supported ***"
 	#endif	
 
-	#define SIXAXIS_READ_PERIOD1			((1000-SIXAXIS_READ_TIME*2) * TICK1US)
-	#define SIXAXIS_READ_PERIOD2			((1000-SIXAXIS_READ_TIME*1) * TICK1US)
-	#define GYRO_READ_PERIOD					((1000-   GYRO_READ_TIME*1) * TICK1US)
+	#if GYRO_LOOPTIME < SIXAXIS_READ_TIME*2
+		#error "I2C DMA gyro read is too slow for the gyro loop time"
+	#endif
+
+	#define SIXAXIS_READ_PERIOD1			((GYRO_LOOPTIME-SIXAXIS_READ_TIME*2) * TICK1US)
+	#define SIXAXIS_READ_PERIOD2			((GYRO_LOOPTIME-SIXAXIS_READ_TIME*1) * TICK1US)
+	#define GYRO_READ_PERIOD					((GYRO_LOOPTIME-   GYRO_READ_TIME*1) * TICK1US)
 
 volatile uint16_t	i2c_dma_phase 				=	0;			//	0:data no ready	1:new data available
 volatile uint16_t	i2c_dma_count 				=	0;			//	0:read count, if 4 times the same data, force output
@@ -121,7 +195,9 @@ void sixaxis_init( void)
     delay(100);
 	
 	i2c_writereg(  28, B00011000);	// 16G scale
-	i2c_writereg(  25, B00000000);	// Sample Rate = Gyroscope Output Rate
+	// Sample Rate = Gyroscope Output Rate
+	// 8kHz with dlpf 0, a multiple of every loop rate, the read is not synced to the gyro so a lower rate only adds delay
+	i2c_writereg(  25, B00000000);
 
     
 // acc lpf for the new gyro type
@@ -190,6 +266,10 @@ void sixaxis_init( void)
 	DMA_ClearFlag( DMA1_FLAG_GL3 );
 	DMA_ITConfig(DMA1_Channel3, DMA_IT_TC, ENABLE);	
 #endif	
+
+#ifdef SOFTI2C_READ_DMA
+	softi2c_dma_init();
+#endif
 }
 
 #ifdef SIXAXIS_READ_DMA
@@ -270,7 +350,7 @@ void DMA1_Channel2_3_IRQHandler(void)
 		
 		i2c_dma_phase = 2;
 		
-		TIM17->ARR = (1000-SIXAXIS_READ_TIME-1)*TICK1US;		
+		TIM17->ARR = (GYRO_LOOPTIME-SIXAXIS_READ_TIME-1)*TICK1US;		
 		sixaxis_read_start();
 		return;
 	}		
@@ -370,17 +450,110 @@ float gyro[3];
 float accelcal[3];
 float gyrocal[3];
 
-float lpffilter(float in, int num);
-float lpffilter2(float in, int num);
+void gyro_filter( float *gyro );
 
-void sixaxis_read(void)
+#ifdef FIXED_POINT
+int32_t gyro_q[3];
+
+void gyro_filter_q( int32_t *gyro );
+#endif
+
+// 1 when accel[] holds a sample imu_calc() has not used yet
+int accel_new;
+
+#ifdef ACCEL_DECIMATION
+// loops until the next accel read
+static int accel_count;
+#endif
+
+// gyrocal in 1/16 lsb, set by gyro_cal()
+static int32_t gyrocal_q[3];
+
+// the next sixaxis_read() reads the accel
+void sixaxis_accel_request( void)
+{
+#ifdef ACCEL_DECIMATION
+	accel_count = 0;
+#endif
+}
+
+// 3 big endian samples in sensor axis order
+static void sixaxis_raw( const uint8_t *data , int32_t *raw )
 {
+	for ( int i = 0 ; i < 3 ; i++)
+		raw[i] = (int16_t) ( ( data[i * 2] << 8 ) + data[i * 2 + 1] );
+}
+
+static void accel_decode( void)
+{
+	int32_t raw[3];
+	sixaxis_raw( &i2c_rx_buffer[0] , raw );
+
+	// accel axes are -x , -y , z of the sensor
+	accel[0] = ORIENT_LSB( -ORIENT_ROW( raw , ORIENT_M0 ) );
+	accel[1] = ORIENT_LSB( -ORIENT_ROW( raw , ORIENT_M1 ) );
+	accel[2] = ORIENT_LSB( ORIENT_ROW( raw , ORIENT_M2 ) );
+
+	accel_new = 1;
+}
+
+// lsb in 1/16 and the 1/1024 matrix to rad/s
+#define GYRO_SCALE ( 0.061035156f * 0.017453292f / ( 16 * ORIENT_ONE ) )
+
+#ifdef FIXED_POINT
+// the same in Q32 , the samples go to Q16 rad/s without float
+#define GYRO_SCALE_Q32 FIXED32( GYRO_SCALE * 65536.0 )
+#endif
+
+static RAMFUNC void gyro_decode( void)
+{
+	int32_t raw[3];
+
+	sixaxis_raw( &i2c_rx_buffer[8] , raw );
+	for ( int i = 0 ; i < 3 ; i++) raw[i] = raw[i] * 16 - gyrocal_q[i];
+
+#ifdef FIXED_POINT
+	// gyro axes are y , -x , -z of the sensor
+	gyro_q[0] = fixed_mul32( ORIENT_ROW( raw , ORIENT_M1 ) , GYRO_SCALE_Q32 );
+	gyro_q[1] = fixed_mul32( -ORIENT_ROW( raw , ORIENT_M0 ) , GYRO_SCALE_Q32 );
+	gyro_q[2] = fixed_mul32( -ORIENT_ROW( raw , ORIENT_M2 ) , GYRO_SCALE_Q32 );
+
+	// filter chain in Q16, the float copy is for level mode and the imu
+#ifndef SOFT_LPF_NONE
+	gyro_filter_q( gyro_q );
+#endif
+	for (int i = 0; i < 3; i++)
+		gyro[i] = FIXED_TO_FLOAT( gyro_q[i] );
+#else
 	float gyronew[3];
 
+	// gyro axes are y , -x , -z of the sensor
+	gyronew[0] = ORIENT_ROW( raw , ORIENT_M1 );
+	gyronew[1] = -ORIENT_ROW( raw , ORIENT_M0 );
+	gyronew[2] = -ORIENT_ROW( raw , ORIENT_M2 );
+
+	for (int i = 0; i < 3; i++)
+		gyro[i] = gyronew[i] * GYRO_SCALE;
+#ifndef SOFT_LPF_NONE
+	gyro_filter( gyro );
+#endif
+#endif
+}
+
+void sixaxis_read(void)
+{
+#ifdef ACCEL_DECIMATION
+	int read_accel = accel_count <= 0;
+	if ( read_accel ) accel_count = ACCEL_DECIMATION;
+	accel_count--;
+#else
+	const int read_accel = 1;
+#endif
+
 #ifdef SIXAXIS_READ_DMA	
 	uint32_t	time=gettime();
-	// wait maximum a LOOPTIME for fresh data, if onground, more wait for flash save when doing calibration 
-	while( i2c_dma_phase < 2 && (gettime()-time) < (LOOPTIME*(1+onground*100)) ) { }
+	// wait maximum a GYRO_LOOPTIME for fresh data, if onground, more wait for flash save when doing calibration 
+	while( i2c_dma_phase < 2 && (gettime()-time) < (GYRO_LOOPTIME*(1+onground*100)) ) { }
 	while( i2c_dma_phase < 2 ) {
 		extern void failloop();
 		failloop(9);
@@ -392,159 +565,28 @@ void sixaxis_read(void)
 	i2c_dma_phase = 0;
 	__enable_irq();
 	
+#elif defined SOFTI2C_READ_DMA
+	// read in the background since the last call
+	softi2c_dma_read( i2c_rx_buffer );
 #else	
 	int data[14];		
 		
-	i2c_readdata( 59 , data , 14 );		
-	for( int i=0;i<14;i++) i2c_rx_buffer[i] = (uint8_t)data[i];	
-#endif		
-	
-#ifdef SENSOR_ROTATE_90_CW	         
-        accel[0] = (int16_t) ((i2c_rx_buffer[2] << 8) + i2c_rx_buffer[3]);
-        accel[1] = -(int16_t) ((i2c_rx_buffer[0] << 8) + i2c_rx_buffer[1]);
-        accel[2] = (int16_t) ((i2c_rx_buffer[4] << 8) + i2c_rx_buffer[5]);
-#else
-        
-	accel[0] = -(int16_t) ((i2c_rx_buffer[0] << 8) + i2c_rx_buffer[1]);
-	accel[1] = -(int16_t) ((i2c_rx_buffer[2] << 8) + i2c_rx_buffer[3]);
-	accel[2] = (int16_t) ((i2c_rx_buffer[4] << 8) + i2c_rx_buffer[5]);  
-        
-#endif
-  
-
-#ifdef SENSOR_ROTATE_90_CW_deleted
-		{//
-		float temp = accel[1];
-		accel[1] = accel[0];
-		accel[0] = -temp;	
-		}
-#endif       
-        
-// this is the value of both cos 45 and sin 45 = 1/sqrt(2)
-#define INVSQRT2 0.707106781f
-		
-#ifdef SENSOR_ROTATE_45_CCW
-		{
-		float temp = accel[0];
-		accel[0] = (accel[0] * INVSQRT2 + accel[1] * INVSQRT2);
-		accel[1] = -(temp * INVSQRT2 - accel[1] * INVSQRT2);	
-		}
-#endif
-        
-#ifdef SENSOR_ROTATE_45_CW
-		{
-		float temp = accel[1];
-		accel[1] = (accel[1] * INVSQRT2 + accel[0] * INVSQRT2);
-		accel[0] = -(temp * INVSQRT2 - accel[0] * INVSQRT2);	
-		}
-#endif
-	
-		
-#ifdef SENSOR_ROTATE_90_CCW
-		{
-		float temp = accel[1];
-		accel[1] = -accel[0];
-		accel[0] = temp;	
-		}
-#endif
-				
-#ifdef SENSOR_ROTATE_180
-		{
-		accel[1] = -accel[1];
-		accel[0] = -accel[0];	
-		}
+	if ( read_accel )
+	{
+		i2c_readdata( 59 , data , 14 );		
+		for( int i=0;i<14;i++) i2c_rx_buffer[i] = (uint8_t)data[i];	
+	}
+	else
+	{
+		// gyro only, 6 of the 14 bytes
+		i2c_readdata( 67 , data , 6 );
+		for( int i=0;i<6;i++) i2c_rx_buffer[8 + i] = (uint8_t)data[i];
+	}
 #endif		
-		
-#ifdef SENSOR_FLIP_180
-		{
-		accel[2] = -accel[2];
-		accel[0] = -accel[0];	
-		}
-#endif	
-//order
-	gyronew[1] = (int16_t) ((i2c_rx_buffer[8] << 8) + i2c_rx_buffer[9]);
-	gyronew[0] = (int16_t) ((i2c_rx_buffer[10] << 8) + i2c_rx_buffer[11]);
-	gyronew[2] = (int16_t) ((i2c_rx_buffer[12] << 8) + i2c_rx_buffer[13]);
-
-
-gyronew[0] = gyronew[0] - gyrocal[0];
-gyronew[1] = gyronew[1] - gyrocal[1];
-gyronew[2] = gyronew[2] - gyrocal[2];
-
-#ifdef SENSOR_ROTATE_90_CW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = -gyronew[0];
-		gyronew[0] = temp;	
-		}
-#endif
-        
 	
-#ifdef SENSOR_ROTATE_45_CCW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = gyronew[0] * INVSQRT2 + gyronew[1] * INVSQRT2;
-		gyronew[0] = gyronew[0] * INVSQRT2 - temp * INVSQRT2;	
-		}
-#endif
-
-#ifdef SENSOR_ROTATE_45_CW
-		{
-		float temp = gyronew[0];
-		gyronew[0] = gyronew[1] * INVSQRT2 + gyronew[0] * INVSQRT2;
-		gyronew[1] = gyronew[1] * INVSQRT2 - temp * INVSQRT2;	
-		}
-#endif	        
-		
-		
-#ifdef SENSOR_ROTATE_90_CCW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = gyronew[0];
-		gyronew[0] = -temp;	
-		}
-#endif
-		
-					
-#ifdef SENSOR_ROTATE_180
-		{
-		gyronew[1] = -gyronew[1];
-		gyronew[0] = -gyronew[0];	
-		}
-#endif		
-		
-#ifdef SENSOR_FLIP_180
-		{
-		gyronew[1] = -gyronew[1];
-		gyronew[2] = -gyronew[2];	
-		}
-#endif	
-
-//gyronew[0] = - gyronew[0];
-gyronew[1] = - gyronew[1];
-gyronew[2] = - gyronew[2];
-
-	for (int i = 0; i < 3; i++)
-	  {
-		  gyronew[i] = gyronew[i] * 0.061035156f * 0.017453292f;
-#ifndef SOFT_LPF_NONE
-
-		#if defined (GYRO_FILTER_PASS2) && defined (GYRO_FILTER_PASS1)
-			gyro[i] = lpffilter(gyronew[i], i);
-			gyro[i] = lpffilter2(gyro[i], i);
-		#endif
-
-		#if defined (GYRO_FILTER_PASS1) && !defined(GYRO_FILTER_PASS2)
-			gyro[i] = lpffilter(gyronew[i], i);
-		#endif
-
-		#if defined (GYRO_FILTER_PASS2) && !defined(GYRO_FILTER_PASS1)
-			gyro[i] = lpffilter2(gyronew[i], i);
-		#endif
-#else
-		  gyro[i] = gyronew[i];
-#endif
-	  }
+	if ( read_accel ) accel_decode();
+	PROFILE_MARK( PROFILE_SIXAXIS );
+	gyro_decode();
 }
 	
 void gyro_read( void)
@@ -552,101 +594,16 @@ void gyro_read( void)
 int data[6];
 	
 i2c_readdata( 67 , data , 6 );
+for( int i=0;i<6;i++) i2c_rx_buffer[8 + i] = (uint8_t)data[i];
 	
-float gyronew[3];
-	// order
-gyronew[1] = (int16_t) ((data[0]<<8) + data[1]);
-gyronew[0] = (int16_t) ((data[2]<<8) + data[3]);
-gyronew[2] = (int16_t) ((data[4]<<8) + data[5]);
-
-		
-gyronew[0] = gyronew[0] - gyrocal[0];
-gyronew[1] = gyronew[1] - gyrocal[1];
-gyronew[2] = gyronew[2] - gyrocal[2];
-	
-	
-		
-#ifdef SENSOR_ROTATE_45_CCW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = gyronew[0] * INVSQRT2 + gyronew[1] * INVSQRT2;
-		gyronew[0] = gyronew[0] * INVSQRT2 - temp * INVSQRT2;	
-		}
-#endif
-        
-#ifdef SENSOR_ROTATE_45_CW
-		{
-		float temp = gyronew[0];
-		gyronew[0] = gyronew[1] * INVSQRT2 + gyronew[0] * INVSQRT2;
-		gyronew[1] = gyronew[1] * INVSQRT2 - temp * INVSQRT2;	
-		}
-#endif
-			
-#ifdef SENSOR_ROTATE_90_CW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = -gyronew[0];
-		gyronew[0] = temp;	
-		}
-#endif
-
-				
-#ifdef SENSOR_ROTATE_90_CCW
-		{
-		float temp = gyronew[1];
-		gyronew[1] = gyronew[0];
-		gyronew[0] = -temp;	
-		}
-#endif
-	
-					
-#ifdef SENSOR_ROTATE_180
-		{
-		gyronew[1] = -gyronew[1];
-		gyronew[0] = -gyronew[0];	
-		}
-#endif		
-		
-							
-#ifdef SENSOR_FLIP_180
-		{
-		gyronew[1] = -gyronew[1];
-		gyronew[2] = -gyronew[2];	
-		}
-#endif		
-	
-
-
-		
-//gyronew[0] = - gyronew[0];
-gyronew[1] = - gyronew[1];
-gyronew[2] = - gyronew[2];
-	
-	
-for (int i = 0; i < 3; i++)
-	  {
-		  gyronew[i] = gyronew[i] * 0.061035156f * 0.017453292f;
-#ifndef SOFT_LPF_NONE
-
-		#if defined (GYRO_FILTER_PASS2) && defined (GYRO_FILTER_PASS1)
-			gyro[i] = lpffilter(gyronew[i], i);
-			gyro[i] = lpffilter2(gyro[i], i);
-		#endif
-
-		#if defined (GYRO_FILTER_PASS1) && !defined(GYRO_FILTER_PASS2)
-			gyro[i] = lpffilter(gyronew[i], i);
-		#endif
-
-		#if defined (GYRO_FILTER_PASS2) && !defined(GYRO_FILTER_PASS1)
-			gyro[i] = lpffilter2(gyronew[i], i);
-		#endif
-#else
-		  gyro[i] = gyronew[i];
-#endif
-	  }
-
+gyro_decode();
 }
  
+static void gyro_cal_q( void)
+{
+	for ( int i = 0 ; i < 3; i++)
+		gyrocal_q[i] = gyrocal[i] * 16;
+}
 
 
 #define CAL_TIME 2e6
@@ -681,9 +638,9 @@ float gyro[3];
 		//gyro[2] = (int16_t) ((data[4]<<8) + data[5]);
 		
 		sixaxis_read();
-		gyro[1] = (int16_t) ((i2c_rx_buffer[8] << 8) + i2c_rx_buffer[9]);
-		gyro[0] = (int16_t) ((i2c_rx_buffer[10] << 8) + i2c_rx_buffer[11]);
-		gyro[2] = (int16_t) ((i2c_rx_buffer[12] << 8) + i2c_rx_buffer[13]);
+		int32_t raw[3];
+		sixaxis_raw( &i2c_rx_buffer[8] , raw );
+		for ( int i = 0 ; i < 3 ; i++) gyro[i] = raw[i];
 		
 /*		
 if ( (time - timestart)%200000 > 100000) 
@@ -732,6 +689,7 @@ checkrx();
 			gyrocal[i] = 0;
 		}
 	}
+	gyro_cal_q();
 }
 #else  // not using dma
 void gyro_cal(void)
@@ -761,10 +719,11 @@ while ( time - timestart < CAL_TIME  &&  time - timemax < 15e6 )
 
 	i2c_readdata(  67 , data , 6 );	
 
-			
-	gyro[1] = (int16_t) ((data[0]<<8) + data[1]);
-	gyro[0] = (int16_t) ((data[2]<<8) + data[3]);
-	gyro[2] = (int16_t) ((data[4]<<8) + data[5]);
+	uint8_t bytes[6];
+	int32_t raw[3];
+	for ( int i = 0 ; i < 6 ; i++) bytes[i] = data[i];
+	sixaxis_raw( bytes , raw );
+	for ( int i = 0 ; i < 3 ; i++) gyro[i] = raw[i];
 		
 
 /*		
@@ -820,6 +779,7 @@ if ( time - timestart < CAL_TIME )
 
 	}
 }
+gyro_cal_q();
 }
 #endif
 
@@ -828,6 +788,7 @@ void acc_cal(void)
 	accelcal[2] = 2048;
 	for (int y = 0; y < 500; y++)
 	  {
+		  sixaxis_accel_request();
 		  sixaxis_read();
 		  for (int x = 0; x < 3; x++)
 		    {
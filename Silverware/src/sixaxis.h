@@ -2,6 +2,7 @@
 void sixaxis_init( void);
 int sixaxis_check( void);
 void sixaxis_read( void);
+void sixaxis_accel_request( void);
 void gyro_read( void);
 void gyro_cal( void);
 
@@ -0,0 +1,39 @@
+#!/bin/sh
+
+# ram budget of the firmware from the linker symbols of flash.ld
+# ./ramreport.sh bwhoop.elf ( or make ramreport )
+
+ELF=${1:-bwhoop.elf}
+NM=${NM:-arm-none-eabi-nm}
+
+$NM -S -n "$ELF" | awk '
+function hex( s,    i, c, v ) {
+	v = 0
+	s = tolower( s )
+	for ( i = 1; i <= length( s ); i++ ) {
+		c = index( "0123456789abcdef", substr( s, i, 1 ) ) - 1
+		v = v * 16 + c
+	}
+	return v
+}
+# address size type name , or address type name
+NF == 4 { addr[ $4 ] = hex( $1 ); size[ $4 ] = hex( $2 ); name[ n++ ] = $4 }
+NF == 3 { addr[ $3 ] = hex( $1 ) }
+END {
+	ramfunc = addr[ "_eramfunc" ] - addr[ "_sramfunc" ]
+	data = addr[ "_edata" ] - addr[ "_sdata" ] - ramfunc
+	bss = addr[ "_ebss" ] - addr[ "_sbss" ]
+	reserve = addr[ "_Min_Heap_Size" ] + addr[ "_Min_Stack_Size" ]
+	total = 4096
+
+	printf "ram functions      %5d\n", ramfunc
+	for ( i = 0; i < n; i++ ) {
+		a = addr[ name[ i ] ]
+		if ( a >= addr[ "_sramfunc" ] && a < addr[ "_eramfunc" ] )
+			printf "    %-24s %5d\n", name[ i ], size[ name[ i ] ]
+	}
+	printf "data               %5d\n", data
+	printf "bss                %5d\n", bss
+	printf "heap + stack       %5d\n", reserve
+	printf "free               %5d of %d\n", total - ramfunc - data - bss - reserve, total
+}'
@@ -0,0 +1,171 @@
+// blackbox log to csv
+// reads a flash dump ( BLACKBOX_FLASH ) or a serial capture ( BLACKBOX_SERIAL ) of the records from blackbox.c
+//
+// usage: blackbox_decode log.bin > log.csv
+//
+// sessions are found by their header, so a session cut short by a power loss does not hide the ones after it
+// a record that runs into the next header or the end of the log is dropped
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "blackbox.h"
+
+static const char *field_names[BB_FIELDS] =
+{
+	"iteration" , "looptime_us" ,
+	"gyro_roll" , "gyro_pitch" , "gyro_yaw" ,
+	"setpoint_roll" , "setpoint_pitch" , "setpoint_yaw" ,
+	"pid_roll" , "pid_pitch" , "pid_yaw" ,
+	"motor0" , "motor1" , "motor2" , "motor3" ,
+	"vbatt"
+};
+
+// divisor of the stored integer
+static float field_scale( int field )
+{
+	if ( field == BB_ITERATION || field == BB_LOOPTIME ) return 1.0f;
+	return 1000.0f;
+}
+
+static int is_header( const uint8_t *data , long pos , long size )
+{
+	return pos + 4 <= size && data[pos] == BLACKBOX_HEADER && data[pos + 1] == 'B' && data[pos + 2] == 'B' && data[pos + 3] == BLACKBOX_VERSION;
+}
+
+// zigzag varint, 0 at the end of the data
+static int get_varint( const uint8_t *data , long *pos , long end , int32_t *value )
+{
+	uint32_t v = 0;
+	int shift = 0;
+
+	while ( *pos < end && shift < 35 )
+	{
+		uint8_t b = data[(*pos)++];
+		v |= (uint32_t) ( b & 0x7f ) << shift;
+		if ( !( b & 0x80 ) )
+		{
+			*value = (int32_t) ( v >> 1 ) ^ -(int32_t) ( v & 1 );
+			return 1;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+// one session from its header to the next one, returns the records written
+static long decode_session( const uint8_t *data , long pos , long end , int session )
+{
+	int32_t looptime , rate , fields;
+	int32_t value[BB_FIELDS];
+	long records = 0;
+
+	pos += 4;
+	if ( !get_varint( data , &pos , end , &looptime ) || !get_varint( data , &pos , end , &rate ) || !get_varint( data , &pos , end , &fields ) ) return 0;
+	if ( fields != BB_FIELDS )
+	{
+		fprintf( stderr , "session %d: %d fields, expected %d\n" , session , fields , BB_FIELDS );
+		return 0;
+	}
+	fprintf( stderr , "session %d: looptime %d us , every %d loops\n" , session , looptime , rate );
+
+	int have_iframe = 0;
+
+	while ( pos < end )
+	{
+		uint8_t type = data[pos++];
+
+		// padding after the end of a session
+		if ( type == 0xFF ) continue;
+		if ( type == BLACKBOX_END ) break;
+		if ( type != BLACKBOX_IFRAME && type != BLACKBOX_PFRAME )
+		{
+			fprintf( stderr , "session %d: bad record type 0x%02x at %ld\n" , session , type , pos - 1 );
+			break;
+		}
+
+		int32_t in[BB_FIELDS];
+		int i;
+		for ( i = 0 ; i < BB_FIELDS ; i++) if ( !get_varint( data , &pos , end , &in[i] ) ) break;
+		if ( i < BB_FIELDS ) break;
+
+		if ( type == BLACKBOX_IFRAME )
+		{
+			memcpy( value , in , sizeof( value ) );
+			have_iframe = 1;
+		}
+		else
+		{
+			// P frames before the first I frame have nothing to add to
+			if ( !have_iframe ) continue;
+			for ( i = 0 ; i < BB_FIELDS ; i++) value[i] += in[i];
+		}
+
+		printf( "%d,%.6f" , session , value[BB_ITERATION] * looptime * 1e-6 );
+		for ( i = 0 ; i < BB_FIELDS ; i++)
+		{
+			if ( field_scale( i ) == 1.0f ) printf( ",%d" , value[i] );
+			else printf( ",%.3f" , value[i] / field_scale( i ) );
+		}
+		printf( "\n" );
+		records++;
+	}
+	return records;
+}
+
+int main( int argc , char **argv )
+{
+	if ( argc < 2 )
+	{
+		fprintf( stderr , "usage: blackbox_decode log.bin > log.csv\n" );
+		return 1;
+	}
+
+	FILE *f = fopen( argv[1] , "rb" );
+	if ( !f )
+	{
+		fprintf( stderr , "can not open %s\n" , argv[1] );
+		return 1;
+	}
+
+	fseek( f , 0 , SEEK_END );
+	long size = ftell( f );
+	fseek( f , 0 , SEEK_SET );
+
+	uint8_t *data = malloc( size > 0 ? size : 1 );
+	if ( !data || fread( data , 1 , size , f ) != (size_t) size )
+	{
+		fprintf( stderr , "can not read %s\n" , argv[1] );
+		return 1;
+	}
+	fclose( f );
+
+	printf( "session,time_s" );
+	for ( int i = 0 ; i < BB_FIELDS ; i++) printf( ",%s" , field_names[i] );
+	printf( "\n" );
+
+	int session = 0;
+	long records = 0;
+	long pos = 0;
+
+	while ( pos < size )
+	{
+		if ( !is_header( data , pos , size ) )
+		{
+			pos++;
+			continue;
+		}
+
+		long next = pos + 1;
+		while ( next < size && !is_header( data , next , size ) ) next++;
+
+		records += decode_session( data , pos , next , session++ );
+		pos = next;
+	}
+
+	fprintf( stderr , "%d sessions , %ld records\n" , session , records );
+	free( data );
+	return 0;
+}
@@ -0,0 +1,276 @@
+// crc check and benchmark
+// runs crc.c built with the 16 entry tables and with CRC_BYTE_TABLE against copies of the bit by bit
+// crcs it replaced ( crsf , sumd , bayang telemetry , blheli 4way , settings store , both ble beacons )
+// on random frames of every length up to 256 bytes , then reports host cycles per frame for some frame sizes
+//
+// usage: crc_check [-n iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sil.h"
+#include "config.h"
+#include "crc.h"
+
+// the byte table build is renamed by the Makefile
+uint8_t crc8_dvb_s2_b( uint8_t crc , const uint8_t *data , int bytes );
+uint16_t crc16_ccitt_b( uint16_t crc , const uint8_t *data , int bytes );
+uint16_t crc16_ccitt_byte_b( uint16_t crc , uint8_t data );
+uint32_t crc24_ble_b( uint32_t crc , const uint8_t *data , int bytes );
+
+// ----- the replaced crcs
+
+// rx_crsf.c
+static uint8_t ref_crc8_dvb_s2( uint8_t crc , unsigned char a )
+{
+	crc ^= a;
+	for ( int ii = 0 ; ii < 8 ; ++ii)
+	{
+		if ( crc & 0x80 ) crc = ( crc << 1 ) ^ 0xD5;
+		else crc = crc << 1;
+	}
+	return crc;
+}
+
+// rx_sumd.c
+static uint16_t ref_sumd_crc16( uint16_t crc , uint8_t value )
+{
+	crc = crc ^ ( int16_t ) value << 8;
+	for ( int i = 0 ; i < 8 ; i++)
+	{
+		if ( crc & 0x8000 ) crc = ( crc << 1 ) ^ 0x1021;
+		else crc = ( crc << 1 );
+	}
+	return crc;
+}
+
+// rx_nrf24_bayang_telemetry.c
+static uint16_t ref_crc16_update( uint16_t crc , uint8_t in )
+{
+	crc ^= in << 8;
+	for ( uint8_t i = 0 ; i < 8 ; ++i)
+	{
+		if ( crc & 0x8000 ) crc = ( crc << 1 ) ^ 0x1021;
+		else crc = crc << 1;
+	}
+	return crc;
+}
+
+// serial_4way.c
+static uint16_t ref_crc_xmodem_update( uint16_t crc , uint8_t data )
+{
+	crc = crc ^ ( (uint16_t) data << 8 );
+	for ( int i = 0 ; i < 8 ; i++)
+	{
+		if ( crc & 0x8000 ) crc = ( crc << 1 ) ^ 0x1021;
+		else crc <<= 1;
+	}
+	return crc;
+}
+
+// flash_kv.c
+static uint16_t ref_flash_kv_crc16( uint16_t crc , const uint8_t *data , int bytes )
+{
+	while ( bytes-- )
+	{
+		crc ^= *data++ << 8;
+		for ( int i = 0 ; i < 8 ; i++) crc = crc & 0x8000 ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+// rx_bayang_ble_app.c
+static void ref_btLeCrc_app( uint8_t *buf , uint8_t len , uint8_t *dst )
+{
+	uint32_t crc = 0x00aaaaaa;
+	while ( len--)
+	{
+		uint8_t d = *( buf++);
+		for ( int i = 8 ; i > 0 ; i--)
+		{
+			uint8_t t = crc & 1;
+			crc >>= 1;
+			if ( t != ( d & 1 ) ) crc ^= 0xDA6000;
+			d >>= 1;
+		}
+	}
+	for ( int i = 0 ; i < 3 ; i++) dst[i] = crc >> ( i * 8 );
+}
+
+// rx_bayang_protocol_ble.c , with the swapbits() of the sent crc
+static uint8_t swapbits( uint8_t a )
+{
+	unsigned int b = a;
+	b = ( ( b * 0x0802LU & 0x22110LU ) | ( b * 0x8020LU & 0x88440LU ) ) * 0x10101LU >> 16;
+	return b;
+}
+
+static void ref_btLeCrc_beacon( const uint8_t *data , uint8_t len , uint8_t *dst )
+{
+	uint8_t v , t , d;
+	while ( len--)
+	{
+		d = *data++;
+		for ( v = 0 ; v < 8 ; v++ , d >>= 1)
+		{
+			t = dst[0] >> 7;
+			dst[0] <<= 1;
+			if ( dst[1] & 0x80 ) dst[0] |= 1;
+			dst[1] <<= 1;
+			if ( dst[2] & 0x80 ) dst[1] |= 1;
+			dst[2] <<= 1;
+			if ( t != ( d & 1 ) )
+			{
+				dst[2] ^= 0x5B;
+				dst[1] ^= 0x06;
+			}
+		}
+	}
+	for ( int i = 0 ; i < 3 ; i++) dst[i] = swapbits( dst[i] );
+}
+
+// ----- check
+
+typedef struct crc_build
+{
+	const char *name;
+	uint8_t ( *crc8 )( uint8_t , const uint8_t * , int );
+	uint16_t ( *crc16 )( uint16_t , const uint8_t * , int );
+	uint16_t ( *crc16_byte )( uint16_t , uint8_t );
+	uint32_t ( *crc24 )( uint32_t , const uint8_t * , int );
+} crc_build_type;
+
+static const crc_build_type builds[2] =
+{
+	{ "nibble" , crc8_dvb_s2 , crc16_ccitt , crc16_ccitt_byte , crc24_ble } ,
+	{ "byte" , crc8_dvb_s2_b , crc16_ccitt_b , crc16_ccitt_byte_b , crc24_ble_b } ,
+};
+
+static int errors;
+
+static void fail( const crc_build_type *b , const char *what , int len )
+{
+	if ( errors++ < 10 ) printf( "%s table: %s differs , %d bytes\n" , b->name , what , len );
+}
+
+static void check( const crc_build_type *b , const uint8_t *data , int len )
+{
+	// crsf , from 0
+	uint8_t c8 = 0;
+	for ( int i = 0 ; i < len ; i++) c8 = ref_crc8_dvb_s2( c8 , data[i] );
+	if ( b->crc8( 0 , data , len ) != c8 ) fail( b , "crc8 dvb-s2" , len );
+
+	// sumd , from 0
+	uint16_t c16 = 0;
+	for ( int i = 0 ; i < len ; i++) c16 = ref_sumd_crc16( c16 , data[i] );
+	if ( b->crc16( 0 , data , len ) != c16 ) fail( b , "sumd crc16" , len );
+
+	// bayang telemetry , from the address crc
+	c16 = 0xb5d2;
+	uint16_t c16b = 0xb5d2;
+	for ( int i = 0 ; i < len ; i++)
+	{
+		c16 = ref_crc16_update( c16 , data[i] );
+		c16b = b->crc16_byte( c16b , data[i] );
+	}
+	if ( c16b != c16 ) fail( b , "bayang crc16" , len );
+
+	// 4way , from 0 a byte at a time
+	c16 = 0;
+	c16b = 0;
+	for ( int i = 0 ; i < len ; i++)
+	{
+		c16 = ref_crc_xmodem_update( c16 , data[i] );
+		c16b = b->crc16_byte( c16b , data[i] );
+	}
+	if ( c16b != c16 ) fail( b , "4way crc16" , len );
+
+	// settings store , from 0xFFFF and continued over a split
+	c16 = ref_flash_kv_crc16( 0xFFFF , data , len / 3 );
+	c16 = ref_flash_kv_crc16( c16 , data + len / 3 , len - len / 3 );
+	c16b = b->crc16( 0xFFFF , data , len / 3 );
+	c16b = b->crc16( c16b , data + len / 3 , len - len / 3 );
+	if ( c16b != c16 ) fail( b , "settings crc16" , len );
+
+	// ble , both beacons send the crc low byte first , their length is a uint8_t
+	if ( len > 255 ) return;
+	uint8_t ref[3];
+	uint32_t c24 = b->crc24( 0xAAAAAA , data , len );
+	ref_btLeCrc_app( (uint8_t *) data , len , ref );
+	if ( ( ref[0] | ref[1] << 8 | ref[2] << 16 ) != (int) c24 ) fail( b , "ble app crc24" , len );
+	ref[0] = ref[1] = ref[2] = 0x55;
+	ref_btLeCrc_beacon( data , len , ref );
+	if ( ( ref[0] | ref[1] << 8 | ref[2] << 16 ) != (int) c24 ) fail( b , "ble beacon crc24" , len );
+}
+
+// ----- benchmark
+
+static volatile uint32_t sink;
+
+static double bench_bit( const uint8_t *data , int len , int iterations )
+{
+	uint64_t c0 = sil_cycles();
+	for ( int n = 0 ; n < iterations ; n++)
+	{
+		uint16_t crc = 0;
+		for ( int i = 0 ; i < len ; i++) crc = ref_crc16_update( crc , data[i] );
+		sink = crc;
+	}
+	return (double) ( sil_cycles() - c0 ) / iterations;
+}
+
+static double bench_table( const crc_build_type *b , const uint8_t *data , int len , int iterations )
+{
+	uint64_t c0 = sil_cycles();
+	for ( int n = 0 ; n < iterations ; n++) sink = b->crc16( 0 , data , len );
+	return (double) ( sil_cycles() - c0 ) / iterations;
+}
+
+int main( int argc , char **argv )
+{
+	int iterations = 100000;
+
+	for ( int i = 1 ; i < argc ; i++)
+	{
+		if ( i < argc - 1 && !strcmp( argv[i] , "-n" ) ) iterations = atoi( argv[++i] );
+		else
+		{
+			fprintf( stderr , "usage: crc_check [-n iterations]\n" );
+			return 1;
+		}
+	}
+	if ( iterations < 1 ) iterations = 1;
+
+	uint8_t data[256];
+	srand( 1 );
+	for ( int round = 0 ; round < 64 ; round++)
+	{
+		for ( int i = 0 ; i < 256 ; i++) data[i] = rand();
+		for ( int len = 0 ; len <= 256 ; len++)
+			for ( int b = 0 ; b < 2 ; b++) check( &builds[b] , data , len );
+	}
+
+	// crc lengths: bayang telemetry payload , crsf rc channels , sumd 16 channels , pid settings record
+	static const int sizes[] = { 15 , 23 , 35 , 38 , 256 };
+#ifdef CRC_BYTE_TABLE
+	printf( "CRC_BYTE_TABLE is set in config.h , both builds are the byte tables\n" );
+#endif
+	printf( "crc16 host cycles per frame , %d iterations\n\n" , iterations );
+	printf( "bytes      bit   nibble     byte\n" );
+	for ( unsigned int s = 0 ; s < sizeof( sizes ) / sizeof( sizes[0] ) ; s++)
+	{
+		int len = sizes[s];
+		printf( "%5d %8.1f %8.1f %8.1f\n" , len , bench_bit( data , len , iterations ) ,
+			bench_table( &builds[0] , data , len , iterations ) , bench_table( &builds[1] , data , len , iterations ) );
+	}
+	printf( "\n" );
+
+	if ( errors )
+	{
+		printf( "crc check failed , %d differences\n" , errors );
+		return 1;
+	}
+	printf( "crc check passed\n" );
+	return 0;
+}
@@ -0,0 +1,197 @@
+// attitude estimator benchmark
+// replays the gyro and accel samples of a sil trace ( sil -t ) through the gravity vector filter of imu.c
+// and through the same file built with IMU_QUATERNION, then reports host cycles per imu_calc()
+// and the attitude error against the plant gravity vector recorded with the samples
+//
+// usage: imu_bench [-a accel_noise_G] [-g gyro_bias_rad/s] [-d accel_decimation] trace
+// the noise and the bias are added to the recorded samples, the same for both estimators
+// -d n gives imu_calc() an accel sample every n th loop like ACCEL_DECIMATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sil.h"
+#include "config.h"
+#include "defines.h"
+
+// the quaternion build is renamed by the Makefile
+void imu_init( void);
+void imu_calc( void);
+extern float GEstG[3];
+extern float attitude[3];
+
+void imu_init_q( void);
+void imu_calc_q( void);
+extern float GEstG_q[3];
+extern float attitude_q[3];
+
+// inputs of imu.c
+float gyro[3];
+float accel[3];
+float accelcal[3];
+float looptime;
+int accel_new;
+
+typedef struct estimator
+{
+	const char *name;
+	void ( *init )( void);
+	void ( *calc )( void);
+	float *gravity;
+	float *attitude;
+} estimator_type;
+
+static const estimator_type estimators[2] =
+{
+	{ "vector" , imu_init , imu_calc , GEstG , attitude } ,
+	{ "quaternion" , imu_init_q , imu_calc_q , GEstG_q , attitude_q } ,
+};
+
+static sil_trace_type *trace;
+static float ( *accel_in )[3];
+static long samples;
+
+// imu_init() averages 100 samples at rest , give it the first one without the noise
+void sixaxis_read( void)
+{
+	for ( int i = 0 ; i < 3 ; i++) accel[i] = trace[0].accel[i];
+}
+
+void sixaxis_accel_request( void)
+{
+}
+
+void delay( uint32_t us )
+{
+	( void ) us;
+}
+
+unsigned long gettime( void)
+{
+	return 0;
+}
+
+// about gaussian , rms 1
+static float noise( void)
+{
+	float sum = 0;
+	for ( int i = 0 ; i < 3 ; i++) sum += rand() * ( 2.0f / RAND_MAX ) - 1.0f;
+	return sum;
+}
+
+static float angle_error( float a , float b )
+{
+	float d = a - b;
+	while ( d > 180.0f ) d -= 360.0f;
+	while ( d < -180.0f ) d += 360.0f;
+	return fabsf( d );
+}
+
+static void run( const estimator_type *e , float gyro_bias , int decimation )
+{
+	uint64_t cycles = 0;
+	double tilt_sq = 0 , angle_sq = 0 , norm = 0;
+	float tilt_max = 0 , angle_max = 0;
+	long angle_count = 0;
+
+	e->init();
+
+	for ( long n = 0 ; n < samples ; n++)
+	{
+		sil_trace_type *t = &trace[n];
+
+		looptime = LOOPTIME * 1e-6f;
+		for ( int i = 0 ; i < 3 ; i++) gyro[i] = t->gyro[i] + gyro_bias;
+		if ( n % decimation == 0 )
+		{
+			for ( int i = 0 ; i < 3 ; i++) accel[i] = accel_in[n][i];
+			accel_new = 1;
+		}
+
+		uint64_t c0 = sil_cycles();
+		e->calc();
+		cycles += sil_cycles() - c0;
+
+		// angle between the estimated and the true gravity vector
+		float *g = e->gravity;
+		float mag = sqrtf( g[0] * g[0] + g[1] * g[1] + g[2] * g[2] );
+		float dot = ( g[0] * t->gravity[0] + g[1] * t->gravity[1] + g[2] * t->gravity[2] ) / mag;
+		if ( dot > 1.0f ) dot = 1.0f;
+		float tilt = acosf( dot ) * RADTODEG;
+		tilt_sq += tilt * tilt;
+		if ( tilt > tilt_max ) tilt_max = tilt;
+		norm += fabsf( mag - 1.0f );
+
+		// roll and pitch as used by level mode , only meaningful the right way up
+		if ( t->gravity[2] > 0.5f )
+		{
+			for ( int i = 0 ; i < 2 ; i++)
+			{
+				float d = angle_error( e->attitude[i] , atan2f( t->gravity[i] , t->gravity[2] ) * RADTODEG );
+				angle_sq += d * d;
+				if ( d > angle_max ) angle_max = d;
+			}
+			angle_count += 2;
+		}
+	}
+
+	printf( "%-10s %8.1f %9.3f %9.3f %9.3f %9.3f %10.2e\n" , e->name , (double) cycles / samples ,
+		sqrt( tilt_sq / samples ) , tilt_max , angle_count ? sqrt( angle_sq / angle_count ) : 0.0 , angle_max , norm / samples );
+}
+
+int main( int argc , char **argv )
+{
+	float accel_noise = 0;
+	float gyro_bias = 0;
+	int decimation = 1;
+	const char *name = 0;
+
+	for ( int i = 1 ; i < argc ; i++)
+	{
+		if ( i < argc - 1 && !strcmp( argv[i] , "-a" ) ) accel_noise = atof( argv[++i] );
+		else if ( i < argc - 1 && !strcmp( argv[i] , "-g" ) ) gyro_bias = atof( argv[++i] );
+		else if ( i < argc - 1 && !strcmp( argv[i] , "-d" ) ) decimation = atoi( argv[++i] );
+		else name = argv[i];
+	}
+	if ( !name || decimation < 1 )
+	{
+		fprintf( stderr , "usage: imu_bench [-a accel_noise_G] [-g gyro_bias_rad/s] [-d accel_decimation] trace\n" );
+		return 1;
+	}
+
+	FILE *f = fopen( name , "rb" );
+	if ( !f )
+	{
+		fprintf( stderr , "can not open %s\n" , name );
+		return 1;
+	}
+	fseek( f , 0 , SEEK_END );
+	samples = ftell( f ) / sizeof( sil_trace_type );
+	fseek( f , 0 , SEEK_SET );
+
+	trace = malloc( ( samples ? samples : 1 ) * sizeof( sil_trace_type ) );
+	accel_in = malloc( ( samples ? samples : 1 ) * sizeof( *accel_in ) );
+	if ( !trace || !accel_in || !samples || fread( trace , sizeof( sil_trace_type ) , samples , f ) != (size_t) samples )
+	{
+		fprintf( stderr , "can not read %s\n" , name );
+		return 1;
+	}
+	fclose( f );
+
+	for ( long n = 0 ; n < samples ; n++)
+		for ( int i = 0 ; i < 3 ; i++) accel_in[n][i] = trace[n].accel[i] + noise() * accel_noise * 2048.0f;
+
+#ifdef IMU_QUATERNION
+	printf( "IMU_QUATERNION is set in config.h , both builds are the quaternion filter\n" );
+#endif
+	printf( "%ld samples , looptime %d us , accel noise %.3f G , gyro bias %.3f rad/s , accel every %d loops\n\n" , samples , LOOPTIME , accel_noise , gyro_bias , decimation );
+	printf( "estimator    cycles  tilt rms  tilt max angle rms angle max  norm error\n" );
+	printf( "            ( host )    ( deg )   ( deg )   ( deg )   ( deg )\n" );
+	for ( int i = 0 ; i < 2 ; i++) run( &estimators[i] , gyro_bias , decimation );
+
+	free( trace );
+	free( accel_in );
+	return 0;
+}
@@ -0,0 +1,72 @@
+// software in the loop build of the flight loop
+// shared between the harness, the plant model and the hardware stubs
+
+#include <inttypes.h>
+#include <time.h>
+
+// quad rotational model
+// rates and gravity vector use the firmware gyro / accel frame
+typedef struct sil_plant
+{
+	float rate[3];			// body rates in rad/s
+	float gravity[3];		// gravity vector in body frame, 1.0 = 1G
+	float motor[4];			// motor thrust after the spin up lag ( 0 - 1 )
+	float command[4];		// last value written by pwm_set
+	float phase[4];			// rotor angle for the vibration model
+	float vibration;		// gyro vibration amplitude in rad/s at full thrust
+	float noise;				// gyro white noise amplitude in rad/s
+} sil_plant_type;
+
+extern sil_plant_type plant;
+
+// one loop of inputs and outputs, recorded by the float build and replayed by the
+// fixed point build to cross check the two control paths
+typedef struct sil_trace
+{
+	float rx[4];
+	float levelmode;
+	float gyro_raw[3];		// gyro sample in lsb
+	float accel[3];			// accel sample in lsb
+	float gyro[3];			// filtered gyro in rad/s
+	float pidoutput[3];
+	float motor[4];			// pwm_set values
+	float erpm[4];			// motor telemetry in 100 eRPM
+	float gravity[3];		// plant gravity vector , attitude reference for imu_bench
+} sil_trace_type;
+
+// when set sixaxis_read() takes its samples from here instead of the plant
+extern sil_trace_type *sil_replay;
+extern float sil_gyro_lsb[3];
+extern float sil_accel_lsb[3];
+extern float sil_erpm[4];
+
+// simulated time in uS, returned by gettime()
+extern unsigned long sil_time;
+
+// free flash for the blackbox log
+#define SIL_FLASH_SIZE 8192
+extern uint8_t sil_flash[SIL_FLASH_SIZE];
+
+void plant_init( sil_plant_type *p );
+void plant_step( sil_plant_type *p , float dt );
+float plant_gyro( sil_plant_type *p , int axis );
+float plant_motor_hz( sil_plant_type *p , int motor );
+float plant_rotor_hz( sil_plant_type *p );
+
+// cycle counter of the host cpu
+static inline uint64_t sil_cycles( void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+	__asm__ __volatile__ ( "rdtsc" : "=a" (lo), "=d" (hi) );
+	return ( (uint64_t) hi << 32 ) | lo;
+#elif defined(__aarch64__)
+	uint64_t val;
+	__asm__ __volatile__ ( "mrs %0, cntvct_el0" : "=r" (val) );
+	return val;
+#else
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC , &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,551 @@
+// software in the loop runner
+// runs the flight loop from main.c against the plant model and reports
+// step response, tracking error and cycles per loop iteration
+//
+// usage: sil [-n benchmark_iterations] [-v vibration_rad/s] [-w noise_rad/s]
+//            [-b] benchmark only
+//            [-t trace] record the test runs
+//            [-c trace] replay a trace open loop and compare against it ( float / fixed cross check )
+//            [-l log] save the blackbox flash ( BLACKBOX ) after the test runs
+//            [-r frame_hz] rx link frame rate , the sticks only change on a frame ( RC_SMOOTHING )
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sil.h"
+#include "config.h"
+#include "defines.h"
+#include "blackbox.h"
+
+extern float looptime;
+extern float rx[4];
+extern char aux[AUXNUMBER];
+extern float setpoint[3];
+extern float gyro[3];
+extern float accel[3];
+extern float pidoutput[3];
+#ifdef MIXER_FIXED
+// the fixed point mixer takes pidoutput_q , the float copy is only kept for the blackbox
+#include "fixed.h"
+extern int32_t pidoutput_q[3];
+#define PIDOUTPUT( a ) FIXED_TO_FLOAT( pidoutput_q[a] )
+#else
+#define PIDOUTPUT( a ) pidoutput[a]
+#endif
+extern uint16_t blackbox_dropped;
+void motor_curve_init( void);
+
+void pid_set( int set );
+
+void control( void);
+void rc_smoothing_frame( void);
+void imu_calc( void);
+void sixaxis_read( void);
+
+// hover throttle stick
+#define SIL_THROTTLE 0.45f
+
+// samples recorded per step ( one per loop )
+#define STEP_SAMPLES ( 400000 / LOOPTIME )
+#define LEVEL_SAMPLES ( 1000000 / LOOPTIME )
+#define SETTLE_SAMPLES ( 300000 / LOOPTIME )
+#define TRACK_SAMPLES ( 2000000 / LOOPTIME )
+#define TRACK_MAXLAG ( 50000 / LOOPTIME )
+
+static float response[LEVEL_SAMPLES];
+
+static const char *axisname[3] = { "roll" , "pitch" , "yaw" };
+
+static FILE *trace_file = 0;
+
+// pid loops per rx frame , 0 updates the sticks every loop
+static int frame_loops = 0;
+
+static void trace_outputs( sil_trace_type *t )
+{
+	for ( int i = 0 ; i < 3 ; i++)
+	{
+		t->gyro_raw[i] = sil_gyro_lsb[i];
+		t->accel[i] = sil_accel_lsb[i];
+		t->gyro[i] = gyro[i];
+		t->pidoutput[i] = PIDOUTPUT( i );
+		t->gravity[i] = plant.gravity[i];
+	}
+	for ( int i = 0 ; i < 4 ; i++)
+	{
+		t->motor[i] = plant.command[i];
+		t->erpm[i] = sil_erpm[i];
+	}
+}
+
+static void sil_iteration( void)
+{
+	looptime = LOOPTIME * 1e-6f;
+
+	// gyro only loops as in main.c
+	for ( int i = 1 ; i < GYRO_RATE_MULTIPLIER ; i++)
+	{
+		sixaxis_read();
+		plant_step( &plant , GYRO_LOOPTIME * 1e-6f );
+	}
+
+	sixaxis_read();
+
+	// the rx link only delivers the sticks every frame_loops loops
+	float sticks[4];
+	if ( frame_loops )
+	{
+		static float held[4];
+		static int frame_count;
+		for ( int i = 0 ; i < 4 ; i++) sticks[i] = rx[i];
+		if ( frame_count++ % frame_loops == 0 )
+		{
+			for ( int i = 0 ; i < 4 ; i++) held[i] = rx[i];
+#ifdef RC_SMOOTHING
+			rc_smoothing_frame();
+#endif
+		}
+		for ( int i = 0 ; i < 4 ; i++) rx[i] = held[i];
+	}
+
+	control();
+
+	if ( frame_loops )
+	{
+		for ( int i = 0 ; i < 4 ; i++) rx[i] = sticks[i];
+	}
+#ifdef BLACKBOX
+	blackbox_log( LOOPTIME );
+	blackbox_write();
+#endif
+	imu_calc();
+
+	if ( trace_file )
+	{
+		sil_trace_type t;
+		for ( int i = 0 ; i < 4 ; i++) t.rx[i] = rx[i];
+		t.levelmode = aux[LEVELMODE];
+		trace_outputs( &t );
+		fwrite( &t , sizeof( t ) , 1 , trace_file );
+	}
+
+	plant_step( &plant , GYRO_LOOPTIME * 1e-6f );
+	sil_time += LOOPTIME;
+}
+
+static void sil_reset( void)
+{
+	plant_init( &plant );
+
+	memset( aux , 0 , AUXNUMBER );
+	aux[CH_ON] = 1;
+
+	// main.c selects pid set 1 at startup
+	pid_set( 0 );
+#if defined(MOTOR_CURVE_TABLE) || defined(THRUST_LINEARISATION)
+	motor_curve_init();
+#endif
+	for ( int i = 0 ; i < 3 ; i++) rx[i] = 0;
+	rx[3] = SIL_THROTTLE;
+}
+
+static void sil_run( int samples )
+{
+	for ( int i = 0 ; i < samples ; i++) sil_iteration();
+}
+
+static float sil_roll_angle( void)
+{
+	return atan2f( plant.gravity[0] , plant.gravity[2] ) * RADTODEG;
+}
+
+// rise ( 10 - 90% ), overshoot and 5% settling time of a recorded step
+static void step_report( const char *name , float target , const char *unit , int samples )
+{
+	int t10 = -1 , t90 = -1 , settle = 0;
+	float peak = 0 , sq = 0;
+
+	for ( int i = 0 ; i < samples ; i++)
+	{
+		float r = response[i] / target;
+		if ( t10 < 0 && r >= 0.1f ) t10 = i;
+		if ( t90 < 0 && r >= 0.9f ) t90 = i;
+		if ( r > peak ) peak = r;
+		if ( fabsf( r - 1.0f ) > 0.05f ) settle = i + 1;
+		sq += ( target - response[i] ) * ( target - response[i] );
+	}
+
+	printf( "%-6s %7.1f %-4s", name , target , unit );
+	if ( t10 >= 0 && t90 >= 0 )
+		printf( " %7.1f ms" , ( t90 - t10 ) * LOOPTIME * 1e-3f );
+	else
+		printf( " %7s   " , "-" );
+	printf( " %7.1f %%" , ( peak - 1.0f ) * 100.0f );
+	if ( settle < samples )
+		printf( " %7.1f ms" , settle * LOOPTIME * 1e-3f );
+	else
+		printf( " %7s   " , "-" );
+	printf( " %8.2f %s\n" , sqrtf( sq / samples ) , unit );
+}
+
+static void step_acro( int axis , float stick )
+{
+	float maxrate = axis == 2 ? (float) MAX_RATEYAW : (float) MAX_RATE;
+
+	rx[axis] = 0;
+	sil_run( SETTLE_SAMPLES );
+
+	rx[axis] = stick;
+	for ( int i = 0 ; i < STEP_SAMPLES ; i++)
+	{
+		sil_iteration();
+		response[i] = plant.rate[axis] * RADTODEG;
+	}
+	rx[axis] = 0;
+
+	step_report( axisname[axis] , stick * maxrate , "dps" , STEP_SAMPLES );
+}
+
+static void step_level( float stick )
+{
+	aux[LEVELMODE] = 1;
+	rx[0] = 0;
+	sil_run( SETTLE_SAMPLES * 3 );
+
+	rx[0] = stick;
+	for ( int i = 0 ; i < LEVEL_SAMPLES ; i++)
+	{
+		sil_iteration();
+		response[i] = sil_roll_angle();
+	}
+	rx[0] = 0;
+	sil_run( SETTLE_SAMPLES );
+	aux[LEVELMODE] = 0;
+
+	step_report( "roll" , stick * (float) LEVEL_MAX_ANGLE + (float) TRIM_ROLL , "deg" , LEVEL_SAMPLES );
+}
+
+static float stick_sine( int axis , int sample )
+{
+	static const float hz[3] = { 2.0f , 3.0f , 1.0f };
+	return 0.3f * sinf( 2.0f * 3.14159265f * hz[axis] * sample * LOOPTIME * 1e-6f );
+}
+
+// sine tracking, rms error and the delay with the best correlation
+static void track_acro( void)
+{
+	float err[3] = { 0 };
+	float kick[3] = { 0 };
+	float lastpid[3];
+	int delay[3];
+
+	rx[0] = rx[1] = rx[2] = 0;
+	sil_run( SETTLE_SAMPLES );
+
+	static float resp[3][TRACK_SAMPLES];
+	static float ref[3][TRACK_SAMPLES];
+
+	for ( int a = 0 ; a < 3 ; a++) lastpid[a] = PIDOUTPUT( a );
+
+	for ( int i = 0 ; i < TRACK_SAMPLES ; i++)
+	{
+		for ( int a = 0 ; a < 3 ; a++) rx[a] = stick_sine( a , i );
+		sil_iteration();
+		for ( int a = 0 ; a < 3 ; a++)
+		{
+			ref[a][i] = setpoint[a] * RADTODEG;
+			resp[a][i] = plant.rate[a] * RADTODEG;
+			err[a] += ( ref[a][i] - resp[a][i] ) * ( ref[a][i] - resp[a][i] );
+			// pid output change per loop , the stick steps of a slow rx link show up here
+			kick[a] += ( PIDOUTPUT( a ) - lastpid[a] ) * ( PIDOUTPUT( a ) - lastpid[a] );
+			lastpid[a] = PIDOUTPUT( a );
+		}
+	}
+	rx[0] = rx[1] = rx[2] = 0;
+
+	for ( int a = 0 ; a < 3 ; a++)
+	{
+		float best = -1e30f;
+		delay[a] = 0;
+		for ( int lag = 0 ; lag < TRACK_MAXLAG ; lag++)
+		{
+			float sum = 0;
+			for ( int i = 0 ; i + lag < TRACK_SAMPLES ; i++) sum += ref[a][i] * resp[a][i + lag];
+			if ( sum > best )
+			{
+				best = sum;
+				delay[a] = lag;
+			}
+		}
+		printf( "%-6s %8.2f dps %7.1f ms %9.5f\n" , axisname[a] , sqrtf( err[a] / TRACK_SAMPLES ) , delay[a] * LOOPTIME * 1e-3f , sqrtf( kick[a] / TRACK_SAMPLES ) );
+	}
+}
+
+#ifdef GYRO_DYN_NOTCH
+extern float dyn_notch_hz[3];
+#endif
+
+// vibration left on the filtered gyro at hover
+static void noise_report( void)
+{
+	float sq[3] = { 0 };
+
+	rx[0] = rx[1] = rx[2] = 0;
+	sil_run( SETTLE_SAMPLES );
+
+	for ( int i = 0 ; i < TRACK_SAMPLES ; i++)
+	{
+		sil_iteration();
+		for ( int a = 0 ; a < 3 ; a++) sq[a] += ( gyro[a] - plant.rate[a] ) * ( gyro[a] - plant.rate[a] );
+	}
+
+	for ( int a = 0 ; a < 3 ; a++)
+	{
+		printf( "%-6s %8.4f rad/s" , axisname[a] , sqrtf( sq[a] / TRACK_SAMPLES ) );
+#ifdef GYRO_DYN_NOTCH
+		printf( " %7.1f Hz" , dyn_notch_hz[a] );
+#endif
+		printf( "\n" );
+	}
+
+	// the gyro sees the rotor frequency folded around its nyquist frequency
+	float fs = 1e6f / GYRO_LOOPTIME;
+	float hz = plant_rotor_hz( &plant );
+	float alias = fabsf( hz - fs * floorf( hz / fs + 0.5f ) );
+	printf( "rotor  %8.1f Hz , %.1f Hz at the gyro rate\n" , hz , alias );
+}
+
+typedef struct stage_cycles
+{
+	uint64_t min , max , sum;
+} stage_cycles_type;
+
+static void stage_add( stage_cycles_type *s , uint64_t c )
+{
+	if ( c < s->min ) s->min = c;
+	if ( c > s->max ) s->max = c;
+	s->sum += c;
+}
+
+static void benchmark( long iterations )
+{
+	stage_cycles_type st[4];
+	static const char *stagename[4] = { "sixaxis" , "control" , "imu" , "total" };
+
+	for ( int i = 0 ; i < 4 ; i++)
+	{
+		st[i].min = ~0ull;
+		st[i].max = 0;
+		st[i].sum = 0;
+	}
+
+	struct timespec t0 , t1;
+	clock_gettime( CLOCK_MONOTONIC , &t0 );
+
+	for ( long n = 0 ; n < iterations ; n++)
+	{
+		for ( int a = 0 ; a < 3 ; a++) rx[a] = stick_sine( a , (int) ( n % TRACK_SAMPLES ) );
+
+		looptime = LOOPTIME * 1e-6f;
+
+		uint64_t c0 = sil_cycles();
+		sixaxis_read();
+		uint64_t c1 = sil_cycles();
+		control();
+		uint64_t c2 = sil_cycles();
+		imu_calc();
+		uint64_t c3 = sil_cycles();
+
+		stage_add( &st[0] , c1 - c0 );
+		stage_add( &st[1] , c2 - c1 );
+		stage_add( &st[2] , c3 - c2 );
+		stage_add( &st[3] , c3 - c0 );
+
+		plant_step( &plant , LOOPTIME * 1e-6f );
+		sil_time += LOOPTIME;
+	}
+
+	clock_gettime( CLOCK_MONOTONIC , &t1 );
+	double seconds = ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) * 1e-9;
+
+	printf( "stage      min     mean      max  ( host cycles )\n" );
+	for ( int i = 0 ; i < 4 ; i++)
+	{
+		printf( "%-7s %6llu %8.1f %8llu\n" , stagename[i] , (unsigned long long) st[i].min ,
+			(double) st[i].sum / iterations , (unsigned long long) st[i].max );
+	}
+	printf( "%ld iterations , %.2f million loops/s with plant\n" , iterations , iterations / seconds * 1e-6 );
+}
+
+typedef struct trace_error
+{
+	double max , sq;
+} trace_error_type;
+
+static void trace_error_add( trace_error_type *e , float a , float b )
+{
+	double d = fabs( (double) a - b );
+	if ( d > e->max ) e->max = d;
+	e->sq += d * d;
+}
+
+// replays the recorded samples open loop, so both builds see exactly the same inputs
+static int crosscheck( const char *name )
+{
+#if GYRO_RATE_MULTIPLIER > 1
+	// the trace holds one gyro sample per pid loop
+	printf( "cross check needs GYRO_RATE_MULTIPLIER 1\n" );
+	return 1;
+#endif
+	FILE *f = fopen( name , "rb" );
+	if ( !f )
+	{
+		printf( "can not open %s\n" , name );
+		return 1;
+	}
+
+	trace_error_type err[3];
+	memset( err , 0 , sizeof( err ) );
+	long count = 0;
+	sil_trace_type rec , out;
+
+	while ( fread( &rec , sizeof( rec ) , 1 , f ) == 1 )
+	{
+		for ( int i = 0 ; i < 4 ; i++) rx[i] = rec.rx[i];
+		aux[LEVELMODE] = rec.levelmode != 0;
+		sil_replay = &rec;
+
+		looptime = LOOPTIME * 1e-6f;
+		sixaxis_read();
+		control();
+		imu_calc();
+		sil_time += LOOPTIME;
+
+		trace_outputs( &out );
+		for ( int i = 0 ; i < 3 ; i++)
+		{
+			trace_error_add( &err[0] , out.gyro[i] , rec.gyro[i] );
+			trace_error_add( &err[1] , out.pidoutput[i] , rec.pidoutput[i] );
+		}
+		for ( int i = 0 ; i < 4 ; i++) trace_error_add( &err[2] , out.motor[i] , rec.motor[i] );
+		count++;
+	}
+	fclose( f );
+	sil_replay = 0;
+
+	if ( !count )
+	{
+		printf( "%s is empty\n" , name );
+		return 1;
+	}
+
+	// 1e-3 is 0.06 deg/s on the gyro and 0.1% on the pid and motor outputs
+	static const char *groupname[3] = { "gyro" , "pid" , "motor" };
+	static const int groupsize[3] = { 3 , 3 , 4 };
+	int fail = 0;
+
+	printf( "cross check against %s , %ld loops\n" , name , count );
+	printf( "output      max error    rms error\n" );
+	for ( int i = 0 ; i < 3 ; i++)
+	{
+		printf( "%-7s %12.2e %12.2e\n" , groupname[i] , err[i].max , sqrt( err[i].sq / ( count * groupsize[i] ) ) );
+		if ( err[i].max > 1e-3 ) fail = 1;
+	}
+	printf( "%s\n" , fail ? "FAILED" : "passed" );
+	return fail;
+}
+
+int main( int argc , char **argv )
+{
+	long iterations = 1000000;
+	float vibration = 0.05f;
+	float noise = 0.01f;
+	int benchmark_only = 0;
+	const char *replay = 0;
+	const char *blackbox_file = 0;
+	float frame_hz = 0;
+
+	for ( int i = 1 ; i < argc ; i++)
+	{
+		if ( !strcmp( argv[i] , "-b" ) ) benchmark_only = 1;
+		else if ( i == argc - 1 ) break;
+		else if ( !strcmp( argv[i] , "-n" ) ) iterations = atol( argv[++i] );
+		else if ( !strcmp( argv[i] , "-v" ) ) vibration = atof( argv[++i] );
+		else if ( !strcmp( argv[i] , "-w" ) ) noise = atof( argv[++i] );
+		else if ( !strcmp( argv[i] , "-t" ) ) trace_file = fopen( argv[++i] , "wb" );
+		else if ( !strcmp( argv[i] , "-c" ) ) replay = argv[++i];
+		else if ( !strcmp( argv[i] , "-l" ) ) blackbox_file = argv[++i];
+		else if ( !strcmp( argv[i] , "-r" ) ) frame_hz = atof( argv[++i] );
+	}
+	if ( iterations < 1 ) iterations = 1;
+	if ( frame_hz > 0 ) frame_loops = (int) ( 1e6f / ( frame_hz * LOOPTIME ) + 0.5f );
+	if ( frame_hz > 0 && frame_loops < 1 ) frame_loops = 1;
+
+	sil_reset();
+	plant.vibration = vibration;
+	plant.noise = noise;
+
+	if ( replay ) return crosscheck( replay );
+
+#ifdef BLACKBOX
+	blackbox_init();
+#endif
+
+#ifdef FIXED_POINT
+	printf( "fixed point control path\n" );
+#endif
+	printf( "looptime %d us , gyro looptime %d us , vibration %.3f rad/s , noise %.3f rad/s\n" , LOOPTIME , GYRO_LOOPTIME , vibration , noise );
+	if ( frame_loops ) printf( "rx frame every %d loops\n" , frame_loops );
+	printf( "\n" );
+
+	if ( benchmark_only )
+	{
+		benchmark( iterations );
+		return 0;
+	}
+
+	printf( "acro step     target       rise   overshoot   settle   rms error\n" );
+	step_acro( 0 , 0.25f );
+	step_acro( 1 , 0.25f );
+	step_acro( 2 , 0.25f );
+
+	printf( "\nlevel step    target       rise   overshoot   settle   rms error\n" );
+	step_level( 0.5f );
+
+	printf( "\nacro tracking  rms error   delay  pid step\n" );
+	track_acro();
+
+#ifdef GYRO_DYN_NOTCH
+	printf( "\nhover noise    rms error   notch\n" );
+#else
+	printf( "\nhover noise    rms error\n" );
+#endif
+	noise_report();
+
+	if ( trace_file )
+	{
+		fclose( trace_file );
+		trace_file = 0;
+	}
+
+#ifdef BLACKBOX
+	// the flash log of the runs above, for blackbox_decode
+	if ( blackbox_file )
+	{
+		FILE *f = fopen( blackbox_file , "wb" );
+		if ( f )
+		{
+			fwrite( sil_flash , 1 , SIL_FLASH_SIZE , f );
+			fclose( f );
+		}
+		printf( "\nblackbox %d records dropped\n" , blackbox_dropped );
+	}
+#endif
+
+	printf( "\n" );
+	benchmark( iterations );
+
+	return 0;
+}
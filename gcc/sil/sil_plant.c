@@ -0,0 +1,143 @@
+// rigid body model of a brushless whoop in x configuration
+// motor thrust follows the pwm_set command through a first order lag
+// only the rotational dynamics are modelled, throttle just sets the operating point
+
+#include <math.h>
+
+#include "sil.h"
+#include "defines.h"
+
+// motor spin up time constant in seconds
+#define PLANT_MOTOR_TAU 0.015f
+
+// angular acceleration in rad/s^2 for a differential thrust of 1.0
+// ( the same scale as pidoutput )
+#define PLANT_ROLL_ACCEL 2000.0f
+#define PLANT_PITCH_ACCEL 2000.0f
+#define PLANT_YAW_ACCEL 300.0f
+
+// aerodynamic rate damping in 1/s
+#define PLANT_RATE_DRAG 3.0f
+
+// inertia ratios for the gyroscopic cross coupling
+#define PLANT_IXX 1.0f
+#define PLANT_IYY 1.0f
+#define PLANT_IZZ 1.8f
+
+// rotor frequency at full thrust in Hz ( 1103 11000kv on 1s )
+#define PLANT_ROTOR_HZ_MAX 700.0f
+
+// integration steps per call
+#define PLANT_SUBSTEPS 8
+
+sil_plant_type plant;
+
+static uint32_t plant_seed = 7;
+
+static float plant_random( void)
+{
+	plant_seed ^= plant_seed << 13;
+	plant_seed ^= plant_seed >> 17;
+	plant_seed ^= plant_seed << 5;
+	return (float) plant_seed * ( 2.0f / 4294967296.0f ) - 1.0f;
+}
+
+void plant_init( sil_plant_type *p )
+{
+	for ( int i = 0 ; i < 3 ; i++)
+	{
+		p->rate[i] = 0;
+		p->gravity[i] = 0;
+	}
+	p->gravity[2] = 1.0f;
+
+	for ( int i = 0 ; i < 4 ; i++)
+	{
+		p->motor[i] = 0;
+		p->command[i] = 0;
+		p->phase[i] = 0;
+	}
+	plant_seed = 7;
+}
+
+void plant_step( sil_plant_type *p , float dt )
+{
+	float h = dt / PLANT_SUBSTEPS;
+	float lag = h / ( PLANT_MOTOR_TAU + h );
+
+	for ( int n = 0 ; n < PLANT_SUBSTEPS ; n++)
+	{
+		for ( int i = 0 ; i < 4 ; i++)
+		{
+			float cmd = p->command[i];
+			if ( cmd < 0 ) cmd = 0;
+			if ( cmd > 1.0f ) cmd = 1.0f;
+			p->motor[i] += ( cmd - p->motor[i] ) * lag;
+
+			// thrust goes with rpm squared
+			p->phase[i] += 2.0f * 3.14159265f * PLANT_ROTOR_HZ_MAX * sqrtf( p->motor[i] ) * h;
+			if ( p->phase[i] > 2.0f * 3.14159265f ) p->phase[i] -= 2.0f * 3.14159265f;
+		}
+
+		// same motor layout as the mixer in control.c
+		float *m = p->motor;
+		float troll = 0.25f * ( m[MOTOR_FL] + m[MOTOR_BL] - m[MOTOR_FR] - m[MOTOR_BR] );
+		float tpitch = 0.25f * ( m[MOTOR_BL] + m[MOTOR_BR] - m[MOTOR_FL] - m[MOTOR_FR] );
+		float tyaw = 0.25f * ( m[MOTOR_FR] + m[MOTOR_BL] - m[MOTOR_FL] - m[MOTOR_BR] );
+
+		float *w = p->rate;
+		float acc[3];
+		acc[0] = troll * PLANT_ROLL_ACCEL + ( PLANT_IYY - PLANT_IZZ ) / PLANT_IXX * w[1] * w[2];
+		acc[1] = tpitch * PLANT_PITCH_ACCEL + ( PLANT_IZZ - PLANT_IXX ) / PLANT_IYY * w[2] * w[0];
+		acc[2] = tyaw * PLANT_YAW_ACCEL + ( PLANT_IXX - PLANT_IYY ) / PLANT_IZZ * w[0] * w[1];
+
+		for ( int i = 0 ; i < 3 ; i++)
+		{
+			w[i] += ( acc[i] - w[i] * PLANT_RATE_DRAG ) * h;
+		}
+
+		// rotate the gravity vector with the same convention as imu_calc()
+		float d[3] = { w[0] * h , w[1] * h , w[2] * h };
+		float *g = p->gravity;
+
+		g[2] = g[2] - d[0] * g[0];
+		g[0] = d[0] * g[2] + g[0];
+
+		g[1] = g[1] + d[1] * g[2];
+		g[2] = -d[1] * g[1] + g[2];
+
+		g[0] = g[0] - d[2] * g[1];
+		g[1] = d[2] * g[0] + g[1];
+
+		float mag = 1.0f / sqrtf( g[0] * g[0] + g[1] * g[1] + g[2] * g[2] );
+		for ( int i = 0 ; i < 3 ; i++) g[i] *= mag;
+	}
+}
+
+// gyro reading with motor vibration and sensor noise added
+float plant_gyro( sil_plant_type *p , int axis )
+{
+	float vib = 0;
+
+	for ( int i = 0 ; i < 4 ; i++)
+	{
+		// each motor shakes the frame a bit differently on each axis
+		vib += p->motor[i] * sinf( p->phase[i] + (float) ( i + axis ) * 1.3f );
+	}
+
+	return p->rate[axis] + vib * p->vibration + plant_random() * p->noise;
+}
+
+// rotor frequency of one motor in Hz
+float plant_motor_hz( sil_plant_type *p , int motor )
+{
+	return PLANT_ROTOR_HZ_MAX * sqrtf( p->motor[motor] > 0 ? p->motor[motor] : 0 );
+}
+
+// mean rotor frequency in Hz
+float plant_rotor_hz( sil_plant_type *p )
+{
+	float hz = 0;
+	for ( int i = 0 ; i < 4 ; i++) hz += plant_motor_hz( p , i );
+	return hz * 0.25f;
+}
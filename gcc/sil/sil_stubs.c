@@ -0,0 +1,210 @@
+// hardware stubs and the globals normally owned by main.c, sixaxis.c and the rx code
+// sixaxis_read() samples the plant instead of the i2c bus
+
+#include <math.h>
+#include <string.h>
+
+#include "sil.h"
+#include "config.h"
+#include "defines.h"
+#include "fixed.h"
+
+unsigned long sil_time = 0;
+
+// main.c
+float looptime;
+float vbattfilt = 4.2f;
+float vbatt_comp = 4.2f;
+int lowbatt = 0;
+float rx[4];
+char aux[AUXNUMBER];
+char lastaux[AUXNUMBER];
+char auxchange[AUXNUMBER];
+float aux_analog[AUXNUMBER];
+float lastaux_analog[AUXNUMBER];
+char aux_analogchange[AUXNUMBER];
+int in_air;
+int armed_state;
+int arming_release;
+int binding_while_armed = 1;
+int ledcommand = 0;
+int ledblink = 0;
+
+// rx
+int rxmode = RXMODE_NORMAL;
+int failsafe = 0;
+int rx_ready = 1;
+
+// flip_sequencer.c
+int controls_override = 0;
+float rx_override[4];
+int acro_override = 0;
+
+// sixaxis.c
+float accel[3];
+float gyro[3];
+float accelcal[3];
+float gyrocal[3];
+int accel_new;
+
+#ifdef ACCEL_DECIMATION
+static int accel_count;
+#endif
+
+void gyro_filter( float *gyro );
+
+#ifdef FIXED_POINT
+int32_t gyro_q[3];
+
+void gyro_filter_q( int32_t *gyro );
+#endif
+
+unsigned long gettime( void)
+{
+	return sil_time;
+}
+
+void delay( uint32_t data)
+{
+	sil_time += data;
+}
+
+#ifdef RPM_FILTER
+// drv_dshot_dma.c, the esc telemetry in 100 eRPM
+uint16_t dshot_erpm[4];
+// the plant telemetry never fails
+uint8_t dshot_erpm_fails[4];
+#endif
+
+void pwm_set( uint8_t number , float pwm)
+{
+	if ( number >= 4 ) return;
+	plant.command[number] = pwm;
+
+	// the telemetry answer to this frame, from the rotor speed
+	if ( sil_replay ) sil_erpm[number] = sil_replay->erpm[number];
+	else sil_erpm[number] = roundf( plant_motor_hz( &plant , number ) * 60.0f * ( MOTOR_POLES / 2 ) / 100.0f );
+#ifdef RPM_FILTER
+	dshot_erpm[number] = sil_erpm[number];
+#endif
+}
+
+#ifdef MIXER_FIXED
+void pwm_set_q( uint8_t number , int32_t pwm)
+{
+	pwm_set( number , FIXED_TO_FLOAT( pwm ) );
+}
+#endif
+
+// drv_fmc1.c, the free flash is a ram array that starts erased
+uint8_t sil_flash[SIL_FLASH_SIZE];
+
+unsigned long fmc_free_start( void)
+{
+	static int erased = 0;
+	if ( !erased ) memset( sil_flash , 0xFF , SIL_FLASH_SIZE );
+	erased = 1;
+	return (unsigned long) sil_flash;
+}
+
+unsigned long fmc_free_end( void)
+{
+	return (unsigned long) sil_flash + SIL_FLASH_SIZE;
+}
+
+int fmc_erase_page( unsigned long address )
+{
+	memset( (void *) address , 0xFF , 1024 );
+	return 0;
+}
+
+int fmc_write_halfword( unsigned long address , uint16_t value )
+{
+	// programming can only clear bits
+	if ( *(uint16_t *) address != 0xFFFF ) return 1;
+	*(uint16_t *) address = value;
+	return 0;
+}
+
+void fmc_unlock( void)
+{
+}
+
+void fmc_lock( void)
+{
+}
+
+// gyro lsb for the 2000 deg/s scale
+#define GYRO_LSB_RAD ( 0.061035156f * 0.017453292f )
+
+static float sil_saturate( float in )
+{
+	in = roundf( in );
+	if ( in > 32767.0f ) in = 32767.0f;
+	if ( in < -32768.0f ) in = -32768.0f;
+	return in;
+}
+
+// replayed samples for the cross check, null when running against the plant
+sil_trace_type *sil_replay = 0;
+
+// last raw gyro sample in lsb, for recording
+float sil_gyro_lsb[3];
+
+// last raw accel sample in lsb, imu_calc() scales accel[] in place
+float sil_accel_lsb[3];
+
+// last motor telemetry in 100 eRPM, for recording
+float sil_erpm[4];
+
+static float sil_gyro_raw( int axis )
+{
+	if ( sil_replay ) return sil_gyro_lsb[axis] = sil_replay->gyro_raw[axis];
+	return sil_gyro_lsb[axis] = sil_saturate( plant_gyro( &plant , axis ) / GYRO_LSB_RAD );
+}
+
+void sixaxis_accel_request( void)
+{
+#ifdef ACCEL_DECIMATION
+	accel_count = 0;
+#endif
+}
+
+void sixaxis_read( void)
+{
+#ifdef ACCEL_DECIMATION
+	// the same accel loops as sixaxis.c
+	int read_accel = accel_count <= 0;
+	if ( read_accel ) accel_count = ACCEL_DECIMATION;
+	accel_count--;
+	if ( read_accel )
+#endif
+	{
+		// accel in raw units, 2048 = 1G
+		for ( int i = 0 ; i < 3 ; i++)
+		{
+			if ( sil_replay ) accel[i] = sil_replay->accel[i];
+			else accel[i] = sil_saturate( plant.gravity[i] * 2048.0f );
+			sil_accel_lsb[i] = accel[i];
+		}
+		accel_new = 1;
+	}
+
+	// quantize to the sensor lsb, then the same filter chain as sixaxis.c
+#ifdef FIXED_POINT
+	// the scaling of sixaxis.c , lsb in 1/16 and the 1/1024 orientation matrix
+	for ( int i = 0 ; i < 3 ; i++)
+		gyro_q[i] = fixed_mul32( (int32_t) sil_gyro_raw( i ) * 16 * 1024 , FIXED32( GYRO_LSB_RAD * 65536.0 / ( 16 * 1024 ) ) );
+#ifndef SOFT_LPF_NONE
+	gyro_filter_q( gyro_q );
+#endif
+	for ( int i = 0 ; i < 3 ; i++)
+		gyro[i] = FIXED_TO_FLOAT( gyro_q[i] );
+#else
+	for ( int i = 0 ; i < 3 ; i++)
+		gyro[i] = sil_gyro_raw( i ) * GYRO_LSB_RAD;
+#ifndef SOFT_LPF_NONE
+	gyro_filter( gyro );
+#endif
+#endif
+}
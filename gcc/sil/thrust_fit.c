@@ -0,0 +1,185 @@
+// motor curve table from thrust measurements , for MOTOR_CURVE_TABLE in config.h
+// reads ( motor output , thrust ) pairs from a csv , a thrust stand log or columns of another log picked with -x / -y
+// the thrust is made monotone in the output ( pool adjacent violators ) and scaled to 1.0 at its maximum,
+// then the table is the output at thrust 0 , 1/32 .. 1 by linear interpolation
+// the first value , the idle output where the thrust starts , is extrapolated from the outputs at 2% and 4%
+// of the thrust as the start of the thrust is in the noise of the measurement
+//
+// usage: thrust_fit [-x output_column] [-y thrust_column] [-p points] data.csv
+// columns by header name or number from 1 , default the first two , separated by commas , tabs or spaces
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+typedef struct sample
+{
+	double output;
+	double thrust;
+	double weight;
+} sample_type;
+
+static int compare_output( const void *a , const void *b )
+{
+	double d = ( (const sample_type *) a )->output - ( (const sample_type *) b )->output;
+	return ( d > 0 ) - ( d < 0 );
+}
+
+// splits a line in place , returns the number of fields
+static int split( char *line , char **field , int max )
+{
+	int n = 0;
+	char *p = line;
+	while ( *p && n < max ) {
+		while ( *p == ' ' || *p == '\t' || *p == ',' ) p++;
+		if ( !*p || *p == '\n' || *p == '\r' ) break;
+		field[n++] = p;
+		while ( *p && *p != ',' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' ) p++;
+		if ( *p ) *p++ = 0;
+	}
+	return n;
+}
+
+static int is_number( const char *s )
+{
+	char *end;
+	strtod( s , &end );
+	return end != s && *end == 0;
+}
+
+// column of a -x / -y argument , by number or by the header
+static int find_column( const char *name , char **header , int fields )
+{
+	if ( is_number( name ) ) return atoi( name ) - 1;
+	for ( int i = 0 ; i < fields ; i++) {
+		if ( !strcmp( header[i] , name ) ) return i;
+	}
+	return -1;
+}
+
+// output at a thrust , the curve is flat over a block and linear from the last output of a block to the first of the next
+static double inverse( const sample_type *block , const double *first , long blocks , double t )
+{
+	if ( t <= block[0].thrust ) {
+		// the dead band ends at the last output of the first block , else from 0 thrust at 0 output
+		return block[0].thrust <= 0 ? block[0].output : first[0] * t / block[0].thrust;
+	}
+	long i = 1;
+	while ( i < blocks - 1 && block[i].thrust < t ) i++;
+	double t0 = block[i - 1].thrust;
+	double o0 = block[i - 1].output;
+	return o0 + ( first[i] - o0 ) * ( t - t0 ) / ( block[i].thrust - t0 );
+}
+
+int main( int argc , char **argv )
+{
+	const char *x_name = "1";
+	const char *y_name = "2";
+	int points = MOTOR_CURVE_POINTS;
+	int opt = 1;
+
+	for ( ; opt < argc - 1 && argv[opt][0] == '-' ; opt += 2 ) {
+		if ( !strcmp( argv[opt] , "-x" ) ) x_name = argv[opt + 1];
+		else if ( !strcmp( argv[opt] , "-y" ) ) y_name = argv[opt + 1];
+		else if ( !strcmp( argv[opt] , "-p" ) ) points = atoi( argv[opt + 1] );
+		else break;
+	}
+	if ( opt != argc - 1 || points < 2 ) {
+		fprintf( stderr , "usage: thrust_fit [-x output_column] [-y thrust_column] [-p points] data.csv\n" );
+		return 1;
+	}
+
+	FILE *file = fopen( argv[opt] , "r" );
+	if ( !file ) {
+		perror( argv[opt] );
+		return 1;
+	}
+
+	sample_type *samples = NULL;
+	long count = 0 , size = 0;
+	int x = -1 , y = -1;
+	char line[4096];
+	char *field[256];
+
+	while ( fgets( line , sizeof( line ) , file ) ) {
+		int fields = split( line , field , 256 );
+		if ( !fields ) continue;
+
+		if ( x < 0 ) {
+			// the first line is a header if it is not all numbers
+			int header = 0;
+			for ( int i = 0 ; i < fields ; i++) if ( !is_number( field[i] ) ) header = 1;
+			x = find_column( x_name , header ? field : NULL , header ? fields : 0 );
+			y = find_column( y_name , header ? field : NULL , header ? fields : 0 );
+			if ( x < 0 || y < 0 ) {
+				fprintf( stderr , "no column %s\n" , x < 0 ? x_name : y_name );
+				return 1;
+			}
+			if ( header ) continue;
+		}
+
+		if ( x >= fields || y >= fields || !is_number( field[x] ) || !is_number( field[y] ) ) continue;
+
+		if ( count == size ) {
+			size = size ? size * 2 : 1024;
+			samples = realloc( samples , size * sizeof( sample_type ) );
+		}
+		samples[count].output = atof( field[x] );
+		samples[count].thrust = atof( field[y] );
+		samples[count].weight = 1;
+		count++;
+	}
+	fclose( file );
+
+	if ( count < 2 ) {
+		fprintf( stderr , "%ld samples , need 2 or more\n" , count );
+		return 1;
+	}
+
+	qsort( samples , count , sizeof( sample_type ) , compare_output );
+
+	// pool adjacent violators: blocks of weighted mean thrust that never decrease with the output
+	// a block keeps the output range of its samples , the first and the last output
+	long blocks = 0;
+	double *first = malloc( count * sizeof( double ) );
+	for ( long i = 0 ; i < count ; i++) {
+		samples[blocks] = samples[i];
+		first[blocks] = samples[i].output;
+		blocks++;
+		while ( blocks > 1 && samples[blocks - 2].thrust >= samples[blocks - 1].thrust ) {
+			sample_type *a = &samples[blocks - 2];
+			sample_type *b = &samples[blocks - 1];
+			double w = a->weight + b->weight;
+			a->thrust = ( a->thrust * a->weight + b->thrust * b->weight ) / w;
+			a->weight = w;
+			a->output = b->output;
+			blocks--;
+		}
+	}
+
+	double max = samples[blocks - 1].thrust;
+	if ( max <= 0 ) {
+		fprintf( stderr , "no thrust\n" );
+		return 1;
+	}
+
+	double *table = malloc( points * sizeof( double ) );
+	for ( int k = 0 ; k < points ; k++) {
+		table[k] = inverse( samples , first , blocks , (double) k / ( points - 1 ) * max );
+	}
+	table[0] = 2 * inverse( samples , first , blocks , 0.02 * max ) - inverse( samples , first , blocks , 0.04 * max );
+	if ( table[0] < 0 ) table[0] = 0;
+
+	printf( "#define MOTOR_CURVE_TABLE" );
+	for ( int k = 0 ; k < points ; k++) printf( "%s %.3f" , k ? " ," : "" , table[k] );
+	printf( "\n" );
+
+	fprintf( stderr , "%ld samples , %ld monotone blocks , output %.3f - %.3f , idle output %.3f , full thrust at %.3f\n" ,
+		count , blocks , first[0] , samples[blocks - 1].output , table[0] , table[points - 1] );
+	free( table );
+	free( first );
+	free( samples );
+	return 0;
+}